@@ -0,0 +1,188 @@
+#include "pch.h"
+
+#include "AdvertisementFilter.h"
+
+// Longest probe sequence. Beyond it the table is treated as full.
+static const unsigned long MAX_PROBES = 32;
+
+// The state is kept in the two top bits of the info word.
+static const unsigned long STATE_SHIFT = 62;
+static const LONG64 TIME_MASK = ((LONG64)1 << STATE_SHIFT) - 1;
+
+LONG64 CAdvertisementFilter::MakeInfo(const TFilterState State, const unsigned __int64 Time)
+{
+	return ((LONG64)State << STATE_SHIFT) | ((LONG64)Time & TIME_MASK);
+}
+
+CAdvertisementFilter::TFilterState CAdvertisementFilter::GetState(const LONG64 Info)
+{
+	return (TFilterState)(((unsigned __int64)Info >> STATE_SHIFT) & 3);
+}
+
+unsigned __int64 CAdvertisementFilter::GetTime(const LONG64 Info)
+{
+	return (unsigned __int64)(Info & TIME_MASK);
+}
+
+CAdvertisementFilter::TSlot* CAdvertisementFilter::FindSlot(const __int64 Address,
+	const bool Add) const
+{
+	// The same 64-bit finalizer mix as the clients registry uses.
+	unsigned __int64 h = (unsigned __int64)Address;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	unsigned long Index = (unsigned long)h & FMask;
+	for (unsigned long i = 0; i < MAX_PROBES && i <= FMask; i++)
+	{
+		TSlot* Slot = &FSlots[Index];
+		LONG64 Current = Slot->Address;
+		if (Current == Address)
+			return Slot;
+
+		if (Current == 0)
+		{
+			// Slots are never freed so the address is not in the table.
+			if (!Add)
+				return NULL;
+
+			Current = InterlockedCompareExchange64(&Slot->Address, Address, 0);
+			// Either we claimed the slot or other thread claimed it for the same
+			// address.
+			if (Current == 0 || Current == Address)
+				return Slot;
+		}
+
+		Index = (Index + 1) & FMask;
+	}
+	return NULL;
+}
+
+CAdvertisementFilter::CAdvertisementFilter(const unsigned long Capacity,
+	const unsigned long PassInterval, const unsigned long RejectTimeout)
+{
+	unsigned long Size = 16;
+	while (Size < Capacity)
+		Size <<= 1;
+
+	FSlots = new TSlot[Size];
+	FMask = Size - 1;
+	FPassInterval = PassInterval;
+	FRejectTimeout = RejectTimeout;
+
+	Clear();
+}
+
+CAdvertisementFilter::~CAdvertisementFilter()
+{
+	delete[] FSlots;
+}
+
+bool CAdvertisementFilter::Pass(const __int64 Address, const unsigned __int64 Now)
+{
+	// Not tracked device is processed as if there is no filter.
+	TSlot* Slot = FindSlot(Address, true);
+	if (Slot == NULL)
+		return true;
+
+	LONG64 Info = Slot->Info;
+	switch (GetState(Info))
+	{
+	case fsConnected:
+		return false;
+
+	case fsRejected:
+		// Give the device a chance to change its name.
+		if (Now - GetTime(Info) < FRejectTimeout)
+			return false;
+		break;
+
+	default:
+		if (FPassInterval > 0 && GetTime(Info) != 0 && Now - GetTime(Info) < FPassInterval)
+			return false;
+		break;
+	}
+
+	// Only one of the concurrent frames passes. If the state changed the frame
+	// is simply dropped: the next one sees the new state.
+	return (InterlockedCompareExchange64(&Slot->Info, MakeInfo(fsNone, Now), Info) == Info);
+}
+
+void CAdvertisementFilter::Connected(const __int64 Address)
+{
+	TSlot* Slot = FindSlot(Address, true);
+	if (Slot != NULL)
+	{
+		InterlockedExchange64(&Slot->Info, MakeInfo(fsConnected, 0));
+		InterlockedExchange64(&Slot->Evidence, 0);
+	}
+}
+
+void CAdvertisementFilter::Forget(const __int64 Address)
+{
+	TSlot* Slot = FindSlot(Address, false);
+	if (Slot != NULL)
+		InterlockedExchange64(&Slot->Info, MakeInfo(fsNone, 0));
+}
+
+void CAdvertisementFilter::Reject(const __int64 Address, const unsigned __int64 Now)
+{
+	TSlot* Slot = FindSlot(Address, true);
+	if (Slot == NULL)
+		return;
+
+	LONG64 Info = Slot->Info;
+	// The device may be connected right now by the other thread.
+	if (GetState(Info) != fsConnected)
+		InterlockedCompareExchange64(&Slot->Info, MakeInfo(fsRejected, Now), Info);
+}
+
+unsigned long CAdvertisementFilter::Collect(const __int64 Address,
+	const unsigned long Conditions, const unsigned __int64 Now)
+{
+	// Not tracked device has only the frame's conditions.
+	TSlot* Slot = FindSlot(Address, true);
+	if (Slot == NULL)
+		return Conditions;
+	if (GetState(Slot->Info) == fsConnected)
+		return 0;
+
+	// The times are truncated to 32 bits. The difference is still right when
+	// the counter wraps.
+	unsigned long Time = (unsigned long)Now;
+	while (true)
+	{
+		LONG64 Evidence = Slot->Evidence;
+		unsigned long Collected = (unsigned long)(Evidence & 0xFFFFFFFF);
+		if (Time - (unsigned long)((unsigned __int64)Evidence >> 32) >= MATCH_EVIDENCE_TIMEOUT)
+			Collected = 0;
+		Collected |= Conditions;
+
+		LONG64 Updated = (LONG64)(((unsigned __int64)Time << 32) | Collected);
+		if (Updated == Evidence || InterlockedCompareExchange64(&Slot->Evidence, Updated, Evidence) == Evidence)
+			return Collected;
+	}
+}
+
+void CAdvertisementFilter::Clear()
+{
+	ZeroMemory(FSlots, (FMask + 1) * sizeof(TSlot));
+}
+
+unsigned long CAdvertisementFilter::GetCapacity() const
+{
+	return FMask + 1;
+}
+
+unsigned long CAdvertisementFilter::GetPassInterval() const
+{
+	return FPassInterval;
+}
+
+unsigned long CAdvertisementFilter::GetRejectTimeout() const
+{
+	return FRejectTimeout;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+// Default number of addresses the filter can track.
+const unsigned long DEFAULT_ADVERTISEMENT_FILTER_SIZE = 16384;
+// Default minimum time between two processed advertisements of the same
+// device (ms).
+const unsigned long DEFAULT_ADVERTISEMENT_PASS_INTERVAL = 250;
+// Default time advertisements of a device with other name are ignored (ms).
+const unsigned long DEFAULT_ADVERTISEMENT_REJECT_TIMEOUT = 10000;
+// Time the match conditions collected from the device's frames are kept (ms).
+// The name, the service UUIDs and the manufacturer data come with different
+// frames: the advertisement and its scan response.
+const unsigned long MATCH_EVIDENCE_TIMEOUT = 2000;
+
+// Lock-free front filter of the advertisement frames. Decides if the frame
+// is worth processing before any lock is taken or the name is compared:
+//   - frames of the devices that are connected (or connecting) are dropped;
+//   - frames of the devices with other name are dropped for RejectTimeout;
+//   - frames of other devices pass not more often than once per
+//     PassInterval.
+// The filter also keeps the match rules conditions each device satisfied so
+// a rule can combine the data of several frames (see CMatchRules).
+// Addresses live in the fixed size open-addressing table (linear probing).
+// A slot is claimed with single CAS and never freed so a lookup needs no lock.
+// When the table is full the new devices are not tracked and all their frames
+// pass: the filter never hides a device. Clear must not be called while other
+// threads use the filter.
+// All the times are in milliseconds from any monotonic source.
+class CAdvertisementFilter
+{
+	DISABLE_COPY(CAdvertisementFilter);
+
+private:
+	typedef enum
+	{
+		fsNone,
+		fsConnected,
+		fsRejected
+	} TFilterState;
+
+	// The state and the time of the last processed frame share one word so
+	// they are changed together. So do the collected match conditions (low
+	// 32 bits) and the time they were last updated (high 32 bits).
+	typedef struct
+	{
+		volatile LONG64	Address;
+		volatile LONG64	Info;
+		volatile LONG64	Evidence;
+	} TSlot;
+
+	TSlot*			FSlots;
+	unsigned long	FMask;
+	unsigned long	FPassInterval;
+	unsigned long	FRejectTimeout;
+
+	static LONG64 MakeInfo(const TFilterState State, const unsigned __int64 Time);
+	static TFilterState GetState(const LONG64 Info);
+	static unsigned __int64 GetTime(const LONG64 Info);
+
+	// Returns the address's slot or NULL. If Add is true the slot is claimed
+	// for the new address.
+	TSlot* FindSlot(const __int64 Address, const bool Add) const;
+
+public:
+	// The capacity is rounded up to the power of 2.
+	CAdvertisementFilter(const unsigned long Capacity = DEFAULT_ADVERTISEMENT_FILTER_SIZE,
+		const unsigned long PassInterval = DEFAULT_ADVERTISEMENT_PASS_INTERVAL,
+		const unsigned long RejectTimeout = DEFAULT_ADVERTISEMENT_REJECT_TIMEOUT);
+	~CAdvertisementFilter();
+
+	// Returns true if the frame must be processed. Can be called from any
+	// thread.
+	bool Pass(const __int64 Address, const unsigned __int64 Now);
+
+	// The device is in the clients registry. Its frames are dropped until
+	// Forget is called. The owner must serialize Connected and Forget calls
+	// of the same address.
+	void Connected(const __int64 Address);
+	// The device left the clients registry. Its next frame passes.
+	void Forget(const __int64 Address);
+	// The device is not ours. Does nothing if the device is connected.
+	void Reject(const __int64 Address, const unsigned __int64 Now);
+	// Adds the match conditions satisfied by the frame to the ones collected
+	// from the device's recent frames and returns all of them. Returns zero
+	// if the device is connected.
+	unsigned long Collect(const __int64 Address, const unsigned long Conditions,
+		const unsigned __int64 Now);
+
+	// Forgets all the devices.
+	void Clear();
+
+	unsigned long GetCapacity() const;
+	unsigned long GetPassInterval() const;
+	unsigned long GetRejectTimeout() const;
+};
@@ -0,0 +1,214 @@
+#include "pch.h"
+
+#include "AsyncQueue.h"
+
+CAsyncQueue::CAsyncQueue()
+{
+	InitializeCriticalSection(&FCS);
+
+	FQueues = new QUEUES();
+	FReady = new list<__int64>();
+	FDepth = DEFAULT_ASYNC_QUEUE_DEPTH;
+	FOpened = false;
+	FLastId = 0;
+	// Manual reset, initially signaled: nothing runs yet.
+	FIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+CAsyncQueue::~CAsyncQueue()
+{
+	// Operations are left here only if the queue was never closed.
+	for (QUEUES::iterator Queue = FQueues->begin(); Queue != FQueues->end(); Queue++)
+	{
+		for (list<TAsyncOperation>::iterator Op = Queue->second.begin(); Op != Queue->second.end(); Op++)
+			Release(*Op);
+	}
+	delete FQueues;
+	delete FReady;
+
+	if (FIdle != NULL)
+		CloseHandle(FIdle);
+
+	DeleteCriticalSection(&FCS);
+}
+
+void CAsyncQueue::Open()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FOpened = true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAsyncQueue::Close(list<TAsyncOperation>* Operations)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FOpened = false;
+		// Keep the devices: their executors are started and remove them on
+		// the next Pop.
+		for (QUEUES::iterator Queue = FQueues->begin(); Queue != FQueues->end(); Queue++)
+			Operations->splice(Operations->end(), Queue->second);
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAsyncQueue::WaitIdle()
+{
+	if (FIdle != NULL)
+		WaitForSingleObject(FIdle, INFINITE);
+
+	// The last executor signals the event under the lock. Make sure it has
+	// left it before the queue can be destroyed.
+	EnterCriticalSection(&FCS);
+	LeaveCriticalSection(&FCS);
+}
+
+int CAsyncQueue::Push(const __int64 Address, const TAsyncOperationKind Kind,
+	const unsigned char* const Data, const unsigned long Length,
+	unsigned long& Id, bool& Start)
+{
+	Id = 0;
+	Start = false;
+
+	TAsyncOperation Operation;
+	Operation.Address = Address;
+	Operation.Kind = Kind;
+	Operation.Data = NULL;
+	Operation.Length = 0;
+	if (Data != NULL && Length > 0)
+	{
+		// Copy outside the lock.
+		Operation.Data = (unsigned char*)malloc(Length);
+		if (Operation.Data == NULL)
+			return WCL_E_OUT_OF_MEMORY;
+		memcpy(Operation.Data, Data, Length);
+		Operation.Length = Length;
+	}
+
+	int Res = WCL_E_SUCCESS;
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FOpened)
+			Res = WCL_E_CONNECTION_CLOSED;
+		else
+		{
+			QUEUES::iterator Queue = FQueues->find(Address);
+			if (Queue != FQueues->end() && Queue->second.size() >= FDepth)
+				Res = ASYNC_QUEUE_E_QUEUE_FULL;
+			else
+			{
+				Operation.Id = (unsigned long)InterlockedIncrement(&FLastId);
+				if (Queue == FQueues->end())
+				{
+					// The device was idle: it needs the executor.
+					if (FQueues->empty() && FIdle != NULL)
+						ResetEvent(FIdle);
+					Queue = FQueues->insert(QUEUES::value_type(Address, list<TAsyncOperation>())).first;
+					FReady->push_back(Address);
+					Start = true;
+				}
+				Queue->second.push_back(Operation);
+				Id = Operation.Id;
+			}
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+
+	if (Res != WCL_E_SUCCESS)
+		Release(Operation);
+	return Res;
+}
+
+bool CAsyncQueue::Next(__int64& Address)
+{
+	Address = 0;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FReady->empty())
+			return false;
+
+		Address = FReady->front();
+		FReady->pop_front();
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CAsyncQueue::Pop(const __int64 Address, TAsyncOperation& Operation)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		QUEUES::iterator Queue = FQueues->find(Address);
+		if (Queue == FQueues->end())
+			return false;
+
+		if (Queue->second.empty())
+		{
+			// The executor stops: the next Push starts new one.
+			FQueues->erase(Queue);
+			if (FQueues->empty() && FIdle != NULL)
+				SetEvent(FIdle);
+			return false;
+		}
+
+		Operation = Queue->second.front();
+		Queue->second.pop_front();
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAsyncQueue::Release(TAsyncOperation& Operation)
+{
+	if (Operation.Data != NULL)
+	{
+		free(Operation.Data);
+		Operation.Data = NULL;
+	}
+	Operation.Length = 0;
+}
+
+unsigned long CAsyncQueue::GetDepth() const
+{
+	return FDepth;
+}
+
+int CAsyncQueue::SetDepth(const unsigned long Depth)
+{
+	if (Depth == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FDepth = Depth;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+	return WCL_E_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <list>
+#include <map>
+
+#include "wclHelpers.h"
+
+using namespace std;
+using namespace wclCommon;
+
+#pragma region Async queue error codes
+const int ASYNC_QUEUE_E_BASE = 0x7F040000;
+// The device already has the maximum number of operations queued.
+const int ASYNC_QUEUE_E_QUEUE_FULL = ASYNC_QUEUE_E_BASE + 0x0000;
+#pragma endregion Async queue error codes
+
+// Default maximum number of operations waiting in the queue of single device.
+const unsigned long DEFAULT_ASYNC_QUEUE_DEPTH = 64;
+
+// The kind of the queued GATT operation.
+typedef enum
+{
+	aoRead,
+	aoWrite
+} TAsyncOperationKind;
+
+// The queued GATT operation.
+typedef struct
+{
+	__int64				Address;
+	// Unique (per queue) operation identifier reported with the completion.
+	unsigned long		Id;
+	TAsyncOperationKind	Kind;
+	// Copy of the data to write owned by the operation. NULL for read.
+	unsigned char*		Data;
+	unsigned long		Length;
+} TAsyncOperation;
+
+// Per-device FIFO queues of the GATT operations. Operations of one device are
+// executed strictly in order by single executor while different devices are
+// served in parallel. Push reports when the device's queue became non-empty
+// so the caller starts the executor for it. The executor takes the device
+// with Next and pops its operations until Pop returns false; at that moment
+// the device is idle again and the next Push starts new executor.
+// The class is thread safe.
+class CAsyncQueue
+{
+	DISABLE_COPY(CAsyncQueue);
+
+private:
+	typedef map<__int64, list<TAsyncOperation>> QUEUES;
+
+	RTL_CRITICAL_SECTION	FCS;
+	// Devices with the executor started. The queue may be empty while its
+	// last operation executes.
+	QUEUES*					FQueues;
+	// Devices waiting for the executor to take them.
+	list<__int64>*			FReady;
+	unsigned long			FDepth;
+	bool					FOpened;
+	volatile LONG			FLastId;
+	// Signaled when no executors run.
+	HANDLE					FIdle;
+
+public:
+	CAsyncQueue();
+	~CAsyncQueue();
+
+	// Allows pushing operations.
+	void Open();
+	// Rejects new operations and moves all the waiting ones to the Operations
+	// list. The caller must complete them and call Release for each one. Running
+	// executors finish their current operation and stop.
+	void Close(list<TAsyncOperation>* Operations);
+	// Waits until all the executors stopped. Must be called after Close.
+	void WaitIdle();
+
+	// Adds the operation to the device's queue. The Data is copied. On success
+	// Id is set to the operation's identifier and Start is true if the caller
+	// must start the executor.
+	int Push(const __int64 Address, const TAsyncOperationKind Kind,
+		const unsigned char* const Data, const unsigned long Length,
+		unsigned long& Id, bool& Start);
+	// Takes the device the executor was started for.
+	bool Next(__int64& Address);
+	// Takes the next operation of the device. Returns false if the queue is
+	// empty: the executor must stop without touching the queue again. The
+	// executor must call Release for the operation after it completes.
+	bool Pop(const __int64 Address, TAsyncOperation& Operation);
+	// Releases the operation's data.
+	static void Release(TAsyncOperation& Operation);
+
+	unsigned long GetDepth() const;
+	// Sets the maximum number of operations waiting in the device's queue.
+	// Must be greater than zero.
+	int SetDepth(const unsigned long Depth);
+};
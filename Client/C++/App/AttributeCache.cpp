@@ -0,0 +1,348 @@
+#include "pch.h"
+
+#include "AttributeCache.h"
+
+// File layout (little endian):
+//   Magic      4 bytes  'MGAC'
+//   Version    2 bytes
+//   Count      4 bytes
+//   Records    Count * RECORD_SIZE bytes
+//   Checksum   4 bytes  FNV-1a of all the preceding bytes
+// Record:
+//   Address         8 bytes
+//   Service UUID    16 bytes
+//   Service handle  2 bytes
+//   3 characteristics (readable, writable, notifiable) CHAR_SIZE bytes each:
+//     UUID                                  16 bytes
+//     Service handle, Handle, Value handle  2 bytes each
+//     Properties bit mask                   1 byte
+// Version 1 had no UUIDs: all the devices had the same profile. Such files
+// are rejected and the cache is filled again by discovery.
+#define CACHE_MAGIC			0x4341474D
+#define CACHE_VERSION		2
+#define HEADER_SIZE			10
+#define UUID_SIZE			16
+#define CHAR_SIZE			(UUID_SIZE + 7)
+#define RECORD_SIZE			(8 + UUID_SIZE + 2 + 3 * CHAR_SIZE)
+#define CHECKSUM_SIZE		4
+
+#define PROP_BROADCASTABLE				0x01
+#define PROP_READABLE					0x02
+#define PROP_WRITABLE					0x04
+#define PROP_WRITABLE_WITHOUT_RESPONSE	0x08
+#define PROP_SIGNED_WRITABLE			0x10
+#define PROP_NOTIFIABLE					0x20
+#define PROP_INDICATABLE				0x40
+#define PROP_EXTENDED_PROPERTIES		0x80
+
+static void PutUInt16(unsigned char*& Data, const unsigned short Value)
+{
+	*Data++ = (unsigned char)(Value & 0xFF);
+	*Data++ = (unsigned char)(Value >> 8);
+}
+
+static void PutUInt32(unsigned char*& Data, const unsigned long Value)
+{
+	PutUInt16(Data, (unsigned short)(Value & 0xFFFF));
+	PutUInt16(Data, (unsigned short)(Value >> 16));
+}
+
+static unsigned short GetUInt16(const unsigned char*& Data)
+{
+	unsigned short Value = Data[0] | (Data[1] << 8);
+	Data += 2;
+	return Value;
+}
+
+static unsigned long GetUInt32(const unsigned char*& Data)
+{
+	unsigned long Lo = GetUInt16(Data);
+	unsigned long Hi = GetUInt16(Data);
+	return Lo | (Hi << 16);
+}
+
+static void PutUuid(unsigned char*& Data, const GUID& Uuid)
+{
+	PutUInt32(Data, Uuid.Data1);
+	PutUInt16(Data, Uuid.Data2);
+	PutUInt16(Data, Uuid.Data3);
+	memcpy(Data, Uuid.Data4, sizeof(Uuid.Data4));
+	Data += sizeof(Uuid.Data4);
+}
+
+static void GetUuid(const unsigned char*& Data, GUID& Uuid)
+{
+	Uuid.Data1 = GetUInt32(Data);
+	Uuid.Data2 = GetUInt16(Data);
+	Uuid.Data3 = GetUInt16(Data);
+	memcpy(Uuid.Data4, Data, sizeof(Uuid.Data4));
+	Data += sizeof(Uuid.Data4);
+}
+
+unsigned long CAttributeCache::Checksum(const unsigned char* const Data,
+	const unsigned long Length)
+{
+	unsigned long Hash = 2166136261UL;
+	for (unsigned long i = 0; i < Length; i++)
+	{
+		Hash ^= Data[i];
+		// The file keeps 32 bits: unsigned long may be wider.
+		Hash = (Hash * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	return Hash;
+}
+
+void CAttributeCache::WriteCharacteristic(unsigned char*& Data,
+	const wclGattCharacteristic& Char)
+{
+	PutUuid(Data, Char.Uuid.LongUuid);
+	PutUInt16(Data, Char.ServiceHandle);
+	PutUInt16(Data, Char.Handle);
+	PutUInt16(Data, Char.ValueHandle);
+
+	unsigned char Props = 0;
+	if (Char.IsBroadcastable)
+		Props |= PROP_BROADCASTABLE;
+	if (Char.IsReadable)
+		Props |= PROP_READABLE;
+	if (Char.IsWritable)
+		Props |= PROP_WRITABLE;
+	if (Char.IsWritableWithoutResponse)
+		Props |= PROP_WRITABLE_WITHOUT_RESPONSE;
+	if (Char.IsSignedWritable)
+		Props |= PROP_SIGNED_WRITABLE;
+	if (Char.IsNotifiable)
+		Props |= PROP_NOTIFIABLE;
+	if (Char.IsIndicatable)
+		Props |= PROP_INDICATABLE;
+	if (Char.HasExtendedProperties)
+		Props |= PROP_EXTENDED_PROPERTIES;
+	*Data++ = Props;
+}
+
+void CAttributeCache::ReadCharacteristic(const unsigned char*& Data,
+	wclGattCharacteristic& Char)
+{
+	Char.Uuid.IsShortUuid = false;
+	Char.Uuid.ShortUuid = 0;
+	GetUuid(Data, Char.Uuid.LongUuid);
+	Char.ServiceHandle = GetUInt16(Data);
+	Char.Handle = GetUInt16(Data);
+	Char.ValueHandle = GetUInt16(Data);
+
+	unsigned char Props = *Data++;
+	Char.IsBroadcastable = ((Props & PROP_BROADCASTABLE) != 0);
+	Char.IsReadable = ((Props & PROP_READABLE) != 0);
+	Char.IsWritable = ((Props & PROP_WRITABLE) != 0);
+	Char.IsWritableWithoutResponse = ((Props & PROP_WRITABLE_WITHOUT_RESPONSE) != 0);
+	Char.IsSignedWritable = ((Props & PROP_SIGNED_WRITABLE) != 0);
+	Char.IsNotifiable = ((Props & PROP_NOTIFIABLE) != 0);
+	Char.IsIndicatable = ((Props & PROP_INDICATABLE) != 0);
+	Char.HasExtendedProperties = ((Props & PROP_EXTENDED_PROPERTIES) != 0);
+}
+
+int CAttributeCache::Parse(const unsigned char* const Data, const unsigned long Length)
+{
+	if (Length < HEADER_SIZE + CHECKSUM_SIZE)
+		return ATTRIBUTE_CACHE_E_INVALID_FORMAT;
+
+	const unsigned char* Tail = Data + Length - CHECKSUM_SIZE;
+	if (GetUInt32(Tail) != Checksum(Data, Length - CHECKSUM_SIZE))
+		return ATTRIBUTE_CACHE_E_INVALID_FORMAT;
+
+	const unsigned char* p = Data;
+	if (GetUInt32(p) != CACHE_MAGIC || GetUInt16(p) != CACHE_VERSION)
+		return ATTRIBUTE_CACHE_E_INVALID_FORMAT;
+	unsigned long Count = GetUInt32(p);
+	// Check the count before the multiplication: the damaged count could wrap
+	// the expected length around to the real one.
+	if (Count > (Length - HEADER_SIZE - CHECKSUM_SIZE) / RECORD_SIZE)
+		return ATTRIBUTE_CACHE_E_INVALID_FORMAT;
+	if (Length != HEADER_SIZE + Count * RECORD_SIZE + CHECKSUM_SIZE)
+		return ATTRIBUTE_CACHE_E_INVALID_FORMAT;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FRecords->clear();
+		for (unsigned long i = 0; i < Count; i++)
+		{
+			__int64 Address = (__int64)GetUInt32(p);
+			Address |= ((__int64)GetUInt32(p)) << 32;
+
+			TAttributeCacheRecord Record;
+			Record.Service.Uuid.IsShortUuid = false;
+			Record.Service.Uuid.ShortUuid = 0;
+			GetUuid(p, Record.Service.Uuid.LongUuid);
+			Record.Service.Handle = GetUInt16(p);
+			ReadCharacteristic(p, Record.ReadableChar);
+			ReadCharacteristic(p, Record.WritableChar);
+			ReadCharacteristic(p, Record.NotifiableChar);
+
+			(*FRecords)[Address] = Record;
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+	return WCL_E_SUCCESS;
+}
+
+CAttributeCache::CAttributeCache()
+{
+	InitializeCriticalSection(&FCS);
+
+	FRecords = new RECORDS();
+}
+
+CAttributeCache::~CAttributeCache()
+{
+	delete FRecords;
+
+	DeleteCriticalSection(&FCS);
+}
+
+bool CAttributeCache::Find(const __int64 Address, TAttributeCacheRecord& Record)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		RECORDS::iterator Item = FRecords->find(Address);
+		if (Item == FRecords->end())
+			return false;
+		Record = Item->second;
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAttributeCache::Store(const __int64 Address, const TAttributeCacheRecord& Record)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		(*FRecords)[Address] = Record;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAttributeCache::Remove(const __int64 Address)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FRecords->erase(Address);
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CAttributeCache::Clear()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FRecords->clear();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+int CAttributeCache::LoadFromFile(const tstring& FileName)
+{
+	HANDLE File = CreateFile(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return ATTRIBUTE_CACHE_E_OPEN_FAILED;
+
+	int Res = WCL_E_SUCCESS;
+	DWORD Size = GetFileSize(File, NULL);
+	if (Size == INVALID_FILE_SIZE)
+		Res = ATTRIBUTE_CACHE_E_READ_FAILED;
+	else
+	{
+		unsigned char* Data = (unsigned char*)malloc(Size > 0 ? Size : 1);
+		if (Data == NULL)
+			Res = WCL_E_OUT_OF_MEMORY;
+		else
+		{
+			DWORD Read = 0;
+			if (!ReadFile(File, Data, Size, &Read, NULL) || Read != Size)
+				Res = ATTRIBUTE_CACHE_E_READ_FAILED;
+			else
+				Res = Parse(Data, Size);
+			free(Data);
+		}
+	}
+
+	CloseHandle(File);
+	return Res;
+}
+
+int CAttributeCache::SaveToFile(const tstring& FileName)
+{
+	unsigned char* Data = NULL;
+	unsigned long Length = 0;
+
+	// Serialize under the lock, write outside.
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		Length = HEADER_SIZE + (unsigned long)FRecords->size() * RECORD_SIZE + CHECKSUM_SIZE;
+		Data = (unsigned char*)malloc(Length);
+		if (Data != NULL)
+		{
+			unsigned char* p = Data;
+			PutUInt32(p, CACHE_MAGIC);
+			PutUInt16(p, CACHE_VERSION);
+			PutUInt32(p, (unsigned long)FRecords->size());
+
+			for (RECORDS::iterator Item = FRecords->begin(); Item != FRecords->end(); Item++)
+			{
+				PutUInt32(p, (unsigned long)(Item->first & 0xFFFFFFFF));
+				PutUInt32(p, (unsigned long)(Item->first >> 32));
+				PutUuid(p, Item->second.Service.Uuid.LongUuid);
+				PutUInt16(p, Item->second.Service.Handle);
+				WriteCharacteristic(p, Item->second.ReadableChar);
+				WriteCharacteristic(p, Item->second.WritableChar);
+				WriteCharacteristic(p, Item->second.NotifiableChar);
+			}
+
+			PutUInt32(p, Checksum(Data, Length - CHECKSUM_SIZE));
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+
+	if (Data == NULL)
+		return WCL_E_OUT_OF_MEMORY;
+
+	int Res = WCL_E_SUCCESS;
+	HANDLE File = CreateFile(FileName.c_str(), GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		Res = ATTRIBUTE_CACHE_E_OPEN_FAILED;
+	else
+	{
+		DWORD Written = 0;
+		if (!WriteFile(File, Data, Length, &Written, NULL) || Written != Length)
+			Res = ATTRIBUTE_CACHE_E_WRITE_FAILED;
+		CloseHandle(File);
+	}
+
+	free(Data);
+	return Res;
+}
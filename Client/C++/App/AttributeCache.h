@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+
+#include "wclBluetooth.h"
+
+using namespace std;
+using namespace wclCommon;
+using namespace wclCommunication;
+using namespace wclBluetooth;
+
+#pragma region Attribute cache error codes
+const int ATTRIBUTE_CACHE_E_BASE = 0x7F010000;
+// Unable to open or create the cache file.
+const int ATTRIBUTE_CACHE_E_OPEN_FAILED = ATTRIBUTE_CACHE_E_BASE + 0x0000;
+// Unable to read the cache file.
+const int ATTRIBUTE_CACHE_E_READ_FAILED = ATTRIBUTE_CACHE_E_BASE + 0x0001;
+// Unable to write the cache file.
+const int ATTRIBUTE_CACHE_E_WRITE_FAILED = ATTRIBUTE_CACHE_E_BASE + 0x0002;
+// The cache file is corrupted or has unsupported version.
+const int ATTRIBUTE_CACHE_E_INVALID_FORMAT = ATTRIBUTE_CACHE_E_BASE + 0x0003;
+#pragma endregion Attribute cache error codes
+
+// Resolved attributes of a single device.
+typedef struct
+{
+	wclGattService			Service;
+	wclGattCharacteristic	ReadableChar;
+	wclGattCharacteristic	WritableChar;
+	wclGattCharacteristic	NotifiableChar;
+} TAttributeCacheRecord;
+
+// The cache of the resolved GATT attribute handles keyed by device address.
+// Our peripherals never change their GATT table so the handles found once can
+// be reused on next connection without discovery. The cache can be saved to
+// and loaded from a compact binary file. The attribute UUIDs are stored with
+// the handles so the devices of different client profiles share the cache.
+// The class is thread safe.
+class CAttributeCache
+{
+	DISABLE_COPY(CAttributeCache);
+
+private:
+	typedef map<__int64, TAttributeCacheRecord> RECORDS;
+
+	RTL_CRITICAL_SECTION	FCS;
+	RECORDS*				FRecords;
+
+	static unsigned long Checksum(const unsigned char* const Data,
+		const unsigned long Length);
+	static void WriteCharacteristic(unsigned char*& Data,
+		const wclGattCharacteristic& Char);
+	static void ReadCharacteristic(const unsigned char*& Data,
+		wclGattCharacteristic& Char);
+
+	int Parse(const unsigned char* const Data, const unsigned long Length);
+
+public:
+	CAttributeCache();
+	~CAttributeCache();
+
+	// Returns true and the cached attributes if the device is in the cache.
+	bool Find(const __int64 Address, TAttributeCacheRecord& Record);
+	// Adds or replaces the device's attributes.
+	void Store(const __int64 Address, const TAttributeCacheRecord& Record);
+	// Removes the device from the cache. Called when cached handles are not
+	// valid anymore.
+	void Remove(const __int64 Address);
+	// Removes all the records.
+	void Clear();
+
+	// Replaces the cache content with the records from the file.
+	int LoadFromFile(const tstring& FileName);
+	// Saves the cache content to the file.
+	int SaveToFile(const tstring& FileName);
+};
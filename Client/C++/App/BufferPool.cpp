@@ -0,0 +1,181 @@
+#include "pch.h"
+
+#include "BufferPool.h"
+
+bool CBufferPool::IsPooled(const unsigned char* const Block) const
+{
+	return (FSlab != NULL && Block >= FSlab && Block < FSlab + FBlockSize * FCapacity);
+}
+
+CBufferPool::CBufferPool(const unsigned long BlockSize, const unsigned long Capacity)
+{
+	InitializeCriticalSection(&FCS);
+
+	// The block must be able to hold the free list link.
+	FBlockSize = BlockSize;
+	if (FBlockSize < sizeof(TFreeBlock))
+		FBlockSize = sizeof(TFreeBlock);
+	// Keep the blocks aligned.
+	FBlockSize = (FBlockSize + sizeof(void*) - 1) & ~((unsigned long)sizeof(void*) - 1);
+
+	FCapacity = Capacity;
+	FFree = NULL;
+	FFreeCount = 0;
+	FSlab = NULL;
+	if (FCapacity > 0)
+		FSlab = (unsigned char*)malloc(FBlockSize * FCapacity);
+
+	if (FSlab == NULL)
+		FCapacity = 0;
+	else
+	{
+		for (unsigned long i = FCapacity; i > 0; i--)
+		{
+			TFreeBlock* Block = (TFreeBlock*)(FSlab + (i - 1) * FBlockSize);
+			Block->Next = FFree;
+			FFree = Block;
+		}
+		FFreeCount = FCapacity;
+	}
+}
+
+CBufferPool::~CBufferPool()
+{
+	if (FSlab != NULL)
+		free(FSlab);
+
+	DeleteCriticalSection(&FCS);
+}
+
+unsigned char* CBufferPool::Acquire()
+{
+	TFreeBlock* Block = NULL;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FFree != NULL)
+		{
+			Block = FFree;
+			FFree = Block->Next;
+			FFreeCount--;
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+
+	// The slab is exhausted. Do not fail, use the heap.
+	if (Block == NULL)
+		return (unsigned char*)malloc(FBlockSize);
+	return (unsigned char*)Block;
+}
+
+void CBufferPool::Release(unsigned char* const Block)
+{
+	if (Block == NULL)
+		return;
+
+	if (!IsPooled(Block))
+	{
+		free(Block);
+		return;
+	}
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		TFreeBlock* Free = (TFreeBlock*)Block;
+		Free->Next = FFree;
+		FFree = Free;
+		FFreeCount++;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+unsigned long CBufferPool::GetBlockSize() const
+{
+	return FBlockSize;
+}
+
+unsigned long CBufferPool::GetCapacity() const
+{
+	return FCapacity;
+}
+
+unsigned long CBufferPool::GetFreeCount()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		return FFreeCount;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+CPooledBuffer::CPooledBuffer()
+{
+	FPool = NULL;
+	FData = NULL;
+	FLength = 0;
+}
+
+CPooledBuffer::~CPooledBuffer()
+{
+	Release();
+}
+
+int CPooledBuffer::Acquire(CBufferPool* const Pool)
+{
+	if (Pool == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	Release();
+
+	FData = Pool->Acquire();
+	if (FData == NULL)
+		return WCL_E_OUT_OF_MEMORY;
+	FPool = Pool;
+	return WCL_E_SUCCESS;
+}
+
+void CPooledBuffer::Release()
+{
+	if (FData != NULL)
+	{
+		FPool->Release(FData);
+		FData = NULL;
+		FPool = NULL;
+	}
+	FLength = 0;
+}
+
+unsigned char* CPooledBuffer::GetData() const
+{
+	return FData;
+}
+
+unsigned long CPooledBuffer::GetSize() const
+{
+	if (FPool == NULL)
+		return 0;
+	return FPool->GetBlockSize();
+}
+
+unsigned long CPooledBuffer::GetLength() const
+{
+	return FLength;
+}
+
+void CPooledBuffer::SetLength(const unsigned long Length)
+{
+	if (Length <= GetSize())
+		FLength = Length;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+#pragma region Buffer pool error codes
+const int BUFFER_POOL_E_BASE = 0x7F020000;
+// The buffer is too small for the value.
+const int BUFFER_POOL_E_BUFFER_TOO_SMALL = BUFFER_POOL_E_BASE + 0x0000;
+#pragma endregion Buffer pool error codes
+
+// Maximum length of the GATT attribute value.
+const unsigned long MAX_ATTRIBUTE_VALUE_LENGTH = 512;
+// Default number of blocks in the read buffers pool.
+const unsigned long DEFAULT_BUFFER_POOL_CAPACITY = 16;
+
+// The pool of fixed-size memory blocks cut from a single slab allocated once.
+// Acquiring and releasing a block never touches the heap while there are free
+// blocks in the slab. If the slab is exhausted the block is allocated on the
+// heap and freed on release so the caller never fails because of the pool.
+// The pool must outlive all the blocks acquired from it.
+// The class is thread safe.
+class CBufferPool
+{
+	DISABLE_COPY(CBufferPool);
+
+private:
+	// Free blocks are linked through their first bytes.
+	typedef struct _TFreeBlock
+	{
+		struct _TFreeBlock*	Next;
+	} TFreeBlock;
+
+	RTL_CRITICAL_SECTION	FCS;
+	unsigned char*			FSlab;
+	unsigned long			FBlockSize;
+	unsigned long			FCapacity;
+	TFreeBlock*				FFree;
+	unsigned long			FFreeCount;
+
+	bool IsPooled(const unsigned char* const Block) const;
+
+public:
+	CBufferPool(const unsigned long BlockSize = MAX_ATTRIBUTE_VALUE_LENGTH,
+		const unsigned long Capacity = DEFAULT_BUFFER_POOL_CAPACITY);
+	~CBufferPool();
+
+	// Returns the block of BlockSize bytes or NULL if there is no memory.
+	unsigned char* Acquire();
+	// Returns the block to the pool.
+	void Release(unsigned char* const Block);
+
+	unsigned long GetBlockSize() const;
+	unsigned long GetCapacity() const;
+	// Returns the number of free blocks in the slab.
+	unsigned long GetFreeCount();
+};
+
+// The buffer that holds a block acquired from the pool and returns it back
+// when the buffer is destroyed or released.
+class CPooledBuffer
+{
+	DISABLE_COPY(CPooledBuffer);
+
+private:
+	CBufferPool*	FPool;
+	unsigned char*	FData;
+	unsigned long	FLength;
+
+public:
+	CPooledBuffer();
+	~CPooledBuffer();
+
+	// Takes new block from the pool. The previous block (if any) is released.
+	int Acquire(CBufferPool* const Pool);
+	// Returns the block to the pool.
+	void Release();
+
+	// Returns the block's memory or NULL if the buffer is empty.
+	unsigned char* GetData() const;
+	// Returns the block size.
+	unsigned long GetSize() const;
+	// Returns the length of the data stored in the buffer.
+	unsigned long GetLength() const;
+	void SetLength(const unsigned long Length);
+
+	__declspec(property(get = GetData)) unsigned char* Data;
+	__declspec(property(get = GetSize)) unsigned long Size;
+	__declspec(property(get = GetLength)) unsigned long Length;
+};
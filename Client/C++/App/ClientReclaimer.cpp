@@ -0,0 +1,160 @@
+#include "pch.h"
+
+#include "ClientReclaimer.h"
+#include "GattClient.h"
+
+void CClientReclaimer::Free(list<TRetiredClient>* Clients)
+{
+	if (Clients->size() > 0)
+	{
+		for (list<TRetiredClient>::iterator Retired = Clients->begin(); Retired != Clients->end(); Retired++)
+			delete Retired->Client;
+	}
+}
+
+CClientReclaimer::CClientReclaimer()
+{
+	InitializeCriticalSection(&FCS);
+
+	FEpoch = 0;
+	FActive[0] = 0;
+	FActive[1] = 0;
+	FRetired = new list<TRetiredClient>();
+	FRetiredCount = 0;
+}
+
+CClientReclaimer::~CClientReclaimer()
+{
+	ReclaimAll();
+
+	delete FRetired;
+
+	DeleteCriticalSection(&FCS);
+}
+
+LONG CClientReclaimer::Enter()
+{
+	while (true)
+	{
+		LONG Epoch = FEpoch;
+		InterlockedIncrement(&FActive[Epoch & 1]);
+		// If the epoch has been advanced between reading and counting we may
+		// have been counted in the wrong slot. Try again.
+		if (FEpoch == Epoch)
+			return Epoch;
+		InterlockedDecrement(&FActive[Epoch & 1]);
+	}
+}
+
+void CClientReclaimer::Leave(const LONG Token)
+{
+	InterlockedDecrement(&FActive[Token & 1]);
+}
+
+void CClientReclaimer::Retire(CGattClient* const Client)
+{
+	if (Client == NULL)
+		return;
+
+	TRetiredClient Retired;
+	Retired.Client = Client;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		Retired.Epoch = FEpoch;
+		// Read under the lock so the Unlinked call can not be missed.
+		Retired.Linked = Client->IsLinked();
+		FRetired->push_back(Retired);
+		InterlockedIncrement(&FRetiredCount);
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CClientReclaimer::Unlinked(CGattClient* const Client)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		for (list<TRetiredClient>::iterator Retired = FRetired->begin(); Retired != FRetired->end(); Retired++)
+		{
+			if (Retired->Client == Client)
+			{
+				// The dispatches running now could reach the client: the
+				// grace period starts here.
+				Retired->Epoch = FEpoch;
+				Retired->Linked = false;
+				break;
+			}
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CClientReclaimer::Reclaim()
+{
+	// Fast path: nothing to do. Called for each advertisement.
+	if (FRetiredCount == 0)
+		return;
+
+	list<TRetiredClient>* Expired = new list<TRetiredClient>();
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		// The epoch can be advanced only when all the dispatches started in the
+		// previous epoch have completed.
+		LONG Epoch = FEpoch;
+		if (FActive[(Epoch + 1) & 1] == 0)
+		{
+			InterlockedIncrement(&FEpoch);
+			Epoch++;
+		}
+
+		list<TRetiredClient>::iterator Retired = FRetired->begin();
+		while (Retired != FRetired->end())
+		{
+			if (!Retired->Linked && Epoch - Retired->Epoch >= 2)
+			{
+				Expired->push_back(*Retired);
+				Retired = FRetired->erase(Retired);
+				InterlockedDecrement(&FRetiredCount);
+			}
+			else
+				Retired++;
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+
+	// Destroy clients outside the lock: client's destructor may fire events.
+	Free(Expired);
+	delete Expired;
+}
+
+void CClientReclaimer::ReclaimAll()
+{
+	list<TRetiredClient>* Expired = new list<TRetiredClient>();
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		Expired->swap(*FRetired);
+		FRetiredCount = 0;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+
+	Free(Expired);
+	delete Expired;
+}
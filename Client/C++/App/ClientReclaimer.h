@@ -0,0 +1,69 @@
+#pragma once
+
+#include <list>
+
+#include "wclHelpers.h"
+
+using namespace std;
+
+class CGattClient;
+
+// Epoch based reclamation of the GATT clients.
+// A client can not be destroyed from inside its own event handler and the
+// client's events may still be running on other threads when it is removed
+// from the watcher. Clients whose reference count dropped to zero are retired
+// here and destroyed only after a grace period: two epoch advances, each of
+// them possible only when no client event dispatch that started in the
+// previous epoch is still running.
+// The grace period covers only the dispatches that started before it. The
+// library fires events on the client itself while its connection is linked
+// (see CGattClient::IsLinked) so a linked client is kept retired and its
+// grace period starts when the last event of the connection unlinks it.
+class CClientReclaimer
+{
+	DISABLE_COPY(CClientReclaimer);
+
+private:
+	typedef struct
+	{
+		CGattClient*	Client;
+		LONG			Epoch;
+		// The library may still dispatch the client's events.
+		bool			Linked;
+	} TRetiredClient;
+
+	RTL_CRITICAL_SECTION	FCS;
+	volatile LONG			FEpoch;
+	// Number of active dispatches started in even and odd epochs.
+	volatile LONG			FActive[2];
+	list<TRetiredClient>*	FRetired;
+	volatile LONG			FRetiredCount;
+
+	void Free(list<TRetiredClient>* Clients);
+
+public:
+	CClientReclaimer();
+	// The destructor destroys all retired clients regardless of the epoch.
+	~CClientReclaimer();
+
+	// Marks the beginning of the client's event dispatch. Returns the token that
+	// must be passed to the Leave method.
+	LONG Enter();
+	// Marks the end of the client's event dispatch.
+	void Leave(const LONG Token);
+
+	// Puts the client into the retired list. The client must not be
+	// referenced by anyone.
+	void Retire(CGattClient* const Client);
+	// Starts the grace period of the retired client whose connection has been
+	// unlinked. Does nothing if the client is not retired. Must be called
+	// between Enter and Leave.
+	void Unlinked(CGattClient* const Client);
+	// Tries to advance the epoch and destroys the clients whose grace period
+	// expired. Must be called from the thread that creates clients and never
+	// from the client's event handler.
+	void Reclaim();
+	// Destroys all retired clients. Use it only when no client events can be
+	// dispatched anymore.
+	void ReclaimAll();
+};
@@ -0,0 +1,156 @@
+#include "pch.h"
+
+#include "ClientRegistry.h"
+
+size_t CClientRegistry::Hash(const __int64 Address)
+{
+	// 64-bit finalizer mix. Bluetooth addresses share vendor prefixes so the low
+	// bits alone are a poor hash.
+	unsigned __int64 h = (unsigned __int64)Address;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+size_t CClientRegistry::FindSlot(const __int64 Address) const
+{
+	size_t Mask = FCapacity - 1;
+	size_t Index = Hash(Address) & Mask;
+	while (FEntries[Index].Address != 0)
+	{
+		if (FEntries[Index].Address == Address)
+			return Index;
+		Index = (Index + 1) & Mask;
+	}
+	return FCapacity;
+}
+
+void CClientRegistry::Grow()
+{
+	TRegistryEntry* OldEntries = FEntries;
+	size_t OldCapacity = FCapacity;
+
+	FCapacity = OldCapacity * 2;
+	FEntries = new TRegistryEntry[FCapacity];
+	ZeroMemory(FEntries, FCapacity * sizeof(TRegistryEntry));
+	FCount = 0;
+
+	for (size_t i = 0; i < OldCapacity; i++)
+	{
+		if (OldEntries[i].Address != 0)
+			Add(OldEntries[i].Address, OldEntries[i].Client, OldEntries[i].State);
+	}
+
+	delete[] OldEntries;
+}
+
+CClientRegistry::CClientRegistry(const size_t Capacity)
+{
+	FCapacity = 16;
+	while (FCapacity < Capacity)
+		FCapacity *= 2;
+
+	FEntries = new TRegistryEntry[FCapacity];
+	ZeroMemory(FEntries, FCapacity * sizeof(TRegistryEntry));
+	FCount = 0;
+}
+
+CClientRegistry::~CClientRegistry()
+{
+	delete[] FEntries;
+}
+
+bool CClientRegistry::Add(const __int64 Address, CGattClient* const Client,
+	const TRegistryState State)
+{
+	if (Address == 0)
+		return false;
+
+	// Keep load factor below 3/4 so probe sequences stay short.
+	if ((FCount + 1) * 4 > FCapacity * 3)
+		Grow();
+
+	size_t Mask = FCapacity - 1;
+	size_t Index = Hash(Address) & Mask;
+	while (FEntries[Index].Address != 0)
+	{
+		if (FEntries[Index].Address == Address)
+			return false;
+		Index = (Index + 1) & Mask;
+	}
+
+	FEntries[Index].Address = Address;
+	FEntries[Index].State = State;
+	FEntries[Index].Client = Client;
+	FCount++;
+	return true;
+}
+
+TRegistryEntry* CClientRegistry::Find(const __int64 Address) const
+{
+	if (Address == 0 || FCount == 0)
+		return NULL;
+
+	size_t Index = FindSlot(Address);
+	if (Index == FCapacity)
+		return NULL;
+	return &FEntries[Index];
+}
+
+bool CClientRegistry::Remove(const __int64 Address)
+{
+	if (Address == 0 || FCount == 0)
+		return false;
+
+	size_t Index = FindSlot(Address);
+	if (Index == FCapacity)
+		return false;
+
+	// Backward shift deletion: move following entries of the same probe chain
+	// into the hole so no tombstones are needed.
+	size_t Mask = FCapacity - 1;
+	size_t Hole = Index;
+	size_t Next = (Hole + 1) & Mask;
+	while (FEntries[Next].Address != 0)
+	{
+		size_t Home = Hash(FEntries[Next].Address) & Mask;
+		// Move the entry only if its home slot is not between the hole and the
+		// entry position (cyclically).
+		if (((Next - Home) & Mask) >= ((Next - Hole) & Mask))
+		{
+			FEntries[Hole] = FEntries[Next];
+			Hole = Next;
+		}
+		Next = (Next + 1) & Mask;
+	}
+
+	ZeroMemory(&FEntries[Hole], sizeof(TRegistryEntry));
+	FCount--;
+	return true;
+}
+
+void CClientRegistry::Clear()
+{
+	ZeroMemory(FEntries, FCapacity * sizeof(TRegistryEntry));
+	FCount = 0;
+}
+
+size_t CClientRegistry::GetCapacity() const
+{
+	return FCapacity;
+}
+
+TRegistryEntry* CClientRegistry::GetSlot(const size_t Index) const
+{
+	if (Index >= FCapacity)
+		return NULL;
+	return &FEntries[Index];
+}
+
+size_t CClientRegistry::GetCount() const
+{
+	return FCount;
+}
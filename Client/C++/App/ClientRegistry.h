@@ -0,0 +1,65 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+class CGattClient;
+
+// The connection state of a device tracked by the registry.
+typedef enum
+{
+	// Connection to the device has been started but not completed yet.
+	rsPending,
+	// The device is connected and ready for communication.
+	rsConnected,
+	// Disconnection has been requested. The client must not be used for I/O.
+	rsClosing
+} TRegistryState;
+
+// A single registry slot. A slot with zero address is free (a valid
+// Bluetooth MAC address is never zero).
+typedef struct
+{
+	__int64			Address;
+	TRegistryState	State;
+	CGattClient*	Client;
+} TRegistryEntry;
+
+// Address keyed open-addressing hash table (linear probing with backward shift
+// deletion) that keeps all known clients regardless of their connection state.
+// Lookups, inserts and removals do not depend on the number of devices.
+// The class is not thread safe. The owner must serialize access to it.
+class CClientRegistry
+{
+	DISABLE_COPY(CClientRegistry);
+
+private:
+	TRegistryEntry*	FEntries;
+	size_t			FCapacity;
+	size_t			FCount;
+
+	static size_t Hash(const __int64 Address);
+	size_t FindSlot(const __int64 Address) const;
+	void Grow();
+
+public:
+	// Capacity is rounded up to the power of 2.
+	CClientRegistry(const size_t Capacity = 64);
+	~CClientRegistry();
+
+	// Adds new entry. Returns false if the address is already registered.
+	bool Add(const __int64 Address, CGattClient* const Client,
+		const TRegistryState State);
+	// Returns the entry for the given address or NULL if not found. The returned
+	// pointer is valid only until next Add or Remove call.
+	TRegistryEntry* Find(const __int64 Address) const;
+	// Removes the entry. Returns false if the address is not registered.
+	bool Remove(const __int64 Address);
+	// Removes all the entries.
+	void Clear();
+
+	// Slots enumeration. Free slots have zero Address.
+	size_t GetCapacity() const;
+	TRegistryEntry* GetSlot(const size_t Index) const;
+
+	size_t GetCount() const;
+};
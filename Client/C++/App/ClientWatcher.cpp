@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "ClientWatcher.h"
+#include "Timestamp.h"
 
 void CClientWatcher::DoClientDisconnected(const __int64 Address, const int Reason)
 {
@@ -17,9 +18,10 @@ void CClientWatcher::DoConnectionStarted(const __int64 Address, const int Result
 	__raise OnConnectionStarted(Address, Result);
 }
 
-void CClientWatcher::DoDeviceFound(const __int64 Address, const tstring& Name)
+void CClientWatcher::DoDeviceFound(const __int64 Address, const tstring& Name,
+	const int Rule)
 {
-	__raise OnDeviceFound(Address, Name);
+	__raise OnDeviceFound(Address, Name, Rule);
 }
 
 void CClientWatcher::DoValueChanged(const __int64 Address, const unsigned char* Value,
@@ -28,14 +30,560 @@ void CClientWatcher::DoValueChanged(const __int64 Address, const unsigned char*
 	__raise OnValueChanged(Address, Value, Length);
 }
 
+void CClientWatcher::DoValuesChanged(const TValueRecord* Records, const unsigned long Count)
+{
+	__raise OnValuesChanged(Records, Count);
+}
+
+void CClientWatcher::DoMessageReceived(const __int64 Address, const unsigned char* Message,
+	const unsigned long Length)
+{
+	__raise OnMessageReceived(Address, Message, Length);
+}
+
+void CClientWatcher::DoReadCompleted(const __int64 Address, const unsigned long Id,
+	const int Result, const unsigned char* Value, const unsigned long Length)
+{
+	__raise OnReadCompleted(Address, Id, Result, Value, Length);
+}
+
+void CClientWatcher::DoWriteCompleted(const __int64 Address, const unsigned long Id,
+	const int Result)
+{
+	__raise OnWriteCompleted(Address, Id, Result);
+}
+
+CValuesBatchMessage::CValuesBatchMessage(CClientWatcher* const Watcher,
+	const unsigned long Slot) : CwclUserDefinedCategoryMessage(WATCHER_MSG_BATCH)
+{
+	FWatcher = Watcher;
+	FSlot = Slot;
+}
+
+CValuesBatchMessage::~CValuesBatchMessage()
+{
+	FWatcher->RecycleBatch(FSlot);
+}
+
+unsigned long CValuesBatchMessage::GetSlot() const
+{
+	return FSlot;
+}
+
+CAsyncCompletedMessage::CAsyncCompletedMessage(const TAsyncOperation& Operation)
+	: CwclUserDefinedCategoryMessage(WATCHER_MSG_ASYNC_COMPLETED)
+{
+	FAddress = Operation.Address;
+	FId = Operation.Id;
+	FKind = Operation.Kind;
+	FResult = WCL_E_SUCCESS;
+	FBuffer = new CPooledBuffer();
+}
+
+CAsyncCompletedMessage::~CAsyncCompletedMessage()
+{
+	// Returns the block to the pool.
+	delete FBuffer;
+}
+
+__int64 CAsyncCompletedMessage::GetAddress() const
+{
+	return FAddress;
+}
+
+unsigned long CAsyncCompletedMessage::GetId() const
+{
+	return FId;
+}
+
+TAsyncOperationKind CAsyncCompletedMessage::GetKind() const
+{
+	return FKind;
+}
+
+int CAsyncCompletedMessage::GetResult() const
+{
+	return FResult;
+}
+
+void CAsyncCompletedMessage::SetResult(const int Result)
+{
+	FResult = Result;
+}
+
+CPooledBuffer* CAsyncCompletedMessage::GetBuffer() const
+{
+	return FBuffer;
+}
+
+DWORD WINAPI CClientWatcher::_BatchProc(LPVOID Param)
+{
+	((CClientWatcher*)Param)->BatchProc();
+	return 0;
+}
+
+void CClientWatcher::BatchProc()
+{
+	unsigned long Slot = 0;
+	bool Taken = false;
+	while (InterlockedCompareExchange(&FBatchTerminate, 0, 0) == 0)
+	{
+		// The slot is taken before the batch is collected so the values are
+		// popped right into it. Waits while all the slots are posted.
+		if (!Taken)
+		{
+			if (!TakeBatchSlot(Slot))
+				break;
+			Taken = true;
+		}
+
+		// Sleep until the first notification of the batch.
+		if (!FNotifications->Wait(INFINITE))
+			continue;
+
+		// Collect the batch until the window expires or the batch is full.
+		TBatchSlot& Batch = FBatchSlots[Slot];
+		ULONGLONG Deadline = GetTickCount64() + FBatchWindow;
+		Batch.Count = 0;
+		while (true)
+		{
+			Batch.Count += FNotifications->Pop(Batch.Notifications + Batch.Count,
+				FBatchSize - Batch.Count);
+			if (Batch.Count == FBatchSize || InterlockedCompareExchange(&FBatchTerminate, 0, 0) != 0)
+				break;
+
+			ULONGLONG Now = GetTickCount64();
+			if (Now >= Deadline)
+				break;
+			FNotifications->Wait((DWORD)(Deadline - Now));
+		}
+
+		if (Batch.Count > 0)
+		{
+			PostBatch(Slot);
+			Taken = false;
+		}
+	}
+
+	if (Taken)
+		InterlockedExchange(&FBatchSlots[Slot].Busy, 0);
+}
+
+bool CClientWatcher::TakeBatchSlot(unsigned long& Slot)
+{
+	WaitForSingleObject(FBatchFree, INFINITE);
+	if (InterlockedCompareExchange(&FBatchTerminate, 0, 0) != 0)
+		return false;
+
+	// The semaphore guarantees there is the free slot. Only this thread takes
+	// the slots.
+	for (Slot = 0; Slot < VALUES_BATCH_SLOTS; Slot++)
+	{
+		if (InterlockedCompareExchange(&FBatchSlots[Slot].Busy, 1, 0) == 0)
+			return true;
+	}
+	return false;
+}
+
+void CClientWatcher::PostBatch(const unsigned long Slot)
+{
+	TBatchSlot& Batch = FBatchSlots[Slot];
+	for (unsigned long i = 0; i < Batch.Count; i++)
+	{
+		Batch.Records[i].Address = Batch.Notifications[i].Address;
+		Batch.Records[i].Handle = Batch.Notifications[i].Handle;
+		Batch.Records[i].Timestamp = Batch.Notifications[i].Timestamp;
+		Batch.Records[i].Value = Batch.Notifications[i].Data;
+		Batch.Records[i].Length = Batch.Notifications[i].Length;
+	}
+
+	// Only this thread makes the counter not zero.
+	if (InterlockedIncrement(&FBatchPosted) == 1)
+		ResetEvent(FBatchIdle);
+
+	// If the message can not be posted it recycles the slot when released.
+	CValuesBatchMessage* Message = new CValuesBatchMessage(this, Slot);
+	FReceiver->Post(Message);
+	Message->Release();
+}
+
+void CClientWatcher::RecycleBatch(const unsigned long Slot)
+{
+	InterlockedExchange(&FBatchSlots[Slot].Busy, 0);
+	ReleaseSemaphore(FBatchFree, 1, NULL);
+	// The semaphore must not be touched after the counter drops to zero:
+	// StopBatching closes it then.
+	if (InterlockedDecrement(&FBatchPosted) == 0)
+		SetEvent(FBatchIdle);
+}
+
+void CClientWatcher::ReportBatch(const unsigned long Slot)
+{
+	// Drop the batches that were posted before batching stopped.
+	if (InterlockedCompareExchange(&FBatchTerminate, 0, 0) != 0)
+		return;
+	DoValuesChanged(FBatchSlots[Slot].Records, FBatchSlots[Slot].Count);
+}
+
+void CClientWatcher::AllocateBatches(const unsigned long Size)
+{
+	for (unsigned long i = 0; i < VALUES_BATCH_SLOTS; i++)
+	{
+		FBatchSlots[i].Notifications = new TNotification[Size];
+		FBatchSlots[i].Records = new TValueRecord[Size];
+		FBatchSlots[i].Count = 0;
+		FBatchSlots[i].Busy = 0;
+	}
+}
+
+void CClientWatcher::ReleaseBatches()
+{
+	for (unsigned long i = 0; i < VALUES_BATCH_SLOTS; i++)
+	{
+		if (FBatchSlots[i].Notifications != NULL)
+		{
+			delete[] FBatchSlots[i].Notifications;
+			delete[] FBatchSlots[i].Records;
+			FBatchSlots[i].Notifications = NULL;
+			FBatchSlots[i].Records = NULL;
+		}
+	}
+}
+
+void CClientWatcher::StartBatching()
+{
+	if (FBatchSize == 0 || FBatchThread != NULL)
+		return;
+
+	if (FNotifications == NULL)
+		FNotifications = new CNotificationRing();
+
+	// One more than the slots: StopBatching releases it to wake the thread.
+	FBatchFree = CreateSemaphore(NULL, VALUES_BATCH_SLOTS, VALUES_BATCH_SLOTS + 1, NULL);
+	if (FBatchFree == NULL)
+		return;
+
+	InterlockedExchange(&FBatchTerminate, 0);
+	FBatchThread = CreateThread(NULL, 0, _BatchProc, this, 0, NULL);
+	if (FBatchThread == NULL)
+	{
+		CloseHandle(FBatchFree);
+		FBatchFree = NULL;
+	}
+}
+
+void CClientWatcher::StopBatching()
+{
+	if (FBatchThread == NULL)
+		return;
+
+	InterlockedExchange(&FBatchTerminate, 1);
+	FNotifications->Wake();
+	ReleaseSemaphore(FBatchFree, 1, NULL);
+	// The thread never waits for the watcher's thread so it stops promptly.
+	// The broadcaster processes the messages if we are on the watcher's
+	// thread.
+	CwclMessageBroadcaster::Wait(FBatchThread);
+	CloseHandle(FBatchThread);
+	FBatchThread = NULL;
+
+	// Wait until the posted batches are dropped. If we are on the watcher's
+	// thread the broadcaster delivers them.
+	ResetEvent(FBatchIdle);
+	if (InterlockedCompareExchange(&FBatchPosted, 0, 0) != 0)
+		CwclMessageBroadcaster::Wait(FBatchIdle);
+	CloseHandle(FBatchFree);
+	FBatchFree = NULL;
+
+	// Drop the values that were not collected so the next start does not
+	// report them.
+	unsigned long Count = FNotifications->Pop(FBatchSlots[0].Notifications, FBatchSize);
+	while (Count > 0)
+		Count = FNotifications->Pop(FBatchSlots[0].Notifications, FBatchSize);
+}
+
+VOID CALLBACK CClientWatcher::_AsyncProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+	((CClientWatcher*)Context)->AsyncProc();
+}
+
+void CClientWatcher::AsyncProc()
+{
+	__int64 Address;
+	if (!FAsync->Next(Address))
+		return;
+
+	// Drain the device's queue. Once Pop returns false other executor may
+	// already be started for the device so the queue must not be touched.
+	TAsyncOperation Operation;
+	while (FAsync->Pop(Address, Operation))
+	{
+		ExecuteAsync(Operation);
+		CAsyncQueue::Release(Operation);
+	}
+}
+
+void CClientWatcher::ExecuteAsync(const TAsyncOperation& Operation)
+{
+	CAsyncCompletedMessage* Message = new CAsyncCompletedMessage(Operation);
+	// The value is read into the pooled block which returns to the pool
+	// after the event.
+	if (Operation.Kind == aoRead)
+		Message->SetResult(ReadData(Operation.Address, *Message->GetBuffer()));
+	else
+		Message->SetResult(WriteData(Operation.Address, Operation.Data, Operation.Length));
+
+	// Report the result on the watcher's thread as the other events are. If
+	// the receiver is closed nobody waits for the event there.
+	if (FReceiver->Post(Message) != WCL_E_SUCCESS)
+		ReportAsync(Message);
+	Message->Release();
+}
+
+void CClientWatcher::ReportAsync(const CAsyncCompletedMessage* const Message)
+{
+	if (Message->GetKind() == aoRead)
+	{
+		CPooledBuffer* Buffer = Message->GetBuffer();
+		DoReadCompleted(Message->GetAddress(), Message->GetId(), Message->GetResult(),
+			Buffer->GetData(), Buffer->GetLength());
+	}
+	else
+		DoWriteCompleted(Message->GetAddress(), Message->GetId(), Message->GetResult());
+}
+
+int CClientWatcher::PushAsync(const __int64 Address, const TAsyncOperationKind Kind,
+	const unsigned char* const Data, const unsigned long Length, unsigned long& Id)
+{
+	bool Start;
+	int Res = FAsync->Push(Address, Kind, Data, Length, Id, Start);
+	if (Res == WCL_E_SUCCESS && Start)
+	{
+		// Execute right here if the thread pool is not available.
+		if (!FAsyncPool->Submit(_AsyncProc, this))
+			AsyncProc();
+	}
+	return Res;
+}
+
+VOID CALLBACK CClientWatcher::_GroupProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+	GroupProc((TGroupContext*)Context);
+}
+
+void CClientWatcher::GroupProc(TGroupContext* Context)
+{
+	// Workers take the devices one by one so a slow device does not hold
+	// others assigned to the same worker.
+	LONG Count = (LONG)Context->Results->size();
+	LONG Index = InterlockedIncrement(&Context->Next) - 1;
+	while (Index < Count)
+	{
+		TGroupResult& Result = (*Context->Results)[Index];
+
+		unsigned __int64 Started = GetTimestamp();
+		if (Context->Kind == aoRead)
+		{
+			const unsigned long MaxAge = Context->MaxAge;
+			Result.Result = Context->Watcher->ReadData(Result.Address, Result.Value,
+				Result.Length, MaxAge);
+		}
+		else
+		{
+			Result.Result = Context->Watcher->WriteData(Result.Address, Context->Data,
+				Context->Length);
+		}
+		Result.Latency = GetTimestamp() - Started;
+
+		Index = InterlockedIncrement(&Context->Next) - 1;
+	}
+
+	// The context lives on the caller's stack so it must not be touched
+	// after the event is set.
+	if (InterlockedDecrement(&Context->Workers) == 0 && Context->Done != NULL)
+		SetEvent(Context->Done);
+}
+
+void CClientWatcher::RunGroup(TGroupContext& Context, const __int64* const Addresses,
+	const unsigned long Count, const unsigned long FanOut)
+{
+	TGroupResult Result;
+	Result.Result = WCL_E_SUCCESS;
+	Result.Latency = 0;
+	Result.Value = NULL;
+	Result.Length = 0;
+
+	Context.Results->clear();
+	if (Addresses != NULL)
+	{
+		Context.Results->reserve(Count);
+		for (unsigned long i = 0; i < Count; i++)
+		{
+			Result.Address = Addresses[i];
+			Context.Results->push_back(Result);
+		}
+	}
+	else
+	{
+		list<CGattClient*>* Clients = new list<CGattClient*>();
+		CopyClients(Clients);
+
+		Context.Results->reserve(Clients->size());
+		for (list<CGattClient*>::iterator Client = Clients->begin(); Client != Clients->end(); Client++)
+		{
+			Result.Address = (*Client)->Address;
+			Context.Results->push_back(Result);
+			(*Client)->Release();
+		}
+
+		delete Clients;
+	}
+	if (Context.Results->empty())
+		return;
+
+	unsigned long Workers = FanOut;
+	if (Workers > Context.Results->size())
+		Workers = (unsigned long)Context.Results->size();
+
+	Context.Watcher = this;
+	Context.Next = 0;
+	Context.Workers = 1;
+	Context.Done = NULL;
+	if (Workers > 1)
+	{
+		Context.Done = CreateEvent(NULL, TRUE, FALSE, NULL);
+		// Without the event the calling thread does all the work.
+		if (Context.Done != NULL)
+		{
+			// Count the calling thread's worker until all others are started
+			// so the event can not be set too early.
+			for (unsigned long i = 1; i < Workers; i++)
+			{
+				InterlockedIncrement(&Context.Workers);
+				if (!FAsyncPool->Submit(_GroupProc, &Context))
+				{
+					InterlockedDecrement(&Context.Workers);
+					break;
+				}
+			}
+		}
+	}
+
+	// The calling thread is one of the workers.
+	GroupProc(&Context);
+
+	if (Context.Done != NULL)
+	{
+		WaitForSingleObject(Context.Done, INFINITE);
+		CloseHandle(Context.Done);
+	}
+}
+
+VOID CALLBACK CClientWatcher::_PolicyTimerProc(PTP_CALLBACK_INSTANCE Instance,
+	PVOID Context, PTP_TIMER Timer)
+{
+	((CClientWatcher*)Context)->PolicyTimerProc();
+}
+
+void CClientWatcher::PolicyTimerProc()
+{
+	list<CGattClient*>* Clients = new list<CGattClient*>();
+	CopyClients(Clients);
+
+	// Switch idle connections to the power saving parameters.
+	if (Clients->size() > 0)
+	{
+		for (list<CGattClient*>::iterator Client = Clients->begin(); Client != Clients->end(); Client++)
+		{
+			(*Client)->UpdateConnectionPolicy();
+			(*Client)->Release();
+		}
+	}
+
+	delete Clients;
+}
+
+VOID CALLBACK CClientWatcher::_ReconnectTimerProc(PTP_CALLBACK_INSTANCE Instance,
+	PVOID Context, PTP_TIMER Timer)
+{
+	// The due reconnections start even if no device advertises. Connections
+	// are started only on the watcher's thread.
+	((CClientWatcher*)Context)->PostSchedule();
+}
+
+void CClientWatcher::PostSchedule()
+{
+	// Single queued message starts everything that is due when it is
+	// delivered.
+	if (InterlockedExchange(&FSchedulePosted, 1) != 0)
+		return;
+
+	CwclMessage* Message = new CwclUserDefinedCategoryMessage(WATCHER_MSG_SCHEDULE);
+	if (FReceiver->Post(Message) != WCL_E_SUCCESS)
+		InterlockedExchange(&FSchedulePosted, 0);
+	Message->Release();
+}
+
+void CClientWatcher::ReceiverMessage(const CwclMessage* const Message)
+{
+	// The clients complete the discovery here so their OnConnect events fire
+	// on the watcher's thread.
+	if (Message->GetCategory() == GATT_CLIENT_MSG_CATEGORY)
+	{
+		if (Message->GetId() == GATT_CLIENT_MSG_DISCOVERED)
+		{
+			const CDiscoveryMessage* Discovery = (const CDiscoveryMessage*)Message;
+			Discovery->GetClient()->CompleteDiscovery(Discovery->GetResult());
+		}
+		return;
+	}
+
+	if (Message->GetCategory() != WCL_MSG_CATEGORY_USER)
+		return;
+
+	switch (Message->GetId())
+	{
+	case WATCHER_MSG_SCHEDULE:
+		InterlockedExchange(&FSchedulePosted, 0);
+		if (Monitoring)
+			ScheduleConnections();
+		break;
+
+	case WATCHER_MSG_BATCH:
+		ReportBatch(((const CValuesBatchMessage*)Message)->GetSlot());
+		break;
+
+	case WATCHER_MSG_ASYNC_COMPLETED:
+		ReportAsync((const CAsyncCompletedMessage*)Message);
+		break;
+	}
+}
+
 void CClientWatcher::ClientCharacteristicChanged(void* Sender, const unsigned short Handle,
 	const unsigned char* Value, const unsigned long Length)
 {
 	if (Monitoring)
 	{
 		CGattClient* Client = (CGattClient*)Sender;
-		// Simple call the value changed event.
-		DoValueChanged(Client->Address, Value, Length);
+
+		// Notifications of the single client come in order from the single
+		// thread so the client's reassembler can be used without lock.
+		CFrameReassembler* Reassembler = Client->GetReassembler();
+		if (Reassembler != NULL)
+		{
+			bool Complete;
+			if (Reassembler->Push(Value, Length, Complete) == WCL_E_SUCCESS && Complete)
+				DoMessageReceived(Client->Address, Reassembler->GetData(), Reassembler->GetLength());
+			return;
+		}
+
+		// Queue the notification if the application takes them in batches.
+		// The queue never blocks the client's thread.
+		if (FNotifications != NULL)
+			FNotifications->Push(Client->Address, Handle, GetTimestamp(), Value, Length);
+		else
+			// Simple call the value changed event.
+			DoValueChanged(Client->Address, Value, Length);
 	}
 }
 
@@ -43,6 +591,16 @@ void CClientWatcher::ClientConnect(void* Sender, const int Error)
 {
 	CGattClient* Client = (CGattClient*)Sender;
 
+	// Connection slot is free now.
+	FScheduler->Completed(Client->Address, Error == WCL_E_SUCCESS, GetTickCount64());
+	// The connection may restore the lost link, whoever started it.
+	unsigned __int64 Downtime;
+	if (FReconnects->Completed(Client->Address, Error == WCL_E_SUCCESS, GetTickCount64(),
+		GetTimestamp(), Downtime))
+	{
+		GetDeviceStatistics(Client->Address)->Recovered(Downtime);
+	}
+
 	// If we stopped we still can get client connection event.
 	if (!Monitoring)
 	{
@@ -54,20 +612,22 @@ void CClientWatcher::ClientConnect(void* Sender, const int Error)
 		return;
 	}
 
-	// If connection failed remove client from connections list.
+	// If connection failed remove client from the registry.
 	if (Error != WCL_E_SUCCESS)
 		RemoveClient(Client);
 	else
 	{
-		// Othewrwise - add it to the connected clients list.
-		EnterCriticalSection(&FConnectionsCS);
+		// Othewrwise - mark it as connected.
+		AcquireSRWLockExclusive(&FConnectionsLock);
 		__try
 		{
-			FConnections->push_back(Client);
+			TRegistryEntry* Entry = FClients->Find(Client->Address);
+			if (Entry != NULL && Entry->Client == Client)
+				Entry->State = rsConnected;
 		}
 		__finally
 		{
-			LeaveCriticalSection(&FConnectionsCS);
+			ReleaseSRWLockExclusive(&FConnectionsLock);
 		}
 	}
 
@@ -78,33 +638,548 @@ void CClientWatcher::ClientConnect(void* Sender, const int Error)
 void CClientWatcher::ClientDisconnect(void* Sender, const int Reason)
 {
 	CGattClient* Client = (CGattClient*)Sender;
+	// The link is lost unless the application closed it.
+	bool Lost = (Monitoring && CReconnectManager::IsRecoverable(Reason) && !IsClosing(Client));
 	// Call disconnect event.
 	DoClientDisconnected(Client->Address, Reason);
-	// Remove client from the lists.
+	// Remove client from the registry.
 	RemoveClient(Client);
+
+	if (Lost)
+	{
+		TClientProfile Profile;
+		Client->GetProfile(Profile);
+		tstring Name;
+		int Rule;
+		Client->GetMatch(Name, Rule);
+		FReconnects->Dropped(Client->Address, Profile, Name, Rule, GetTickCount64(),
+			GetTimestamp());
+	}
 }
 
 CClientWatcher::CClientWatcher() : CwclBluetoothLeBeaconWatcher()
 {
-	InitializeCriticalSection(&FConnectionsCS);
+	InitializeSRWLock(&FConnectionsLock);
+
+	FClients = new CClientRegistry();
+	FReclaimer = new CClientReclaimer();
+	FScheduler = new CConnectionScheduler();
+	FFilter = new CAdvertisementFilter();
+	FScheduledAt = 0;
+	FReconnects = new CReconnectManager();
+	FReconnectTimer = CreateThreadpoolTimer(_ReconnectTimerProc, this, NULL);
+	FRadios = new CRadioBalancer();
+	FRules = new CMatchRules();
+
+	// The receiver delivers the messages to the thread that creates it.
+	FReceiver = new CwclMessageReceiver();
+	__hook(&CwclMessageReceiver::OnMessage, FReceiver, &CClientWatcher::ReceiverMessage);
+	FReceiver->Open();
+	FSchedulePosted = 0;
+
+	FDiscoveryConcurrency = DEFAULT_DISCOVERY_CONCURRENCY;
+	FDiscovery = new CWorkPool();
+	FDiscovery->Open(FDiscoveryConcurrency);
+	FAttributeCache = new CAttributeCache();
+
+	FNotifications = NULL;
+
+	FBufferPool = new CBufferPool();
+	FFraming = false;
+
+	FAsync = new CAsyncQueue();
+	FAsyncPool = new CWorkPool();
+	FAsyncPool->Open(DEFAULT_ASYNC_CONCURRENCY);
+
+	InitializeSRWLock(&FStatisticsLock);
+	FStatistics = new map<__int64, CConnectionStats*>();
+
+	CConnectionPolicy::GetDefaultParams(FPolicyParams);
+	FPolicyTimer = CreateThreadpoolTimer(_PolicyTimerProc, this, NULL);
+
+	FBatchWindow = DEFAULT_VALUES_BATCH_WINDOW;
+	FBatchSize = 0;
+	for (unsigned long i = 0; i < VALUES_BATCH_SLOTS; i++)
+	{
+		FBatchSlots[i].Notifications = NULL;
+		FBatchSlots[i].Records = NULL;
+	}
+	FBatchFree = NULL;
+	FBatchPosted = 0;
+	FBatchIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	FBatchThread = NULL;
+	FBatchTerminate = 0;
+}
+
+CClientWatcher::~CClientWatcher()
+{
+	// We have to call stop here to prevent from issues with objects!
+	Stop();
+
+	// Drop registry's references of the clients that are still there. No
+	// events can be dispatched to us after that.
+	for (size_t i = 0; i < FClients->GetCapacity(); i++)
+	{
+		TRegistryEntry* Entry = FClients->GetSlot(i);
+		if (Entry->Address != 0)
+		{
+			__unhook(Entry->Client);
+			Entry->Client->Release();
+		}
+	}
+	delete FClients;
+
+	// Wait for the discoveries that are still running. They hold their
+	// clients' references.
+	FDiscovery->Close();
+
+	// The timers and the pool are stopped so nothing is posted anymore. Drop
+	// what is queued: the messages release their clients' references.
+	FReceiver->Close();
+	__unhook(&CwclMessageReceiver::OnMessage, FReceiver, &CClientWatcher::ReceiverMessage);
+	delete FReceiver;
+
+	// Now all the clients can be destroyed.
+	delete FReclaimer;
+	delete FScheduler;
+	delete FFilter;
+	delete FRules;
+	if (FReconnectTimer != NULL)
+		CloseThreadpoolTimer(FReconnectTimer);
+	delete FReconnects;
+	delete FRadios;
+
+	delete FDiscovery;
+	delete FAttributeCache;
+
+	StopBatching();
+	ReleaseBatches();
+	CloseHandle(FBatchIdle);
+	if (FNotifications != NULL)
+		delete FNotifications;
+
+	// Stop is done so no executors are running. Wait for the group workers.
+	delete FAsyncPool;
+	delete FAsync;
+	delete FBufferPool;
+
+	if (FPolicyTimer != NULL)
+		CloseThreadpoolTimer(FPolicyTimer);
+
+	// All the clients are destroyed so nobody uses statistics.
+	for (map<__int64, CConnectionStats*>::iterator Stats = FStatistics->begin(); Stats != FStatistics->end(); Stats++)
+		delete Stats->second;
+	delete FStatistics;
+}
+
+unsigned long CClientWatcher::GetMaxPendingConnections() const
+{
+	return FScheduler->GetMaxInFlight();
+}
+
+int CClientWatcher::SetMaxPendingConnections(const unsigned long Value)
+{
+	if (Value == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	FScheduler->SetMaxInFlight(Value);
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::SetConnectBackoff(const unsigned long Backoff, const unsigned long MaxBackoff)
+{
+	if (Backoff == 0 || MaxBackoff < Backoff)
+		return WCL_E_INVALID_ARGUMENT;
+
+	FScheduler->SetBackoff(Backoff, MaxBackoff);
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::SetReconnect(const TReconnectParams& Params)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+	if (Params.Enabled && (Params.Delay == 0 || Params.MaxDelay < Params.Delay ||
+		Params.MaxAttempts == 0))
+	{
+		return WCL_E_INVALID_ARGUMENT;
+	}
+
+	FReconnects->SetParams(Params);
+	return WCL_E_SUCCESS;
+}
+
+void CClientWatcher::GetReconnect(TReconnectParams& Params) const
+{
+	FReconnects->GetParams(Params);
+}
+
+void CClientWatcher::GetReconnectStats(TReconnectStats& Stats) const
+{
+	FReconnects->GetStats(Stats);
+}
+
+int CClientWatcher::SetConnectionRadios(CwclBluetoothRadio* const* const Radios,
+	const unsigned long Count)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	return FRadios->SetRadios(Radios, Count);
+}
+
+unsigned long CClientWatcher::GetConnectionRadios(CwclBluetoothRadio** const Radios,
+	const unsigned long Count) const
+{
+	return FRadios->GetRadios(Radios, Count);
+}
+
+int CClientWatcher::SetMaxConnectionsPerRadio(const unsigned long Value)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	FRadios->SetMaxConnections(Value);
+	return WCL_E_SUCCESS;
+}
+
+unsigned long CClientWatcher::GetMaxConnectionsPerRadio() const
+{
+	return FRadios->GetMaxConnections();
+}
+
+unsigned long CClientWatcher::GetRadioLoads(TRadioLoad* const Loads, const unsigned long Count)
+{
+	return FRadios->GetLoads(Loads, Count);
+}
+
+int CClientWatcher::SetAdvertisementFilter(const unsigned long Capacity,
+	const unsigned long PassInterval, const unsigned long RejectTimeout)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+	if (Capacity == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	CAdvertisementFilter* Filter = new CAdvertisementFilter(Capacity, PassInterval,
+		RejectTimeout);
+	delete FFilter;
+	FFilter = Filter;
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::SetMatchRules(const TMatchRule* const Rules, const unsigned long Count)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	int Res = FRules->Compile(Rules, Count);
+	// Devices rejected or partially matched by the old rules must be checked
+	// again.
+	if (Res == WCL_E_SUCCESS)
+		FFilter->Clear();
+	return Res;
+}
+
+unsigned long CClientWatcher::GetMatchRules(TMatchRule* const Rules,
+	const unsigned long Count) const
+{
+	return FRules->GetRules(Rules, Count);
+}
+
+int CClientWatcher::SetServiceFilter(const GUID* const Uuids, const unsigned long Count)
+{
+	if (Count > 0 && Uuids == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	vector<TMatchRule> Rules(Count);
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		Rules[i].Conditions = MATCH_SERVICE;
+		Rules[i].Service = Uuids[i];
+		Rules[i].CompanyId = 0;
+		Rules[i].MinRssi = MATCH_ANY_RSSI;
+		Rules[i].Profile = DEFAULT_CLIENT_PROFILE;
+	}
+	return SetMatchRules(Rules.data(), Count);
+}
+
+unsigned long CClientWatcher::GetServiceFilter(GUID* const Uuids, const unsigned long Count) const
+{
+	vector<TMatchRule> Rules(FRules->GetRules(NULL, 0));
+	FRules->GetRules(Rules.data(), (unsigned long)Rules.size());
+
+	unsigned long Found = 0;
+	for (vector<TMatchRule>::iterator Rule = Rules.begin(); Rule != Rules.end(); Rule++)
+	{
+		if (Rule->Conditions != MATCH_SERVICE)
+			continue;
+		if (Uuids != NULL && Found < Count)
+			Uuids[Found] = Rule->Service;
+		Found++;
+	}
+	return Found;
+}
+
+unsigned long CClientWatcher::GetDiscoveryConcurrency() const
+{
+	return FDiscoveryConcurrency;
+}
+
+int CClientWatcher::SetDiscoveryConcurrency(const unsigned long Value)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	if (Value != FDiscoveryConcurrency)
+	{
+		// The watcher is stopped so the pool is drained already. Clients
+		// created later discover synchronously while the pool is closed.
+		FDiscovery->Close();
+		if (Value > 0)
+		{
+			int Res = FDiscovery->Open(Value);
+			if (Res != WCL_E_SUCCESS)
+				return Res;
+		}
+		FDiscoveryConcurrency = Value;
+	}
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::LoadAttributeCache(const tstring& FileName)
+{
+	return FAttributeCache->LoadFromFile(FileName);
+}
+
+int CClientWatcher::SaveAttributeCache(const tstring& FileName)
+{
+	return FAttributeCache->SaveToFile(FileName);
+}
+
+int CClientWatcher::SetNotificationQueueSize(const unsigned long Size)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	if (FNotifications != NULL)
+	{
+		delete FNotifications;
+		FNotifications = NULL;
+	}
+	if (Size > 0)
+		FNotifications = new CNotificationRing(Size);
+	return WCL_E_SUCCESS;
+}
+
+unsigned long CClientWatcher::PopNotifications(TNotification* const Records,
+	const unsigned long Count)
+{
+	// The batching thread is the only consumer while it runs.
+	if (FNotifications == NULL || FBatchThread != NULL)
+		return 0;
+	return FNotifications->Pop(Records, Count);
+}
+
+bool CClientWatcher::WaitNotifications(const DWORD Timeout)
+{
+	if (FNotifications == NULL || FBatchThread != NULL)
+		return false;
+	return FNotifications->Wait(Timeout);
+}
+
+unsigned long CClientWatcher::GetDroppedNotifications() const
+{
+	if (FNotifications == NULL)
+		return 0;
+	return FNotifications->GetDropped() + FNotifications->GetOversized();
+}
+
+int CClientWatcher::SetConnectionPolicy(const TConnectionPolicyParams& Params)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	if (Params.Enabled && (Params.BurstOperations == 0 || Params.IdleTimeout == 0))
+		return WCL_E_INVALID_ARGUMENT;
+
+	FPolicyParams = Params;
+	return WCL_E_SUCCESS;
+}
+
+void CClientWatcher::GetConnectionPolicy(TConnectionPolicyParams& Params) const
+{
+	Params = FPolicyParams;
+}
+
+int CClientWatcher::SetFraming(const bool Enabled)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	FFraming = Enabled;
+	return WCL_E_SUCCESS;
+}
+
+bool CClientWatcher::GetFraming() const
+{
+	return FFraming;
+}
+
+int CClientWatcher::SetValuesBatch(const unsigned long Window, const unsigned long Size)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	if (Size != FBatchSize)
+	{
+		// The watcher is stopped so no slot is posted.
+		ReleaseBatches();
+		if (Size > 0)
+			AllocateBatches(Size);
+		FBatchSize = Size;
+	}
+	FBatchWindow = Window;
+
+	if (FBatchSize > 0 && FNotifications == NULL)
+		FNotifications = new CNotificationRing();
+	return WCL_E_SUCCESS;
+}
+
+unsigned long CClientWatcher::GetValuesBatchWindow() const
+{
+	return FBatchWindow;
+}
+
+unsigned long CClientWatcher::GetValuesBatchSize() const
+{
+	return FBatchSize;
+}
+
+int CClientWatcher::GetClient(const __int64 Address, CGattClientRef& Client)
+{
+	Client.Reset();
+
+	AcquireSRWLockShared(&FConnectionsLock);
+	__try
+	{
+		TRegistryEntry* Entry = FClients->Find(Address);
+		if (Entry == NULL || Entry->State != rsConnected)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+
+		// Reference counter is changed atomically so shared lock is enough.
+		Client.Assign(Entry->Client);
+		return WCL_E_SUCCESS;
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FConnectionsLock);
+	}
+}
+
+CConnectionStats* CClientWatcher::GetDeviceStatistics(const __int64 Address)
+{
+	CConnectionStats* Stats = NULL;
+
+	AcquireSRWLockShared(&FStatisticsLock);
+	__try
+	{
+		map<__int64, CConnectionStats*>::iterator Item = FStatistics->find(Address);
+		if (Item != FStatistics->end())
+			Stats = Item->second;
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FStatisticsLock);
+	}
+
+	if (Stats != NULL)
+		return Stats;
+
+	AcquireSRWLockExclusive(&FStatisticsLock);
+	__try
+	{
+		// Other thread may have added it.
+		map<__int64, CConnectionStats*>::iterator Item = FStatistics->find(Address);
+		if (Item != FStatistics->end())
+			Stats = Item->second;
+		else
+		{
+			Stats = new CConnectionStats(Address);
+			(*FStatistics)[Address] = Stats;
+		}
+	}
+	__finally
+	{
+		ReleaseSRWLockExclusive(&FStatisticsLock);
+	}
+	return Stats;
+}
+
+int CClientWatcher::GetStatistics(const __int64 Address, TConnectionStatistics& Stats)
+{
+	ZeroMemory(&Stats, sizeof(TConnectionStatistics));
+
+	AcquireSRWLockShared(&FStatisticsLock);
+	__try
+	{
+		map<__int64, CConnectionStats*>::iterator Item = FStatistics->find(Address);
+		if (Item == FStatistics->end())
+			return WCL_E_INVALID_ARGUMENT;
+
+		Item->second->GetSnapshot(Stats);
+		return WCL_E_SUCCESS;
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FStatisticsLock);
+	}
+}
+
+void CClientWatcher::GetStatistics(list<TConnectionStatistics>* Stats)
+{
+	if (Stats == NULL)
+		return;
 
-	FConnections = new list<CGattClient*>();
-	FPendingConnections = new list<__int64>();
-	FOldClient = NULL;
+	AcquireSRWLockShared(&FStatisticsLock);
+	__try
+	{
+		TConnectionStatistics Snapshot;
+		for (map<__int64, CConnectionStats*>::iterator Item = FStatistics->begin(); Item != FStatistics->end(); Item++)
+		{
+			Item->second->GetSnapshot(Snapshot);
+			Stats->push_back(Snapshot);
+		}
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FStatisticsLock);
+	}
 }
 
-CClientWatcher::~CClientWatcher()
+void CClientWatcher::ResetStatistics()
 {
-	// We have to call stop here to prevent from issues with objects!
-	Stop();
-
-	delete FConnections;
-	delete FPendingConnections;
+	AcquireSRWLockShared(&FStatisticsLock);
+	__try
+	{
+		for (map<__int64, CConnectionStats*>::iterator Item = FStatistics->begin(); Item != FStatistics->end(); Item++)
+			Item->second->Reset();
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FStatisticsLock);
+	}
+}
 
-	if (FOldClient != NULL)
-		delete FOldClient;
+int CClientWatcher::GetConnectionInfo(const __int64 Address, TConnectionInfo& Info)
+{
+	ZeroMemory(&Info, sizeof(TConnectionInfo));
 
-	DeleteCriticalSection(&FConnectionsCS);
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->GetConnectionInfo(Info);
 }
 
 int CClientWatcher::Disconnect(const __int64 Address)
@@ -112,31 +1187,45 @@ int CClientWatcher::Disconnect(const __int64 Address)
 	if (!Monitoring)
 		return WCL_E_CONNECTION_CLOSED;
 
-	EnterCriticalSection(&FConnectionsCS);
+	CGattClient* Client;
+	AcquireSRWLockExclusive(&FConnectionsLock);
 	__try
 	{
-		CGattClient* Client = FindClient(Address);
-		if (Client == NULL)
+		TRegistryEntry* Entry = FClients->Find(Address);
+		if (Entry == NULL || Entry->State != rsConnected)
 			return WCL_E_CONNECTION_NOT_ACTIVE;
-		return Client->Disconnect();
+
+		// Do not allow any new I/O with the client that is going away.
+		Entry->State = rsClosing;
+		Client = Entry->Client;
+		Client->AddRef();
 	}
 	__finally
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		ReleaseSRWLockExclusive(&FConnectionsLock);
 	}
-}
 
-CGattClient* CClientWatcher::FindClient(const __int64 Address)
-{
-	if (FConnections->size() > 0)
+	// Disconnect outside the lock: the disconnection event may fire right from
+	// the call and it needs the exclusive lock to remove the client.
+	int Res = Client->Disconnect();
+	if (Res != WCL_E_SUCCESS)
 	{
-		for (list<CGattClient*>::iterator Client = FConnections->begin(); Client != FConnections->end(); Client++)
+		// Client is still connected. Allow to use it again.
+		AcquireSRWLockExclusive(&FConnectionsLock);
+		__try
+		{
+			TRegistryEntry* Entry = FClients->Find(Address);
+			if (Entry != NULL && Entry->Client == Client && Entry->State == rsClosing)
+				Entry->State = rsConnected;
+		}
+		__finally
 		{
-			if ((*Client)->Address == Address)
-				return *Client;
+			ReleaseSRWLockExclusive(&FConnectionsLock);
 		}
 	}
-	return NULL;
+
+	Client->Release();
+	return Res;
 }
 
 void CClientWatcher::RemoveClient(CGattClient* Client)
@@ -144,67 +1233,121 @@ void CClientWatcher::RemoveClient(CGattClient* Client)
 	if (Client == NULL)
 		return;
 
-	EnterCriticalSection(&FConnectionsCS);
+	bool Removed = false;
+	AcquireSRWLockExclusive(&FConnectionsLock);
 	__try
 	{
-		// Remove client from the connections list.
-		if (find(FPendingConnections->begin(), FPendingConnections->end(), Client->Address) != FPendingConnections->end())
+		// Remove client from the registry. Make sure that the entry belongs to
+		// this client.
+		TRegistryEntry* Entry = FClients->Find(Client->Address);
+		if (Entry != NULL && Entry->Client == Client)
 		{
 			__unhook(Client);
-			FPendingConnections->remove(Client->Address);
+			FClients->Remove(Client->Address);
+			// Let the device's advertisements in again.
+			FFilter->Forget(Client->Address);
+			Removed = true;
 		}
-
-		// Remove client from the clients list.
-		if (find(FConnections->begin(), FConnections->end(), Client) != FConnections->end())
-			FConnections->remove(Client);
-
-		SetOldClient(Client);
 	}
 	__finally
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		ReleaseSRWLockExclusive(&FConnectionsLock);
+	}
+
+	// Drop the registry's reference. The client is not destroyed here: we are
+	// in its event handler. When the last reference is gone the client is
+	// retired and destroyed later by the reclaimer.
+	if (Removed)
+	{
+		// The radio can take other connection now.
+		FRadios->Release(Client->GetConnectionRadio());
+		Client->Release();
 	}
 }
 
-void CClientWatcher::SetOldClient(CGattClient* Client)
+// Each copied client is referenced. The caller must release them.
+void CClientWatcher::CopyClients(list<CGattClient*>* Clients)
 {
-	EnterCriticalSection(&FConnectionsCS);
+	AcquireSRWLockShared(&FConnectionsLock);
 	__try
 	{
-		if (FOldClient != NULL)
+		// Make copy of the connected clients.
+		for (size_t i = 0; i < FClients->GetCapacity(); i++)
 		{
-			delete FOldClient;
-			FOldClient = NULL;
+			TRegistryEntry* Entry = FClients->GetSlot(i);
+			if (Entry->Address != 0 && Entry->State == rsConnected)
+			{
+				Entry->Client->AddRef();
+				Clients->push_back(Entry->Client);
+			}
 		}
-
-		FOldClient = Client;
 	}
 	__finally
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		ReleaseSRWLockShared(&FConnectionsLock);
 	}
 }
 
-void CClientWatcher::CopyClients(list<CGattClient*>* Clients)
+void CClientWatcher::DoStarted()
 {
-	EnterCriticalSection(&FConnectionsCS);
-	__try
+	// Start the batching thread before any client connects.
+	StartBatching();
+
+	if (FPolicyParams.Enabled && FPolicyTimer != NULL)
 	{
-		if (FConnections->size() > 0)
-		{
-			// Make copy of the connected clients.
-			for (list<CGattClient*>::iterator Client = FConnections->begin(); Client != FConnections->end(); Client++)
-				Clients->push_back(*Client);
-		}
+		// Relative due time in 100 ns units.
+		LONGLONG Due = -(LONGLONG)CONNECTION_POLICY_PERIOD * 10000;
+		FILETIME DueTime;
+		DueTime.dwLowDateTime = (DWORD)(Due & 0xFFFFFFFF);
+		DueTime.dwHighDateTime = (DWORD)(Due >> 32);
+		SetThreadpoolTimer(FPolicyTimer, &DueTime, CONNECTION_POLICY_PERIOD, 0);
 	}
-	__finally
+
+	TReconnectParams Reconnect;
+	FReconnects->GetParams(Reconnect);
+	if (Reconnect.Enabled && FReconnectTimer != NULL)
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		LONGLONG Due = -(LONGLONG)RECONNECT_CHECK_PERIOD * 10000;
+		FILETIME DueTime;
+		DueTime.dwLowDateTime = (DWORD)(Due & 0xFFFFFFFF);
+		DueTime.dwHighDateTime = (DWORD)(Due >> 32);
+		SetThreadpoolTimer(FReconnectTimer, &DueTime, RECONNECT_CHECK_PERIOD, 0);
 	}
+
+	FAsync->Open();
+	FRadios->Open(Radio);
+
+	CwclBluetoothLeBeaconWatcher::DoStarted();
 }
 
 void CClientWatcher::DoStopped()
 {
+	// Complete the operations that were not started yet. The running ones
+	// fail when their clients disconnect.
+	list<TAsyncOperation>* Operations = new list<TAsyncOperation>();
+	FAsync->Close(Operations);
+	for (list<TAsyncOperation>::iterator Op = Operations->begin(); Op != Operations->end(); Op++)
+	{
+		if (Op->Kind == aoRead)
+			DoReadCompleted(Op->Address, Op->Id, WCL_E_CONNECTION_CLOSED, NULL, 0);
+		else
+			DoWriteCompleted(Op->Address, Op->Id, WCL_E_CONNECTION_CLOSED);
+		CAsyncQueue::Release(*Op);
+	}
+	delete Operations;
+
+	// Stop the policy timer and wait for the running callback.
+	if (FPolicyTimer != NULL)
+	{
+		SetThreadpoolTimer(FPolicyTimer, NULL, 0, 0);
+		WaitForThreadpoolTimerCallbacks(FPolicyTimer, TRUE);
+	}
+	if (FReconnectTimer != NULL)
+	{
+		SetThreadpoolTimer(FReconnectTimer, NULL, 0, 0);
+		WaitForThreadpoolTimerCallbacks(FReconnectTimer, TRUE);
+	}
+
 	list<CGattClient*>* Clients = new list<CGattClient*>();
 	CopyClients(Clients);
 
@@ -212,83 +1355,327 @@ void CClientWatcher::DoStopped()
 	if (Clients->size() > 0)
 	{
 		for (list<CGattClient*>::iterator Client = Clients->begin(); Client != Clients->end(); Client++)
+		{
 			(*Client)->Disconnect();
+			(*Client)->Release();
+		}
 	}
 
 	delete Clients;
 
+	// The executors and the discoveries must not run when the watcher
+	// restarts or is destroyed. Discoveries that complete now post to the
+	// receiver.
+	FAsync->WaitIdle();
+	FAsyncPool->Drain();
+	FDiscovery->Drain();
+
+	// Drop the values that were not reported yet.
+	StopBatching();
+
+	// Forget all the candidates and backoffs. Next start begins from scratch.
+	FScheduler->Clear();
+	FReconnects->Clear();
+	FReclaimer->Reclaim();
+
 	CwclBluetoothLeBeaconWatcher::DoStopped();
 }
 
-void CClientWatcher::CreateClient(const __int64 Address)
+void CClientWatcher::CreateClient(const __int64 Address, const TClientProfile& Profile,
+	const tstring& Name, const int Rule)
 {
 	// Create client.
-	CGattClient* Client = new CGattClient();
+	CGattClient* Client = new CGattClient(FReclaimer);
+	Client->SetProfile(Profile);
+	Client->SetMatch(Name, Rule);
 	// Set required event handlers.
 	__hook(&CGattClient::OnCharacteristicChanged, Client, &CClientWatcher::ClientCharacteristicChanged);
 	__hook(&CGattClient::OnConnect, Client, &CClientWatcher::ClientConnect);
 	__hook(&CGattClient::OnDisconnect, Client, &CClientWatcher::ClientDisconnect);
-	// Try to start connection to the device.
-	int Result = Client->Connect(Address, Radio);
+	// Limit number of clients discovering attributes at the same time and
+	// complete the connections on our thread.
+	Client->SetDiscoveryExecutor(FDiscovery, FReceiver);
+	// Reuse attribute handles found on previous connections.
+	Client->SetAttributeCache(FAttributeCache);
+	Client->SetFraming(FFraming);
+	Client->SetConnectionPolicy(FPolicyParams);
+	Client->SetStatistics(GetDeviceStatistics(Address));
+
+	// Reserve the registry entry first. The client's events may fire before
+	// Connect returns. The registry owns the initial client's reference.
+	bool Added;
+	AcquireSRWLockExclusive(&FConnectionsLock);
+	__try
+	{
+		Added = FClients->Add(Address, Client, rsPending);
+		if (Added)
+			FFilter->Connected(Address);
+	}
+	__finally
+	{
+		ReleaseSRWLockExclusive(&FConnectionsLock);
+	}
+
+	// Other thread already started connection to this device.
+	if (!Added)
+	{
+		__unhook(Client);
+		Client->Release();
+		// It is not our attempt so free the slot without backoff. The other
+		// attempt owns the device now.
+		FScheduler->Completed(Address, true, GetTickCount64());
+		FReconnects->Cancel(Address);
+		return;
+	}
+
+	// Try to start connection to the device through the least loaded radio.
+	// The slot is returned when the client is removed from the registry.
+	CwclBluetoothRadio* ConnectionRadio = FRadios->Acquire();
+	int Result;
+	if (ConnectionRadio == NULL)
+		Result = RADIO_BALANCER_E_NO_FREE_RADIO;
+	else
+		Result = Client->Connect(Address, ConnectionRadio);
 	// Report connection start event.
 	DoConnectionStarted(Address, Result);
-	// If connection started with success...
-	if (Result == WCL_E_SUCCESS)
-		// ...add device to pending connections list.
-		FPendingConnections->push_back(Address);
-	else
-		delete Client;
+	// If connection failed remove the device from the registry. The connection
+	// event will not fire so free the slot here.
+	if (Result != WCL_E_SUCCESS)
+	{
+		RemoveClient(Client);
+		FScheduler->Completed(Address, false, GetTickCount64());
+		unsigned __int64 Downtime;
+		FReconnects->Completed(Address, false, GetTickCount64(), GetTimestamp(), Downtime);
+	}
 }
 
-void CClientWatcher::DoAdvertisementFrameInformation(const __int64 Address, const __int64 Timestamp,
-	const char Rssi, const tstring& Name, const wclBluetoothLeAdvertisementType PacketType,
-	const wclBluetoothLeAdvertisementFlags& Flags)
+void CClientWatcher::ScheduleConnections()
 {
-	// Do nothing if we stopped.
-	if (!Monitoring)
-		return;
-
-	EnterCriticalSection(&FConnectionsCS);
-	__try
+	// The devices that lost the link go first: the application waits for
+	// their data.
+	__int64 Address;
+	TClientProfile Profile;
+	tstring Name;
+	int Rule;
+	while (Monitoring && FRadios->HasFreeSlot() && FReconnects->Next(GetTickCount64(), Address, Profile, Name, Rule))
 	{
-		// Make sure that device is not in connections list.
-		if (find(FPendingConnections->begin(), FPendingConnections->end(), Address) != FPendingConnections->end())
-			return;
-
-		// Check devices name.
-		if (Name == DEVICE_NAME)
+		if (!FScheduler->Acquire(Address))
 		{
-			// Notify about new device.
-			DoDeviceFound(Address, Name);
-			CreateClient(Address);
+			FReconnects->Postpone(Address, GetTickCount64());
+			break;
 		}
+		// The device was reported disconnected when it lost the link. Report
+		// it found again as the application tracks the devices by these
+		// events.
+		DoDeviceFound(Address, Name, Rule);
+		CreateClient(Address, Profile, Name, Rule);
+	}
+
+	unsigned long RuleIndex;
+	while (Monitoring && FRadios->HasFreeSlot() && FScheduler->Next(GetTickCount64(), Address, RuleIndex, Name))
+	{
+		// Notify about new device. The name is empty if the device matched
+		// without it.
+		DoDeviceFound(Address, Name, (int)RuleIndex);
+		CreateClient(Address, FRules->GetProfile(RuleIndex), Name, (int)RuleIndex);
+	}
+}
+
+bool CClientWatcher::IsClosing(CGattClient* const Client)
+{
+	AcquireSRWLockShared(&FConnectionsLock);
+	__try
+	{
+		TRegistryEntry* Entry = FClients->Find(Client->Address);
+		return (Entry != NULL && Entry->Client == Client && Entry->State == rsClosing);
 	}
 	__finally
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		ReleaseSRWLockShared(&FConnectionsLock);
 	}
 }
 
-int CClientWatcher::ReadData(const __int64 Address, unsigned char*& Data, unsigned long& Length)
+void CClientWatcher::ProcessAdvertisement(const __int64 Address, const char Rssi,
+	const int Rule, const tstring& Name)
 {
-	Data = NULL;
-	Length = 0;
+	// Most of the frames are repeats from connected devices or from devices
+	// seen a moment ago. Drop them without locks.
+	unsigned __int64 Now = GetTickCount64();
+	if (!FFilter->Pass(Address, Now))
+	{
+		// Completed connections free the slots for the next candidates. Do not
+		// wait for a passed frame to use them but check not more than once per
+		// tick.
+		LONG64 Last = FScheduledAt;
+		if (Last != (LONG64)Now && InterlockedCompareExchange64(&FScheduledAt, (LONG64)Now, Last) == Last)
+			ScheduleConnections();
+		return;
+	}
 
-	if (!Monitoring)
-		return WCL_E_CONNECTION_CLOSED;
+	// Advertisements come often and never from client's event handler so it is
+	// a good place to destroy retired clients.
+	FReclaimer->Reclaim();
 
-	EnterCriticalSection(&FConnectionsCS);
+	bool Known;
+	AcquireSRWLockShared(&FConnectionsLock);
 	__try
 	{
-		CGattClient* Client = FindClient(Address);
-		if (Client == NULL)
-			return WCL_E_CONNECTION_NOT_ACTIVE;
-		return Client->ReadValue(Data, Length);
+		// Make sure that device is not in the registry.
+		Known = (FClients->Find(Address) != NULL);
 	}
 	__finally
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		ReleaseSRWLockShared(&FConnectionsLock);
+	}
+
+	// Do not connect right away: when many devices appear at once concurrent
+	// connections overload the stack and time out. Offer the device to the
+	// scheduler and let it pick the best candidates.
+	if (!Known)
+	{
+		if (Rule >= 0)
+			FScheduler->Offer(Address, Rssi, Now, (unsigned long)Rule, Name);
+		else
+			FFilter->Reject(Address, Now);
 	}
+
+	ScheduleConnections();
+}
+
+void CClientWatcher::MatchAdvertisement(const __int64 Address, const char Rssi,
+	const unsigned long Conditions, const tstring& Name)
+{
+	// A frame that satisfies nothing adds nothing to the device's conditions.
+	unsigned long Collected = Conditions;
+	if (Conditions != 0)
+		Collected = FFilter->Collect(Address, Conditions, GetTickCount64());
+
+	int Rule = FRules->Match(Collected, Rssi);
+	if (Rule >= 0)
+		ProcessAdvertisement(Address, Rssi, Rule, Name);
+}
+
+void CClientWatcher::DoAdvertisementFrameInformation(const __int64 Address, const __int64 Timestamp,
+	const char Rssi, const tstring& Name, const wclBluetoothLeAdvertisementType PacketType,
+	const wclBluetoothLeAdvertisementFlags& Flags)
+{
+	// Do nothing if we stopped.
+	if (!Monitoring)
+		return;
+
+	// The name may come only with the scan response so a frame without the
+	// name tells nothing about the device.
+	if (Name.empty())
+		return;
+
+	// Check devices name. If every rule needs the name the device with other
+	// one is not ours.
+	unsigned long Conditions = FRules->EvaluateName(Name);
+	if (Conditions == 0 && FRules->IsNameRequired())
+		ProcessAdvertisement(Address, Rssi, -1, Name);
+	else
+		MatchAdvertisement(Address, Rssi, Conditions, Name);
+}
+
+void CClientWatcher::DoAdvertisementUuidFrame(const __int64 Address, const __int64 Timestamp,
+	const char Rssi, const GUID& Uuid)
+{
+	// The device may advertise several services. Other ones do not reject the
+	// device.
+	if (Monitoring)
+		MatchAdvertisement(Address, Rssi, FRules->EvaluateService(Uuid), tstring());
+}
+
+void CClientWatcher::DoAdvertisementManufacturerRawFrame(const __int64 Address,
+	const __int64 Timestamp, const char Rssi, const unsigned short CompanyId,
+	const unsigned char* const Data, const unsigned long Length)
+{
+	if (Monitoring)
+		MatchAdvertisement(Address, Rssi, FRules->EvaluateManufacturer(CompanyId), tstring());
+}
+
+int CClientWatcher::ReadData(const __int64 Address, unsigned char*& Data, unsigned long& Length,
+	const unsigned long MaxAge)
+{
+	Data = NULL;
+	Length = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	// The GATT operation executes outside the registry lock so other devices
+	// are not blocked by this one.
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->ReadValue(Data, Length, MaxAge);
+}
+
+int CClientWatcher::ReadData(const __int64 Address, unsigned char* const Buffer,
+	const unsigned long Size, unsigned long& Length, const unsigned long MaxAge)
+{
+	Length = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (Buffer == NULL || Size == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->ReadValue(Buffer, Size, Length, MaxAge);
+}
+
+int CClientWatcher::ReadData(const __int64 Address, CPooledBuffer& Buffer,
+	const unsigned long MaxAge)
+{
+	int Res = Buffer.Acquire(FBufferPool);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	unsigned long Length;
+	Res = ReadData(Address, Buffer.GetData(), Buffer.GetSize(), Length, MaxAge);
+	if (Res != WCL_E_SUCCESS)
+		Buffer.Release();
+	else
+		Buffer.SetLength(Length);
+	return Res;
+}
+
+int CClientWatcher::ReadNotifiedData(const __int64 Address, unsigned char*& Data,
+	unsigned long& Length, const unsigned long MaxAge)
+{
+	Data = NULL;
+	Length = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->GetNotifiedValue(MaxAge, Data, Length);
+}
+
+int CClientWatcher::ReadCachedData(const __int64 Address, const unsigned short Handle,
+	unsigned char*& Data, unsigned long& Length, const unsigned long MaxAge)
+{
+	Data = NULL;
+	Length = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->GetCachedValue(Handle, MaxAge, Data, Length);
 }
 
 int CClientWatcher::WriteData(const __int64 Address, const unsigned char* const Data,
@@ -300,16 +1687,168 @@ int CClientWatcher::WriteData(const __int64 Address, const unsigned char* const
 	if (Data == NULL || Length == 0)
 		return WCL_E_INVALID_ARGUMENT;
 
-	EnterCriticalSection(&FConnectionsCS);
-	__try
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->WriteValue(Data, Length);
+}
+
+int CClientWatcher::ReadDataAsync(const __int64 Address, unsigned long& Id)
+{
+	Id = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	return PushAsync(Address, aoRead, NULL, 0, Id);
+}
+
+int CClientWatcher::WriteDataAsync(const __int64 Address, const unsigned char* const Data,
+	const unsigned long Length, unsigned long& Id)
+{
+	Id = 0;
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (Data == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	return PushAsync(Address, aoWrite, Data, Length, Id);
+}
+
+int CClientWatcher::WriteGroup(const __int64* const Addresses, const unsigned long Count,
+	const unsigned char* const Data, const unsigned long Length,
+	const unsigned long FanOut, vector<TGroupResult>* Results)
+{
+	if (Results == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+	Results->clear();
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (Data == NULL || Length == 0 || FanOut == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	TGroupContext Context;
+	Context.Kind = aoWrite;
+	Context.Data = Data;
+	Context.Length = Length;
+	Context.MaxAge = 0;
+	Context.Results = Results;
+	RunGroup(Context, Addresses, Count, FanOut);
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::ReadGroup(const __int64* const Addresses, const unsigned long Count,
+	const unsigned long FanOut, vector<TGroupResult>* Results, const unsigned long MaxAge)
+{
+	if (Results == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+	Results->clear();
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (FanOut == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	TGroupContext Context;
+	Context.Kind = aoRead;
+	Context.Data = NULL;
+	Context.Length = 0;
+	Context.MaxAge = MaxAge;
+	Context.Results = Results;
+	RunGroup(Context, Addresses, Count, FanOut);
+	return WCL_E_SUCCESS;
+}
+
+void CClientWatcher::ReleaseGroupResults(vector<TGroupResult>* Results)
+{
+	if (Results == NULL)
+		return;
+
+	for (vector<TGroupResult>::iterator Result = Results->begin(); Result != Results->end(); Result++)
 	{
-		CGattClient* Client = FindClient(Address);
-		if (Client == NULL)
-			return WCL_E_CONNECTION_NOT_ACTIVE;
-		return Client->WriteValue(Data, Length);
+		if (Result->Value != NULL)
+			free(Result->Value);
 	}
-	__finally
+	Results->clear();
+}
+
+unsigned long CClientWatcher::GetAsyncQueueDepth() const
+{
+	return FAsync->GetDepth();
+}
+
+int CClientWatcher::SetAsyncQueueDepth(const unsigned long Depth)
+{
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	return FAsync->SetDepth(Depth);
+}
+
+unsigned long CClientWatcher::GetAsyncConcurrency() const
+{
+	return FAsyncPool->GetMaxThreads();
+}
+
+int CClientWatcher::SetAsyncConcurrency(const unsigned long Value)
+{
+	if (Value == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	if (Monitoring)
+		return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+
+	if (Value != FAsyncPool->GetMaxThreads())
 	{
-		LeaveCriticalSection(&FConnectionsCS);
+		// Close waits for the workers of the group operations that are
+		// still running.
+		FAsyncPool->Close();
+		int Res = FAsyncPool->Open(Value);
+		if (Res != WCL_E_SUCCESS)
+			return Res;
 	}
+	return WCL_E_SUCCESS;
+}
+
+int CClientWatcher::StreamData(const __int64 Address, const unsigned char* const Data,
+	const unsigned long Length, const unsigned long Window, TStreamStats& Stats)
+{
+	ZeroMemory(&Stats, sizeof(TStreamStats));
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (Data == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	// The stream may take long time. The reference keeps the client alive but
+	// does not block other devices.
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->StreamValue(Data, Length, Window, Stats);
+}
+
+int CClientWatcher::WriteMessage(const __int64 Address, const unsigned char* const Message,
+	const unsigned long Length, const unsigned long Window, TStreamStats& Stats)
+{
+	ZeroMemory(&Stats, sizeof(TStreamStats));
+
+	if (!Monitoring)
+		return WCL_E_CONNECTION_CLOSED;
+
+	if (Message == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	CGattClientRef Client;
+	int Res = GetClient(Address, Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+	return Client->WriteMessage(Message, Length, Window, Stats);
 }
\ No newline at end of file
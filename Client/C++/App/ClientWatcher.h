@@ -1,9 +1,19 @@
 #pragma once
 
 #include <list>
+#include <map>
+#include <vector>
 
 #include "wclBluetooth.h"
+#include "AdvertisementFilter.h"
+#include "AsyncQueue.h"
 #include "GattClient.h"
+#include "ClientRegistry.h"
+#include "ConnectionScheduler.h"
+#include "MatchRules.h"
+#include "NotificationRing.h"
+#include "RadioBalancer.h"
+#include "ReconnectManager.h"
 
 using namespace std;
 using namespace wclCommon;
@@ -15,14 +25,116 @@ using namespace wclBluetooth;
 #define ClientConnectionStarted(_event_name_) \
 	__event void _event_name_(const __int64 Address, const int Result)
 #define ClientDeviceFound(_event_name_) \
-	__event void _event_name_(const __int64 Address, const tstring& name)
+	__event void _event_name_(const __int64 Address, const tstring& Name, const int Rule)
 #define ClientDisconnected(_event_name_) \
 	__event void _event_name_(const __int64 Address, const int Reason)
 #define ClientValueChanged(_event_name_) \
 	__event void _event_name_(const __int64 Address, const unsigned char* Value, \
 	const unsigned long Length);
+#define ClientMessageReceived(_event_name_) \
+	__event void _event_name_(const __int64 Address, const unsigned char* Message, \
+	const unsigned long Length);
+#define ClientValuesChanged(_event_name_) \
+	__event void _event_name_(const TValueRecord* Records, const unsigned long Count);
+#define ClientReadCompleted(_event_name_) \
+	__event void _event_name_(const __int64 Address, const unsigned long Id, \
+	const int Result, const unsigned char* Value, const unsigned long Length);
+#define ClientWriteCompleted(_event_name_) \
+	__event void _event_name_(const __int64 Address, const unsigned long Id, \
+	const int Result);
+
+// Single value in the batch of the changed values.
+typedef struct
+{
+	__int64					Address;
+	unsigned short			Handle;
+	// Time the notification was received (see GetTimestamp).
+	unsigned __int64		Timestamp;
+	// Points to the batch's memory. Valid only inside the event handler.
+	const unsigned char*	Value;
+	unsigned long			Length;
+} TValueRecord;
+
+// Result of the group operation on single device.
+typedef struct
+{
+	__int64				Address;
+	int					Result;
+	// Time the operation took on this device (us).
+	unsigned __int64	Latency;
+	// The value read from the device. NULL for writes and failed reads.
+	unsigned char*		Value;
+	unsigned long		Length;
+} TGroupResult;
+
+// Default number of devices the group operation serves at the same time.
+const unsigned long DEFAULT_GROUP_FAN_OUT = 8;
+
+// Default number of clients that can run attributes discovery at the same time.
+const unsigned long DEFAULT_DISCOVERY_CONCURRENCY = 4;
+// Default number of threads serving the asynchronous and group operations.
+const unsigned long DEFAULT_ASYNC_CONCURRENCY = 8;
+// Connection policy check period (ms).
+const unsigned long CONNECTION_POLICY_PERIOD = 1000;
+// Default time the values are collected before the batch is reported (ms).
+const unsigned long DEFAULT_VALUES_BATCH_WINDOW = 100;
+// Number of the batches that can wait for the watcher's thread.
+const unsigned long VALUES_BATCH_SLOTS = 4;
+
+// The messages the watcher posts to its own thread.
+// Starts the due connections.
+const unsigned char WATCHER_MSG_SCHEDULE = 1;
+// Reports the collected values (see CValuesBatchMessage).
+const unsigned char WATCHER_MSG_BATCH = 2;
+// Reports the completed asynchronous operation (see CAsyncCompletedMessage).
+const unsigned char WATCHER_MSG_ASYNC_COMPLETED = 3;
 
-const tstring DEVICE_NAME = _T("MultyGattServer");
+class CClientWatcher;
+
+// Hands the batch arena's slot over to the watcher's thread. The slot
+// returns to the arena when the message is destroyed: after the event or
+// when the message is dropped.
+class CValuesBatchMessage : public CwclUserDefinedCategoryMessage
+{
+	DISABLE_COPY(CValuesBatchMessage);
+
+private:
+	CClientWatcher*	FWatcher;
+	unsigned long	FSlot;
+
+public:
+	CValuesBatchMessage(CClientWatcher* const Watcher, const unsigned long Slot);
+	virtual ~CValuesBatchMessage();
+
+	unsigned long GetSlot() const;
+};
+
+// Carries the result of the asynchronous operation from the executor to the
+// watcher's thread. The read value stays in the pooled block until the
+// message is destroyed.
+class CAsyncCompletedMessage : public CwclUserDefinedCategoryMessage
+{
+	DISABLE_COPY(CAsyncCompletedMessage);
+
+private:
+	__int64				FAddress;
+	unsigned long		FId;
+	TAsyncOperationKind	FKind;
+	int					FResult;
+	CPooledBuffer*		FBuffer;
+
+public:
+	CAsyncCompletedMessage(const TAsyncOperation& Operation);
+	virtual ~CAsyncCompletedMessage();
+
+	__int64 GetAddress() const;
+	unsigned long GetId() const;
+	TAsyncOperationKind GetKind() const;
+	int GetResult() const;
+	void SetResult(const int Result);
+	// The buffer the read value is stored to.
+	CPooledBuffer* GetBuffer() const;
+};
 
 class CClientWatcher : public CwclBluetoothLeBeaconWatcher
 {
@@ -30,18 +142,185 @@ class CClientWatcher : public CwclBluetoothLeBeaconWatcher
 
 private:
 #pragma region Connections management
-	RTL_CRITICAL_SECTION	FConnectionsCS;
-	list<CGattClient*>*		FConnections;
-	list<__int64>*			FPendingConnections;
-	CGattClient*			FOldClient;
+	// Lookups take the lock shared, registry changes take it exclusive. The
+	// lock is never held during GATT operations.
+	SRWLOCK					FConnectionsLock;
+	CClientRegistry*		FClients;
+	// Destroys removed clients when it is safe.
+	CClientReclaimer*		FReclaimer;
+	// Limits and orders connection attempts.
+	CConnectionScheduler*	FScheduler;
+	// Drops repeated advertisements before any lock is taken. Connected and
+	// Forget are called under the exclusive registry lock.
+	CAdvertisementFilter*	FFilter;
+	// Time of the last connections scheduling for the dropped frame.
+	volatile LONG64			FScheduledAt;
+	// Reconnects the devices that lost the link.
+	CReconnectManager*		FReconnects;
+	PTP_TIMER				FReconnectTimer;
+	// Spreads the connections over the radios.
+	CRadioBalancer*			FRadios;
+
+	static VOID CALLBACK _ReconnectTimerProc(PTP_CALLBACK_INSTANCE Instance,
+		PVOID Context, PTP_TIMER Timer);
 #pragma endregion Connections management
 
+#pragma region Thread synchronization
+	// Delivers the work of the timers and the pool threads to the watcher's
+	// thread: the one that created the watcher and gets its events. The
+	// connections are started and the application's events are fired there.
+	CwclMessageReceiver*	FReceiver;
+	// Not zero while the scheduling message is queued.
+	volatile LONG			FSchedulePosted;
+
+	void ReceiverMessage(const CwclMessage* const Message);
+	// Queues the connections scheduling to the watcher's thread. Can be
+	// called from any thread.
+	void PostSchedule();
+#pragma endregion Thread synchronization
+
+#pragma region Devices matching
+	// Changed only when watcher is not running so it is read without lock.
+	CMatchRules*			FRules;
+#pragma endregion Devices matching
+
+#pragma region Discovery management
+	unsigned long			FDiscoveryConcurrency;
+	// Runs the clients discovery. The discovery completes on the watcher's
+	// thread through FReceiver.
+	CWorkPool*				FDiscovery;
+	CAttributeCache*		FAttributeCache;
+#pragma endregion Discovery management
+
+	// Blocks for the pooled reads.
+	CBufferPool*			FBufferPool;
+	// If true notifications are reassembled into messages.
+	bool					FFraming;
+
+	// Statistics of all the devices ever connected. Objects are never
+	// deleted while the watcher exists so clients use them without lock.
+	SRWLOCK					FStatisticsLock;
+	map<__int64, CConnectionStats*>*	FStatistics;
+	CConnectionStats* GetDeviceStatistics(const __int64 Address);
+
+	// Connection parameters policy.
+	TConnectionPolicyParams	FPolicyParams;
+	PTP_TIMER				FPolicyTimer;
+
+	static VOID CALLBACK _PolicyTimerProc(PTP_CALLBACK_INSTANCE Instance,
+		PVOID Context, PTP_TIMER Timer);
+	void PolicyTimerProc();
+
+#pragma region Notifications management
+	// If not NULL notifications are queued here instead of the OnValueChanged
+	// event.
+	CNotificationRing*		FNotifications;
+
+	// Batched values dispatching. The records are popped from the queue right
+	// into the reusable arena's slot so no memory is allocated per batch. The
+	// filled slot is posted to the watcher's thread and returns to the arena
+	// after the event.
+	typedef struct
+	{
+		TNotification*		Notifications;
+		TValueRecord*		Records;
+		unsigned long		Count;
+		// Not zero while the slot is posted.
+		volatile LONG		Busy;
+	} TBatchSlot;
+
+	friend class CValuesBatchMessage;
+
+	unsigned long			FBatchWindow;
+	unsigned long			FBatchSize;
+	TBatchSlot				FBatchSlots[VALUES_BATCH_SLOTS];
+	// Counts the free slots. Stop releases it once more to wake the thread.
+	HANDLE					FBatchFree;
+	// Number of the posted slots. The event is set when it drops to zero.
+	volatile LONG			FBatchPosted;
+	HANDLE					FBatchIdle;
+	HANDLE					FBatchThread;
+	// Not zero when batching stops. The posted batches are dropped then.
+	volatile LONG			FBatchTerminate;
+
+	static DWORD WINAPI _BatchProc(LPVOID Param);
+	void BatchProc();
+	// Waits for the free slot. Returns false if batching stops.
+	bool TakeBatchSlot(unsigned long& Slot);
+	void PostBatch(const unsigned long Slot);
+	// Called by the message when the slot is not needed anymore.
+	void RecycleBatch(const unsigned long Slot);
+	void ReportBatch(const unsigned long Slot);
+	void AllocateBatches(const unsigned long Size);
+	void ReleaseBatches();
+	void StartBatching();
+	void StopBatching();
+#pragma endregion Notifications management
+
+#pragma region Asynchronous operations
+	// Per-device queues of the operations. Each device with queued operations
+	// has single executor running on the FAsyncPool.
+	CAsyncQueue*			FAsync;
+	// Runs the executors and the group workers. The executors block on GATT
+	// requests so they do not take the threads of the process-wide pool.
+	CWorkPool*				FAsyncPool;
+
+	static VOID CALLBACK _AsyncProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context);
+	void AsyncProc();
+	void ExecuteAsync(const TAsyncOperation& Operation);
+	// Fires the completion event of the operation.
+	void ReportAsync(const CAsyncCompletedMessage* const Message);
+	// Queues the operation and starts the executor for the device if needed.
+	int PushAsync(const __int64 Address, const TAsyncOperationKind Kind,
+		const unsigned char* const Data, const unsigned long Length, unsigned long& Id);
+#pragma endregion Asynchronous operations
+
+#pragma region Group operations
+	// The state shared by the workers of single group operation.
+	typedef struct
+	{
+		CClientWatcher*			Watcher;
+		TAsyncOperationKind		Kind;
+		const unsigned char*	Data;
+		unsigned long			Length;
+		unsigned long			MaxAge;
+		vector<TGroupResult>*	Results;
+		// Index of the next result to fill.
+		volatile LONG			Next;
+		// Workers still running. The last one sets the Done event.
+		volatile LONG			Workers;
+		HANDLE					Done;
+	} TGroupContext;
+
+	static VOID CALLBACK _GroupProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context);
+	static void GroupProc(TGroupContext* Context);
+	// Fills the results with the devices and runs the operation on them.
+	void RunGroup(TGroupContext& Context, const __int64* const Addresses,
+		const unsigned long Count, const unsigned long FanOut);
+#pragma endregion Group operations
+
 #pragma region Helper method
-	void __fastcall SetOldClient(CGattClient* Client);
 	void __fastcall RemoveClient(CGattClient* Client);
-	CGattClient* __fastcall FindClient(const __int64 Address);
 	void CopyClients(list<CGattClient*>* Clients);
-	void CreateClient(const __int64 Address);
+	// Creates the client with the Profile and connects it. The Name and the
+	// Rule are the ones the device was found with.
+	void CreateClient(const __int64 Address, const TClientProfile& Profile,
+		const tstring& Name, const int Rule);
+	// Starts due reconnections and then connections to the best candidates
+	// while there are free slots.
+	void ScheduleConnections();
+	// Returns true if the client is being disconnected by the application.
+	bool IsClosing(CGattClient* const Client);
+	// Handles the advertisement of the device. Rule is the index of the
+	// matched rule or -1 if the device is not ours. Name is empty if the
+	// frame has no name.
+	void ProcessAdvertisement(const __int64 Address, const char Rssi, const int Rule,
+		const tstring& Name);
+	// Adds the conditions satisfied by the frame to the ones collected from
+	// the device's other frames and handles the advertisement if a rule
+	// matches.
+	void MatchAdvertisement(const __int64 Address, const char Rssi,
+		const unsigned long Conditions, const tstring& Name);
 #pragma endregion Helper method
 
 #pragma region Client event handlers
@@ -55,9 +334,16 @@ private:
 	void DoClientDisconnected(const __int64 Address, const int Reason);
 	void DoConnectionCompleted(const __int64 Address, const int Result);
 	void DoConnectionStarted(const __int64 Address, const int Result);
-	void DoDeviceFound(const __int64 Address, const tstring& Name);
+	void DoDeviceFound(const __int64 Address, const tstring& Name, const int Rule);
 	void DoValueChanged(const __int64 Address, const unsigned char* Value,
 		const unsigned long Length);
+	void DoValuesChanged(const TValueRecord* Records, const unsigned long Count);
+	void DoMessageReceived(const __int64 Address, const unsigned char* Message,
+		const unsigned long Length);
+	void DoReadCompleted(const __int64 Address, const unsigned long Id,
+		const int Result, const unsigned char* Value, const unsigned long Length);
+	void DoWriteCompleted(const __int64 Address, const unsigned long Id,
+		const int Result);
 #pragma endregion Events management
 
 protected:
@@ -66,6 +352,12 @@ protected:
 		const __int64 Timestamp, const char Rssi, const tstring& Name,
 		const wclBluetoothLeAdvertisementType PacketType,
 		const wclBluetoothLeAdvertisementFlags& Flags) override;
+	virtual void DoAdvertisementUuidFrame(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const GUID& Uuid) override;
+	virtual void DoAdvertisementManufacturerRawFrame(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const unsigned short CompanyId,
+		const unsigned char* const Data, const unsigned long Length) override;
+	virtual void DoStarted() override;
 	virtual void DoStopped() override;
 #pragma endregion Device search handling
 
@@ -76,18 +368,282 @@ public:
 #pragma endregion Constructor and destructor
 
 #pragma region Communication methods
+	// Returns the reference to the connected client. The reference keeps the
+	// client alive so it can be used without holding any watcher's lock.
+	int GetClient(const __int64 Address, CGattClientRef& Client);
+
 	int Disconnect(const __int64 Address);
+	// Returns the connection information and the traffic counters.
+	int GetConnectionInfo(const __int64 Address, TConnectionInfo& Info);
+	// Reads the device's value. If MaxAge is not zero and the value was read
+	// or notified not more than MaxAge milliseconds ago it is returned from
+	// the client's last value cache without the radio round trip. Zero MaxAge
+	// always reads from the device.
 	int ReadData(const __int64 Address, unsigned char*& Data,
-		unsigned long& Length);
+		unsigned long& Length, const unsigned long MaxAge = 0);
+	// Reads the value into the caller's buffer so the caller never frees it.
+	// The device's value still comes in the library's heap buffer that is
+	// copied and freed inside. If the buffer is too small
+	// BUFFER_POOL_E_BUFFER_TOO_SMALL is returned and Length receives the
+	// required size.
+	int ReadData(const __int64 Address, unsigned char* const Buffer,
+		const unsigned long Size, unsigned long& Length, const unsigned long MaxAge = 0);
+	// Reads the value into the block taken from the watcher's buffer pool.
+	// The block returns to the pool when the Buffer is released or destroyed.
+	int ReadData(const __int64 Address, CPooledBuffer& Buffer,
+		const unsigned long MaxAge = 0);
+	// Returns the device's last notified value if it came not more than
+	// MaxAge milliseconds ago. The device is not asked: the notifiable
+	// characteristic can not be read. Returns VALUE_CACHE_E_NO_FRESH_VALUE if
+	// there is no such value. MaxAge must not be zero: the zero MaxAge returns
+	// WCL_E_INVALID_ARGUMENT. The caller must free the Data.
+	int ReadNotifiedData(const __int64 Address, unsigned char*& Data,
+		unsigned long& Length, const unsigned long MaxAge);
+	// Returns the last read or notified value of the device's characteristic
+	// with the value Handle. See ReadNotifiedData for details.
+	int ReadCachedData(const __int64 Address, const unsigned short Handle,
+		unsigned char*& Data, unsigned long& Length, const unsigned long MaxAge);
 	int WriteData(const __int64 Address, const unsigned char* const Data,
 		const unsigned long Length);
+	// Streams large data to the device with Write Without Response. See
+	// CGattClient::StreamValue for details.
+	int StreamData(const __int64 Address, const unsigned char* const Data,
+		const unsigned long Length, const unsigned long Window, TStreamStats& Stats);
+
+	// Sends the message of any length as the sequence of framed segments. See
+	// CGattClient::WriteMessage for details.
+	int WriteMessage(const __int64 Address, const unsigned char* const Message,
+		const unsigned long Length, const unsigned long Window, TStreamStats& Stats);
+	// Enables framing. The notifications are reassembled into messages and
+	// reported with the OnMessageReceived event instead of the OnValueChanged
+	// and OnValuesChanged events. Can be changed only when watcher is not
+	// running.
+	int SetFraming(const bool Enabled);
+	bool GetFraming() const;
+	__declspec(property(get = GetFraming)) bool Framing;
 #pragma endregion Communication methods
 
+#pragma region Asynchronous communication
+	// Queues the read of the device's value and returns immediately. The
+	// operations of each device are executed one by one in the order they
+	// were queued and different devices are served in parallel by the
+	// watcher's pool of AsyncConcurrency threads, so single thread can keep
+	// many devices busy. The result is reported with the OnReadCompleted
+	// event with the Id returned here. The event fires on the watcher's
+	// thread, as the connection events do, so the handler may touch the UI.
+	// The value is valid only inside the event handler.
+	// Returns ASYNC_QUEUE_E_QUEUE_FULL if the device already has
+	// AsyncQueueDepth operations waiting. Any other error, including not
+	// connected device, is reported by the event.
+	int ReadDataAsync(const __int64 Address, unsigned long& Id);
+	// Queues the write of the value. The Data is copied so the caller can
+	// release it right after the call. The result is reported with the
+	// OnWriteCompleted event. See ReadDataAsync for details.
+	int WriteDataAsync(const __int64 Address, const unsigned char* const Data,
+		const unsigned long Length, unsigned long& Id);
+
+	// Gets the maximum number of operations waiting in the queue of single
+	// device.
+	unsigned long GetAsyncQueueDepth() const;
+	// Sets the queue depth. Must be greater than zero. Can be changed only
+	// when watcher is not running.
+	int SetAsyncQueueDepth(const unsigned long Depth);
+	__declspec(property(get = GetAsyncQueueDepth)) unsigned long AsyncQueueDepth;
+
+	// Gets the number of threads executing the asynchronous operations and
+	// the group operations' workers.
+	unsigned long GetAsyncConcurrency() const;
+	// Sets the number of the threads. Must be greater than zero. Can be
+	// changed only when watcher is not running.
+	int SetAsyncConcurrency(const unsigned long Value);
+	__declspec(property(get = GetAsyncConcurrency)) unsigned long AsyncConcurrency;
+#pragma endregion Asynchronous communication
+
+#pragma region Group communication
+	// Writes the Data to each device of the Addresses array or, if Addresses
+	// is NULL, to all the connected devices. Up to FanOut devices are served
+	// at the same time by the thread pool and the calling thread. The call
+	// returns when all the writes complete. Results gets one entry per device
+	// in the order of the Addresses with the result and the time of the write.
+	int WriteGroup(const __int64* const Addresses, const unsigned long Count,
+		const unsigned char* const Data, const unsigned long Length,
+		const unsigned long FanOut, vector<TGroupResult>* Results);
+	// Reads the value of each device. See WriteGroup for details. The values
+	// must be freed with ReleaseGroupResults. MaxAge has the same meaning as
+	// for ReadData.
+	int ReadGroup(const __int64* const Addresses, const unsigned long Count,
+		const unsigned long FanOut, vector<TGroupResult>* Results,
+		const unsigned long MaxAge = 0);
+	// Frees the values read by ReadGroup and clears the Results.
+	static void ReleaseGroupResults(vector<TGroupResult>* Results);
+#pragma endregion Group communication
+
+#pragma region Connection configuration
+	// Gets the maximum number of connections that can be started at the same
+	// time.
+	unsigned long GetMaxPendingConnections() const;
+	// Sets the maximum number of connections that can be started at the same
+	// time. Must be greater than zero.
+	int SetMaxPendingConnections(const unsigned long Value);
+	__declspec(property(get = GetMaxPendingConnections)) unsigned long MaxPendingConnections;
+
+	// Sets the delays before reconnection to the device that failed to connect.
+	// The delay doubles on each failure starting from Backoff until it reaches
+	// MaxBackoff. Times are in milliseconds.
+	int SetConnectBackoff(const unsigned long Backoff, const unsigned long MaxBackoff);
+
+	// Sets the automatic reconnection of the devices that lost the link. The
+	// device is connected again directly by its address with jittered
+	// exponential backoff. The client reuses the cached attribute handles so
+	// only the subscription is restored. The devices disconnected by the
+	// application are not reconnected. Enabled by default. Can be changed
+	// only when watcher is not running.
+	int SetReconnect(const TReconnectParams& Params);
+	void GetReconnect(TReconnectParams& Params) const;
+	// Returns the reconnection counters. Time-to-recover of each device is
+	// in its statistics.
+	void GetReconnectStats(TReconnectStats& Stats) const;
+
+	// Sets the radios the connections are spread over. The devices are still
+	// found by the radio the watcher is started with, but each new
+	// connection goes through the least loaded radio that has a free slot
+	// (see SetMaxConnectionsPerRadio), so the number of devices and the
+	// throughput grow with the number of adapters. The radio is picked by its
+	// connections count only: the RSSI is not used because the devices are
+	// heard by the scanning radio only, so a far device may be connected
+	// through a far adapter. The scanning radio may be in the list too. Zero
+	// Count (default) connects through the scanning radio only. Can be changed
+	// only when watcher is not running.
+	int SetConnectionRadios(CwclBluetoothRadio* const* const Radios, const unsigned long Count);
+	// Copies up to Count radios to the Radios array. Returns the number of
+	// radios set.
+	unsigned long GetConnectionRadios(CwclBluetoothRadio** const Radios,
+		const unsigned long Count) const;
+	// Sets the maximum number of connections of each radio: the controller's
+	// limit. The devices are not connected while all the radios are full.
+	// Zero (default) means no limit. Can be changed only when watcher is not
+	// running.
+	int SetMaxConnectionsPerRadio(const unsigned long Value);
+	unsigned long GetMaxConnectionsPerRadio() const;
+	__declspec(property(get = GetMaxConnectionsPerRadio)) unsigned long MaxConnectionsPerRadio;
+	// Copies up to Count radio loads to the Loads array. Returns the number
+	// of radios in use.
+	unsigned long GetRadioLoads(TRadioLoad* const Loads, const unsigned long Count);
+
+	// Configures the advertisements front filter. Capacity is the number of
+	// tracked devices. Advertisements of a not connected device are processed
+	// not more often than once per PassInterval (zero processes all of them)
+	// and a device with other name is ignored for RejectTimeout. Times are in
+	// milliseconds. Can be changed only when watcher is not running.
+	int SetAdvertisementFilter(const unsigned long Capacity, const unsigned long PassInterval,
+		const unsigned long RejectTimeout);
+
+	// Sets the rules that select the devices to connect. Each advertisement
+	// frame is checked against all the rules in one pass and the first rule
+	// satisfied by the device's recent frames gives the profile the client
+	// uses, so one watcher can manage devices of different kinds. Zero Count
+	// restores the default rule: the devices which name starts with
+	// DEVICE_NAME and our server's profile. Can be changed only when watcher
+	// is not running.
+	int SetMatchRules(const TMatchRule* const Rules, const unsigned long Count);
+	// Copies up to Count rules to the Rules array. Returns the number of
+	// rules.
+	unsigned long GetMatchRules(TMatchRule* const Rules, const unsigned long Count) const;
+
+	// Matches the devices by the 128-bit service UUIDs from the advertisement
+	// payload instead of the name: sets the rule per UUID with the default
+	// profile. The UUID is in the advertisement itself so the watcher can be
+	// started with passive scanning (smPassive) and a device is found without
+	// waiting for its scan response. Zero Count returns to the name matching.
+	// Can be changed only when watcher is not running.
+	int SetServiceFilter(const GUID* const Uuids, const unsigned long Count);
+	// Copies up to Count UUIDs of the service rules to the Uuids array.
+	// Returns the number of such rules.
+	unsigned long GetServiceFilter(GUID* const Uuids, const unsigned long Count) const;
+#pragma endregion Connection configuration
+
+#pragma region Connection parameters policy
+	// Sets the connection parameters policy for new connections. When enabled
+	// a burst of operations switches the connection to the throughput
+	// optimized parameters and an idle connection goes to the power optimized
+	// ones. Requires Windows 11. Can be changed only when watcher is not
+	// running.
+	int SetConnectionPolicy(const TConnectionPolicyParams& Params);
+	void GetConnectionPolicy(TConnectionPolicyParams& Params) const;
+#pragma endregion Connection parameters policy
+
+#pragma region Statistics
+	// Returns the statistics snapshot of the device.
+	int GetStatistics(const __int64 Address, TConnectionStatistics& Stats);
+	// Returns the statistics snapshots of all the devices.
+	void GetStatistics(list<TConnectionStatistics>* Stats);
+	// Clears the statistics of all the devices.
+	void ResetStatistics();
+#pragma endregion Statistics
+
+#pragma region Discovery configuration
+	// Gets the number of clients that can run attributes discovery at the same
+	// time. The discovery runs on the watcher's private pool of that many
+	// threads and the connection completes on the watcher's thread. Zero means
+	// the discovery runs synchronously from the connection event.
+	unsigned long GetDiscoveryConcurrency() const;
+	// Sets the discovery concurrency limit. Can be changed only when watcher is
+	// not running.
+	int SetDiscoveryConcurrency(const unsigned long Value);
+	__declspec(property(get = GetDiscoveryConcurrency)) unsigned long DiscoveryConcurrency;
+
+	// Loads the attribute handles cache. Devices found in the cache skip
+	// discovery on connect.
+	int LoadAttributeCache(const tstring& FileName);
+	// Saves the attribute handles cache.
+	int SaveAttributeCache(const tstring& FileName);
+#pragma endregion Discovery configuration
+
+#pragma region Notifications queue
+	// Sets the size of the notifications queue. If the size is not zero the
+	// notifications are not reported with the OnValueChanged event. Instead
+	// they are stored in the lock-free queue and the application takes them
+	// in batches with PopNotifications. Zero size (default) removes the queue.
+	// Can be changed only when watcher is not running.
+	int SetNotificationQueueSize(const unsigned long Size);
+	// Copies up to Count oldest notifications to the Records array. Returns
+	// number of copied notifications. Only one thread can pop notifications.
+	unsigned long PopNotifications(TNotification* const Records,
+		const unsigned long Count);
+	// Waits for notifications. Returns true if there are notifications in the
+	// queue. Must be called from the thread that pops notifications.
+	bool WaitNotifications(const DWORD Timeout);
+	// Returns number of notifications lost because the queue was full or the
+	// value was too long.
+	unsigned long GetDroppedNotifications() const;
+
+	// Enables the OnValuesChanged event. The notifications are collected for
+	// Window milliseconds after the first one arrived or until Size
+	// notifications are collected and then reported with single event from
+	// the watcher's thread (the one that created it). The values that were
+	// not reported when the watcher stops are dropped. The OnValueChanged
+	// event is not fired and PopNotifications can not be used while batching
+	// is enabled. Zero Size disables batching. Creates the notifications queue
+	// of default size if it was not set. Can be changed only when watcher is
+	// not running.
+	int SetValuesBatch(const unsigned long Window, const unsigned long Size);
+	unsigned long GetValuesBatchWindow() const;
+	unsigned long GetValuesBatchSize() const;
+	__declspec(property(get = GetValuesBatchWindow)) unsigned long ValuesBatchWindow;
+	__declspec(property(get = GetValuesBatchSize)) unsigned long ValuesBatchSize;
+#pragma endregion Notifications queue
+
 #pragma region Events
 	ClientDisconnected(OnClientDisconnected);
 	ClientConnectionCompleted(OnConnectionCompleted);
 	ClientConnectionStarted(OnConnectionStarted);
 	ClientDeviceFound(OnDeviceFound);
 	ClientValueChanged(OnValueChanged);
+	ClientValuesChanged(OnValuesChanged);
+	ClientMessageReceived(OnMessageReceived);
+	// The operations not yet executed when the watcher stops are completed
+	// with WCL_E_CONNECTION_CLOSED.
+	ClientReadCompleted(OnReadCompleted);
+	ClientWriteCompleted(OnWriteCompleted);
 #pragma endregion Events
 };
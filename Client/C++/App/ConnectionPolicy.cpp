@@ -0,0 +1,144 @@
+#include "pch.h"
+
+#include "ConnectionPolicy.h"
+
+CConnectionPolicy::CConnectionPolicy()
+{
+	InitializeCriticalSection(&FCS);
+
+	GetDefaultParams(FParams);
+
+	FWindowStart = 0;
+	FOperations = 0;
+	FLastActivity = 0;
+	FProfile = cpDefault;
+}
+
+CConnectionPolicy::~CConnectionPolicy()
+{
+	DeleteCriticalSection(&FCS);
+}
+
+void CConnectionPolicy::Configure(const TConnectionPolicyParams& Params,
+	const unsigned __int64 Now)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FParams = Params;
+		// Zero values make no sense.
+		if (FParams.BurstOperations == 0)
+			FParams.BurstOperations = 1;
+		if (FParams.IdleTimeout == 0)
+			FParams.IdleTimeout = DEFAULT_IDLE_TIMEOUT;
+
+		FWindowStart = Now;
+		FOperations = 0;
+		// Connection is considered active at start so it does not go to the
+		// power saving mode right away.
+		FLastActivity = Now;
+		FProfile = cpDefault;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CConnectionPolicy::Disable()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FParams.Enabled = false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CConnectionPolicy::Activity(const unsigned __int64 Now, TConnectionProfile& Profile)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FLastActivity = Now;
+		if (!FParams.Enabled)
+			return false;
+
+		if (Now - FWindowStart > FParams.BurstWindow)
+		{
+			FWindowStart = Now;
+			FOperations = 0;
+		}
+		FOperations++;
+
+		if (FProfile == cpThroughput || FOperations < FParams.BurstOperations)
+			return false;
+
+		FProfile = cpThroughput;
+		Profile = FProfile;
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CConnectionPolicy::Check(const unsigned __int64 Now, TConnectionProfile& Profile)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FParams.Enabled || FProfile == cpPowerSaving)
+			return false;
+		if (Now - FLastActivity < FParams.IdleTimeout)
+			return false;
+
+		FProfile = cpPowerSaving;
+		Profile = FProfile;
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CConnectionPolicy::Failed(const TConnectionProfile Profile)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		// Other thread may have requested other profile already.
+		if (FProfile == Profile)
+			FProfile = cpDefault;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+TConnectionProfile CConnectionPolicy::GetProfile()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		return FProfile;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CConnectionPolicy::GetDefaultParams(TConnectionPolicyParams& Params)
+{
+	Params.Enabled = false;
+	Params.BurstOperations = DEFAULT_BURST_OPERATIONS;
+	Params.BurstWindow = DEFAULT_BURST_WINDOW;
+	Params.IdleTimeout = DEFAULT_IDLE_TIMEOUT;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+// Default number of operations within the burst window that switch the
+// connection to the throughput optimized parameters.
+const unsigned long DEFAULT_BURST_OPERATIONS = 4;
+// Default burst detection window (ms).
+const unsigned long DEFAULT_BURST_WINDOW = 1000;
+// Default time without operations after which the connection switches to the
+// power optimized parameters (ms).
+const unsigned long DEFAULT_IDLE_TIMEOUT = 5000;
+
+// Connection parameters profile requested by the policy.
+typedef enum
+{
+	// Parameters selected by the OS on connection.
+	cpDefault,
+	// Long connection interval. Saves peripheral's battery.
+	cpPowerSaving,
+	// Short connection interval. Low latency of the requests.
+	cpThroughput
+} TConnectionProfile;
+
+// The connection policy configuration.
+typedef struct
+{
+	bool			Enabled;
+	unsigned long	BurstOperations;
+	unsigned long	BurstWindow;
+	unsigned long	IdleTimeout;
+} TConnectionPolicyParams;
+
+// Decides which connection parameters a connection should use based on its
+// traffic. A burst of operations switches the connection to the short
+// interval, a long pause switches it back to the power saving one. The
+// policy only decides: the caller applies the profile to the connection.
+// All the times are in milliseconds from any monotonic source.
+// The class is thread safe.
+class CConnectionPolicy
+{
+	DISABLE_COPY(CConnectionPolicy);
+
+private:
+	RTL_CRITICAL_SECTION	FCS;
+	TConnectionPolicyParams	FParams;
+
+	unsigned __int64		FWindowStart;
+	unsigned long			FOperations;
+	unsigned __int64		FLastActivity;
+	TConnectionProfile		FProfile;
+
+public:
+	CConnectionPolicy();
+	~CConnectionPolicy();
+
+	// Sets the configuration and resets the state.
+	void Configure(const TConnectionPolicyParams& Params, const unsigned __int64 Now);
+	// Disables the policy. Used when the connection does not support
+	// parameters change.
+	void Disable();
+
+	// Records the operation. Returns true if the connection must be switched
+	// to the Profile.
+	bool Activity(const unsigned __int64 Now, TConnectionProfile& Profile);
+	// Checks for the idle connection. Returns true if the connection must be
+	// switched to the Profile.
+	bool Check(const unsigned __int64 Now, TConnectionProfile& Profile);
+	// Must be called if the profile could not be applied. The profile will be
+	// requested again on next Activity or Check.
+	void Failed(const TConnectionProfile Profile);
+
+	// Returns the last requested profile.
+	TConnectionProfile GetProfile();
+
+	// Returns the default configuration (disabled).
+	static void GetDefaultParams(TConnectionPolicyParams& Params);
+};
@@ -0,0 +1,252 @@
+#include "pch.h"
+
+#include "ConnectionScheduler.h"
+
+bool CConnectionScheduler::TQueueOrder::operator()(const TQueueItem& a,
+	const TQueueItem& b) const
+{
+	// priority_queue keeps the "largest" item on top, so "a < b" means b is
+	// better.
+	if (a.Rssi != b.Rssi)
+		return (a.Rssi < b.Rssi);
+	return (a.LastSeen < b.LastSeen);
+}
+
+// Must be called under the lock.
+void CConnectionScheduler::Rebuild()
+{
+	// Repeated advertisements leave outdated items in the queue. Rebuild it
+	// from the live candidates when the garbage takes too much space.
+	delete FQueue;
+	FQueue = new QUEUE();
+	for (CANDIDATES::iterator Candidate = FCandidates->begin(); Candidate != FCandidates->end(); Candidate++)
+	{
+		TQueueItem Item;
+		Item.Address = Candidate->first;
+		Item.Rssi = Candidate->second.Rssi;
+		Item.LastSeen = Candidate->second.LastSeen;
+		Item.Stamp = Candidate->second.Stamp;
+		FQueue->push(Item);
+	}
+}
+
+CConnectionScheduler::CConnectionScheduler()
+{
+	InitializeCriticalSection(&FCS);
+
+	FCandidates = new CANDIDATES();
+	FQueue = new QUEUE();
+	FBackoffs = new BACKOFFS();
+	FInFlight = new ADDRESSES();
+	FStamp = 0;
+
+	FMaxInFlight = DEFAULT_MAX_PENDING_CONNECTIONS;
+	FBackoff = DEFAULT_CONNECT_BACKOFF;
+	FMaxBackoff = DEFAULT_MAX_CONNECT_BACKOFF;
+}
+
+CConnectionScheduler::~CConnectionScheduler()
+{
+	delete FCandidates;
+	delete FQueue;
+	delete FBackoffs;
+	delete FInFlight;
+
+	DeleteCriticalSection(&FCS);
+}
+
+void CConnectionScheduler::Offer(const __int64 Address, const char Rssi,
+	const unsigned __int64 Now, const unsigned long Rule, const tstring& Name)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FInFlight->find(Address) != FInFlight->end())
+			return;
+
+		BACKOFFS::iterator Backoff = FBackoffs->find(Address);
+		if (Backoff != FBackoffs->end() && Now < Backoff->second.RetryAt)
+			return;
+
+		FStamp++;
+		TCandidate& Candidate = (*FCandidates)[Address];
+		Candidate.Rssi = Rssi;
+		Candidate.LastSeen = Now;
+		Candidate.Stamp = FStamp;
+		Candidate.Rule = Rule;
+		if (!Name.empty())
+			Candidate.Name = Name;
+
+		TQueueItem Item;
+		Item.Address = Address;
+		Item.Rssi = Rssi;
+		Item.LastSeen = Now;
+		Item.Stamp = FStamp;
+		FQueue->push(Item);
+
+		if (FQueue->size() > 4 * FCandidates->size() + 64)
+			Rebuild();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CConnectionScheduler::Next(const unsigned __int64 Now, __int64& Address,
+	unsigned long& Rule, tstring& Name)
+{
+	Address = 0;
+	Rule = 0;
+	Name.clear();
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		while (FInFlight->size() < FMaxInFlight && !FQueue->empty())
+		{
+			TQueueItem Item = FQueue->top();
+			FQueue->pop();
+
+			// Skip outdated queue items: the candidate has been refreshed
+			// (newer item is in the queue) or already taken.
+			CANDIDATES::iterator Candidate = FCandidates->find(Item.Address);
+			if (Candidate == FCandidates->end() || Candidate->second.Stamp != Item.Stamp)
+				continue;
+
+			// Device is not advertising anymore.
+			if (Now - Item.LastSeen > CANDIDATE_TIMEOUT)
+			{
+				FCandidates->erase(Candidate);
+				continue;
+			}
+
+			FInFlight->insert(Item.Address);
+			Address = Item.Address;
+			Rule = Candidate->second.Rule;
+			Name = Candidate->second.Name;
+			FCandidates->erase(Candidate);
+			return true;
+		}
+		return false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CConnectionScheduler::Acquire(const __int64 Address)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FInFlight->size() >= FMaxInFlight || FInFlight->find(Address) != FInFlight->end())
+			return false;
+
+		// Its queue items become outdated.
+		FCandidates->erase(Address);
+		FInFlight->insert(Address);
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CConnectionScheduler::Completed(const __int64 Address, const bool Success,
+	const unsigned __int64 Now)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FInFlight->erase(Address) == 0)
+			return;
+
+		if (Success)
+			FBackoffs->erase(Address);
+		else
+		{
+			TBackoff& Backoff = (*FBackoffs)[Address];
+			// Double the delay up to the limit. Keep shift in range.
+			unsigned __int64 Delay = FBackoff;
+			for (unsigned long i = 0; i < Backoff.Failures && Delay < FMaxBackoff; i++)
+				Delay *= 2;
+			if (Delay > FMaxBackoff)
+				Delay = FMaxBackoff;
+
+			Backoff.Failures++;
+			Backoff.RetryAt = Now + Delay;
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CConnectionScheduler::Clear()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FCandidates->clear();
+		delete FQueue;
+		FQueue = new QUEUE();
+		FBackoffs->clear();
+		FInFlight->clear();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CConnectionScheduler::IsInFlight(const __int64 Address)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		return (FInFlight->find(Address) != FInFlight->end());
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+size_t CConnectionScheduler::GetInFlightCount()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		return FInFlight->size();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+unsigned long CConnectionScheduler::GetMaxInFlight() const
+{
+	return FMaxInFlight;
+}
+
+void CConnectionScheduler::SetMaxInFlight(const unsigned long Value)
+{
+	// At least one connection must be possible.
+	if (Value > 0)
+		FMaxInFlight = Value;
+}
+
+void CConnectionScheduler::SetBackoff(const unsigned long Backoff,
+	const unsigned long MaxBackoff)
+{
+	if (Backoff > 0 && MaxBackoff >= Backoff)
+	{
+		FBackoff = Backoff;
+		FMaxBackoff = MaxBackoff;
+	}
+}
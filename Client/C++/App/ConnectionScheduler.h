@@ -0,0 +1,118 @@
+#pragma once
+
+#include <map>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include "wclHelpers.h"
+
+using namespace std;
+
+// Default maximum number of connections started at the same time.
+const unsigned long DEFAULT_MAX_PENDING_CONNECTIONS = 4;
+// Default delay before first reconnection attempt after a failure (ms).
+const unsigned long DEFAULT_CONNECT_BACKOFF = 1000;
+// Default maximum delay between reconnection attempts (ms).
+const unsigned long DEFAULT_MAX_CONNECT_BACKOFF = 60000;
+// A candidate that has not been seen for this time is dropped (ms).
+const unsigned long CANDIDATE_TIMEOUT = 5000;
+
+// Connection admission scheduler.
+// Advertised devices are offered as candidates. The scheduler keeps no more
+// than the configured number of connections in flight and picks the next
+// device by the best RSSI and then by the most recent advertisement. A device
+// that failed to connect is not admitted again until its exponential backoff
+// expires.
+// All the times are in milliseconds from any monotonic source.
+// The class is thread safe.
+class CConnectionScheduler
+{
+	DISABLE_COPY(CConnectionScheduler);
+
+private:
+	typedef struct
+	{
+		char				Rssi;
+		unsigned __int64	LastSeen;
+		unsigned long		Stamp;
+		// Index of the match rule the device satisfied.
+		unsigned long		Rule;
+		tstring				Name;
+	} TCandidate;
+
+	typedef struct
+	{
+		__int64				Address;
+		char				Rssi;
+		unsigned __int64	LastSeen;
+		unsigned long		Stamp;
+	} TQueueItem;
+
+	// Orders queue items: better RSSI first, then the most recently seen.
+	struct TQueueOrder
+	{
+		bool operator()(const TQueueItem& a, const TQueueItem& b) const;
+	};
+
+	typedef struct
+	{
+		unsigned long		Failures;
+		unsigned __int64	RetryAt;
+	} TBackoff;
+
+	typedef map<__int64, TCandidate> CANDIDATES;
+	typedef priority_queue<TQueueItem, vector<TQueueItem>, TQueueOrder> QUEUE;
+	typedef map<__int64, TBackoff> BACKOFFS;
+	typedef set<__int64> ADDRESSES;
+
+	RTL_CRITICAL_SECTION	FCS;
+	CANDIDATES*				FCandidates;
+	QUEUE*					FQueue;
+	BACKOFFS*				FBackoffs;
+	ADDRESSES*				FInFlight;
+	unsigned long			FStamp;
+
+	unsigned long			FMaxInFlight;
+	unsigned long			FBackoff;
+	unsigned long			FMaxBackoff;
+
+	void Rebuild();
+
+public:
+	CConnectionScheduler();
+	~CConnectionScheduler();
+
+	// Adds new candidate or refreshes existing one. The device is ignored if
+	// its connection is in flight or its backoff has not expired yet. The
+	// Rule is the index of the match rule the device satisfied. Next returns
+	// it with the candidate. The Name is the advertised device name or empty
+	// if the frame has no name: then the name known from the device's
+	// previous frames is kept.
+	void Offer(const __int64 Address, const char Rssi, const unsigned __int64 Now,
+		const unsigned long Rule, const tstring& Name);
+	// Takes the best candidate if a connection slot is free. On success the
+	// slot is taken and the method returns true. The Name is empty if the
+	// device's name is unknown.
+	bool Next(const unsigned __int64 Now, __int64& Address, unsigned long& Rule,
+		tstring& Name);
+	// Takes a connection slot for the device out of the candidates order.
+	// Returns false if no slot is free or the device is already in flight.
+	bool Acquire(const __int64 Address);
+	// Must be called when the connection taken by Next or Acquire completed. Frees the
+	// slot. If connection failed the device goes to backoff.
+	void Completed(const __int64 Address, const bool Success,
+		const unsigned __int64 Now);
+	// Drops all the candidates, the slots and the backoffs.
+	void Clear();
+
+	// Returns true if the device is taken by Next and not completed yet.
+	bool IsInFlight(const __int64 Address);
+	size_t GetInFlightCount();
+
+	unsigned long GetMaxInFlight() const;
+	void SetMaxInFlight(const unsigned long Value);
+	// Sets the backoff limits. The delay doubles on each failure starting from
+	// Backoff until it reaches MaxBackoff.
+	void SetBackoff(const unsigned long Backoff, const unsigned long MaxBackoff);
+};
@@ -0,0 +1,153 @@
+#include "pch.h"
+
+#include "ConnectionStats.h"
+
+CConnectionStats::CConnectionStats(const __int64 Address)
+{
+	FAddress = Address;
+
+	FConnect = new CLatencyHistogram();
+	FDiscovery = new CLatencyHistogram();
+	FRead = new CLatencyHistogram();
+	FWrite = new CLatencyHistogram();
+	FNotificationInterval = new CLatencyHistogram();
+	FRecovery = new CLatencyHistogram();
+
+	Reset();
+}
+
+CConnectionStats::~CConnectionStats()
+{
+	delete FConnect;
+	delete FDiscovery;
+	delete FRead;
+	delete FWrite;
+	delete FNotificationInterval;
+	delete FRecovery;
+}
+
+void CConnectionStats::Connected(const unsigned __int64 Latency)
+{
+	InterlockedIncrement64(&FConnects);
+	FConnect->Record(Latency);
+	// Do not count the time between connections as notification interval.
+	InterlockedExchange64(&FLastNotification, 0);
+}
+
+void CConnectionStats::ConnectFailed()
+{
+	InterlockedIncrement64(&FConnectFailures);
+}
+
+void CConnectionStats::Discovered(const unsigned __int64 Latency)
+{
+	FDiscovery->Record(Latency);
+}
+
+void CConnectionStats::Read(const int Result, const unsigned __int64 Latency,
+	const unsigned long Length)
+{
+	if (Result != WCL_E_SUCCESS)
+		InterlockedIncrement64(&FReadFailures);
+	else
+	{
+		InterlockedIncrement64(&FReads);
+		InterlockedExchangeAdd64(&FBytesRead, Length);
+		FRead->Record(Latency);
+	}
+}
+
+void CConnectionStats::Written(const int Result, const unsigned __int64 Latency,
+	const unsigned long Length, const bool WithResponse)
+{
+	if (Result != WCL_E_SUCCESS)
+		InterlockedIncrement64(&FWriteFailures);
+	else
+	{
+		InterlockedIncrement64(&FWrites);
+		InterlockedExchangeAdd64(&FBytesWritten, Length);
+		// Write Without Response returns before the data leaves the host so
+		// its time is not a round trip.
+		if (WithResponse)
+			FWrite->Record(Latency);
+	}
+}
+
+void CConnectionStats::Notified(const unsigned __int64 Timestamp, const unsigned long Length)
+{
+	InterlockedIncrement64(&FNotifications);
+	InterlockedExchangeAdd64(&FBytesNotified, Length);
+
+	LONG64 Last = InterlockedExchange64(&FLastNotification, (LONG64)Timestamp);
+	if (Last != 0 && (unsigned __int64)Last <= Timestamp)
+		FNotificationInterval->Record(Timestamp - Last);
+}
+
+void CConnectionStats::Recovered(const unsigned __int64 Downtime)
+{
+	InterlockedIncrement64(&FRecoveries);
+	FRecovery->Record(Downtime);
+}
+
+void CConnectionStats::Coalesced(const int Result)
+{
+	if (Result == WCL_E_SUCCESS)
+		InterlockedIncrement64(&FCoalescedReads);
+}
+
+void CConnectionStats::Cached()
+{
+	InterlockedIncrement64(&FCachedReads);
+}
+
+void CConnectionStats::Reset()
+{
+	InterlockedExchange64(&FConnects, 0);
+	InterlockedExchange64(&FConnectFailures, 0);
+	InterlockedExchange64(&FReads, 0);
+	InterlockedExchange64(&FReadFailures, 0);
+	InterlockedExchange64(&FWrites, 0);
+	InterlockedExchange64(&FWriteFailures, 0);
+	InterlockedExchange64(&FNotifications, 0);
+	InterlockedExchange64(&FBytesRead, 0);
+	InterlockedExchange64(&FBytesWritten, 0);
+	InterlockedExchange64(&FBytesNotified, 0);
+	InterlockedExchange64(&FRecoveries, 0);
+	InterlockedExchange64(&FCoalescedReads, 0);
+	InterlockedExchange64(&FCachedReads, 0);
+	InterlockedExchange64(&FLastNotification, 0);
+
+	FConnect->Reset();
+	FDiscovery->Reset();
+	FRead->Reset();
+	FWrite->Reset();
+	FNotificationInterval->Reset();
+	FRecovery->Reset();
+}
+
+void CConnectionStats::GetSnapshot(TConnectionStatistics& Stats) const
+{
+	ZeroMemory(&Stats, sizeof(TConnectionStatistics));
+
+	Stats.Address = FAddress;
+	Stats.Connects = FConnects;
+	Stats.ConnectFailures = FConnectFailures;
+	Stats.Reads = FReads;
+	Stats.ReadFailures = FReadFailures;
+	Stats.Writes = FWrites;
+	Stats.WriteFailures = FWriteFailures;
+	Stats.Notifications = FNotifications;
+	Stats.BytesRead = FBytesRead;
+	Stats.BytesWritten = FBytesWritten;
+	Stats.BytesNotified = FBytesNotified;
+	Stats.Recoveries = FRecoveries;
+	Stats.CoalescedReads = FCoalescedReads;
+	Stats.CachedReads = FCachedReads;
+
+	FConnect->GetSummary(Stats.Connect);
+	FDiscovery->GetSummary(Stats.Discovery);
+	FRead->GetSummary(Stats.Read);
+	FWrite->GetSummary(Stats.Write);
+	FNotificationInterval->GetSummary(Stats.NotificationInterval);
+	FRecovery->GetSummary(Stats.Recovery);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+#include "LatencyHistogram.h"
+
+using namespace wclCommon;
+
+// Snapshot of the device's statistics. Latencies are in microseconds.
+typedef struct
+{
+	__int64				Address;
+
+	unsigned __int64	Connects;
+	unsigned __int64	ConnectFailures;
+	unsigned __int64	Reads;
+	unsigned __int64	ReadFailures;
+	unsigned __int64	Writes;
+	unsigned __int64	WriteFailures;
+	unsigned __int64	Notifications;
+	unsigned __int64	BytesRead;
+	unsigned __int64	BytesWritten;
+	unsigned __int64	BytesNotified;
+	// Connections restored after the link loss.
+	unsigned __int64	Recoveries;
+	// Reads answered by other caller's read in flight. Not included in
+	// Reads.
+	unsigned __int64	CoalescedReads;
+	// Reads answered from the last known value. Not included in Reads.
+	unsigned __int64	CachedReads;
+
+	// From Connect call to the link established.
+	TLatencySummary		Connect;
+	// From the link established to the attributes resolved and subscribed.
+	TLatencySummary		Discovery;
+	// Read and write (with response) round trips.
+	TLatencySummary		Read;
+	TLatencySummary		Write;
+	// Time between two notifications of the same connection.
+	TLatencySummary		NotificationInterval;
+	// From the link loss to the connection restored and subscribed again.
+	TLatencySummary		Recovery;
+} TConnectionStatistics;
+
+// Statistics of the single device. The object lives for the whole watcher's
+// life so it collects data across reconnections. All the updates are atomic
+// operations without locks.
+class CConnectionStats
+{
+	DISABLE_COPY(CConnectionStats);
+
+private:
+	__int64					FAddress;
+
+	volatile LONG64			FConnects;
+	volatile LONG64			FConnectFailures;
+	volatile LONG64			FReads;
+	volatile LONG64			FReadFailures;
+	volatile LONG64			FWrites;
+	volatile LONG64			FWriteFailures;
+	volatile LONG64			FNotifications;
+	volatile LONG64			FBytesRead;
+	volatile LONG64			FBytesWritten;
+	volatile LONG64			FBytesNotified;
+	volatile LONG64			FRecoveries;
+	volatile LONG64			FCoalescedReads;
+	volatile LONG64			FCachedReads;
+	// Timestamp of the last notification. Zero after connection.
+	volatile LONG64			FLastNotification;
+
+	CLatencyHistogram*		FConnect;
+	CLatencyHistogram*		FDiscovery;
+	CLatencyHistogram*		FRead;
+	CLatencyHistogram*		FWrite;
+	CLatencyHistogram*		FNotificationInterval;
+	CLatencyHistogram*		FRecovery;
+
+public:
+	CConnectionStats(const __int64 Address);
+	~CConnectionStats();
+
+	// All the times are from GetTimestamp.
+	void Connected(const unsigned __int64 Latency);
+	void ConnectFailed();
+	void Discovered(const unsigned __int64 Latency);
+	void Read(const int Result, const unsigned __int64 Latency, const unsigned long Length);
+	// Latency is recorded only for the writes with response.
+	void Written(const int Result, const unsigned __int64 Latency, const unsigned long Length,
+		const bool WithResponse);
+	void Notified(const unsigned __int64 Timestamp, const unsigned long Length);
+	void Recovered(const unsigned __int64 Downtime);
+	// The read got the result of other caller's read.
+	void Coalesced(const int Result);
+	// The read got the last known value without the request to the device.
+	void Cached();
+
+	void Reset();
+	void GetSnapshot(TConnectionStatistics& Stats) const;
+};
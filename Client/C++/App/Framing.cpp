@@ -0,0 +1,226 @@
+#include "pch.h"
+
+#include "Framing.h"
+
+CFrameSegmenter::CFrameSegmenter()
+{
+	FData = NULL;
+	FLength = 0;
+	FSegmentSize = 0;
+	FMessageId = 0;
+	FOffset = 0;
+	FSequence = 0;
+	FDone = true;
+}
+
+int CFrameSegmenter::Init(const unsigned char* const Data, const unsigned long Length,
+	const unsigned long SegmentSize, const unsigned char MessageId)
+{
+	if (Data == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	// The first segment must carry at least one byte of payload.
+	if (SegmentSize <= FRAME_FIRST_HEADER_SIZE)
+		return FRAMING_E_SEGMENT_TOO_SMALL;
+	// The sequence number must not wrap.
+	if (GetSegmentCount(Length, SegmentSize) > 0xFFFF)
+		return FRAMING_E_MESSAGE_TOO_LARGE;
+
+	FData = Data;
+	FLength = Length;
+	FSegmentSize = SegmentSize;
+	FMessageId = MessageId;
+	FOffset = 0;
+	FSequence = 0;
+	FDone = false;
+	return WCL_E_SUCCESS;
+}
+
+bool CFrameSegmenter::Next(unsigned char* const Segment, unsigned long& Length, bool& Last)
+{
+	Length = 0;
+	Last = false;
+	if (FDone || Segment == NULL)
+		return false;
+
+	bool First = (FSequence == 0);
+	unsigned long Header = (First ? FRAME_FIRST_HEADER_SIZE : FRAME_HEADER_SIZE);
+	unsigned long Payload = FLength - FOffset;
+	if (Payload > FSegmentSize - Header)
+		Payload = FSegmentSize - Header;
+	Last = (FOffset + Payload == FLength);
+
+	unsigned char Flags = FRAME_MARKER;
+	if (First)
+		Flags |= FRAME_FIRST;
+	if (Last)
+		Flags |= FRAME_LAST;
+
+	Segment[0] = Flags;
+	Segment[1] = FMessageId;
+	Segment[2] = (unsigned char)(FSequence & 0xFF);
+	Segment[3] = (unsigned char)(FSequence >> 8);
+	if (First)
+	{
+		Segment[4] = (unsigned char)(FLength & 0xFF);
+		Segment[5] = (unsigned char)((FLength >> 8) & 0xFF);
+		Segment[6] = (unsigned char)((FLength >> 16) & 0xFF);
+		Segment[7] = (unsigned char)(FLength >> 24);
+	}
+	memcpy(Segment + Header, FData + FOffset, Payload);
+
+	Length = Header + Payload;
+	FOffset += Payload;
+	FSequence++;
+	FDone = Last;
+	return true;
+}
+
+unsigned long CFrameSegmenter::GetSegmentCount(const unsigned long Length,
+	const unsigned long SegmentSize)
+{
+	if (Length == 0 || SegmentSize <= FRAME_FIRST_HEADER_SIZE)
+		return 0;
+
+	unsigned long First = SegmentSize - FRAME_FIRST_HEADER_SIZE;
+	if (Length <= First)
+		return 1;
+	unsigned long Other = SegmentSize - FRAME_HEADER_SIZE;
+	return 1 + (Length - First + Other - 1) / Other;
+}
+
+CFrameReassembler::CFrameReassembler(const unsigned long MaxSize)
+{
+	FBuffer = NULL;
+	FCapacity = 0;
+	FMaxSize = MaxSize;
+
+	FLength = 0;
+	FReceived = 0;
+	FMessageId = 0;
+	FSequence = 0;
+	FActive = false;
+
+	FErrors = 0;
+}
+
+CFrameReassembler::~CFrameReassembler()
+{
+	if (FBuffer != NULL)
+		free(FBuffer);
+}
+
+int CFrameReassembler::Push(const unsigned char* const Segment, const unsigned long Length,
+	bool& Complete)
+{
+	Complete = false;
+
+	if (Segment == NULL || Length < FRAME_HEADER_SIZE ||
+		(Segment[0] & FRAME_MARKER_MASK) != FRAME_MARKER)
+	{
+		FErrors++;
+		return FRAMING_E_INVALID_SEGMENT;
+	}
+
+	unsigned char Flags = Segment[0];
+	unsigned char MessageId = Segment[1];
+	unsigned short Sequence = Segment[2] | (Segment[3] << 8);
+	const unsigned char* Payload = Segment + FRAME_HEADER_SIZE;
+	unsigned long PayloadLength = Length - FRAME_HEADER_SIZE;
+
+	if ((Flags & FRAME_FIRST) != 0)
+	{
+		// New message starts. The partial one (if any) is lost.
+		if (FActive)
+			FErrors++;
+		FActive = false;
+
+		if (Sequence != 0 || Length < FRAME_FIRST_HEADER_SIZE)
+		{
+			FErrors++;
+			return FRAMING_E_INVALID_SEGMENT;
+		}
+
+		unsigned long MessageLength = Payload[0] | (Payload[1] << 8) |
+			(Payload[2] << 16) | ((unsigned long)Payload[3] << 24);
+		Payload += 4;
+		PayloadLength -= 4;
+
+		if (MessageLength > FMaxSize)
+		{
+			FErrors++;
+			return FRAMING_E_MESSAGE_TOO_LARGE;
+		}
+
+		// The buffer only grows so the steady state does not allocate.
+		if (MessageLength > FCapacity)
+		{
+			unsigned char* Buffer = (unsigned char*)realloc(FBuffer, MessageLength);
+			if (Buffer == NULL)
+				return WCL_E_OUT_OF_MEMORY;
+			FBuffer = Buffer;
+			FCapacity = MessageLength;
+		}
+
+		FLength = MessageLength;
+		FReceived = 0;
+		FMessageId = MessageId;
+		FSequence = 0;
+		FActive = true;
+	}
+	else
+	{
+		if (!FActive || MessageId != FMessageId || Sequence != FSequence)
+		{
+			if (FActive)
+				FErrors++;
+			FActive = false;
+			return FRAMING_E_SEQUENCE_GAP;
+		}
+	}
+
+	if (FReceived + PayloadLength > FLength)
+	{
+		FErrors++;
+		FActive = false;
+		return FRAMING_E_INVALID_SEGMENT;
+	}
+
+	if (PayloadLength > 0)
+		memcpy(FBuffer + FReceived, Payload, PayloadLength);
+	FReceived += PayloadLength;
+	FSequence++;
+
+	if ((Flags & FRAME_LAST) != 0)
+	{
+		FActive = false;
+		if (FReceived != FLength)
+		{
+			FErrors++;
+			return FRAMING_E_INVALID_SEGMENT;
+		}
+		Complete = true;
+	}
+	return WCL_E_SUCCESS;
+}
+
+void CFrameReassembler::Reset()
+{
+	FActive = false;
+	FLength = 0;
+	FReceived = 0;
+}
+
+const unsigned char* CFrameReassembler::GetData() const
+{
+	return FBuffer;
+}
+
+unsigned long CFrameReassembler::GetLength() const
+{
+	return FLength;
+}
+
+unsigned long CFrameReassembler::GetErrors() const
+{
+	return FErrors;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+#pragma region Framing error codes
+const int FRAMING_E_BASE = 0x7F030000;
+// The segment is too short or has invalid header.
+const int FRAMING_E_INVALID_SEGMENT = FRAMING_E_BASE + 0x0000;
+// A segment of the message has been lost or belongs to other message.
+const int FRAMING_E_SEQUENCE_GAP = FRAMING_E_BASE + 0x0001;
+// The message is longer than the reassembler allows.
+const int FRAMING_E_MESSAGE_TOO_LARGE = FRAMING_E_BASE + 0x0002;
+// The segment size is too small to carry the headers.
+const int FRAMING_E_SEGMENT_TOO_SMALL = FRAMING_E_BASE + 0x0003;
+#pragma endregion Framing error codes
+
+// Segment layout (little endian):
+//   Marker and flags  1 byte   FRAME_MARKER | FRAME_FIRST | FRAME_LAST
+//   Message ID        1 byte
+//   Sequence          2 bytes  segment index in the message
+//   Message length    4 bytes  only in the first segment
+//   Payload           the rest of the segment
+// The marker in the high nibble of the first byte can not start a printable
+// text so the peer can tell framed segments from plain writes.
+const unsigned char FRAME_MARKER = 0xA0;
+const unsigned char FRAME_MARKER_MASK = 0xF0;
+const unsigned char FRAME_FIRST = 0x01;
+const unsigned char FRAME_LAST = 0x02;
+
+const unsigned long FRAME_HEADER_SIZE = 4;
+const unsigned long FRAME_FIRST_HEADER_SIZE = FRAME_HEADER_SIZE + 4;
+
+// Default maximum size of the reassembled message.
+const unsigned long DEFAULT_MAX_MESSAGE_SIZE = 64 * 1024;
+
+// Splits the message into segments that fit into the ATT PDU. The segmenter
+// does not copy the message: it must stay valid until the last segment is
+// taken.
+class CFrameSegmenter
+{
+	DISABLE_COPY(CFrameSegmenter);
+
+private:
+	const unsigned char*	FData;
+	unsigned long			FLength;
+	unsigned long			FSegmentSize;
+	unsigned char			FMessageId;
+	unsigned long			FOffset;
+	unsigned short			FSequence;
+	bool					FDone;
+
+public:
+	CFrameSegmenter();
+
+	// Starts segmentation of the message. SegmentSize is the maximum segment
+	// length including headers (usually MTU - 3).
+	int Init(const unsigned char* const Data, const unsigned long Length,
+		const unsigned long SegmentSize, const unsigned char MessageId);
+	// Builds next segment into the Segment buffer that must be at least
+	// SegmentSize bytes long. Returns false when all the segments were taken.
+	bool Next(unsigned char* const Segment, unsigned long& Length, bool& Last);
+
+	// Returns the number of segments needed for the message.
+	static unsigned long GetSegmentCount(const unsigned long Length,
+		const unsigned long SegmentSize);
+};
+
+// Collects the segments back into the message. The segments must arrive in
+// order (ATT guarantees that for a single connection). If a segment is lost
+// the partial message is dropped.
+// The class is not thread safe: feed it from a single thread.
+class CFrameReassembler
+{
+	DISABLE_COPY(CFrameReassembler);
+
+private:
+	unsigned char*	FBuffer;
+	unsigned long	FCapacity;
+	unsigned long	FMaxSize;
+
+	unsigned long	FLength;
+	unsigned long	FReceived;
+	unsigned char	FMessageId;
+	unsigned short	FSequence;
+	bool			FActive;
+
+	unsigned long	FErrors;
+
+public:
+	CFrameReassembler(const unsigned long MaxSize = DEFAULT_MAX_MESSAGE_SIZE);
+	~CFrameReassembler();
+
+	// Processes the segment. When the message is complete Complete is set to
+	// true and the message is available with GetData and GetLength until next
+	// call of Push.
+	int Push(const unsigned char* const Segment, const unsigned long Length,
+		bool& Complete);
+	// Drops the partial message.
+	void Reset();
+
+	const unsigned char* GetData() const;
+	unsigned long GetLength() const;
+	// Returns number of dropped messages and invalid segments.
+	unsigned long GetErrors() const;
+};
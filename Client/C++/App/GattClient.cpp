@@ -1,73 +1,285 @@
 #include "pch.h"
 
 #include "GattClient.h"
+#include "Timestamp.h"
 
-void CGattClient::DoConnect(const int Error)
+bool CGattClient::EnterDispatch(LONG& Token)
+{
+	Token = 0;
+	if (FReclaimer != NULL)
+		Token = FReclaimer->Enter();
+	if (TryAddRef())
+		return true;
+
+	// The last reference is already gone and the client is retired. A late
+	// event must not revive it: it would be retired and destroyed twice.
+	if (FReclaimer != NULL)
+		FReclaimer->Leave(Token);
+	return false;
+}
+
+void CGattClient::LeaveDispatch(const LONG Token)
+{
+	// Release first: if it was the last reference the client is retired inside
+	// the protected region so it can not be destroyed before we leave it.
+	Release();
+	if (FReclaimer != NULL)
+		FReclaimer->Leave(Token);
+}
+
+void CGattClient::Unlink()
+{
+	if (FReclaimer == NULL)
+	{
+		InterlockedExchange(&FLinked, 0);
+		return;
+	}
+
+	// The retired client is kept while it is linked. Once it is unlinked it
+	// can be destroyed after the grace period so stay inside the protected
+	// region until the reclaimer knows about it.
+	LONG Token = FReclaimer->Enter();
+	if (InterlockedExchange(&FLinked, 0) != 0)
+		FReclaimer->Unlinked(this);
+	FReclaimer->Leave(Token);
+}
+
+int CGattClient::ResumeFromCache()
 {
-	// Copy this to be able to modify it if needed.
-	int Res = Error;
+	TAttributeCacheRecord Record;
+	if (FAttributeCache == NULL || !FAttributeCache->Find(Address, Record))
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+	// The device has been connected with other profile. Profiles may share
+	// the service so the characteristics are compared too.
+	if (!IsEqualGUID(Record.Service.Uuid.LongUuid, FProfile.Service) ||
+		!IsEqualGUID(Record.ReadableChar.Uuid.LongUuid, FProfile.ReadableChar) ||
+		!IsEqualGUID(Record.WritableChar.Uuid.LongUuid, FProfile.WritableChar) ||
+		!IsEqualGUID(Record.NotifiableChar.Uuid.LongUuid, FProfile.NotifiableChar))
+	{
+		FAttributeCache->Remove(Address);
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+	}
 
-	// If connection was success try to read required attributes.
+	// Subscribing is the only request here. If the handles are wrong the device
+	// rejects it and we fall back to discovery.
+	int Res = SubscribeForNotifications(Record.NotifiableChar);
 	if (Res == WCL_E_SUCCESS)
 	{
-		wclGattUuid Uuid;
-		Uuid.IsShortUuid = false;
+		FReadableChar = Record.ReadableChar;
+		FWritableChar = Record.WritableChar;
+		FNotifiableChar = Record.NotifiableChar;
+	}
+	else
+		FAttributeCache->Remove(Address);
+	return Res;
+}
 
-		// First find required service.
-		Uuid.LongUuid = SERVICE_UUID;
-		wclGattService Service;
-		Res = FindService(Uuid, Service);
-		if (Res == WCL_E_SUCCESS)
+int CGattClient::Discover()
+{
+	wclGattUuid Uuid;
+	Uuid.IsShortUuid = false;
+
+	// First find required service.
+	Uuid.LongUuid = FProfile.Service;
+	wclGattService Service;
+	int Res = FindService(Uuid, Service);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	// Read all the service's characteristics with single request and find
+	// the required ones locally instead of asking the device for each of them.
+	wclGattCharacteristics Chars;
+	Res = ReadCharacteristics(Service, goNone, Chars);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	bool ReadableFound = false;
+	bool WritableFound = false;
+	bool NotifiableFound = false;
+	for (wclGattCharacteristics::iterator Char = Chars.begin(); Char != Chars.end(); Char++)
+	{
+		if (Char->Uuid.IsShortUuid)
+			continue;
+
+		if (IsEqualGUID(Char->Uuid.LongUuid, FProfile.ReadableChar))
+		{
+			FReadableChar = *Char;
+			ReadableFound = true;
+		}
+		else if (IsEqualGUID(Char->Uuid.LongUuid, FProfile.WritableChar))
 		{
-			// Service found. Try to find readable characteristic.
-			Uuid.LongUuid = READABLE_CHARACTERISTIC_UUID;
-			Res = FindCharacteristic(Service, Uuid, FReadableChar);
-			if (Res == WCL_E_SUCCESS)
-			{
-				// If readable characteristic found try to find writable one.
-				Uuid.LongUuid = WRITABLE_CHARACTERISTIC_UUID;
-				Res = FindCharacteristic(Service, Uuid, FWritableChar);
-				if (Res == WCL_E_SUCCESS)
-				{
-					// Ok, we got writable characteristic. Now try to find notifiable one.
-					Uuid.LongUuid = NOTIFIABLE_CHARACTERISTIC_UUID;
-					wclGattCharacteristic NotifiableChar;
-					Res = FindCharacteristic(Service, Uuid, NotifiableChar);
-					if (Res == WCL_E_SUCCESS)
-					{
-						// Notifiable characteristic found. Try to subscribe. We do not need to
-						// save the characteristic globally. It will be unsubscribed during disconnection.
-						Res = SubscribeForNotifications(NotifiableChar);
-
-						// If subscribed - set connected flag.
-						if (Res == WCL_E_SUCCESS)
-						{
-							EnterCriticalSection(&FCS);
-							__try
-							{
-								FConnected = true;
-							}
-							__finally
-							{
-								LeaveCriticalSection(&FCS);
-							}
-						}
-					}
-				}
-			}
+			FWritableChar = *Char;
+			WritableFound = true;
 		}
+		else if (IsEqualGUID(Char->Uuid.LongUuid, FProfile.NotifiableChar))
+		{
+			FNotifiableChar = *Char;
+			NotifiableFound = true;
+		}
+	}
+	if (!ReadableFound || !WritableFound || !NotifiableFound)
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
 
-		// If something went wrong we must disconnect!
-		if (Res != WCL_E_SUCCESS)
-			Disconnect();
+	// Notifiable characteristic found. Try to subscribe. It will be
+	// unsubscribed during disconnection. The characteristic is kept so its
+	// notified values can be looked up.
+	Res = SubscribeForNotifications(FNotifiableChar);
+
+	// Remember found attributes for the next connection.
+	if (Res == WCL_E_SUCCESS && FAttributeCache != NULL)
+	{
+		TAttributeCacheRecord Record;
+		Record.Service = Service;
+		Record.ReadableChar = FReadableChar;
+		Record.WritableChar = FWritableChar;
+		Record.NotifiableChar = FNotifiableChar;
+		FAttributeCache->Store(Address, Record);
+	}
+	return Res;
+}
+
+int CGattClient::ResolveAttributes()
+{
+	unsigned __int64 Started = GetTimestamp();
+
+	int Res = ResumeFromCache();
+	if (Res != WCL_E_SUCCESS)
+		Res = Discover();
+
+	if (Res == WCL_E_SUCCESS && FStats != NULL)
+		FStats->Discovered(GetTimestamp() - Started);
+	return Res;
+}
+
+void CGattClient::CompleteConnect(const int Error)
+{
+	// If subscribed - set connected flag.
+	if (Error == WCL_E_SUCCESS)
+	{
+		// MTU exchange is done by the OS when connection is established.
+		UpdateMaxPduSize();
+		UpdateConnectionParams();
+		UpdatePhy();
+		FPolicy->Configure(FPolicyParams, GetTickCount64());
+
+		EnterCriticalSection(&FCS);
+		__try
+		{
+			FConnected = true;
+		}
+		__finally
+		{
+			LeaveCriticalSection(&FCS);
+		}
 	}
 
 	// Call inherited method anyway so the OnConnect event fires.
-	CwclGattClient::DoConnect(Res);
+	CwclGattClient::DoConnect(Error);
+
+	// If something went wrong we must disconnect! The link is up even though
+	// we are not "connected". The OnDisconnect event comes after the OnConnect
+	// one and unlinks the client.
+	if (Error != WCL_E_SUCCESS)
+		CwclGattClient::Disconnect();
+}
+
+VOID CALLBACK CGattClient::_DiscoveryProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+	((CGattClient*)Context)->DiscoveryProc();
+}
+
+void CGattClient::DiscoveryProc()
+{
+	LONG Token;
+	if (EnterDispatch(Token))
+	{
+		// The pool's size limits the number of the discoveries running at
+		// the same time.
+		int Res = ResolveAttributes();
+
+		// Complete the connection on the receiver's thread so the OnConnect
+		// event fires where the other events do. If the receiver is closed
+		// nobody waits for the event there.
+		CDiscoveryMessage* Message = new CDiscoveryMessage(this, Res);
+		if (FDiscoveryReceiver->Post(Message) != WCL_E_SUCCESS)
+			CompleteConnect(Res);
+		Message->Release();
+
+		LeaveDispatch(Token);
+	}
+	// Release the reference taken when the work has been queued.
+	Release();
+}
+
+void CGattClient::CompleteDiscovery(const int Error)
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+		return;
+	CompleteConnect(Error);
+	LeaveDispatch(Token);
+}
+
+void CGattClient::DoConnect(const int Error)
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+	{
+		// Nobody uses the client anymore. Close the link it got: the
+		// disconnection event unlinks it.
+		if (Error == WCL_E_SUCCESS)
+			CwclGattClient::Disconnect();
+		else
+			Unlink();
+		return;
+	}
+
+	if (FStats != NULL)
+	{
+		if (Error == WCL_E_SUCCESS)
+			FStats->Connected(GetTimestamp() - FConnectStarted);
+		else
+			FStats->ConnectFailed();
+	}
+
+	// If connection failed simple call OnConnect event with error. No more
+	// events come for this connection.
+	if (Error != WCL_E_SUCCESS)
+	{
+		CwclGattClient::DoConnect(Error);
+		Unlink();
+	}
+	else
+	{
+		bool Queued = false;
+		// If the executor is set run discovery there so discovery of many
+		// clients overlaps.
+		if (FDiscoveryPool != NULL && FDiscoveryReceiver != NULL)
+		{
+			// The work item holds its own reference.
+			AddRef();
+			Queued = FDiscoveryPool->Submit(_DiscoveryProc, this);
+			if (!Queued)
+				Release();
+		}
+
+		// Otherwise discover right here.
+		if (!Queued)
+			CompleteConnect(ResolveAttributes());
+	}
+
+	LeaveDispatch(Token);
 }
 
 void CGattClient::DoDisconnect(const int Reason)
 {
+	LONG Token;
+	if (!EnterDispatch(Token))
+	{
+		Unlink();
+		return;
+	}
+
 	// Make sure that we were "connected".
 	if (FConnected)
 	{
@@ -85,11 +297,92 @@ void CGattClient::DoDisconnect(const int Reason)
 
 	// Call the inherited method to fire the OnDisconnect event.
 	CwclGattClient::DoDisconnect(Reason);
+	// This is the last event of the connection.
+	Unlink();
+
+	LeaveDispatch(Token);
+}
+
+void CGattClient::DoCharacteristicChanged(const unsigned short Handle,
+	const unsigned char* const Value, const unsigned long Length)
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+		return;
+	CountRx(Length);
+	unsigned __int64 Timestamp = GetTimestamp();
+	if (FStats != NULL)
+		FStats->Notified(Timestamp, Length);
+	// Segments of the framed messages are not values. The values are cached
+	// under the handle they came from: usually the notifiable characteristic,
+	// not the readable one.
+	if (FReassembler == NULL)
+		FValues->Put(Handle, Value, Length, Timestamp);
+	CwclGattClient::DoCharacteristicChanged(Handle, Value, Length);
+	LeaveDispatch(Token);
+}
+
+void CGattClient::DoMaxPduSizeChanged()
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+		return;
+	UpdateMaxPduSize();
+	CwclGattClient::DoMaxPduSizeChanged();
+	LeaveDispatch(Token);
 }
 
-CGattClient::CGattClient() : CwclGattClient()
+void CGattClient::DoConnectionParamsChanged()
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+		return;
+	UpdateConnectionParams();
+	CwclGattClient::DoConnectionParamsChanged();
+	LeaveDispatch(Token);
+}
+
+void CGattClient::DoConnectionPhyChanged()
+{
+	LONG Token;
+	if (!EnterDispatch(Token))
+		return;
+	UpdatePhy();
+	CwclGattClient::DoConnectionPhyChanged();
+	LeaveDispatch(Token);
+}
+
+CGattClient::CGattClient(CClientReclaimer* const Reclaimer) : CwclGattClient()
 {
 	FConnected = false;
+	FRefCount = 1;
+	FReclaimer = Reclaimer;
+	FLinked = 0;
+	FDiscoveryPool = NULL;
+	FDiscoveryReceiver = NULL;
+	FAttributeCache = NULL;
+	FMaxPduSize = 0;
+	FReassembler = NULL;
+	FMessageId = 0;
+	FPolicy = new CConnectionPolicy();
+	CConnectionPolicy::GetDefaultParams(FPolicyParams);
+	ZeroMemory(&FConnectionParams, sizeof(wclBluetoothLeConnectionParameters));
+	ZeroMemory(&FNotifiableChar, sizeof(wclGattCharacteristic));
+	FConnectionParamsKnown = false;
+	FStats = NULL;
+	FConnectStarted = 0;
+	FConnectionRadio = NULL;
+	FReadCoalescer = new CReadCoalescer();
+	FValues = new CValueCache();
+	FProfile = DEFAULT_CLIENT_PROFILE;
+	FRule = -1;
+	FTxPhy = lpUnknown;
+	FRxPhy = lpUnknown;
+	for (int i = 0; i < LE_PHY_COUNT; i++)
+	{
+		FTxBytes[i] = 0;
+		FRxBytes[i] = 0;
+	}
 
 	InitializeCriticalSection(&FCS);
 }
@@ -98,9 +391,103 @@ CGattClient::~CGattClient()
 {
 	Disconnect();
 
+	if (FReassembler != NULL)
+		delete FReassembler;
+	delete FPolicy;
+	delete FReadCoalescer;
+	delete FValues;
+
 	DeleteCriticalSection(&FCS);
 }
 
+LONG CGattClient::AddRef()
+{
+	return InterlockedIncrement(&FRefCount);
+}
+
+bool CGattClient::TryAddRef()
+{
+	LONG Count = FRefCount;
+	while (Count > 0)
+	{
+		LONG Current = InterlockedCompareExchange(&FRefCount, Count + 1, Count);
+		if (Current == Count)
+			return true;
+		Count = Current;
+	}
+	return false;
+}
+
+bool CGattClient::IsLinked() const
+{
+	return (FLinked != 0);
+}
+
+LONG CGattClient::Release()
+{
+	LONG Res = InterlockedDecrement(&FRefCount);
+	if (Res == 0)
+	{
+		// We may be inside our own event handler here. Let the reclaimer destroy
+		// the client later.
+		if (FReclaimer != NULL)
+			FReclaimer->Retire(this);
+		else
+			delete this;
+	}
+	return Res;
+}
+
+int CGattClient::SetDiscoveryExecutor(CWorkPool* const Pool,
+	CwclMessageReceiver* const Receiver)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FDiscoveryPool = Pool;
+	FDiscoveryReceiver = Receiver;
+	return WCL_E_SUCCESS;
+}
+
+int CGattClient::SetAttributeCache(CAttributeCache* const Cache)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FAttributeCache = Cache;
+	return WCL_E_SUCCESS;
+}
+
+int CGattClient::SetProfile(const TClientProfile& Profile)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FProfile = Profile;
+	return WCL_E_SUCCESS;
+}
+
+void CGattClient::GetProfile(TClientProfile& Profile) const
+{
+	Profile = FProfile;
+}
+
+int CGattClient::SetMatch(const tstring& Name, const int Rule)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FName = Name;
+	FRule = Rule;
+	return WCL_E_SUCCESS;
+}
+
+void CGattClient::GetMatch(tstring& Name, int& Rule) const
+{
+	Name = FName;
+	Rule = FRule;
+}
+
 // Override connect method. We need it for thread synchronization.
 int CGattClient::Connect(const __int64 Address, CwclBluetoothRadio* const Radio)
 {
@@ -114,7 +501,14 @@ int CGattClient::Connect(const __int64 Address, CwclBluetoothRadio* const Radio)
 			return WCL_E_CONNECTION_ACTIVE;
 
 		this->Address = Address;
-		return CwclGattClient::Connect(Radio);
+		FConnectStarted = GetTimestamp();
+		FConnectionRadio = Radio;
+		// The events may fire before Connect returns.
+		InterlockedExchange(&FLinked, 1);
+		int Res = CwclGattClient::Connect(Radio);
+		if (Res != WCL_E_SUCCESS)
+			InterlockedExchange(&FLinked, 0);
+		return Res;
 	}
 	__finally
 	{
@@ -122,6 +516,11 @@ int CGattClient::Connect(const __int64 Address, CwclBluetoothRadio* const Radio)
 	}
 }
 
+CwclBluetoothRadio* CGattClient::GetConnectionRadio() const
+{
+	return FConnectionRadio;
+}
+
 // Override disconnect method. We need it for thread synchronization.
 int CGattClient::Disconnect()
 {
@@ -139,19 +538,148 @@ int CGattClient::Disconnect()
 	}
 }
 
-int CGattClient::ReadValue(unsigned char*& Value, unsigned long& Length)
+int CGattClient::ReadFromDevice(unsigned char*& Value, unsigned long& Length)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FConnected)
+			return WCL_E_CONNECTION_CLOSED;
+
+		// Always use Read From Device.
+		unsigned __int64 Started = GetTimestamp();
+		int Res = ReadCharacteristicValue(FReadableChar, goReadFromDevice, Value, Length);
+		if (FStats != NULL)
+			FStats->Read(Res, GetTimestamp() - Started, Length);
+		if (Res == WCL_E_SUCCESS)
+		{
+			CountRx(Length);
+			// The device could change the value while the request was in
+			// flight so the value is as old as the request.
+			FValues->Put(FReadableChar.ValueHandle, Value, Length, Started);
+		}
+		return Res;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+int CGattClient::ReadValue(unsigned char*& Value, unsigned long& Length,
+	const unsigned long MaxAge)
 {
 	Value = NULL;
 	Length = 0;
 
+	if (MaxAge > 0 && FConnected && FValues->Get(FReadableChar.ValueHandle, MaxAge, Value, Length))
+	{
+		if (FStats != NULL)
+			FStats->Cached();
+		return WCL_E_SUCCESS;
+	}
+
+	NoteActivity();
+
+	// Join the read in flight instead of queueing for the air behind it.
+	TReaderRole Role = FReadCoalescer->Begin();
+	if (Role == rrFollower)
+	{
+		int Res = FReadCoalescer->Wait(Value, Length);
+		if (FStats != NULL)
+			FStats->Coalesced(Res);
+		return Res;
+	}
+
+	int Res = ReadFromDevice(Value, Length);
+	if (Role == rrLeader)
+		FReadCoalescer->Complete(Res, Value, Length);
+	return Res;
+}
+
+int CGattClient::ReadValue(unsigned char* const Buffer, const unsigned long Size,
+	unsigned long& Length, const unsigned long MaxAge)
+{
+	Length = 0;
+	if (Buffer == NULL || Size == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	// The fresh value is copied right into the buffer. If it does not fit the
+	// device's value would not fit either: report the required length.
+	if (MaxAge > 0 && FConnected && FValues->Get(FReadableChar.ValueHandle, MaxAge, Buffer, Size, Length))
+	{
+		if (Length > Size)
+			return BUFFER_POOL_E_BUFFER_TOO_SMALL;
+		if (FStats != NULL)
+			FStats->Cached();
+		return WCL_E_SUCCESS;
+	}
+
+	// The library always returns the value in its own heap buffer. Copy it and
+	// free right here so the caller does not deal with the heap at all.
+	unsigned char* Value;
+	int Res = ReadValue(Value, Length);
+	if (Res == WCL_E_SUCCESS)
+	{
+		if (Length > Size)
+			Res = BUFFER_POOL_E_BUFFER_TOO_SMALL;
+		else
+		{
+			if (Length > 0)
+				memcpy(Buffer, Value, Length);
+		}
+	}
+	if (Value != NULL)
+		free(Value);
+	return Res;
+}
+
+int CGattClient::GetCachedValue(const unsigned short Handle, const unsigned long MaxAge,
+	unsigned char*& Value, unsigned long& Length)
+{
+	Value = NULL;
+	Length = 0;
+
+	if (!FConnected)
+		return WCL_E_CONNECTION_CLOSED;
+	if (MaxAge == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	if (!FValues->Get(Handle, MaxAge, Value, Length))
+		return VALUE_CACHE_E_NO_FRESH_VALUE;
+	if (FStats != NULL)
+		FStats->Cached();
+	return WCL_E_SUCCESS;
+}
+
+int CGattClient::GetNotifiedValue(const unsigned long MaxAge, unsigned char*& Value,
+	unsigned long& Length)
+{
+	return GetCachedValue(FNotifiableChar.ValueHandle, MaxAge, Value, Length);
+}
+
+int CGattClient::WriteValue(const unsigned char* const Value, const unsigned long Length)
+{
+	if (Value == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	NoteActivity();
+
 	EnterCriticalSection(&FCS);
 	__try
 	{
 		if (!FConnected)
 			return WCL_E_CONNECTION_CLOSED;
 
-		// Always use Read From Device.
-		return ReadCharacteristicValue(FReadableChar, goReadFromDevice, Value, Length);
+		// The characteristic supports Write Without Response for streaming.
+		// Simple write must always be confirmed.
+		unsigned __int64 Started = GetTimestamp();
+		int Res = WriteCharacteristicValue(FWritableChar, Value, Length, plNone, wkWithResponse);
+		if (FStats != NULL)
+			FStats->Written(Res, GetTimestamp() - Started, Length, true);
+		if (Res == WCL_E_SUCCESS)
+			CountTx(Length);
+		return Res;
 	}
 	__finally
 	{
@@ -159,21 +687,426 @@ int CGattClient::ReadValue(unsigned char*& Value, unsigned long& Length)
 	}
 }
 
-int CGattClient::WriteValue(const unsigned char* const Value, const unsigned long Length)
+int CGattClient::WriteChunk(const unsigned char* const Value, const unsigned long Length,
+	const wclGattWriteKind Kind)
+{
+	NoteActivity();
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FConnected)
+			return WCL_E_CONNECTION_CLOSED;
+
+		unsigned __int64 Started = GetTimestamp();
+		int Res = WriteCharacteristicValue(FWritableChar, Value, Length, plNone, Kind);
+		if (FStats != NULL)
+			FStats->Written(Res, GetTimestamp() - Started, Length, Kind == wkWithResponse);
+		if (Res == WCL_E_SUCCESS)
+			CountTx(Length);
+		return Res;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CGattClient::UpdateMaxPduSize()
+{
+	unsigned short Mtu;
+	if (GetMaxPduSize(Mtu) == WCL_E_SUCCESS)
+		FMaxPduSize = Mtu;
+}
+
+int CGattClient::GetChunkSize(unsigned short& Size)
+{
+	// Default ATT MTU.
+	Size = 23 - 3;
+
+	int Res = WCL_E_SUCCESS;
+	if (FMaxPduSize == 0)
+	{
+		unsigned short Mtu;
+		Res = GetMaxPduSize(Mtu);
+		if (Res == WCL_E_SUCCESS)
+			FMaxPduSize = Mtu;
+	}
+
+	// ATT Write Command header takes 3 bytes. The attribute value can not be
+	// longer than 512 bytes.
+	if (FMaxPduSize > 23)
+		Size = FMaxPduSize - 3;
+	if (Size > MAX_ATTRIBUTE_VALUE_LENGTH)
+		Size = MAX_ATTRIBUTE_VALUE_LENGTH;
+	return Res;
+}
+
+int CGattClient::StreamValue(const unsigned char* const Value, const unsigned long Length,
+	const unsigned long Window, TStreamStats& Stats)
 {
+	ZeroMemory(&Stats, sizeof(TStreamStats));
+
 	if (Value == NULL || Length == 0)
 		return WCL_E_INVALID_ARGUMENT;
+	if (!FConnected)
+		return WCL_E_CONNECTION_CLOSED;
+	if (!FWritableChar.IsWritableWithoutResponse)
+		return WCL_E_BLUETOOTH_LE_WRITE_WITHOUT_RESPONSE_NOT_SUPPORTED;
+
+	unsigned short ChunkSize;
+	// If MTU is unknown use the default one.
+	GetChunkSize(ChunkSize);
+	Stats.ChunkSize = ChunkSize;
+
+	unsigned long Checkpoint = Window;
+	if (Checkpoint == 0)
+		Checkpoint = DEFAULT_STREAM_WINDOW;
+
+	int Res = WCL_E_SUCCESS;
+	unsigned __int64 Started = GetTimestamp();
+	while (Stats.Bytes < Length)
+	{
+		unsigned long Size = Length - Stats.Bytes;
+		if (Size > ChunkSize)
+			Size = ChunkSize;
+
+		// Flow control: wait for the response on each window boundary and on
+		// the last chunk.
+		wclGattWriteKind Kind = wkWithoutResponse;
+		if ((Stats.Chunks + 1) % Checkpoint == 0 || Stats.Bytes + Size == Length)
+			Kind = wkWithResponse;
 
+		// Each chunk takes the client's lock on its own so reads of this
+		// device can run between the chunks.
+		Res = WriteChunk(Value + Stats.Bytes, Size, Kind);
+		if (Res != WCL_E_SUCCESS)
+			break;
+
+		Stats.Bytes += Size;
+		Stats.Chunks++;
+	}
+
+	Stats.Duration = GetTimestamp() - Started;
+	if (Stats.Duration > 0)
+		Stats.Throughput = (unsigned long)(Stats.Bytes * 1000000ULL / Stats.Duration);
+	return Res;
+}
+
+void CGattClient::NoteActivity()
+{
+	if (!FConnected)
+		return;
+
+	TConnectionProfile Profile;
+	if (FPolicy->Activity(GetTickCount64(), Profile))
+		ApplyProfile(Profile);
+}
+
+void CGattClient::ApplyProfile(const TConnectionProfile Profile)
+{
+	int Res;
+	if (Profile == cpThroughput)
+		Res = SetConnectionParams(ppThroughputOptimized);
+	else
+	{
+		if (Profile == cpPowerSaving)
+			Res = SetConnectionParams(ppPowerOptimized);
+		else
+			Res = SetConnectionParams(ppBalanced);
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		// Parameters change needs Windows 11. Do not try again.
+		if (Res == WCL_E_BLUETOOTH_LE_FEATURE_NOT_SUPPORTED)
+			FPolicy->Disable();
+		else
+			FPolicy->Failed(Profile);
+	}
+}
+
+void CGattClient::UpdateConnectionParams()
+{
+	wclBluetoothLeConnectionParameters Params;
+	if (GetConnectionParams(Params) != WCL_E_SUCCESS)
+		return;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FConnectionParams = Params;
+		FConnectionParamsKnown = true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+int CGattClient::SetConnectionPolicy(const TConnectionPolicyParams& Params)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FPolicyParams = Params;
+	return WCL_E_SUCCESS;
+}
+
+void CGattClient::UpdateConnectionPolicy()
+{
+	if (!FConnected)
+		return;
+
+	TConnectionProfile Profile;
+	if (FPolicy->Check(GetTickCount64(), Profile))
+		ApplyProfile(Profile);
+}
+
+int CGattClient::GetCurrentConnectionParams(wclBluetoothLeConnectionParameters& Params)
+{
 	EnterCriticalSection(&FCS);
 	__try
 	{
 		if (!FConnected)
 			return WCL_E_CONNECTION_CLOSED;
+		if (!FConnectionParamsKnown)
+			return WCL_E_BLUETOOTH_LE_FEATURE_NOT_SUPPORTED;
 
-		return WriteCharacteristicValue(FWritableChar, Value, Length);
+		Params = FConnectionParams;
+		return WCL_E_SUCCESS;
 	}
 	__finally
 	{
 		LeaveCriticalSection(&FCS);
 	}
+}
+
+TConnectionProfile CGattClient::GetConnectionProfile() const
+{
+	return FPolicy->GetProfile();
+}
+
+TLePhy CGattClient::PhyFromInfo(const wclBluetoothLeConnectionPhyInfo& Info)
+{
+	if (Info.IsUncoded2MPhy)
+		return lp2M;
+	if (Info.IsUncoded1MPhy)
+		return lp1M;
+	if (Info.IsCoded)
+		return lpCoded;
+	return lpUnknown;
+}
+
+void CGattClient::UpdatePhy()
+{
+	// Needs Windows 11. On older systems PHY stays unknown.
+	wclBluetoothLeConnectionPhy Phy;
+	if (GetConnectionPhyInfo(Phy) == WCL_E_SUCCESS)
+	{
+		InterlockedExchange(&FTxPhy, PhyFromInfo(Phy.Transmit));
+		InterlockedExchange(&FRxPhy, PhyFromInfo(Phy.Receive));
+	}
+}
+
+void CGattClient::CountTx(const unsigned long Length)
+{
+	InterlockedExchangeAdd64(&FTxBytes[FTxPhy], Length);
+}
+
+void CGattClient::CountRx(const unsigned long Length)
+{
+	InterlockedExchangeAdd64(&FRxBytes[FRxPhy], Length);
+}
+
+int CGattClient::SetStatistics(CConnectionStats* const Stats)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	FStats = Stats;
+	return WCL_E_SUCCESS;
+}
+
+int CGattClient::GetConnectionInfo(TConnectionInfo& Info)
+{
+	ZeroMemory(&Info, sizeof(TConnectionInfo));
+
+	Info.MaxPduSize = FMaxPduSize;
+	Info.Profile = FPolicy->GetProfile();
+	Info.TxPhy = (TLePhy)FTxPhy;
+	Info.RxPhy = (TLePhy)FRxPhy;
+	for (int i = 0; i < LE_PHY_COUNT; i++)
+	{
+		Info.TxBytes[i] = FTxBytes[i];
+		Info.RxBytes[i] = FRxBytes[i];
+	}
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FConnected)
+			return WCL_E_CONNECTION_CLOSED;
+
+		Info.ParamsKnown = FConnectionParamsKnown;
+		Info.Params = FConnectionParams;
+		return WCL_E_SUCCESS;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+int CGattClient::SetFraming(const bool Enabled)
+{
+	if (State != csDisconnected)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	if (FReassembler != NULL)
+	{
+		delete FReassembler;
+		FReassembler = NULL;
+	}
+	if (Enabled)
+		FReassembler = new CFrameReassembler();
+	return WCL_E_SUCCESS;
+}
+
+CFrameReassembler* CGattClient::GetReassembler() const
+{
+	return FReassembler;
+}
+
+int CGattClient::WriteMessage(const unsigned char* const Message, const unsigned long Length,
+	const unsigned long Window, TStreamStats& Stats)
+{
+	ZeroMemory(&Stats, sizeof(TStreamStats));
+
+	if (Message == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	if (!FConnected)
+		return WCL_E_CONNECTION_CLOSED;
+
+	unsigned short SegmentSize;
+	GetChunkSize(SegmentSize);
+	Stats.ChunkSize = SegmentSize;
+
+	CFrameSegmenter Segmenter;
+	int Res = Segmenter.Init(Message, Length, SegmentSize,
+		(unsigned char)InterlockedIncrement(&FMessageId));
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	unsigned long Checkpoint = Window;
+	if (Checkpoint == 0)
+		Checkpoint = DEFAULT_STREAM_WINDOW;
+	// If the device does not support Write Without Response each segment is
+	// confirmed.
+	bool Streaming = FWritableChar.IsWritableWithoutResponse;
+
+	unsigned char Segment[MAX_ATTRIBUTE_VALUE_LENGTH];
+	unsigned long SegmentLength;
+	bool Last;
+	unsigned __int64 Started = GetTimestamp();
+	while (Segmenter.Next(Segment, SegmentLength, Last))
+	{
+		wclGattWriteKind Kind = wkWithResponse;
+		if (Streaming && !Last && (Stats.Chunks + 1) % Checkpoint != 0)
+			Kind = wkWithoutResponse;
+
+		Res = WriteChunk(Segment, SegmentLength, Kind);
+		if (Res != WCL_E_SUCCESS)
+			break;
+
+		Stats.Bytes += SegmentLength;
+		Stats.Chunks++;
+	}
+
+	Stats.Duration = GetTimestamp() - Started;
+	if (Stats.Duration > 0)
+		Stats.Throughput = (unsigned long)(Stats.Bytes * 1000000ULL / Stats.Duration);
+	return Res;
+}
+
+CDiscoveryMessage::CDiscoveryMessage(CGattClient* const Client, const int Result)
+	: CwclMessage(GATT_CLIENT_MSG_DISCOVERED, GATT_CLIENT_MSG_CATEGORY)
+{
+	FClient = Client;
+	FClient->AddRef();
+	FResult = Result;
+}
+
+CDiscoveryMessage::~CDiscoveryMessage()
+{
+	FClient->Release();
+}
+
+CGattClient* CDiscoveryMessage::GetClient() const
+{
+	return FClient;
+}
+
+int CDiscoveryMessage::GetResult() const
+{
+	return FResult;
+}
+
+CGattClientRef::CGattClientRef()
+{
+	FClient = NULL;
+}
+
+CGattClientRef::CGattClientRef(CGattClient* const Client)
+{
+	FClient = Client;
+	if (FClient != NULL)
+		FClient->AddRef();
+}
+
+CGattClientRef::CGattClientRef(const CGattClientRef& Ref)
+{
+	FClient = Ref.FClient;
+	if (FClient != NULL)
+		FClient->AddRef();
+}
+
+CGattClientRef::~CGattClientRef()
+{
+	Reset();
+}
+
+CGattClientRef& CGattClientRef::operator=(const CGattClientRef& Ref)
+{
+	Assign(Ref.FClient);
+	return *this;
+}
+
+CGattClient* CGattClientRef::operator->() const
+{
+	return FClient;
+}
+
+void CGattClientRef::Assign(CGattClient* const Client)
+{
+	// Take new reference first: the Client may be the same object.
+	if (Client != NULL)
+		Client->AddRef();
+	Reset();
+	FClient = Client;
+}
+
+void CGattClientRef::Reset()
+{
+	if (FClient != NULL)
+	{
+		CGattClient* Client = FClient;
+		FClient = NULL;
+		Client->Release();
+	}
+}
+
+CGattClient* CGattClientRef::Get() const
+{
+	return FClient;
 }
\ No newline at end of file
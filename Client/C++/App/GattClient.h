@@ -2,6 +2,16 @@
 
 #include "wclBluetooth.h"
 
+#include "AttributeCache.h"
+#include "BufferPool.h"
+#include "ConnectionPolicy.h"
+#include "ConnectionStats.h"
+#include "Framing.h"
+#include "ReadCoalescer.h"
+#include "ValueCache.h"
+#include "WorkPool.h"
+#include "ClientReclaimer.h"
+
 using namespace wclCommon;
 using namespace wclCommunication;
 using namespace wclBluetooth;
@@ -14,6 +24,73 @@ const GUID READABLE_CHARACTERISTIC_UUID = { 0x468dfe19, 0x8de3, 0x4181, 0xb7, 0x
 const GUID WRITABLE_CHARACTERISTIC_UUID = { 0x421754b0, 0xe70a, 0x42c9, 0x90, 0xed, 0x4a, 0xed, 0x82, 0xfa, 0x7a, 0xc0 };
 #pragma endregion Attribute UUIDs
 
+// The attributes the client works with. Devices of different kinds have
+// different GATT tables: the profile tells the client which service and
+// characteristics to use.
+typedef struct
+{
+	GUID	Service;
+	GUID	ReadableChar;
+	GUID	WritableChar;
+	GUID	NotifiableChar;
+} TClientProfile;
+
+// The profile of our server.
+const TClientProfile DEFAULT_CLIENT_PROFILE = { SERVICE_UUID, READABLE_CHARACTERISTIC_UUID,
+	WRITABLE_CHARACTERISTIC_UUID, NOTIFIABLE_CHARACTERISTIC_UUID };
+
+// Default number of Write Without Response chunks sent between two flow
+// control checkpoints.
+const unsigned long DEFAULT_STREAM_WINDOW = 16;
+
+// Streaming write statistics.
+typedef struct
+{
+	// Number of bytes and chunks actually written.
+	unsigned long		Bytes;
+	unsigned long		Chunks;
+	// The chunk size used (MTU - 3).
+	unsigned short		ChunkSize;
+	// Time spent for the stream in microseconds.
+	unsigned __int64	Duration;
+	// Bytes per second.
+	unsigned long		Throughput;
+} TStreamStats;
+
+// Bluetooth LE physical layer.
+typedef enum
+{
+	lpUnknown,
+	lp1M,
+	lp2M,
+	lpCoded
+} TLePhy;
+
+const int LE_PHY_COUNT = 4;
+
+// Connection information and traffic statistics.
+typedef struct
+{
+	// Negotiated ATT MTU. Zero if unknown.
+	unsigned short						MaxPduSize;
+	// The connection parameters in effect.
+	bool								ParamsKnown;
+	wclBluetoothLeConnectionParameters	Params;
+	// The profile requested by the connection parameters policy.
+	TConnectionProfile					Profile;
+	// Active PHYs. Unknown if the OS does not report them (Windows 10).
+	TLePhy								TxPhy;
+	TLePhy								RxPhy;
+	// Value bytes transferred on each PHY, indexed by TLePhy.
+	unsigned __int64					TxBytes[LE_PHY_COUNT];
+	unsigned __int64					RxBytes[LE_PHY_COUNT];
+} TConnectionInfo;
+
+// The category of the messages the client posts to its discovery receiver.
+const unsigned char GATT_CLIENT_MSG_CATEGORY = WCL_MSG_CATEGORY_USER + 1;
+// The discovery run by the executor completed (see CDiscoveryMessage).
+const unsigned char GATT_CLIENT_MSG_DISCOVERED = 1;
+
 class CGattClient : public CwclGattClient
 {
 	DISABLE_COPY(CGattClient);
@@ -22,13 +99,109 @@ private:
 #pragma region Private fields
 	bool					FConnected;
 	RTL_CRITICAL_SECTION	FCS;
+	volatile LONG			FRefCount;
+	CClientReclaimer*		FReclaimer;
+	// Not zero from Connect until the last event of the connection.
+	volatile LONG			FLinked;
+	// Discovery executor and the receiver that completes the connection on
+	// its owner's thread. NULL if discovery runs in the connection event.
+	CWorkPool*				FDiscoveryPool;
+	CwclMessageReceiver*	FDiscoveryReceiver;
+	CAttributeCache*		FAttributeCache;
+	// Negotiated ATT MTU. Zero if unknown.
+	volatile unsigned short	FMaxPduSize;
+	// Not NULL if framing is enabled.
+	CFrameReassembler*		FReassembler;
+	volatile LONG			FMessageId;
+	// Connection parameters management.
+	CConnectionPolicy*		FPolicy;
+	TConnectionPolicyParams	FPolicyParams;
+	wclBluetoothLeConnectionParameters	FConnectionParams;
+	bool					FConnectionParamsKnown;
+	// PHY tracking and per-PHY traffic accounting.
+	volatile LONG			FTxPhy;
+	volatile LONG			FRxPhy;
+	volatile LONG64			FTxBytes[LE_PHY_COUNT];
+	volatile LONG64			FRxBytes[LE_PHY_COUNT];
+	// Latency statistics. NULL if not collected.
+	CConnectionStats*		FStats;
+	unsigned __int64		FConnectStarted;
+	// The radio the connection was started through.
+	CwclBluetoothRadio*		FConnectionRadio;
+	// Concurrent reads share single read from the device.
+	CReadCoalescer*			FReadCoalescer;
+	// Last values of the characteristics from the reads and the
+	// notifications, each under its own handle.
+	CValueCache*			FValues;
 
 #pragma region Attributes
+	TClientProfile			FProfile;
+	// The advertised name and the match rule the client was created for.
+	tstring					FName;
+	int						FRule;
 	wclGattCharacteristic	FReadableChar;
 	wclGattCharacteristic	FWritableChar;
+	wclGattCharacteristic	FNotifiableChar;
 #pragma endregion Attributes
 #pragma endregion Private fields
 
+#pragma region Attributes discovery
+	// Tries to subscribe using the cached attribute handles. If it fails the
+	// cached record is dropped.
+	int ResumeFromCache();
+	// Finds the service and reads all its characteristics with single request,
+	// then subscribes to the notifiable characteristic.
+	int Discover();
+	// Uses cached attributes if possible. Otherwise runs full discovery.
+	int ResolveAttributes();
+	// Sets the connected flag and fires the OnConnect event.
+	void CompleteConnect(const int Error);
+
+	static VOID CALLBACK _DiscoveryProc(PTP_CALLBACK_INSTANCE Instance, PVOID Context);
+	void DiscoveryProc();
+#pragma endregion Attributes discovery
+
+#pragma region Reading
+	// Reads the readable characteristic from the device.
+	int ReadFromDevice(unsigned char*& Value, unsigned long& Length);
+#pragma endregion Reading
+
+#pragma region Streaming
+	// Writes single chunk to the writable characteristic.
+	int WriteChunk(const unsigned char* const Value, const unsigned long Length,
+		const wclGattWriteKind Kind);
+	// Reads the negotiated MTU from the connection.
+	void UpdateMaxPduSize();
+#pragma endregion Streaming
+
+#pragma region Connection parameters
+	// Reports the operation to the connection policy and applies the profile
+	// if the policy asks for it.
+	void NoteActivity();
+	void ApplyProfile(const TConnectionProfile Profile);
+	// Reads the current connection parameters from the connection.
+	void UpdateConnectionParams();
+#pragma endregion Connection parameters
+
+#pragma region PHY tracking
+	static TLePhy PhyFromInfo(const wclBluetoothLeConnectionPhyInfo& Info);
+	// Reads the active PHYs from the connection.
+	void UpdatePhy();
+	// Counts transferred bytes on the active PHY.
+	void CountTx(const unsigned long Length);
+	void CountRx(const unsigned long Length);
+#pragma endregion PHY tracking
+
+#pragma region Dispatch protection
+	// Keep the client alive while its event is dispatched. Returns false if
+	// the client has already been released: the event must be ignored then.
+	bool EnterDispatch(LONG& Token);
+	void LeaveDispatch(const LONG Token);
+	// Called after the last event of the connection. The library does not
+	// dispatch the client's events anymore so the reclaimer may destroy it.
+	void Unlink();
+#pragma endregion Dispatch protection
+
 protected:
 #pragma region GATT Client overrides
 	// The method called when connection procedure completed (with or without success).
@@ -41,25 +214,200 @@ protected:
 	// The method called when the remote device disconnected. The Reason parameter
 	// indicates disconnection reason.
 	virtual void DoDisconnect(const int Reason) override;
+	// The method called when characteristic value changed. Overridden only to
+	// protect the client from destroying during the event dispatch.
+	virtual void DoCharacteristicChanged(const unsigned short Handle,
+		const unsigned char* const Value, const unsigned long Length) override;
+	// The method called when the MTU has been changed. Updates the segment
+	// size used by streaming and framing.
+	virtual void DoMaxPduSizeChanged() override;
+	// The method called when the connection parameters have been changed.
+	// Updates the cached parameters.
+	virtual void DoConnectionParamsChanged() override;
+	// The method called when the PHY has been changed. Updates the active PHYs.
+	virtual void DoConnectionPhyChanged() override;
 #pragma endregion GATT Client overrides
 
 public:
 #pragma region Constructor and Destructor
-	CGattClient();
+	// New client has reference count 1. Do not delete the client directly, use
+	// Release instead. If the Reclaimer is not NULL the client is retired
+	// to it when the last reference is released. Otherwise the client is
+	// destroyed immediately.
+	CGattClient(CClientReclaimer* const Reclaimer = NULL);
 	virtual ~CGattClient();
 #pragma endregion Constructor and Destructor
 
+#pragma region Reference counting
+	// Increments the reference count. Returns new value.
+	LONG AddRef();
+	// Increments the reference count only if the client still has any
+	// reference. Returns false if the client is being destroyed.
+	bool TryAddRef();
+	// Decrements the reference count and destroys the client when it reaches
+	// zero. Returns new value.
+	LONG Release();
+	// Returns true while the library may fire the client's events: from the
+	// successful Connect call until the OnDisconnect event or the failed
+	// OnConnect event. The reclaimer does not destroy the linked client.
+	bool IsLinked() const;
+#pragma endregion Reference counting
+
 #pragma region Connection and disconnection
+	// Sets the executor of the attributes discovery. The discovery runs on
+	// the Pool so the pool's size limits the number of clients discovering at
+	// the same time. The result is posted to the Receiver and the connection
+	// is completed (and the OnConnect event fires) when the receiver's owner
+	// passes the CDiscoveryMessage to CompleteDiscovery. If the pool or the
+	// receiver is closed the discovery runs in the connection event. Both
+	// must outlive the client. Must be called before Connect.
+	int SetDiscoveryExecutor(CWorkPool* const Pool, CwclMessageReceiver* const Receiver);
+	// Completes the connection with the result of the discovery. Must be
+	// called from the receiver's thread.
+	void CompleteDiscovery(const int Error);
+	// Sets the attribute handles cache. If the cache has the record for the
+	// device the client skips discovery and only subscribes. Must be called
+	// before Connect.
+	int SetAttributeCache(CAttributeCache* const Cache);
+	// Sets the service and the characteristics the client uses. The default
+	// profile is our server's one. Must be called before Connect.
+	int SetProfile(const TClientProfile& Profile);
+	void GetProfile(TClientProfile& Profile) const;
+	// Sets the device's advertised name (empty if unknown) and the index of
+	// the match rule the client was created for. Must be called before
+	// Connect.
+	int SetMatch(const tstring& Name, const int Rule);
+	void GetMatch(tstring& Name, int& Rule) const;
 	// Override connect method. We need it for thread synchronization.
 	int Connect(const __int64 Address, CwclBluetoothRadio* const Radio);
+	// Returns the radio passed to the last Connect call or NULL.
+	CwclBluetoothRadio* GetConnectionRadio() const;
 	// Override disconnect method. We need it for thread synchronization.
 	int Disconnect();
 #pragma endregion Connection and disconnection
 
 #pragma region Reading and writing values
-	// Simple read value from the readable characteristic.
-	int ReadValue(unsigned char*& Value, unsigned long& Length);
+	// Simple read value from the readable characteristic. The callers that
+	// come while other caller's read is in flight do not send own requests:
+	// they wait for that read and get the same result. If MaxAge is not zero
+	// and the value was read or notified not more than MaxAge milliseconds
+	// ago it is returned without the request to the device.
+	int ReadValue(unsigned char*& Value, unsigned long& Length,
+		const unsigned long MaxAge = 0);
+	// Reads value from the readable characteristic into the caller's buffer.
+	// If the buffer is too small BUFFER_POOL_E_BUFFER_TOO_SMALL is returned
+	// and Length receives the required size.
+	int ReadValue(unsigned char* const Buffer, const unsigned long Size,
+		unsigned long& Length, const unsigned long MaxAge = 0);
 	// Simple write value to the writable characteristic.
 	int WriteValue(const unsigned char* const Value, const unsigned long Length);
+
+	// Returns the maximum value length that fits into the single ATT PDU. The
+	// negotiated MTU is used if it is known.
+	int GetChunkSize(unsigned short& Size);
+	// Writes large value as the sequence of chunks of the GetChunkSize length
+	// using Write Without Response. Each Window-th chunk and the last chunk are
+	// written with response: the response to the write request confirms that
+	// all the commands sent before it have been delivered, so the stream never
+	// outruns the device by more than Window chunks. Zero Window means the
+	// default one. The Stats are filled even if the stream fails.
+	int StreamValue(const unsigned char* const Value, const unsigned long Length,
+		const unsigned long Window, TStreamStats& Stats);
+
+	// Returns the last value of the characteristic with the value Handle if
+	// it was read or notified not more than MaxAge milliseconds ago. The
+	// device is never asked: VALUE_CACHE_E_NO_FRESH_VALUE is returned if there
+	// is no such value. MaxAge must not be zero (WCL_E_INVALID_ARGUMENT). The
+	// caller must free the Value.
+	int GetCachedValue(const unsigned short Handle, const unsigned long MaxAge,
+		unsigned char*& Value, unsigned long& Length);
+	// Returns the last notified value of the notifiable characteristic. The
+	// characteristic can not be read so only the notified values are there.
+	int GetNotifiedValue(const unsigned long MaxAge, unsigned char*& Value,
+		unsigned long& Length);
 #pragma endregion Reading and writing values
+
+#pragma region Connection parameters policy
+	// Sets the connection parameters policy. Must be called before Connect.
+	int SetConnectionPolicy(const TConnectionPolicyParams& Params);
+	// Checks if the connection is idle and switches it to the power saving
+	// parameters. Must be called periodically.
+	void UpdateConnectionPolicy();
+	// Returns the current connection parameters.
+	int GetCurrentConnectionParams(wclBluetoothLeConnectionParameters& Params);
+	// Returns the profile last requested by the policy.
+	TConnectionProfile GetConnectionProfile() const;
+#pragma endregion Connection parameters policy
+
+#pragma region Statistics
+	// Sets the statistics object of the device. The object must outlive the
+	// client. Must be called before Connect.
+	int SetStatistics(CConnectionStats* const Stats);
+#pragma endregion Statistics
+
+#pragma region Connection information
+	// Returns the connection information: MTU, parameters, PHYs and the
+	// traffic counters. The PHY can not be requested by an application:
+	// Windows selects 2M PHY by itself when both sides support it, so the
+	// information shows whether bulk transfers use it.
+	int GetConnectionInfo(TConnectionInfo& Info);
+#pragma endregion Connection information
+
+#pragma region Framing
+	// Enables or disables reassembly of the framed notifications. Must be
+	// called before Connect.
+	int SetFraming(const bool Enabled);
+	// Returns the reassembler of the framed notifications or NULL if framing
+	// is disabled. Feed it from the notification event only.
+	CFrameReassembler* GetReassembler() const;
+	// Writes the message as the sequence of framed segments that fit into the
+	// ATT PDU. Write Without Response with the flow control checkpoints is
+	// used as in StreamValue if the characteristic supports it.
+	int WriteMessage(const unsigned char* const Message, const unsigned long Length,
+		const unsigned long Window, TStreamStats& Stats);
+#pragma endregion Framing
+};
+
+// Posted by the client to its discovery receiver when the discovery run by
+// the executor completed. The message holds a reference to the client.
+class CDiscoveryMessage : public CwclMessage
+{
+	DISABLE_COPY(CDiscoveryMessage);
+
+private:
+	CGattClient*	FClient;
+	int				FResult;
+
+public:
+	CDiscoveryMessage(CGattClient* const Client, const int Result);
+	virtual ~CDiscoveryMessage();
+
+	CGattClient* GetClient() const;
+	int GetResult() const;
+};
+
+// The smart pointer that holds a reference to the GATT client. The client can
+// not be destroyed while at least one reference exists so an application can
+// use it outside the client watcher's lock.
+class CGattClientRef
+{
+private:
+	CGattClient*	FClient;
+
+public:
+	CGattClientRef();
+	// Takes new reference to the client.
+	explicit CGattClientRef(CGattClient* const Client);
+	CGattClientRef(const CGattClientRef& Ref);
+	~CGattClientRef();
+
+	CGattClientRef& operator=(const CGattClientRef& Ref);
+	CGattClient* operator->() const;
+
+	// Replaces the referenced client. Takes new reference to the client.
+	void Assign(CGattClient* const Client);
+	// Drops the reference.
+	void Reset();
+
+	CGattClient* Get() const;
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "pch.h"
+
+#include "LatencyHistogram.h"
+
+unsigned long CLatencyHistogram::BucketIndex(const unsigned __int64 Value)
+{
+	if (Value < HISTOGRAM_SUB_COUNT)
+		return (unsigned long)Value;
+
+	// Position of the highest bit.
+	unsigned long Bit = 0;
+	unsigned __int64 v = Value;
+	while (v >>= 1)
+		Bit++;
+	if (Bit >= HISTOGRAM_MAX_BITS)
+		return HISTOGRAM_BUCKET_COUNT - 1;
+
+	unsigned long Shift = Bit - HISTOGRAM_SUB_BITS;
+	unsigned long Sub = (unsigned long)(Value >> Shift) & (HISTOGRAM_SUB_COUNT - 1);
+	return (Shift + 1) * HISTOGRAM_SUB_COUNT + Sub;
+}
+
+unsigned __int64 CLatencyHistogram::BucketValue(const unsigned long Index)
+{
+	if (Index < HISTOGRAM_SUB_COUNT)
+		return Index;
+
+	unsigned long Shift = Index / HISTOGRAM_SUB_COUNT - 1;
+	unsigned __int64 Sub = Index % HISTOGRAM_SUB_COUNT;
+	unsigned __int64 Low = (HISTOGRAM_SUB_COUNT + Sub) << Shift;
+	return Low + ((1ULL << Shift) - 1);
+}
+
+CLatencyHistogram::CLatencyHistogram()
+{
+	Reset();
+}
+
+void CLatencyHistogram::Record(const unsigned __int64 Value)
+{
+	InterlockedIncrement(&FBuckets[BucketIndex(Value)]);
+	InterlockedIncrement64(&FCount);
+	InterlockedExchangeAdd64(&FSum, (LONG64)Value);
+
+	LONG64 Current = FMax;
+	while ((LONG64)Value > Current)
+	{
+		LONG64 Prev = InterlockedCompareExchange64(&FMax, (LONG64)Value, Current);
+		if (Prev == Current)
+			break;
+		Current = Prev;
+	}
+
+	Current = FMin;
+	while ((LONG64)Value < Current)
+	{
+		LONG64 Prev = InterlockedCompareExchange64(&FMin, (LONG64)Value, Current);
+		if (Prev == Current)
+			break;
+		Current = Prev;
+	}
+}
+
+void CLatencyHistogram::Reset()
+{
+	for (unsigned long i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+		InterlockedExchange(&FBuckets[i], 0);
+	InterlockedExchange64(&FCount, 0);
+	InterlockedExchange64(&FSum, 0);
+	InterlockedExchange64(&FMin, MAXLONGLONG);
+	InterlockedExchange64(&FMax, 0);
+}
+
+void CLatencyHistogram::GetSummary(TLatencySummary& Summary) const
+{
+	ZeroMemory(&Summary, sizeof(TLatencySummary));
+
+	// Count the copied buckets instead of using FCount so the percentiles are
+	// consistent with the buckets.
+	unsigned long Buckets[HISTOGRAM_BUCKET_COUNT];
+	unsigned __int64 Count = 0;
+	for (unsigned long i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		Buckets[i] = FBuckets[i];
+		Count += Buckets[i];
+	}
+	if (Count == 0)
+		return;
+
+	Summary.Count = Count;
+	Summary.Min = FMin;
+	Summary.Max = FMax;
+	Summary.Mean = (unsigned __int64)FSum / (unsigned __int64)(FCount > 0 ? FCount : 1);
+
+	// Ranks of the percentiles (rounded up).
+	const unsigned __int64 Ranks[4] = {
+		(Count * 500 + 999) / 1000,
+		(Count * 900 + 999) / 1000,
+		(Count * 990 + 999) / 1000,
+		(Count * 999 + 999) / 1000 };
+	unsigned __int64* Values[4] = { &Summary.P50, &Summary.P90, &Summary.P99, &Summary.P999 };
+
+	unsigned __int64 Seen = 0;
+	unsigned long Next = 0;
+	for (unsigned long i = 0; i < HISTOGRAM_BUCKET_COUNT && Next < 4; i++)
+	{
+		Seen += Buckets[i];
+		while (Next < 4 && Seen >= Ranks[Next])
+		{
+			// The bucket's upper bound can not be above the real maximum.
+			unsigned __int64 Value = BucketValue(i);
+			if (Value > Summary.Max)
+				Value = Summary.Max;
+			*Values[Next] = Value;
+			Next++;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+// Each power of 2 range is split into 2^HISTOGRAM_SUB_BITS linear buckets so
+// the relative error of a value is not more than 1/2^HISTOGRAM_SUB_BITS.
+const unsigned long HISTOGRAM_SUB_BITS = 3;
+const unsigned long HISTOGRAM_SUB_COUNT = 1 << HISTOGRAM_SUB_BITS;
+// Values above 2^HISTOGRAM_MAX_BITS - 1 (about 71 minutes in microseconds)
+// go to the last bucket.
+const unsigned long HISTOGRAM_MAX_BITS = 32;
+const unsigned long HISTOGRAM_BUCKET_COUNT =
+	HISTOGRAM_SUB_COUNT + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_COUNT;
+
+// Summary of the recorded values.
+typedef struct
+{
+	unsigned __int64	Count;
+	unsigned __int64	Min;
+	unsigned __int64	Max;
+	unsigned __int64	Mean;
+	unsigned __int64	P50;
+	unsigned __int64	P90;
+	unsigned __int64	P99;
+	unsigned __int64	P999;
+} TLatencySummary;
+
+// Log-linear (HDR style) histogram of the latencies. Recording a value is a
+// few atomic operations without any lock so it can be used on the hot path
+// from any thread.
+class CLatencyHistogram
+{
+	DISABLE_COPY(CLatencyHistogram);
+
+private:
+	volatile LONG		FBuckets[HISTOGRAM_BUCKET_COUNT];
+	volatile LONG64		FCount;
+	volatile LONG64		FSum;
+	volatile LONG64		FMin;
+	volatile LONG64		FMax;
+
+	static unsigned long BucketIndex(const unsigned __int64 Value);
+	// Returns the highest value that goes to the bucket.
+	static unsigned __int64 BucketValue(const unsigned long Index);
+
+public:
+	CLatencyHistogram();
+
+	// Records the value. Can be called from any thread.
+	void Record(const unsigned __int64 Value);
+	// Clears the histogram. Values recorded at the same time may be lost.
+	void Reset();
+
+	// Builds the summary of the recorded values. The summary is consistent
+	// only approximately if values are recorded at the same time.
+	void GetSummary(TLatencySummary& Summary) const;
+};
@@ -0,0 +1,182 @@
+#include "pch.h"
+
+#include "MatchRules.h"
+
+// Evidence bits of the rule's conditions.
+static const unsigned long BITS_PER_RULE = 3;
+static const unsigned long NAME_BIT = 0;
+static const unsigned long SERVICE_BIT = 1;
+static const unsigned long MANUFACTURER_BIT = 2;
+
+static const unsigned long ALL_CONDITIONS = MATCH_NAME_PREFIX | MATCH_SERVICE |
+	MATCH_MANUFACTURER;
+
+CMatchRules::TUuidKey CMatchRules::MakeKey(const GUID& Uuid)
+{
+	TUuidKey Key;
+	memcpy(&Key, &Uuid, sizeof(TUuidKey));
+	return Key;
+}
+
+CMatchRules::CMatchRules()
+{
+	FRules = new vector<TMatchRule>();
+	FCompiled = new vector<TCompiledRule>();
+	FNames = new vector<TNameCondition>();
+	FServices = new vector<TServiceCondition>();
+	FManufacturers = new vector<TManufacturerCondition>();
+	FNameRequired = false;
+
+	Compile(NULL, 0);
+}
+
+CMatchRules::~CMatchRules()
+{
+	delete FRules;
+	delete FCompiled;
+	delete FNames;
+	delete FServices;
+	delete FManufacturers;
+}
+
+int CMatchRules::Compile(const TMatchRule* const Rules, const unsigned long Count)
+{
+	if (Count > MAX_MATCH_RULES || (Count > 0 && Rules == NULL))
+		return WCL_E_INVALID_ARGUMENT;
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		if ((Rules[i].Conditions & ~ALL_CONDITIONS) != 0)
+			return WCL_E_INVALID_ARGUMENT;
+		if ((Rules[i].Conditions & MATCH_NAME_PREFIX) != 0 && Rules[i].NamePrefix.empty())
+			return WCL_E_INVALID_ARGUMENT;
+	}
+
+	FRules->clear();
+	if (Count == 0)
+	{
+		TMatchRule Rule;
+		Rule.Conditions = MATCH_NAME_PREFIX;
+		Rule.NamePrefix = DEVICE_NAME;
+		ZeroMemory(&Rule.Service, sizeof(GUID));
+		Rule.CompanyId = 0;
+		Rule.MinRssi = MATCH_ANY_RSSI;
+		Rule.Profile = DEFAULT_CLIENT_PROFILE;
+		FRules->push_back(Rule);
+	}
+	else
+		FRules->assign(Rules, Rules + Count);
+
+	// Split the rules into the conditions of each kind so a frame is checked
+	// only against the conditions it can satisfy.
+	FCompiled->clear();
+	FNames->clear();
+	FServices->clear();
+	FManufacturers->clear();
+	FNameRequired = true;
+	for (unsigned long i = 0; i < FRules->size(); i++)
+	{
+		const TMatchRule& Rule = (*FRules)[i];
+		unsigned long Shift = i * BITS_PER_RULE;
+
+		TCompiledRule Compiled;
+		Compiled.Required = 0;
+		Compiled.MinRssi = Rule.MinRssi;
+
+		if ((Rule.Conditions & MATCH_NAME_PREFIX) != 0)
+		{
+			TNameCondition Name;
+			Name.Prefix = Rule.NamePrefix;
+			Name.Bit = 1UL << (Shift + NAME_BIT);
+			FNames->push_back(Name);
+			Compiled.Required |= Name.Bit;
+		}
+		else
+			FNameRequired = false;
+
+		if ((Rule.Conditions & MATCH_SERVICE) != 0)
+		{
+			TServiceCondition Service;
+			Service.Uuid = MakeKey(Rule.Service);
+			Service.Bit = 1UL << (Shift + SERVICE_BIT);
+			FServices->push_back(Service);
+			Compiled.Required |= Service.Bit;
+		}
+
+		if ((Rule.Conditions & MATCH_MANUFACTURER) != 0)
+		{
+			TManufacturerCondition Manufacturer;
+			Manufacturer.CompanyId = Rule.CompanyId;
+			Manufacturer.Bit = 1UL << (Shift + MANUFACTURER_BIT);
+			FManufacturers->push_back(Manufacturer);
+			Compiled.Required |= Manufacturer.Bit;
+		}
+
+		FCompiled->push_back(Compiled);
+	}
+	return WCL_E_SUCCESS;
+}
+
+unsigned long CMatchRules::GetRules(TMatchRule* const Rules, const unsigned long Count) const
+{
+	if (Rules != NULL)
+	{
+		for (unsigned long i = 0; i < Count && i < FRules->size(); i++)
+			Rules[i] = (*FRules)[i];
+	}
+	return (unsigned long)FRules->size();
+}
+
+const TClientProfile& CMatchRules::GetProfile(const unsigned long Rule) const
+{
+	return (*FRules)[Rule].Profile;
+}
+
+bool CMatchRules::IsNameRequired() const
+{
+	return FNameRequired;
+}
+
+unsigned long CMatchRules::EvaluateName(const tstring& Name) const
+{
+	unsigned long Conditions = 0;
+	for (vector<TNameCondition>::const_iterator Cond = FNames->begin(); Cond != FNames->end(); Cond++)
+	{
+		if (Name.compare(0, Cond->Prefix.length(), Cond->Prefix) == 0)
+			Conditions |= Cond->Bit;
+	}
+	return Conditions;
+}
+
+unsigned long CMatchRules::EvaluateService(const GUID& Uuid) const
+{
+	TUuidKey Key = MakeKey(Uuid);
+	unsigned long Conditions = 0;
+	for (vector<TServiceCondition>::const_iterator Cond = FServices->begin(); Cond != FServices->end(); Cond++)
+	{
+		if (Cond->Uuid.Lo == Key.Lo && Cond->Uuid.Hi == Key.Hi)
+			Conditions |= Cond->Bit;
+	}
+	return Conditions;
+}
+
+unsigned long CMatchRules::EvaluateManufacturer(const unsigned short CompanyId) const
+{
+	unsigned long Conditions = 0;
+	for (vector<TManufacturerCondition>::const_iterator Cond = FManufacturers->begin(); Cond != FManufacturers->end(); Cond++)
+	{
+		if (Cond->CompanyId == CompanyId)
+			Conditions |= Cond->Bit;
+	}
+	return Conditions;
+}
+
+int CMatchRules::Match(const unsigned long Conditions, const char Rssi) const
+{
+	for (unsigned long i = 0; i < FCompiled->size(); i++)
+	{
+		const TCompiledRule& Rule = (*FCompiled)[i];
+		if ((Conditions & Rule.Required) == Rule.Required && Rssi >= Rule.MinRssi)
+			return (int)i;
+	}
+	return -1;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+
+#include "GattClient.h"
+
+using namespace std;
+
+const tstring DEVICE_NAME = _T("MultyGattServer");
+
+#pragma region Match conditions
+// The device name starts with NamePrefix.
+const unsigned long MATCH_NAME_PREFIX = 0x01;
+// The device advertises the Service UUID.
+const unsigned long MATCH_SERVICE = 0x02;
+// The device advertises the manufacturer data of the CompanyId.
+const unsigned long MATCH_MANUFACTURER = 0x04;
+#pragma endregion Match conditions
+
+// Maximum number of rules in the table. Each rule takes 3 bits of the 32-bit
+// word the filter collects the device's conditions in.
+const unsigned long MAX_MATCH_RULES = 10;
+// The RSSI value that accepts any signal.
+const char MATCH_ANY_RSSI = -128;
+
+// Rule that selects the devices and the profile used to work with them.
+typedef struct
+{
+	// Combination of the MATCH_ conditions. All of them must be satisfied.
+	// Zero matches any device with the required signal.
+	unsigned long	Conditions;
+	tstring			NamePrefix;
+	GUID			Service;
+	unsigned short	CompanyId;
+	// Weakest signal of the frame that completes the match.
+	char			MinRssi;
+	TClientProfile	Profile;
+} TMatchRule;
+
+// Compiled table of the device match rules. An advertisement reports the
+// name, the service UUIDs and the manufacturer data with separate frames so
+// each frame is evaluated against all the rules in one pass and gives the
+// bit mask of the rule conditions it satisfies (3 bits per rule). The masks
+// of the device's frames are collected by the advertisement filter and the
+// first rule which conditions are all present wins.
+// The table is not changed after Compile so it is read without lock.
+class CMatchRules
+{
+	DISABLE_COPY(CMatchRules);
+
+private:
+	// 128-bit UUID as two 64-bit words: matching a frame costs two compares.
+	typedef struct
+	{
+		unsigned __int64	Lo;
+		unsigned __int64	Hi;
+	} TUuidKey;
+
+	// The rule's conditions of each kind with their evidence bits.
+	typedef struct
+	{
+		tstring				Prefix;
+		unsigned long		Bit;
+	} TNameCondition;
+	typedef struct
+	{
+		TUuidKey			Uuid;
+		unsigned long		Bit;
+	} TServiceCondition;
+	typedef struct
+	{
+		unsigned short		CompanyId;
+		unsigned long		Bit;
+	} TManufacturerCondition;
+
+	typedef struct
+	{
+		unsigned long		Required;
+		char				MinRssi;
+	} TCompiledRule;
+
+	vector<TMatchRule>*				FRules;
+	vector<TCompiledRule>*			FCompiled;
+	vector<TNameCondition>*			FNames;
+	vector<TServiceCondition>*		FServices;
+	vector<TManufacturerCondition>*	FManufacturers;
+	// True if every rule checks the name: a device with other name never
+	// matches.
+	bool							FNameRequired;
+
+	static TUuidKey MakeKey(const GUID& Uuid);
+
+public:
+	// The table has the default rule: our server's name (DEVICE_NAME) and
+	// profile.
+	CMatchRules();
+	~CMatchRules();
+
+	// Replaces the rules. Zero Count restores the default rule.
+	int Compile(const TMatchRule* const Rules, const unsigned long Count);
+	// Copies up to Count rules to the Rules array. Returns the number of rules.
+	unsigned long GetRules(TMatchRule* const Rules, const unsigned long Count) const;
+	const TClientProfile& GetProfile(const unsigned long Rule) const;
+	bool IsNameRequired() const;
+
+	// Return the conditions satisfied by the frame.
+	unsigned long EvaluateName(const tstring& Name) const;
+	unsigned long EvaluateService(const GUID& Uuid) const;
+	unsigned long EvaluateManufacturer(const unsigned short CompanyId) const;
+	// Returns the index of the first rule satisfied by the collected
+	// conditions and the RSSI of the last frame or -1.
+	int Match(const unsigned long Conditions, const char Rssi) const;
+};
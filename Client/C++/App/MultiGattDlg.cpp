@@ -39,6 +39,21 @@ CString IntToStr(const unsigned long i)
 	return s;
 }
 
+// The attribute cache file is stored next to the executable.
+tstring AttributeCacheFileName()
+{
+	TCHAR Path[MAX_PATH];
+	DWORD Len = GetModuleFileName(NULL, Path, MAX_PATH);
+	if (Len == 0 || Len >= MAX_PATH)
+		return _T("MultiGatt.cache");
+
+	tstring FileName = Path;
+	size_t Dot = FileName.find_last_of(_T('.'));
+	if (Dot != tstring::npos)
+		FileName.erase(Dot);
+	return FileName + _T(".cache");
+}
+
 // CMultiGattDlg dialog
 
 
@@ -106,10 +121,26 @@ BOOL CMultiGattDlg::OnInitDialog()
 	__hook(&CClientWatcher::OnConnectionCompleted, FWatcher, &CMultiGattDlg::WatcherConnectionCompleted);
 	__hook(&CClientWatcher::OnConnectionStarted, FWatcher, &CMultiGattDlg::WatcherConnectionStarted);
 	__hook(&CClientWatcher::OnDeviceFound, FWatcher, &CMultiGattDlg::WatcherDeviceFound);
-	__hook(&CClientWatcher::OnValueChanged, FWatcher, &CMultiGattDlg::WatcherValueChanged);
+	__hook(&CClientWatcher::OnValuesChanged, FWatcher, &CMultiGattDlg::WatcherValuesChanged);
 	__hook(&CClientWatcher::OnStarted, FWatcher, &CMultiGattDlg::WatcherStarted);
 	__hook(&CClientWatcher::OnStopped, FWatcher, &CMultiGattDlg::WatcherStopped);
 
+	// Our server advertises its service UUID: find it without the scan
+	// response.
+	FWatcher->SetServiceFilter(&SERVICE_UUID, 1);
+
+	// Take notifications in batches: one event per 64 values or 100 ms.
+	FWatcher->SetValuesBatch(DEFAULT_VALUES_BATCH_WINDOW, 64);
+
+	// Short connection interval during bursts, power saving when idle.
+	TConnectionPolicyParams Policy;
+	CConnectionPolicy::GetDefaultParams(Policy);
+	Policy.Enabled = true;
+	FWatcher->SetConnectionPolicy(Policy);
+
+	// Attribute handles of known devices. It is OK if there is no cache yet.
+	FWatcher->LoadAttributeCache(AttributeCacheFileName());
+
 	UpdateButtons();
 
 	return TRUE;  // return TRUE  unless you set the focus to a control
@@ -181,6 +212,7 @@ void CMultiGattDlg::OnDestroy()
 
 	OnBnClickedButtonStop();
 
+	FWatcher->SaveAttributeCache(AttributeCacheFileName());
 	__unhook(FWatcher);
 	delete FWatcher;
 	__unhook(FManager);
@@ -215,7 +247,22 @@ void CMultiGattDlg::OnBnClickedButtonStart()
 			AfxMessageBox(_T("Get working radio failed: 0x") + IntToHex(Res));
 		else
 		{
-			Res = FWatcher->Start(Radio);
+			// Spread the connections over all the working LE adapters. The
+			// radio returned by GetLeRadio scans for the devices.
+			CwclBluetoothRadio* Radios[MAX_CONNECTION_RADIOS];
+			unsigned long Count = 0;
+			for (size_t i = 0; i < FManager->Count && Count < MAX_CONNECTION_RADIOS; i++)
+			{
+				CwclBluetoothRadio* LeRadio = FManager->Radios[i];
+				if (LeRadio->Available && LeRadio->LeSupported)
+				{
+					Radios[Count] = LeRadio;
+					Count++;
+				}
+			}
+			Res = FWatcher->SetConnectionRadios(Radios, Count);
+			if (Res == WCL_E_SUCCESS)
+				Res = FWatcher->Start(Radio, smPassive);
 			if (Res != WCL_E_SUCCESS)
 				AfxMessageBox(_T("Start Watcher failed: 0x") + IntToHex(Res));
 		}
@@ -240,25 +287,22 @@ void CMultiGattDlg::OnBnClickedButtonRead()
 		int Item = lvDevices.GetNextSelectedItem(Pos);
 		__int64 Address = StrToInt64(lvDevices.GetItemText(Item, 0));
 
-		unsigned char* Data;
-		unsigned long Length;
-		int Res = FWatcher->ReadData(Address, Data, Length);
+		// The buffer returns to the watcher's pool when it goes out of scope.
+		CPooledBuffer Data;
+		int Res = FWatcher->ReadData(Address, Data);
 		if (Res != WCL_E_SUCCESS)
 			AfxMessageBox(_T("Read failed: 0x") + IntToHex(Res));
 		else
 		{
-			if (Data == NULL || Length == 0)
+			if (Data.Length == 0)
 				AfxMessageBox(_T("Data is empty"));
 			else
 			{
 				CStringA s;
-				for (unsigned long i = 0; i < Length; i++)
-					s += (char)Data[i];
+				for (unsigned long i = 0; i < Data.Length; i++)
+					s += (char)Data.Data[i];
 				MessageBoxA(this->m_hWnd, "Data read: " + s, "Received data", 0);
 			}
-
-			if (Data != NULL)
-				free(Data);
 		}
 	}
 }
@@ -346,6 +390,14 @@ void CMultiGattDlg::WatcherConnectionCompleted(const __int64 Address, const int
 				{
 					lvDevices.SetItemText(Item, 2, _T("Connected"));
 					lvDevices.SetItemData(Item, (DWORD_PTR)dsConnected);
+
+					TConnectionInfo Info;
+					if (FWatcher->GetConnectionInfo(Address, Info) == WCL_E_SUCCESS)
+					{
+						static const TCHAR* PhyNames[LE_PHY_COUNT] = { _T("unknown"), _T("1M"), _T("2M"), _T("Coded") };
+						lbLog.AddString(_T("  MTU: ") + IntToStr(Info.MaxPduSize) +
+							_T(" TX PHY: ") + PhyNames[Info.TxPhy] + _T(" RX PHY: ") + PhyNames[Info.RxPhy]);
+					}
 				}
 				UpdateButtons();
 				break;
@@ -379,10 +431,13 @@ void CMultiGattDlg::WatcherConnectionStarted(const __int64 Address, const int Re
 	}
 }
 
-void CMultiGattDlg::WatcherDeviceFound(const __int64 Address, const tstring& Name)
+void CMultiGattDlg::WatcherDeviceFound(const __int64 Address, const tstring& Name,
+	const int Rule)
 {
 	// SYNC
-	lbLog.AddString(_T("Device ") + IntToHex(Address) + _T(" found: ") + CString(Name.c_str()));
+	// The name is empty if the device matched the rule without it.
+	lbLog.AddString(_T("Device ") + IntToHex(Address) + _T(" found: ") + CString(Name.c_str()) +
+		_T(" (rule ") + IntToStr(Rule) + _T(")"));
 	int Item = lvDevices.GetItemCount();
 	lvDevices.InsertItem(Item, IntToHex(Address));
 	lvDevices.SetItemText(Item, 1, Name.c_str());
@@ -407,16 +462,23 @@ void CMultiGattDlg::WatcherStarted(void* Sender)
 	UpdateButtons();
 }
 
-void CMultiGattDlg::WatcherValueChanged(const __int64 Address, const unsigned char* Value,
-	const unsigned long Length)
+void CMultiGattDlg::WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count)
 {
 	// SYNC
-	if (Length > 3)
+	// Repaint the log once per batch.
+	lbLog.SetRedraw(FALSE);
+	for (unsigned long i = 0; i < Count; i++)
 	{
-		unsigned long Val = (Value[3] << 24) | (Value[2] << 16) |
-			(Value[1] << 8) | Value[0];
-		lbLog.AddString(_T("Data received from ") + IntToHex(Address) + _T(": ") + IntToStr(Val));
+		const unsigned char* Value = Records[i].Value;
+		if (Records[i].Length > 3)
+		{
+			unsigned long Val = (Value[3] << 24) | (Value[2] << 16) |
+				(Value[1] << 8) | Value[0];
+			lbLog.AddString(_T("Data received from ") + IntToHex(Records[i].Address) + _T(": ") + IntToStr(Val));
+		}
+		else
+			lbLog.AddString(_T("Empty data received"));
 	}
-	else
-		lbLog.AddString(_T("Empty data received"));
+	lbLog.SetRedraw(TRUE);
+	lbLog.Invalidate();
 }
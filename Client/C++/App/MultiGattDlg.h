@@ -62,11 +62,10 @@ private:
 	void WatcherClientDisconnected(const __int64 Address, const int Reason);
 	void WatcherConnectionCompleted(const __int64 Address, const int Result);
 	void WatcherConnectionStarted(const __int64 Address, const int Result);
-	void WatcherDeviceFound(const __int64 Address, const tstring& Name);
+	void WatcherDeviceFound(const __int64 Address, const tstring& Name, const int Rule);
 	void WatcherStopped(void* Sender);
 	void WatcherStarted(void* Sender);
-	void WatcherValueChanged(const __int64 Address, const unsigned char* Value,
-		const unsigned long Length);
+	void WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count);
 
 public:
 	afx_msg void OnBnClickedButtonClear();
@@ -0,0 +1,170 @@
+#include "pch.h"
+
+#include "NotificationRing.h"
+
+LONG64 CNotificationRing::LoadSequence(const TCell* const Cell)
+{
+	// Exchanging zero for zero never changes the value.
+	return InterlockedCompareExchange64(const_cast<volatile LONG64*>(&Cell->Sequence), 0, 0);
+}
+
+bool CNotificationRing::IsReady() const
+{
+	const TCell* Cell = &FCells[FPopPos & FMask];
+	return (LoadSequence(Cell) == FPopPos + 1);
+}
+
+CNotificationRing::CNotificationRing(const unsigned long Capacity)
+{
+	unsigned long Size = 2;
+	while (Size < Capacity)
+		Size <<= 1;
+
+	FCells = new TCell[Size];
+	FMask = Size - 1;
+	// Cell is free for the producer when its sequence equals the position.
+	for (unsigned long i = 0; i < Size; i++)
+		FCells[i].Sequence = i;
+
+	FPushPos = 0;
+	FPopPos = 0;
+
+	FDropped = 0;
+	FOversized = 0;
+	FWaiting = 0;
+	FEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+CNotificationRing::~CNotificationRing()
+{
+	if (FEvent != NULL)
+		CloseHandle(FEvent);
+	delete[] FCells;
+}
+
+bool CNotificationRing::Push(const __int64 Address, const unsigned short Handle,
+	const unsigned __int64 Timestamp, const unsigned char* const Data,
+	const unsigned long Length)
+{
+	if (Length > NOTIFICATION_MAX_PAYLOAD)
+	{
+		InterlockedIncrement(&FOversized);
+		return false;
+	}
+
+	TCell* Cell;
+	LONG64 Pos = FPushPos;
+	while (true)
+	{
+		Cell = &FCells[Pos & FMask];
+		LONG64 Diff = LoadSequence(Cell) - Pos;
+		if (Diff == 0)
+		{
+			// The cell is free. Try to claim it.
+			LONG64 Prev = InterlockedCompareExchange64(&FPushPos, Pos + 1, Pos);
+			if (Prev == Pos)
+				break;
+			Pos = Prev;
+		}
+		else
+		{
+			if (Diff < 0)
+			{
+				// The consumer has not freed the cell yet: the ring is full.
+				InterlockedIncrement(&FDropped);
+				return false;
+			}
+			// Other producer claimed the cell. Reload the position.
+			Pos = FPushPos;
+		}
+	}
+
+	Cell->Record.Address = Address;
+	Cell->Record.Handle = Handle;
+	Cell->Record.Length = (unsigned short)Length;
+	Cell->Record.Timestamp = Timestamp;
+	if (Length > 0)
+		memcpy(Cell->Record.Data, Data, Length);
+	// Publish the record. Full barrier: the record must be visible before the
+	// sequence and the sequence before we check the waiting flag.
+	InterlockedExchange64(&Cell->Sequence, Pos + 1);
+
+	if (FWaiting != 0 && InterlockedExchange(&FWaiting, 0) != 0)
+		SetEvent(FEvent);
+	return true;
+}
+
+unsigned long CNotificationRing::Pop(TNotification* const Records,
+	const unsigned long Count)
+{
+	if (Records == NULL)
+		return 0;
+
+	LONG64 Pos = FPopPos;
+	unsigned long Popped = 0;
+	while (Popped < Count)
+	{
+		TCell* Cell = &FCells[Pos & FMask];
+		if (LoadSequence(Cell) != Pos + 1)
+			break;
+
+		TNotification* Record = &Records[Popped];
+		Record->Address = Cell->Record.Address;
+		Record->Handle = Cell->Record.Handle;
+		Record->Length = Cell->Record.Length;
+		Record->Timestamp = Cell->Record.Timestamp;
+		memcpy(Record->Data, Cell->Record.Data, Cell->Record.Length);
+
+		// Give the cell back to the producers for the next lap.
+		InterlockedExchange64(&Cell->Sequence, Pos + FMask + 1);
+		Pos++;
+		Popped++;
+	}
+	FPopPos = Pos;
+	return Popped;
+}
+
+bool CNotificationRing::Wait(const DWORD Timeout)
+{
+	if (IsReady())
+		return true;
+	if (FEvent == NULL)
+		return false;
+
+	InterlockedExchange(&FWaiting, 1);
+	// A record may have been published before the flag was set.
+	if (!IsReady())
+		WaitForSingleObject(FEvent, Timeout);
+	InterlockedExchange(&FWaiting, 0);
+
+	return IsReady();
+}
+
+void CNotificationRing::Wake()
+{
+	if (FEvent != NULL)
+		SetEvent(FEvent);
+}
+
+unsigned long CNotificationRing::GetCapacity() const
+{
+	return FMask + 1;
+}
+
+unsigned long CNotificationRing::GetCount() const
+{
+	LONG64 Count = FPushPos - FPopPos;
+	if (Count < 0)
+		return 0;
+	return (unsigned long)Count;
+}
+
+unsigned long CNotificationRing::GetDropped() const
+{
+	return FDropped;
+}
+
+unsigned long CNotificationRing::GetOversized() const
+{
+	return FOversized;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+// Maximum notification payload stored in the ring. Our server negotiates
+// 255 bytes MTU so the notification value can not be longer than MTU - 3.
+const unsigned long NOTIFICATION_MAX_PAYLOAD = 252;
+// Default number of records in the notification ring.
+const unsigned long DEFAULT_NOTIFICATION_RING_SIZE = 4096;
+
+// Single notification record. The payload is stored inline so pushing a
+// notification never allocates memory.
+typedef struct
+{
+	__int64				Address;
+	unsigned short		Handle;
+	unsigned short		Length;
+	// Time the notification was received (see GetTimestamp).
+	unsigned __int64	Timestamp;
+	unsigned char		Data[NOTIFICATION_MAX_PAYLOAD];
+} TNotification;
+
+// Bounded lock-free ring of the notification records.
+// Any number of threads can push records at the same time (the GATT clients'
+// event threads). Only one thread can pop them. Producers never block: if the
+// ring is full or the value does not fit into the record it is dropped and
+// counted. The consumer takes records in batches so it pays for the
+// synchronization once per batch, not once per notification.
+// The ring is based on the D. Vyukov's bounded queue: each cell has its own
+// sequence number so producers claim cells with a single CAS and the
+// consumer never touches the producers' position.
+class CNotificationRing
+{
+	DISABLE_COPY(CNotificationRing);
+
+private:
+	typedef struct
+	{
+		volatile LONG64	Sequence;
+		TNotification	Record;
+	} TCell;
+
+	TCell*					FCells;
+	unsigned long			FMask;
+
+	// Producers' and consumer's positions are kept on separate cache lines.
+	unsigned char			FPad0[64];
+	volatile LONG64			FPushPos;
+	unsigned char			FPad1[64];
+	volatile LONG64			FPopPos;
+	unsigned char			FPad2[64];
+
+	volatile LONG			FDropped;
+	volatile LONG			FOversized;
+	// Set by the consumer that waits for new records.
+	volatile LONG			FWaiting;
+	HANDLE					FEvent;
+
+	// Reads the cell's sequence with the full barrier so the record written
+	// before the sequence was published is visible after it is read.
+	static LONG64 LoadSequence(const TCell* const Cell);
+	// Returns true if the cell at the consumer's position is published.
+	bool IsReady() const;
+
+public:
+	// The capacity is rounded up to the power of 2.
+	CNotificationRing(const unsigned long Capacity = DEFAULT_NOTIFICATION_RING_SIZE);
+	~CNotificationRing();
+
+	// Pushes the notification. Returns false if the record has been dropped.
+	// Can be called from any thread.
+	bool Push(const __int64 Address, const unsigned short Handle,
+		const unsigned __int64 Timestamp, const unsigned char* const Data,
+		const unsigned long Length);
+	// Copies up to Count oldest records to the Records array and removes them
+	// from the ring. Returns the number of copied records. Must be called
+	// from the single consumer thread.
+	unsigned long Pop(TNotification* const Records, const unsigned long Count);
+	// Waits until the ring has records or the timeout expires. Returns true if
+	// there are records to pop. Must be called from the consumer thread.
+	bool Wait(const DWORD Timeout);
+	// Wakes up the consumer waiting in the Wait method.
+	void Wake();
+
+	unsigned long GetCapacity() const;
+	// Returns approximate number of records in the ring.
+	unsigned long GetCount() const;
+	// Returns number of records dropped because the ring was full.
+	unsigned long GetDropped() const;
+	// Returns number of records dropped because the value was too long.
+	unsigned long GetOversized() const;
+};
@@ -0,0 +1,190 @@
+#include "pch.h"
+
+#include "RadioBalancer.h"
+
+CRadioBalancer::CRadioBalancer()
+{
+	InitializeCriticalSection(&FCS);
+
+	FRadios = new vector<CwclBluetoothRadio*>();
+	FLoads = new vector<TRadioLoad>();
+	FMaxConnections = 0;
+}
+
+CRadioBalancer::~CRadioBalancer()
+{
+	delete FRadios;
+	delete FLoads;
+
+	DeleteCriticalSection(&FCS);
+}
+
+int CRadioBalancer::SetRadios(CwclBluetoothRadio* const* const Radios, const unsigned long Count)
+{
+	if (Count > MAX_CONNECTION_RADIOS || (Count > 0 && Radios == NULL))
+		return WCL_E_INVALID_ARGUMENT;
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		if (Radios[i] == NULL)
+			return WCL_E_INVALID_ARGUMENT;
+	}
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FRadios->assign(Radios, Radios + Count);
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+	return WCL_E_SUCCESS;
+}
+
+unsigned long CRadioBalancer::GetRadios(CwclBluetoothRadio** const Radios,
+	const unsigned long Count) const
+{
+	if (Radios != NULL)
+	{
+		for (unsigned long i = 0; i < Count && i < FRadios->size(); i++)
+			Radios[i] = (*FRadios)[i];
+	}
+	return (unsigned long)FRadios->size();
+}
+
+unsigned long CRadioBalancer::GetMaxConnections() const
+{
+	return FMaxConnections;
+}
+
+void CRadioBalancer::SetMaxConnections(const unsigned long Value)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FMaxConnections = Value;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CRadioBalancer::Open(CwclBluetoothRadio* const Default)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FLoads->clear();
+
+		TRadioLoad Load;
+		Load.Connections = 0;
+		if (FRadios->empty())
+		{
+			Load.Radio = Default;
+			FLoads->push_back(Load);
+		}
+		else
+		{
+			for (vector<CwclBluetoothRadio*>::iterator Radio = FRadios->begin(); Radio != FRadios->end(); Radio++)
+			{
+				Load.Radio = *Radio;
+				FLoads->push_back(Load);
+			}
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CRadioBalancer::HasFreeSlot()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FMaxConnections == 0)
+			return true;
+
+		for (vector<TRadioLoad>::iterator Load = FLoads->begin(); Load != FLoads->end(); Load++)
+		{
+			if (Load->Connections < FMaxConnections)
+				return true;
+		}
+		return false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+CwclBluetoothRadio* CRadioBalancer::Acquire()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		// There are few radios so the linear search is fine.
+		TRadioLoad* Best = NULL;
+		for (vector<TRadioLoad>::iterator Load = FLoads->begin(); Load != FLoads->end(); Load++)
+		{
+			if (FMaxConnections > 0 && Load->Connections >= FMaxConnections)
+				continue;
+			if (Best == NULL || Load->Connections < Best->Connections)
+				Best = &(*Load);
+		}
+
+		if (Best == NULL)
+			return NULL;
+		Best->Connections++;
+		return Best->Radio;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CRadioBalancer::Release(CwclBluetoothRadio* const Radio)
+{
+	if (Radio == NULL)
+		return;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		for (vector<TRadioLoad>::iterator Load = FLoads->begin(); Load != FLoads->end(); Load++)
+		{
+			// The connection of the previous run may close after Open.
+			if (Load->Radio == Radio)
+			{
+				if (Load->Connections > 0)
+					Load->Connections--;
+				break;
+			}
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+unsigned long CRadioBalancer::GetLoads(TRadioLoad* const Loads, const unsigned long Count)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (Loads != NULL)
+		{
+			for (unsigned long i = 0; i < Count && i < FLoads->size(); i++)
+				Loads[i] = (*FLoads)[i];
+		}
+		return (unsigned long)FLoads->size();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
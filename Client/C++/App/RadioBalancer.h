@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include "wclBluetooth.h"
+
+using namespace std;
+using namespace wclCommon;
+using namespace wclBluetooth;
+
+#pragma region Radio balancer error codes
+const int RADIO_BALANCER_E_BASE = 0x7F050000;
+// All the radios have the maximum number of connections.
+const int RADIO_BALANCER_E_NO_FREE_RADIO = RADIO_BALANCER_E_BASE + 0x0000;
+#pragma endregion Radio balancer error codes
+
+// Maximum number of radios the connections can be spread over.
+const unsigned long MAX_CONNECTION_RADIOS = 8;
+
+// The number of the connections of the radio.
+typedef struct
+{
+	CwclBluetoothRadio*	Radio;
+	// Connections started or established through the radio.
+	unsigned long		Connections;
+} TRadioLoad;
+
+// Spreads the connections over several Bluetooth LE radios. Each controller
+// has its own limit of simultaneous connections and its own air time, so a
+// new connection goes to the least loaded radio that still has a free slot.
+// A slot is taken when the connection starts and returned when the client
+// leaves the watcher. If no radios are set the connections use the scanning
+// radio only.
+// The class is thread safe.
+class CRadioBalancer
+{
+	DISABLE_COPY(CRadioBalancer);
+
+private:
+	RTL_CRITICAL_SECTION	FCS;
+	// The radios set by the application.
+	vector<CwclBluetoothRadio*>*	FRadios;
+	// The radios in use and their connections.
+	vector<TRadioLoad>*		FLoads;
+	// Maximum connections per radio. Zero means no limit.
+	unsigned long			FMaxConnections;
+
+public:
+	CRadioBalancer();
+	~CRadioBalancer();
+
+	// Sets the radios. Zero Count returns to the scanning radio only.
+	int SetRadios(CwclBluetoothRadio* const* const Radios, const unsigned long Count);
+	// Copies up to Count radios to the Radios array. Returns the number of
+	// radios.
+	unsigned long GetRadios(CwclBluetoothRadio** const Radios, const unsigned long Count) const;
+
+	unsigned long GetMaxConnections() const;
+	void SetMaxConnections(const unsigned long Value);
+
+	// Starts the balancing from scratch. The Default radio is used if no
+	// radios are set.
+	void Open(CwclBluetoothRadio* const Default);
+	// Returns true if any radio can take a connection.
+	bool HasFreeSlot();
+	// Takes the slot on the least loaded radio. Returns NULL if all the
+	// radios are full.
+	CwclBluetoothRadio* Acquire();
+	// Returns the slot of the connection that used the Radio.
+	void Release(CwclBluetoothRadio* const Radio);
+
+	// Copies up to Count radio loads to the Loads array. Returns the number
+	// of radios in use.
+	unsigned long GetLoads(TRadioLoad* const Loads, const unsigned long Count);
+};
@@ -0,0 +1,124 @@
+#include "pch.h"
+
+#include "ReadCoalescer.h"
+
+CReadCoalescer::CReadCoalescer()
+{
+	InitializeCriticalSection(&FCS);
+
+	FDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	FInFlight = false;
+	FWaiters = 0;
+	FResult = WCL_E_SUCCESS;
+	FValue = NULL;
+	FLength = 0;
+}
+
+CReadCoalescer::~CReadCoalescer()
+{
+	if (FValue != NULL)
+		free(FValue);
+	if (FDone != NULL)
+		CloseHandle(FDone);
+
+	DeleteCriticalSection(&FCS);
+}
+
+TReaderRole CReadCoalescer::Begin()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (FInFlight)
+		{
+			FWaiters++;
+			return rrFollower;
+		}
+
+		// The event is shared by all the flights. It can not be reset while
+		// the previous flight's followers wait for it.
+		if (FWaiters > 0 || FDone == NULL)
+			return rrAlone;
+
+		ResetEvent(FDone);
+		FInFlight = true;
+		return rrLeader;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReadCoalescer::Complete(const int Result, const unsigned char* const Value,
+	const unsigned long Length)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FInFlight = false;
+		if (FWaiters > 0)
+		{
+			FResult = Result;
+			FValue = NULL;
+			FLength = 0;
+			if (Result == WCL_E_SUCCESS && Value != NULL && Length > 0)
+			{
+				FValue = (unsigned char*)malloc(Length);
+				if (FValue == NULL)
+					FResult = WCL_E_OUT_OF_MEMORY;
+				else
+				{
+					memcpy(FValue, Value, Length);
+					FLength = Length;
+				}
+			}
+			SetEvent(FDone);
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+int CReadCoalescer::Wait(unsigned char*& Value, unsigned long& Length)
+{
+	Value = NULL;
+	Length = 0;
+
+	WaitForSingleObject(FDone, INFINITE);
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		int Res = FResult;
+		if (Res == WCL_E_SUCCESS)
+		{
+			// Keep the library's contract: the leader gets the heap buffer
+			// even for the empty value.
+			Value = (unsigned char*)malloc(FLength > 0 ? FLength : 1);
+			if (Value == NULL)
+				Res = WCL_E_OUT_OF_MEMORY;
+			else
+			{
+				if (FLength > 0)
+					memcpy(Value, FValue, FLength);
+				Length = FLength;
+			}
+		}
+
+		FWaiters--;
+		if (FWaiters == 0 && FValue != NULL)
+		{
+			free(FValue);
+			FValue = NULL;
+			FLength = 0;
+		}
+		return Res;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+// The role of the reader returned by CReadCoalescer::Begin.
+typedef enum
+{
+	// No read is in flight: the caller reads from the device and must call
+	// Complete.
+	rrLeader,
+	// The read is in flight: the caller must call Wait to get its result.
+	rrFollower,
+	// The followers of the previous read are still collecting the result:
+	// the caller reads from the device without coalescing.
+	rrAlone
+} TReaderRole;
+
+// Deduplicates concurrent reads of the same characteristic. The first reader
+// becomes the leader and goes to the device. The readers that come while its
+// read is in flight do not queue for the air: they wait for the leader and
+// all get the same result. The flight state is embedded so no memory is
+// allocated when there are no followers. A new flight is started only after
+// all the followers of the previous one have taken the result.
+// The class is thread safe.
+class CReadCoalescer
+{
+	DISABLE_COPY(CReadCoalescer);
+
+private:
+	RTL_CRITICAL_SECTION	FCS;
+	// Signaled when the flight completes.
+	HANDLE					FDone;
+	bool					FInFlight;
+	unsigned long			FWaiters;
+	// The leader's result shared by the followers. The value is copied only
+	// if there are followers and freed by the last one.
+	int						FResult;
+	unsigned char*			FValue;
+	unsigned long			FLength;
+
+public:
+	CReadCoalescer();
+	~CReadCoalescer();
+
+	TReaderRole Begin();
+	// The leader's read completed. The Value stays owned by the leader.
+	void Complete(const int Result, const unsigned char* const Value,
+		const unsigned long Length);
+	// Waits for the leader's read and returns its result. On success the
+	// Value is the copy the caller must free. As the library's value it is
+	// never NULL, even if the value is empty.
+	int Wait(unsigned char*& Value, unsigned long& Length);
+};
@@ -0,0 +1,238 @@
+#include "pch.h"
+
+#include "ReconnectManager.h"
+
+unsigned __int64 CReconnectManager::NextDelay(const unsigned long Failures)
+{
+	// Double the delay up to the limit. Keep shift in range.
+	unsigned __int64 Delay = FParams.Delay;
+	for (unsigned long i = 0; i < Failures && Delay < FParams.MaxDelay; i++)
+		Delay *= 2;
+	if (Delay > FParams.MaxDelay)
+		Delay = FParams.MaxDelay;
+
+	// xorshift64 is good enough to spread the attempts.
+	FRandom ^= FRandom << 13;
+	FRandom ^= FRandom >> 7;
+	FRandom ^= FRandom << 17;
+
+	unsigned __int64 Half = Delay / 2;
+	return Delay - Half + FRandom % (Half + 1);
+}
+
+CReconnectManager::CReconnectManager()
+{
+	InitializeCriticalSection(&FCS);
+
+	FDevices = new DEVICES();
+	GetDefaultParams(FParams);
+	// Must not be zero.
+	FRandom = GetTickCount64() | 1;
+
+	FRecovered = 0;
+	FAbandoned = 0;
+	FAttempts = 0;
+}
+
+CReconnectManager::~CReconnectManager()
+{
+	delete FDevices;
+
+	DeleteCriticalSection(&FCS);
+}
+
+bool CReconnectManager::IsRecoverable(const int Reason)
+{
+	// The connection closed by our side reports success.
+	return (Reason != WCL_E_SUCCESS);
+}
+
+void CReconnectManager::Dropped(const __int64 Address, const TClientProfile& Profile,
+	const tstring& Name, const int Rule, const unsigned __int64 Now,
+	const unsigned __int64 Timestamp)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		if (!FParams.Enabled)
+			return;
+
+		TDevice& Device = (*FDevices)[Address];
+		Device.Profile = Profile;
+		Device.Name = Name;
+		Device.Rule = Rule;
+		Device.Failures = 0;
+		Device.RetryAt = Now + NextDelay(0);
+		Device.DroppedAt = Timestamp;
+		Device.InFlight = false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CReconnectManager::Next(const unsigned __int64 Now, __int64& Address,
+	TClientProfile& Profile, tstring& Name, int& Rule)
+{
+	Address = 0;
+	Rule = -1;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		// Only the devices that lost the link are here so the list is short.
+		for (DEVICES::iterator Device = FDevices->begin(); Device != FDevices->end(); Device++)
+		{
+			if (Device->second.InFlight || Device->second.RetryAt > Now)
+				continue;
+
+			Device->second.InFlight = true;
+			FAttempts++;
+			Address = Device->first;
+			Profile = Device->second.Profile;
+			Name = Device->second.Name;
+			Rule = Device->second.Rule;
+			return true;
+		}
+		return false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::Postpone(const __int64 Address, const unsigned __int64 Now)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		DEVICES::iterator Device = FDevices->find(Address);
+		if (Device != FDevices->end() && Device->second.InFlight)
+		{
+			Device->second.InFlight = false;
+			Device->second.RetryAt = Now + RECONNECT_CHECK_PERIOD;
+			FAttempts--;
+		}
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CReconnectManager::Completed(const __int64 Address, const bool Success,
+	const unsigned __int64 Now, const unsigned __int64 Timestamp, unsigned __int64& Downtime)
+{
+	Downtime = 0;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		DEVICES::iterator Device = FDevices->find(Address);
+		if (Device == FDevices->end())
+			return false;
+
+		if (Success)
+		{
+			Downtime = Timestamp - Device->second.DroppedAt;
+			FDevices->erase(Device);
+			FRecovered++;
+			return true;
+		}
+
+		Device->second.Failures++;
+		if (Device->second.Failures >= FParams.MaxAttempts)
+		{
+			FDevices->erase(Device);
+			FAbandoned++;
+		}
+		else
+		{
+			Device->second.InFlight = false;
+			Device->second.RetryAt = Now + NextDelay(Device->second.Failures);
+		}
+		return false;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::Cancel(const __int64 Address)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FDevices->erase(Address);
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::Clear()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FDevices->clear();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::GetStats(TReconnectStats& Stats)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		Stats.Pending = (unsigned long)FDevices->size();
+		Stats.Recovered = FRecovered;
+		Stats.Abandoned = FAbandoned;
+		Stats.Attempts = FAttempts;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::GetParams(TReconnectParams& Params)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		Params = FParams;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::SetParams(const TReconnectParams& Params)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		FParams = Params;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CReconnectManager::GetDefaultParams(TReconnectParams& Params)
+{
+	Params.Enabled = true;
+	Params.Delay = DEFAULT_RECONNECT_DELAY;
+	Params.MaxDelay = DEFAULT_MAX_RECONNECT_DELAY;
+	Params.MaxAttempts = DEFAULT_RECONNECT_ATTEMPTS;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <map>
+
+#include "GattClient.h"
+
+using namespace std;
+
+// Default delay before the first reconnection attempt (ms).
+const unsigned long DEFAULT_RECONNECT_DELAY = 100;
+// Default maximum delay between reconnection attempts (ms).
+const unsigned long DEFAULT_MAX_RECONNECT_DELAY = 30000;
+// Default number of attempts before the device is left to the advertisements.
+const unsigned long DEFAULT_RECONNECT_ATTEMPTS = 8;
+// Period the due reconnections are checked with (ms).
+const unsigned long RECONNECT_CHECK_PERIOD = 50;
+
+// The reconnection configuration.
+typedef struct
+{
+	bool			Enabled;
+	unsigned long	Delay;
+	unsigned long	MaxDelay;
+	unsigned long	MaxAttempts;
+} TReconnectParams;
+
+// Reconnection counters.
+typedef struct
+{
+	// Devices that lost the link and are waiting for reconnection now.
+	unsigned long		Pending;
+	// Devices connected again after the link loss.
+	unsigned __int64	Recovered;
+	// Devices that failed all the attempts.
+	unsigned __int64	Abandoned;
+	// Attempts started by the manager.
+	unsigned __int64	Attempts;
+} TReconnectStats;
+
+// Decides when to reconnect the devices that lost the link. The device is
+// connected directly by its address without waiting for its advertisement.
+// The attempts are spread with exponential backoff: the delay doubles on each
+// failure starting from Delay until it reaches MaxDelay and the actual wait
+// is random between a half and the whole delay so the devices dropped at
+// once by the same interference do not come back at once. After MaxAttempts
+// failures the device is forgotten: it is found by its advertisements again.
+// The manager also measures the time from the link loss to the restored
+// connection.
+// The ms times are from any monotonic source. The time-to-recover is measured
+// with GetTimestamp.
+// The class is thread safe.
+class CReconnectManager
+{
+	DISABLE_COPY(CReconnectManager);
+
+private:
+	typedef struct
+	{
+		TClientProfile		Profile;
+		tstring				Name;
+		int					Rule;
+		unsigned long		Failures;
+		unsigned __int64	RetryAt;
+		// Timestamp of the link loss.
+		unsigned __int64	DroppedAt;
+		bool				InFlight;
+	} TDevice;
+
+	typedef map<__int64, TDevice> DEVICES;
+
+	RTL_CRITICAL_SECTION	FCS;
+	DEVICES*				FDevices;
+	TReconnectParams		FParams;
+	unsigned __int64		FRandom;
+
+	unsigned __int64		FRecovered;
+	unsigned __int64		FAbandoned;
+	unsigned __int64		FAttempts;
+
+	// Returns the delay before the next attempt. Must be called under the
+	// lock.
+	unsigned __int64 NextDelay(const unsigned long Failures);
+
+public:
+	CReconnectManager();
+	~CReconnectManager();
+
+	// Returns true if the link loss with the Reason must be recovered.
+	static bool IsRecoverable(const int Reason);
+
+	// The device lost the link. Schedules the first attempt. The client
+	// created for the attempt uses the Profile. The Name and the Rule the
+	// device was found with are returned by Next.
+	void Dropped(const __int64 Address, const TClientProfile& Profile,
+		const tstring& Name, const int Rule, const unsigned __int64 Now,
+		const unsigned __int64 Timestamp);
+	// Takes the device which attempt is due. On success the attempt is in
+	// flight until Completed or Postpone is called.
+	bool Next(const unsigned __int64 Now, __int64& Address, TClientProfile& Profile,
+		tstring& Name, int& Rule);
+	// The attempt taken by Next could not be started. It is retried after
+	// RECONNECT_CHECK_PERIOD and is not counted as a failure.
+	void Postpone(const __int64 Address, const unsigned __int64 Now);
+	// Must be called when any connection to the device completed, not only
+	// the one started by the manager. Returns true and the time since the
+	// link loss (us) if the device is recovered.
+	bool Completed(const __int64 Address, const bool Success, const unsigned __int64 Now,
+		const unsigned __int64 Timestamp, unsigned __int64& Downtime);
+	// Stops reconnecting the device.
+	void Cancel(const __int64 Address);
+	// Forgets all the devices. The counters are not cleared.
+	void Clear();
+
+	void GetStats(TReconnectStats& Stats);
+
+	void GetParams(TReconnectParams& Params);
+	// Sets the configuration. The devices already waiting keep their
+	// schedule.
+	void SetParams(const TReconnectParams& Params);
+	// Returns the default configuration.
+	static void GetDefaultParams(TReconnectParams& Params);
+};
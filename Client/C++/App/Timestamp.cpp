@@ -0,0 +1,23 @@
+#include "pch.h"
+
+#include "Timestamp.h"
+
+static LARGE_INTEGER GetFrequency()
+{
+	LARGE_INTEGER Frequency;
+	// Never fails on Windows XP and above.
+	QueryPerformanceFrequency(&Frequency);
+	return Frequency;
+}
+
+unsigned __int64 GetTimestamp()
+{
+	static const LARGE_INTEGER Frequency = GetFrequency();
+
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+	// Split the conversion to avoid overflow of Counter * 1000000.
+	unsigned __int64 Seconds = Counter.QuadPart / Frequency.QuadPart;
+	unsigned __int64 Rest = Counter.QuadPart % Frequency.QuadPart;
+	return Seconds * 1000000 + Rest * 1000000 / Frequency.QuadPart;
+}
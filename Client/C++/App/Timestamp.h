@@ -0,0 +1,5 @@
+#pragma once
+
+// Returns the monotonic time in microseconds. The value has meaning only
+// relative to other values returned by this function.
+unsigned __int64 GetTimestamp();
@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "ValueCache.h"
+#include "Timestamp.h"
+
+CValueCache::CValueCache()
+{
+	InitializeCriticalSection(&FCS);
+
+	FEntries = new vector<TEntry>();
+}
+
+CValueCache::~CValueCache()
+{
+	Clear();
+	delete FEntries;
+
+	DeleteCriticalSection(&FCS);
+}
+
+const CValueCache::TEntry* CValueCache::Find(const unsigned short Handle,
+	const unsigned long MaxAge) const
+{
+	for (vector<TEntry>::const_iterator Entry = FEntries->begin(); Entry != FEntries->end(); Entry++)
+	{
+		if (Entry->Handle != Handle)
+			continue;
+
+		// The timestamp may be a bit ahead of Now if the value has been
+		// stored by other thread right after Now was taken.
+		unsigned __int64 Now = GetTimestamp();
+		if (Entry->Timestamp <= Now && Now - Entry->Timestamp > (unsigned __int64)MaxAge * 1000)
+			return NULL;
+		return &(*Entry);
+	}
+	return NULL;
+}
+
+void CValueCache::Put(const unsigned short Handle, const unsigned char* const Value,
+	const unsigned long Length, const unsigned __int64 Timestamp)
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		TEntry* Entry = NULL;
+		for (vector<TEntry>::iterator i = FEntries->begin(); i != FEntries->end(); i++)
+		{
+			if (i->Handle == Handle)
+			{
+				Entry = &(*i);
+				break;
+			}
+		}
+
+		if (Entry == NULL)
+		{
+			TEntry New;
+			New.Handle = Handle;
+			New.Timestamp = 0;
+			New.Value = NULL;
+			New.Length = 0;
+			New.Capacity = 0;
+			FEntries->push_back(New);
+			Entry = &FEntries->back();
+		}
+		else if (Entry->Timestamp > Timestamp)
+			// A read started before the notification may complete after it.
+			return;
+
+		if (Length > Entry->Capacity)
+		{
+			unsigned char* Buffer = (unsigned char*)realloc(Entry->Value, Length);
+			if (Buffer == NULL)
+			{
+				// Do not keep the stale value.
+				Entry->Timestamp = 0;
+				Entry->Length = 0;
+				return;
+			}
+			Entry->Value = Buffer;
+			Entry->Capacity = Length;
+		}
+
+		if (Length > 0)
+			memcpy(Entry->Value, Value, Length);
+		Entry->Length = Length;
+		Entry->Timestamp = Timestamp;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CValueCache::Get(const unsigned short Handle, const unsigned long MaxAge,
+	unsigned char*& Value, unsigned long& Length)
+{
+	Value = NULL;
+	Length = 0;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		const TEntry* Entry = Find(Handle, MaxAge);
+		if (Entry == NULL || Entry->Timestamp == 0)
+			return false;
+
+		// Keep the library's contract: a value is always returned in the heap
+		// buffer, even the empty one.
+		Value = (unsigned char*)malloc(Entry->Length > 0 ? Entry->Length : 1);
+		if (Value == NULL)
+			return false;
+		if (Entry->Length > 0)
+			memcpy(Value, Entry->Value, Entry->Length);
+		Length = Entry->Length;
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+bool CValueCache::Get(const unsigned short Handle, const unsigned long MaxAge,
+	unsigned char* const Buffer, const unsigned long Size, unsigned long& Length)
+{
+	Length = 0;
+
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		const TEntry* Entry = Find(Handle, MaxAge);
+		if (Entry == NULL || Entry->Timestamp == 0)
+			return false;
+
+		if (Entry->Length > 0 && Entry->Length <= Size)
+			memcpy(Buffer, Entry->Value, Entry->Length);
+		Length = Entry->Length;
+		return true;
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
+
+void CValueCache::Clear()
+{
+	EnterCriticalSection(&FCS);
+	__try
+	{
+		for (vector<TEntry>::iterator Entry = FEntries->begin(); Entry != FEntries->end(); Entry++)
+		{
+			if (Entry->Value != NULL)
+				free(Entry->Value);
+		}
+		FEntries->clear();
+	}
+	__finally
+	{
+		LeaveCriticalSection(&FCS);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+
+using namespace std;
+using namespace wclCommon;
+
+#pragma region Value cache error codes
+const int VALUE_CACHE_E_BASE = 0x7F070000;
+// There is no value received not more than MaxAge milliseconds ago.
+const int VALUE_CACHE_E_NO_FRESH_VALUE = VALUE_CACHE_E_BASE + 0x0000;
+#pragma endregion Value cache error codes
+
+// The last known values of the characteristics of single connection, keyed
+// by the characteristic's value handle. Each value keeps the time it was
+// received so the reader decides if it is fresh enough. The value buffers
+// are reused, so updating a value allocates memory only when it grows. The
+// connection has few characteristics and the values are looked up linearly.
+// The class is thread safe.
+class CValueCache
+{
+	DISABLE_COPY(CValueCache);
+
+private:
+	typedef struct
+	{
+		unsigned short		Handle;
+		// Time the value was received (see GetTimestamp).
+		unsigned __int64	Timestamp;
+		unsigned char*		Value;
+		unsigned long		Length;
+		unsigned long		Capacity;
+	} TEntry;
+
+	RTL_CRITICAL_SECTION	FCS;
+	vector<TEntry>*			FEntries;
+
+	// Returns the fresh entry or NULL. Must be called under the lock.
+	const TEntry* Find(const unsigned short Handle, const unsigned long MaxAge) const;
+
+public:
+	CValueCache();
+	~CValueCache();
+
+	// Stores the value of the characteristic received at the Timestamp. An
+	// older value never replaces a newer one.
+	void Put(const unsigned short Handle, const unsigned char* const Value,
+		const unsigned long Length, const unsigned __int64 Timestamp);
+	// Returns the copy of the value if it was received not more than MaxAge
+	// milliseconds ago. The caller must free the Value.
+	bool Get(const unsigned short Handle, const unsigned long MaxAge,
+		unsigned char*& Value, unsigned long& Length);
+	// Copies the fresh value into the caller's buffer. Returns false if there
+	// is no fresh value. If the value does not fit into the buffer nothing is
+	// copied and Length receives the value's length: it is greater than Size.
+	bool Get(const unsigned short Handle, const unsigned long MaxAge,
+		unsigned char* const Buffer, const unsigned long Size, unsigned long& Length);
+	// Forgets all the values.
+	void Clear();
+};
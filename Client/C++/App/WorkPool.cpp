@@ -0,0 +1,130 @@
+#include "pch.h"
+
+#include "WorkPool.h"
+
+CWorkPool::CWorkPool()
+{
+	InitializeSRWLock(&FLock);
+
+	FPool = NULL;
+	FCleanupGroup = NULL;
+	FMaxThreads = 0;
+}
+
+CWorkPool::~CWorkPool()
+{
+	Close();
+}
+
+int CWorkPool::Open(const unsigned long MaxThreads)
+{
+	if (MaxThreads == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	AcquireSRWLockExclusive(&FLock);
+	__try
+	{
+		if (FPool != NULL)
+			return WORK_POOL_E_OPENED;
+
+		FPool = CreateThreadpool(NULL);
+		if (FPool == NULL)
+			return WCL_E_OUT_OF_MEMORY;
+
+		FCleanupGroup = CreateThreadpoolCleanupGroup();
+		if (FCleanupGroup == NULL)
+		{
+			CloseThreadpool(FPool);
+			FPool = NULL;
+			return WCL_E_OUT_OF_MEMORY;
+		}
+
+		SetThreadpoolThreadMaximum(FPool, MaxThreads);
+		SetThreadpoolThreadMinimum(FPool, 1);
+
+		// The cleanup group tracks the submitted items so the pool can wait
+		// for them.
+		InitializeThreadpoolEnvironment(&FEnvironment);
+		SetThreadpoolCallbackPool(&FEnvironment, FPool);
+		SetThreadpoolCallbackCleanupGroup(&FEnvironment, FCleanupGroup, NULL);
+
+		FMaxThreads = MaxThreads;
+		return WCL_E_SUCCESS;
+	}
+	__finally
+	{
+		ReleaseSRWLockExclusive(&FLock);
+	}
+}
+
+void CWorkPool::Close()
+{
+	PTP_POOL Pool;
+	PTP_CLEANUP_GROUP CleanupGroup;
+	AcquireSRWLockExclusive(&FLock);
+	__try
+	{
+		// No new items after that.
+		Pool = FPool;
+		CleanupGroup = FCleanupGroup;
+		FPool = NULL;
+		FCleanupGroup = NULL;
+	}
+	__finally
+	{
+		ReleaseSRWLockExclusive(&FLock);
+	}
+
+	if (Pool == NULL)
+		return;
+
+	// The items may take a while. Do not hold the lock: Submit must not block.
+	CloseThreadpoolCleanupGroupMembers(CleanupGroup, FALSE, NULL);
+	CloseThreadpoolCleanupGroup(CleanupGroup);
+	DestroyThreadpoolEnvironment(&FEnvironment);
+	CloseThreadpool(Pool);
+}
+
+bool CWorkPool::Submit(PTP_SIMPLE_CALLBACK Callback, PVOID Context)
+{
+	AcquireSRWLockShared(&FLock);
+	__try
+	{
+		if (FPool == NULL)
+			return false;
+		return (TrySubmitThreadpoolCallback(Callback, Context, &FEnvironment) == TRUE);
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FLock);
+	}
+}
+
+void CWorkPool::Drain()
+{
+	PTP_CLEANUP_GROUP CleanupGroup;
+	AcquireSRWLockShared(&FLock);
+	__try
+	{
+		CleanupGroup = FCleanupGroup;
+	}
+	__finally
+	{
+		ReleaseSRWLockShared(&FLock);
+	}
+
+	// Only the owner closes the pool so the group stays valid here. The group
+	// is still usable after its members have been closed.
+	if (CleanupGroup != NULL)
+		CloseThreadpoolCleanupGroupMembers(CleanupGroup, FALSE, NULL);
+}
+
+bool CWorkPool::GetActive() const
+{
+	return (FPool != NULL);
+}
+
+unsigned long CWorkPool::GetMaxThreads() const
+{
+	return FMaxThreads;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+#pragma region Work pool error codes
+const int WORK_POOL_E_BASE = 0x7F060000;
+// The pool is already opened.
+const int WORK_POOL_E_OPENED = WORK_POOL_E_BASE + 0x0000;
+#pragma endregion Work pool error codes
+
+// Private bounded thread pool. The items submitted here run on the pool's
+// own threads, not more than MaxThreads of them at the same time, so the
+// items that block on GATT requests never take the threads of the
+// process-wide pool the timers and other work need. The pool tracks the
+// submitted items: Drain and Close wait until they complete.
+// Submit can be called from any thread. Open, Close and Drain must be called
+// by the owner only and never from the pool's item.
+class CWorkPool
+{
+	DISABLE_COPY(CWorkPool);
+
+private:
+	// Submit takes the lock shared so the pool can not be closed under it.
+	SRWLOCK					FLock;
+	PTP_POOL				FPool;
+	PTP_CLEANUP_GROUP		FCleanupGroup;
+	TP_CALLBACK_ENVIRON		FEnvironment;
+	unsigned long			FMaxThreads;
+
+public:
+	CWorkPool();
+	// Closes the pool.
+	~CWorkPool();
+
+	// Creates the pool's threads. MaxThreads must be greater than zero.
+	int Open(const unsigned long MaxThreads);
+	// Rejects new items, waits for the submitted ones and destroys the pool's
+	// threads. Does nothing if the pool is not opened.
+	void Close();
+
+	// Queues the item. Returns false if the pool is not opened or the item
+	// can not be queued: the caller must run the item by itself then.
+	bool Submit(PTP_SIMPLE_CALLBACK Callback, PVOID Context);
+	// Waits until all the items submitted so far complete.
+	void Drain();
+
+	bool GetActive() const;
+	// Returns the maximum number of the items running at the same time.
+	unsigned long GetMaxThreads() const;
+};
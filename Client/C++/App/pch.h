@@ -8,6 +8,11 @@
 #define PCH_H
 
 // add headers that you want to pre-compile here
+#ifdef MULTIGATT_SIMULATOR
+// The core modules are built by the Linux simulator (see Client/C++/Simulator).
+#include "Win32Compat.h"
+#else
 #include "framework.h"
+#endif
 
 #endif //PCH_H
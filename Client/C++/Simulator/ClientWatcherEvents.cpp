@@ -0,0 +1,54 @@
+// Bodies of the CClientWatcher's events. With the events emulation an event is
+// an ordinary method which calls the handlers from the registry.
+
+#include "ClientWatcher.h"
+
+void CClientWatcher::OnClientDisconnected(const __int64 Address, const int Reason)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnClientDisconnected, Address, Reason);
+}
+
+void CClientWatcher::OnConnectionCompleted(const __int64 Address, const int Error)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnConnectionCompleted, Address, Error);
+}
+
+void CClientWatcher::OnConnectionStarted(const __int64 Address, const int Result)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnConnectionStarted, Address, Result);
+}
+
+void CClientWatcher::OnDeviceFound(const __int64 Address, const tstring& Name,
+	const int Rule)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnDeviceFound, Address, Name, Rule);
+}
+
+void CClientWatcher::OnValueChanged(const __int64 Address, const unsigned char* Value,
+	const unsigned long Length)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnValueChanged, Address, Value, Length);
+}
+
+void CClientWatcher::OnValuesChanged(const TValueRecord* Records, const unsigned long Count)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnValuesChanged, Records, Count);
+}
+
+void CClientWatcher::OnMessageReceived(const __int64 Address, const unsigned char* Message,
+	const unsigned long Length)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnMessageReceived, Address, Message, Length);
+}
+
+void CClientWatcher::OnReadCompleted(const __int64 Address, const unsigned long Id,
+	const int Result, const unsigned char* Value, const unsigned long Length)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnReadCompleted, Address, Id, Result, Value, Length);
+}
+
+void CClientWatcher::OnWriteCompleted(const __int64 Address, const unsigned long Id,
+	const int Result)
+{
+	wclEvents::Raise(this, &CClientWatcher::OnWriteCompleted, Address, Id, Result);
+}
@@ -0,0 +1,802 @@
+#include "Win32Compat.h"
+
+using namespace std;
+
+thread_local TSehLock SehLastLock = { NULL, NULL };
+
+#pragma region Locks
+static void ReleaseCriticalSection(void* Lock)
+{
+	pthread_mutex_unlock(&((RTL_CRITICAL_SECTION*)Lock)->Mutex);
+}
+
+static void ReleaseShared(void* Lock)
+{
+	pthread_rwlock_unlock(&((SRWLOCK*)Lock)->Lock);
+}
+
+static void ReleaseExclusive(void* Lock)
+{
+	pthread_rwlock_unlock(&((SRWLOCK*)Lock)->Lock);
+}
+
+static void RememberLock(void* Lock, void (*Release)(void* Lock))
+{
+	SehLastLock.Lock = Lock;
+	SehLastLock.Release = Release;
+}
+
+static void ForgetLock(void* Lock)
+{
+	if (SehLastLock.Lock == Lock)
+		SehLastLock.Lock = NULL;
+}
+
+void InitializeCriticalSection(RTL_CRITICAL_SECTION* CS)
+{
+	// Critical sections are recursive.
+	pthread_mutexattr_t Attr;
+	pthread_mutexattr_init(&Attr);
+	pthread_mutexattr_settype(&Attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&CS->Mutex, &Attr);
+	pthread_mutexattr_destroy(&Attr);
+}
+
+void DeleteCriticalSection(RTL_CRITICAL_SECTION* CS)
+{
+	pthread_mutex_destroy(&CS->Mutex);
+}
+
+void EnterCriticalSection(RTL_CRITICAL_SECTION* CS)
+{
+	pthread_mutex_lock(&CS->Mutex);
+	RememberLock(CS, ReleaseCriticalSection);
+}
+
+void LeaveCriticalSection(RTL_CRITICAL_SECTION* CS)
+{
+	ForgetLock(CS);
+	pthread_mutex_unlock(&CS->Mutex);
+}
+
+void InitializeSRWLock(SRWLOCK* Lock)
+{
+	pthread_rwlock_init(&Lock->Lock, NULL);
+}
+
+void AcquireSRWLockShared(SRWLOCK* Lock)
+{
+	pthread_rwlock_rdlock(&Lock->Lock);
+	RememberLock(Lock, ReleaseShared);
+}
+
+void ReleaseSRWLockShared(SRWLOCK* Lock)
+{
+	ForgetLock(Lock);
+	pthread_rwlock_unlock(&Lock->Lock);
+}
+
+void AcquireSRWLockExclusive(SRWLOCK* Lock)
+{
+	pthread_rwlock_wrlock(&Lock->Lock);
+	RememberLock(Lock, ReleaseExclusive);
+}
+
+void ReleaseSRWLockExclusive(SRWLOCK* Lock)
+{
+	ForgetLock(Lock);
+	pthread_rwlock_unlock(&Lock->Lock);
+}
+#pragma endregion Locks
+
+#pragma region Kernel objects
+// Base of all the objects behind HANDLE. The handle is a reference:
+// DuplicateHandle adds one and CloseHandle drops one.
+class CKernelObject
+{
+private:
+	volatile LONG	FRefCount;
+
+public:
+	CKernelObject() { FRefCount = 1; }
+	virtual ~CKernelObject() { }
+
+	void AddRef() { InterlockedIncrement(&FRefCount); }
+	void Release()
+	{
+		if (InterlockedDecrement(&FRefCount) == 0)
+			delete this;
+	}
+
+	virtual DWORD Wait(const DWORD Timeout) { return WAIT_FAILED; }
+};
+
+// The object that can be waited for.
+class CWaitableObject : public CKernelObject
+{
+protected:
+	mutex				FLock;
+	condition_variable	FSignal;
+
+	// Returns true if the object is signaled and takes the signal if the
+	// object is auto-reset. Called under the lock.
+	virtual bool TryAcquire() = 0;
+
+public:
+	virtual DWORD Wait(const DWORD Timeout) override
+	{
+		unique_lock<mutex> Lock(FLock);
+		if (Timeout == INFINITE)
+		{
+			FSignal.wait(Lock, [this] { return TryAcquire(); });
+			return WAIT_OBJECT_0;
+		}
+		if (FSignal.wait_for(Lock, chrono::milliseconds(Timeout), [this] { return TryAcquire(); }))
+			return WAIT_OBJECT_0;
+		return WAIT_TIMEOUT;
+	}
+};
+
+class CEventObject : public CWaitableObject
+{
+private:
+	bool	FManualReset;
+	bool	FSignaled;
+
+protected:
+	virtual bool TryAcquire() override
+	{
+		if (!FSignaled)
+			return false;
+		if (!FManualReset)
+			FSignaled = false;
+		return true;
+	}
+
+public:
+	CEventObject(const bool ManualReset, const bool Signaled)
+	{
+		FManualReset = ManualReset;
+		FSignaled = Signaled;
+	}
+
+	void Set()
+	{
+		lock_guard<mutex> Lock(FLock);
+		FSignaled = true;
+		FSignal.notify_all();
+	}
+
+	void Reset()
+	{
+		lock_guard<mutex> Lock(FLock);
+		FSignaled = false;
+	}
+};
+
+class CSemaphoreObject : public CWaitableObject
+{
+private:
+	LONG	FCount;
+	LONG	FMaximum;
+
+protected:
+	virtual bool TryAcquire() override
+	{
+		if (FCount == 0)
+			return false;
+		FCount--;
+		return true;
+	}
+
+public:
+	CSemaphoreObject(const LONG Count, const LONG Maximum)
+	{
+		FCount = Count;
+		FMaximum = Maximum;
+	}
+
+	bool Release(const LONG Count, LONG* Previous)
+	{
+		lock_guard<mutex> Lock(FLock);
+		if (Count <= 0 || FCount + Count > FMaximum)
+			return false;
+		if (Previous != NULL)
+			*Previous = FCount;
+		FCount += Count;
+		FSignal.notify_all();
+		return true;
+	}
+};
+
+// Signaled when the thread function returns.
+class CThreadObject : public CWaitableObject
+{
+private:
+	bool	FTerminated;
+
+protected:
+	virtual bool TryAcquire() override
+	{
+		return FTerminated;
+	}
+
+public:
+	CThreadObject() { FTerminated = false; }
+
+	void Terminated()
+	{
+		lock_guard<mutex> Lock(FLock);
+		FTerminated = true;
+		FSignal.notify_all();
+	}
+};
+
+class CFileObject : public CKernelObject
+{
+public:
+	FILE*	File;
+
+	explicit CFileObject(FILE* const File) { this->File = File; }
+	virtual ~CFileObject() { fclose(File); }
+};
+
+template<typename T>
+static T* GetObject(HANDLE Handle)
+{
+	if (Handle == NULL || Handle == INVALID_HANDLE_VALUE)
+		return NULL;
+	return dynamic_cast<T*>((CKernelObject*)Handle);
+}
+
+HANDLE CreateEvent(void* Attributes, const BOOL ManualReset, const BOOL InitialState,
+	const char* Name)
+{
+	return (CKernelObject*)new CEventObject(ManualReset != FALSE, InitialState != FALSE);
+}
+
+BOOL SetEvent(HANDLE Event)
+{
+	CEventObject* Object = GetObject<CEventObject>(Event);
+	if (Object == NULL)
+		return FALSE;
+	Object->Set();
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE Event)
+{
+	CEventObject* Object = GetObject<CEventObject>(Event);
+	if (Object == NULL)
+		return FALSE;
+	Object->Reset();
+	return TRUE;
+}
+
+HANDLE CreateSemaphore(void* Attributes, const LONG InitialCount, const LONG MaximumCount,
+	const char* Name)
+{
+	if (InitialCount < 0 || MaximumCount <= 0 || InitialCount > MaximumCount)
+		return NULL;
+	return (CKernelObject*)new CSemaphoreObject(InitialCount, MaximumCount);
+}
+
+BOOL ReleaseSemaphore(HANDLE Semaphore, const LONG ReleaseCount, LONG* PreviousCount)
+{
+	CSemaphoreObject* Object = GetObject<CSemaphoreObject>(Semaphore);
+	if (Object == NULL)
+		return FALSE;
+	return (Object->Release(ReleaseCount, PreviousCount) ? TRUE : FALSE);
+}
+
+HANDLE CreateThread(void* Attributes, const size_t StackSize, LPTHREAD_START_ROUTINE Proc,
+	LPVOID Param, const DWORD Flags, DWORD* ThreadId)
+{
+	if (Proc == NULL)
+		return NULL;
+
+	CThreadObject* Object = new CThreadObject();
+	// The running thread holds its own reference.
+	Object->AddRef();
+	thread Thread([Object, Proc, Param]
+	{
+		Proc(Param);
+		Object->Terminated();
+		Object->Release();
+	});
+	Thread.detach();
+
+	if (ThreadId != NULL)
+		*ThreadId = 0;
+	return (CKernelObject*)Object;
+}
+
+DWORD WaitForSingleObject(HANDLE Handle, const DWORD Timeout)
+{
+	CKernelObject* Object = GetObject<CKernelObject>(Handle);
+	if (Object == NULL)
+		return WAIT_FAILED;
+	return Object->Wait(Timeout);
+}
+
+BOOL CloseHandle(HANDLE Handle)
+{
+	CKernelObject* Object = GetObject<CKernelObject>(Handle);
+	if (Object == NULL)
+		return FALSE;
+	Object->Release();
+	return TRUE;
+}
+
+HANDLE GetCurrentProcess()
+{
+	// Pseudo handle as on Windows.
+	return INVALID_HANDLE_VALUE;
+}
+
+BOOL DuplicateHandle(HANDLE SourceProcess, HANDLE Source, HANDLE TargetProcess,
+	HANDLE* Target, const DWORD Access, const BOOL Inherit, const DWORD Options)
+{
+	CKernelObject* Object = GetObject<CKernelObject>(Source);
+	if (Object == NULL || Target == NULL)
+		return FALSE;
+	Object->AddRef();
+	*Target = Source;
+	return TRUE;
+}
+#pragma endregion Kernel objects
+
+#pragma region Thread pool
+// The threads are created on demand up to the maximum and wait for the work
+// until the pool is closed. The process-wide pool is never closed.
+class CThreadPool
+{
+private:
+	mutex						FLock;
+	condition_variable			FSignal;
+	queue<function<void()>>		FWork;
+	DWORD						FMaxThreads;
+	DWORD						FThreads;
+	DWORD						FIdle;
+	bool						FClosed;
+
+	void WorkerProc()
+	{
+		unique_lock<mutex> Lock(FLock);
+		while (true)
+		{
+			FIdle++;
+			FSignal.wait(Lock, [this] { return (!FWork.empty() || FClosed); });
+			FIdle--;
+			if (FWork.empty())
+				break;
+
+			function<void()> Work = FWork.front();
+			FWork.pop();
+			Lock.unlock();
+			Work();
+			Lock.lock();
+		}
+
+		// The last thread of the closed pool destroys it.
+		FThreads--;
+		bool Last = (FThreads == 0);
+		Lock.unlock();
+		if (Last)
+			delete this;
+	}
+
+	// Called under the lock.
+	void AddThread()
+	{
+		FThreads++;
+		thread(&CThreadPool::WorkerProc, this).detach();
+	}
+
+public:
+	CThreadPool(const DWORD MaxThreads)
+	{
+		FMaxThreads = MaxThreads;
+		FThreads = 0;
+		FIdle = 0;
+		FClosed = false;
+	}
+
+	bool Submit(const function<void()>& Work)
+	{
+		lock_guard<mutex> Lock(FLock);
+		if (FClosed)
+			return false;
+
+		FWork.push(Work);
+		if (FIdle < FWork.size() && FThreads < FMaxThreads)
+			AddThread();
+		FSignal.notify_one();
+		return true;
+	}
+
+	void SetMaximum(const DWORD Maximum)
+	{
+		lock_guard<mutex> Lock(FLock);
+		FMaxThreads = (Maximum > 0 ? Maximum : 1);
+	}
+
+	void SetMinimum(const DWORD Minimum)
+	{
+		lock_guard<mutex> Lock(FLock);
+		while (FThreads < Minimum && FThreads < FMaxThreads)
+			AddThread();
+	}
+
+	void Close()
+	{
+		unique_lock<mutex> Lock(FLock);
+		FClosed = true;
+		FSignal.notify_all();
+		if (FThreads == 0)
+		{
+			Lock.unlock();
+			delete this;
+		}
+	}
+
+	static CThreadPool* Get()
+	{
+		// Never destroyed: the workers may still run when static objects are
+		// destroyed.
+		static CThreadPool* Pool = CreateDefault();
+		return Pool;
+	}
+
+	static CThreadPool* CreateDefault()
+	{
+		unsigned int Count = thread::hardware_concurrency() * 2;
+		if (Count < 8)
+			Count = 8;
+		CThreadPool* Pool = new CThreadPool(Count);
+		Pool->SetMinimum(Count);
+		return Pool;
+	}
+};
+
+// Counts the callbacks submitted with the group's environment.
+class CCleanupGroup
+{
+private:
+	mutex				FLock;
+	condition_variable	FSignal;
+	unsigned long		FPending;
+
+public:
+	CCleanupGroup()
+	{
+		FPending = 0;
+	}
+
+	void Enter()
+	{
+		lock_guard<mutex> Lock(FLock);
+		FPending++;
+	}
+
+	void Leave()
+	{
+		lock_guard<mutex> Lock(FLock);
+		FPending--;
+		if (FPending == 0)
+			FSignal.notify_all();
+	}
+
+	void Wait()
+	{
+		unique_lock<mutex> Lock(FLock);
+		FSignal.wait(Lock, [this] { return (FPending == 0); });
+	}
+};
+
+PTP_POOL CreateThreadpool(PVOID Reserved)
+{
+	// The system's default maximum.
+	return new CThreadPool(500);
+}
+
+VOID SetThreadpoolThreadMaximum(PTP_POOL Pool, const DWORD Maximum)
+{
+	if (Pool != NULL)
+		Pool->SetMaximum(Maximum);
+}
+
+BOOL SetThreadpoolThreadMinimum(PTP_POOL Pool, const DWORD Minimum)
+{
+	if (Pool == NULL)
+		return FALSE;
+	Pool->SetMinimum(Minimum);
+	return TRUE;
+}
+
+VOID CloseThreadpool(PTP_POOL Pool)
+{
+	if (Pool != NULL)
+		Pool->Close();
+}
+
+VOID InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON Environment)
+{
+	Environment->Pool = NULL;
+	Environment->CleanupGroup = NULL;
+}
+
+VOID DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON Environment)
+{
+}
+
+VOID SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON Environment, PTP_POOL Pool)
+{
+	Environment->Pool = Pool;
+}
+
+VOID SetThreadpoolCallbackCleanupGroup(PTP_CALLBACK_ENVIRON Environment,
+	PTP_CLEANUP_GROUP Group, PTP_CLEANUP_GROUP_CANCEL_CALLBACK Callback)
+{
+	Environment->CleanupGroup = Group;
+}
+
+PTP_CLEANUP_GROUP CreateThreadpoolCleanupGroup()
+{
+	return new CCleanupGroup();
+}
+
+VOID CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP Group,
+	const BOOL CancelPendingCallbacks, PVOID CleanupContext)
+{
+	if (Group != NULL)
+		Group->Wait();
+}
+
+VOID CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP Group)
+{
+	if (Group != NULL)
+		delete Group;
+}
+
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK Callback, PVOID Context,
+	PTP_CALLBACK_ENVIRON Environment)
+{
+	if (Callback == NULL)
+		return FALSE;
+
+	CThreadPool* Pool = CThreadPool::Get();
+	CCleanupGroup* Group = NULL;
+	if (Environment != NULL)
+	{
+		if (Environment->Pool != NULL)
+			Pool = Environment->Pool;
+		Group = Environment->CleanupGroup;
+	}
+
+	if (Group != NULL)
+		Group->Enter();
+	bool Submitted = Pool->Submit([Callback, Context, Group]
+	{
+		Callback(NULL, Context);
+		if (Group != NULL)
+			Group->Leave();
+	});
+	if (!Submitted && Group != NULL)
+		Group->Leave();
+	return (Submitted ? TRUE : FALSE);
+}
+
+// Each timer has its own thread. The simulator uses only a few timers.
+class CThreadpoolTimer
+{
+private:
+	PTP_TIMER_CALLBACK				FCallback;
+	PVOID							FContext;
+
+	mutex							FLock;
+	condition_variable				FSignal;
+	bool							FArmed;
+	chrono::steady_clock::time_point	FDue;
+	DWORD							FPeriod;
+	bool							FRunning;
+	bool							FTerminate;
+	thread							FThread;
+
+	void TimerProc()
+	{
+		unique_lock<mutex> Lock(FLock);
+		while (!FTerminate)
+		{
+			if (!FArmed)
+			{
+				FSignal.wait(Lock);
+				continue;
+			}
+			if (chrono::steady_clock::now() < FDue)
+			{
+				FSignal.wait_until(Lock, FDue);
+				continue;
+			}
+
+			if (FPeriod > 0)
+				FDue += chrono::milliseconds(FPeriod);
+			else
+				FArmed = false;
+
+			FRunning = true;
+			Lock.unlock();
+			FCallback(NULL, FContext, this);
+			Lock.lock();
+			FRunning = false;
+			FSignal.notify_all();
+		}
+	}
+
+public:
+	CThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context)
+	{
+		FCallback = Callback;
+		FContext = Context;
+		FArmed = false;
+		FPeriod = 0;
+		FRunning = false;
+		FTerminate = false;
+		FThread = thread(&CThreadpoolTimer::TimerProc, this);
+	}
+
+	~CThreadpoolTimer()
+	{
+		{
+			lock_guard<mutex> Lock(FLock);
+			FTerminate = true;
+			FSignal.notify_all();
+		}
+		if (FThread.get_id() == this_thread::get_id())
+			FThread.detach();
+		else
+			FThread.join();
+	}
+
+	void Set(const FILETIME* const DueTime, const DWORD Period)
+	{
+		lock_guard<mutex> Lock(FLock);
+		if (DueTime == NULL)
+			FArmed = false;
+		else
+		{
+			LONGLONG Due = (LONGLONG)(((ULONGLONG)DueTime->dwHighDateTime << 32) |
+				DueTime->dwLowDateTime);
+			// Relative time in 100 ns units. Absolute time fires right away.
+			LONGLONG Delay = (Due < 0 ? -Due / 10 : 0);
+			FDue = chrono::steady_clock::now() + chrono::microseconds(Delay);
+			FPeriod = Period;
+			FArmed = true;
+		}
+		FSignal.notify_all();
+	}
+
+	void Wait(const bool Cancel)
+	{
+		unique_lock<mutex> Lock(FLock);
+		if (Cancel)
+			FArmed = false;
+		// Do not wait for ourselves.
+		if (FThread.get_id() != this_thread::get_id())
+			FSignal.wait(Lock, [this] { return !FRunning; });
+	}
+};
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context,
+	PTP_CALLBACK_ENVIRON Environment)
+{
+	if (Callback == NULL)
+		return NULL;
+	return new CThreadpoolTimer(Callback, Context);
+}
+
+VOID SetThreadpoolTimer(PTP_TIMER Timer, FILETIME* DueTime, const DWORD Period,
+	const DWORD WindowLength)
+{
+	if (Timer != NULL)
+		Timer->Set(DueTime, Period);
+}
+
+VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer, const BOOL CancelPending)
+{
+	if (Timer != NULL)
+		Timer->Wait(CancelPending != FALSE);
+}
+
+VOID CloseThreadpoolTimer(PTP_TIMER Timer)
+{
+	if (Timer != NULL)
+		delete Timer;
+}
+#pragma endregion Thread pool
+
+#pragma region Files
+HANDLE CreateFile(const char* FileName, const DWORD Access, const DWORD ShareMode,
+	void* Attributes, const DWORD Disposition, const DWORD Flags, HANDLE Template)
+{
+	const char* Mode;
+	if (Disposition == CREATE_ALWAYS)
+		Mode = ((Access & GENERIC_READ) != 0 ? "w+b" : "wb");
+	else
+		Mode = ((Access & GENERIC_WRITE) != 0 ? "r+b" : "rb");
+
+	FILE* File = fopen(FileName, Mode);
+	if (File == NULL)
+		return INVALID_HANDLE_VALUE;
+	return (CKernelObject*)new CFileObject(File);
+}
+
+DWORD GetFileSize(HANDLE File, DWORD* SizeHigh)
+{
+	CFileObject* Object = GetObject<CFileObject>(File);
+	if (Object == NULL)
+		return INVALID_FILE_SIZE;
+
+	long Position = ftell(Object->File);
+	if (fseek(Object->File, 0, SEEK_END) != 0)
+		return INVALID_FILE_SIZE;
+	long Size = ftell(Object->File);
+	fseek(Object->File, Position, SEEK_SET);
+	if (Size < 0)
+		return INVALID_FILE_SIZE;
+
+	if (SizeHigh != NULL)
+		*SizeHigh = (DWORD)((unsigned long long)Size >> 32);
+	return (DWORD)Size;
+}
+
+BOOL ReadFile(HANDLE File, void* Buffer, const DWORD Size, DWORD* Read, void* Overlapped)
+{
+	CFileObject* Object = GetObject<CFileObject>(File);
+	if (Object == NULL)
+		return FALSE;
+	size_t Count = fread(Buffer, 1, Size, Object->File);
+	if (Read != NULL)
+		*Read = (DWORD)Count;
+	return (ferror(Object->File) == 0 ? TRUE : FALSE);
+}
+
+BOOL WriteFile(HANDLE File, const void* Buffer, const DWORD Size, DWORD* Written,
+	void* Overlapped)
+{
+	CFileObject* Object = GetObject<CFileObject>(File);
+	if (Object == NULL)
+		return FALSE;
+	size_t Count = fwrite(Buffer, 1, Size, Object->File);
+	if (Written != NULL)
+		*Written = (DWORD)Count;
+	return (Count == Size ? TRUE : FALSE);
+}
+#pragma endregion Files
+
+#pragma region Time
+ULONGLONG GetTickCount64()
+{
+	return (ULONGLONG)chrono::duration_cast<chrono::milliseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* Counter)
+{
+	Counter->QuadPart = (LONGLONG)chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency)
+{
+	// The counter runs in nanoseconds.
+	Frequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+VOID Sleep(const DWORD Milliseconds)
+{
+	this_thread::sleep_for(chrono::milliseconds(Milliseconds));
+}
+#pragma endregion Time
@@ -0,0 +1,327 @@
+#pragma once
+
+// The subset of the Win32 API used by the client's core modules implemented
+// on top of the C++ standard library and POSIX. Only what the application
+// sources actually call is here: it is not a general purpose emulation.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+
+// libstdc++ uses the __try and __finally names internally so all the standard
+// headers the application needs must be included before they are redefined.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#pragma region Compiler extensions
+#define __int64			long long
+#define __fastcall
+#define WINAPI
+#define CALLBACK
+// Properties are not supported by GCC. The declaration becomes an unused
+// field so the code must call the getters.
+#define __declspec(x)
+#pragma endregion Compiler extensions
+
+#pragma region Basic types
+typedef void				VOID;
+typedef void*				PVOID;
+typedef void*				LPVOID;
+typedef int					BOOL;
+typedef int					LONG;
+typedef unsigned int		DWORD;
+typedef long long			LONG64;
+typedef long long			LONGLONG;
+typedef unsigned long long	ULONGLONG;
+typedef void*				HANDLE;
+
+#define TRUE				1
+#define FALSE				0
+#define INFINITE			0xFFFFFFFF
+#define MAXLONGLONG			0x7FFFFFFFFFFFFFFFLL
+
+#define WAIT_OBJECT_0		0x00000000
+#define WAIT_TIMEOUT		0x00000102
+#define WAIT_FAILED			0xFFFFFFFF
+
+#define INVALID_HANDLE_VALUE	((HANDLE)(intptr_t)-1)
+
+typedef union
+{
+	struct
+	{
+		DWORD	LowPart;
+		LONG	HighPart;
+	};
+	LONGLONG	QuadPart;
+} LARGE_INTEGER;
+
+typedef struct
+{
+	DWORD	dwLowDateTime;
+	DWORD	dwHighDateTime;
+} FILETIME;
+
+typedef struct
+{
+	uint32_t		Data1;
+	unsigned short	Data2;
+	unsigned short	Data3;
+	unsigned char	Data4[8];
+} GUID;
+
+inline bool IsEqualGUID(const GUID& a, const GUID& b)
+{
+	return (memcmp(&a, &b, sizeof(GUID)) == 0);
+}
+
+#define ZeroMemory(Destination, Length)	memset((Destination), 0, (Length))
+#pragma endregion Basic types
+
+#pragma region Interlocked operations
+inline LONG InterlockedIncrement(volatile LONG* Value)
+{
+	return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* Value)
+{
+	return __atomic_sub_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* Target, const LONG Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG* Target, const LONG Value)
+{
+	return __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* Target, const LONG Exchange,
+	const LONG Comparand)
+{
+	LONG Expected = Comparand;
+	__atomic_compare_exchange_n(Target, &Expected, Exchange, false, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return Expected;
+}
+
+inline LONG64 InterlockedIncrement64(volatile LONG64* Value)
+{
+	return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedDecrement64(volatile LONG64* Value)
+{
+	return __atomic_sub_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchange64(volatile LONG64* Target, const LONG64 Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchangeAdd64(volatile LONG64* Target, const LONG64 Value)
+{
+	return __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedCompareExchange64(volatile LONG64* Target, const LONG64 Exchange,
+	const LONG64 Comparand)
+{
+	LONG64 Expected = Comparand;
+	__atomic_compare_exchange_n(Target, &Expected, Exchange, false, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return Expected;
+}
+#pragma endregion Interlocked operations
+
+#pragma region Locks
+typedef struct
+{
+	pthread_mutex_t		Mutex;
+} RTL_CRITICAL_SECTION, CRITICAL_SECTION;
+
+typedef struct
+{
+	pthread_rwlock_t	Lock;
+} SRWLOCK;
+
+void InitializeCriticalSection(RTL_CRITICAL_SECTION* CS);
+void DeleteCriticalSection(RTL_CRITICAL_SECTION* CS);
+void EnterCriticalSection(RTL_CRITICAL_SECTION* CS);
+void LeaveCriticalSection(RTL_CRITICAL_SECTION* CS);
+
+void InitializeSRWLock(SRWLOCK* Lock);
+void AcquireSRWLockShared(SRWLOCK* Lock);
+void ReleaseSRWLockShared(SRWLOCK* Lock);
+void AcquireSRWLockExclusive(SRWLOCK* Lock);
+void ReleaseSRWLockExclusive(SRWLOCK* Lock);
+#pragma endregion Locks
+
+#pragma region Structured exception handling
+// The application protects every lock with
+//     Acquire(Lock);
+//     __try { ... } __finally { Release(Lock); }
+// and the __finally block never does anything else. GCC has no SEH so the
+// pattern is emulated: each acquire remembers the lock in the thread's slot,
+// __try moves it into a guard object that releases the lock when the
+// protected block is left by any path (including return), and the __finally
+// block is skipped. Code compiled for the simulator must keep that pattern.
+typedef struct
+{
+	void*	Lock;
+	void	(*Release)(void* Lock);
+} TSehLock;
+
+extern thread_local TSehLock SehLastLock;
+
+class CSehFinally
+{
+private:
+	TSehLock	FLock;
+
+public:
+	CSehFinally()
+	{
+		FLock = SehLastLock;
+		SehLastLock.Lock = NULL;
+	}
+
+	~CSehFinally()
+	{
+		if (FLock.Lock != NULL)
+			FLock.Release(FLock.Lock);
+	}
+
+	CSehFinally(const CSehFinally&) = delete;
+	CSehFinally& operator=(const CSehFinally&) = delete;
+};
+
+// The guard lives in the if statement's initializer so it is destroyed when
+// the protected block is left in any way. libstdc++ has its own __try.
+#undef __try
+#define __try		if (CSehFinally _SehFinally; true)
+#define __finally	if (false)
+#pragma endregion Structured exception handling
+
+#pragma region Kernel objects
+HANDLE CreateEvent(void* Attributes, const BOOL ManualReset, const BOOL InitialState,
+	const char* Name);
+BOOL SetEvent(HANDLE Event);
+BOOL ResetEvent(HANDLE Event);
+
+HANDLE CreateSemaphore(void* Attributes, const LONG InitialCount, const LONG MaximumCount,
+	const char* Name);
+BOOL ReleaseSemaphore(HANDLE Semaphore, const LONG ReleaseCount, LONG* PreviousCount);
+
+typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID Param);
+HANDLE CreateThread(void* Attributes, const size_t StackSize, LPTHREAD_START_ROUTINE Proc,
+	LPVOID Param, const DWORD Flags, DWORD* ThreadId);
+
+DWORD WaitForSingleObject(HANDLE Handle, const DWORD Timeout);
+BOOL CloseHandle(HANDLE Handle);
+
+#define DUPLICATE_SAME_ACCESS	0x00000002
+HANDLE GetCurrentProcess();
+BOOL DuplicateHandle(HANDLE SourceProcess, HANDLE Source, HANDLE TargetProcess,
+	HANDLE* Target, const DWORD Access, const BOOL Inherit, const DWORD Options);
+#pragma endregion Kernel objects
+
+#pragma region Thread pool
+typedef struct TP_CALLBACK_INSTANCE_* PTP_CALLBACK_INSTANCE;
+typedef class CThreadPool* PTP_POOL;
+typedef class CCleanupGroup* PTP_CLEANUP_GROUP;
+typedef class CThreadpoolTimer* PTP_TIMER;
+
+// Only the pool and the cleanup group of the environment are used.
+typedef struct TP_CALLBACK_ENVIRON_
+{
+	PTP_POOL			Pool;
+	PTP_CLEANUP_GROUP	CleanupGroup;
+} TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+
+typedef VOID (*PTP_SIMPLE_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context);
+typedef VOID (*PTP_TIMER_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context,
+	PTP_TIMER Timer);
+typedef VOID (*PTP_CLEANUP_GROUP_CANCEL_CALLBACK)(PVOID ObjectContext, PVOID CleanupContext);
+
+// The private pool's threads are created on demand up to the maximum. The
+// closed pool is destroyed when its last callback returns.
+PTP_POOL CreateThreadpool(PVOID Reserved);
+VOID SetThreadpoolThreadMaximum(PTP_POOL Pool, const DWORD Maximum);
+BOOL SetThreadpoolThreadMinimum(PTP_POOL Pool, const DWORD Minimum);
+VOID CloseThreadpool(PTP_POOL Pool);
+
+VOID InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON Environment);
+VOID DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON Environment);
+VOID SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON Environment, PTP_POOL Pool);
+VOID SetThreadpoolCallbackCleanupGroup(PTP_CALLBACK_ENVIRON Environment,
+	PTP_CLEANUP_GROUP Group, PTP_CLEANUP_GROUP_CANCEL_CALLBACK Callback);
+
+PTP_CLEANUP_GROUP CreateThreadpoolCleanupGroup();
+// Only waiting for the members is supported: the pending callbacks are never
+// cancelled.
+VOID CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP Group,
+	const BOOL CancelPendingCallbacks, PVOID CleanupContext);
+VOID CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP Group);
+
+// Without the environment the callback runs on the process-wide pool.
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK Callback, PVOID Context,
+	PTP_CALLBACK_ENVIRON Environment);
+
+// The environment is ignored: each timer has its own thread.
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context,
+	PTP_CALLBACK_ENVIRON Environment);
+// Only relative due times (negative values) are supported.
+VOID SetThreadpoolTimer(PTP_TIMER Timer, FILETIME* DueTime, const DWORD Period,
+	const DWORD WindowLength);
+VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer, const BOOL CancelPending);
+VOID CloseThreadpoolTimer(PTP_TIMER Timer);
+#pragma endregion Thread pool
+
+#pragma region Files
+#define GENERIC_READ			0x80000000
+#define GENERIC_WRITE			0x40000000
+#define FILE_SHARE_READ			0x00000001
+#define CREATE_ALWAYS			2
+#define OPEN_EXISTING			3
+#define FILE_ATTRIBUTE_NORMAL	0x00000080
+#define INVALID_FILE_SIZE		0xFFFFFFFF
+
+HANDLE CreateFile(const char* FileName, const DWORD Access, const DWORD ShareMode,
+	void* Attributes, const DWORD Disposition, const DWORD Flags, HANDLE Template);
+DWORD GetFileSize(HANDLE File, DWORD* SizeHigh);
+BOOL ReadFile(HANDLE File, void* Buffer, const DWORD Size, DWORD* Read, void* Overlapped);
+BOOL WriteFile(HANDLE File, const void* Buffer, const DWORD Size, DWORD* Written,
+	void* Overlapped);
+#pragma endregion Files
+
+#pragma region Time
+ULONGLONG GetTickCount64();
+BOOL QueryPerformanceCounter(LARGE_INTEGER* Counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* Frequency);
+VOID Sleep(const DWORD Milliseconds);
+#pragma endregion Time
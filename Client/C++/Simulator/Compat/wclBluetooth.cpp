@@ -0,0 +1,303 @@
+#include "wclBluetooth.h"
+
+#include "SimFleet.h"
+
+namespace wclBluetooth
+{
+#pragma region CwclBluetoothRadio
+	CwclBluetoothRadio::CwclBluetoothRadio(CSimFleet* const Fleet)
+	{
+		FFleet = Fleet;
+	}
+
+	CSimFleet* CwclBluetoothRadio::GetFleet() const
+	{
+		return FFleet;
+	}
+#pragma endregion CwclBluetoothRadio
+
+#pragma region CwclBluetoothLeBeaconWatcher
+	void CwclBluetoothLeBeaconWatcher::DoAdvertisementFrameInformation(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const tstring& Name,
+		const wclBluetoothLeAdvertisementType PacketType,
+		const wclBluetoothLeAdvertisementFlags& Flags)
+	{
+		// The fleet's advertisements have no other data.
+	}
+
+	void CwclBluetoothLeBeaconWatcher::DoAdvertisementUuidFrame(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const GUID& Uuid)
+	{
+		OnAdvertisementUuidFrame(this, Address, Timestamp, Rssi, Uuid);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::DoAdvertisementManufacturerRawFrame(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const unsigned short CompanyId,
+		const unsigned char* const Data, const unsigned long Length)
+	{
+		OnAdvertisementManufacturerRawFrame(this, Address, Timestamp, Rssi, CompanyId,
+			Data, Length);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::DoStarted()
+	{
+		OnStarted(this);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::DoStopped()
+	{
+		OnStopped(this);
+	}
+
+	CwclBluetoothLeBeaconWatcher::CwclBluetoothLeBeaconWatcher()
+	{
+		Monitoring = false;
+		Radio = NULL;
+		ScanningMode = smActive;
+	}
+
+	CwclBluetoothLeBeaconWatcher::~CwclBluetoothLeBeaconWatcher()
+	{
+		if (Monitoring)
+		{
+			Monitoring = false;
+			Radio->GetFleet()->StopScan(this);
+		}
+		wclEvents::RemoveSource(this);
+	}
+
+	int CwclBluetoothLeBeaconWatcher::Start(CwclBluetoothRadio* const Radio,
+		const wclBluetoothLeScanningMode ScanningMode)
+	{
+		if (Monitoring)
+			return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING;
+		if (Radio == NULL)
+			return WCL_E_INVALID_ARGUMENT;
+
+		this->Radio = Radio;
+		this->ScanningMode = ScanningMode;
+		Monitoring = true;
+
+		DoStarted();
+		Radio->GetFleet()->StartScan(this);
+		return WCL_E_SUCCESS;
+	}
+
+	int CwclBluetoothLeBeaconWatcher::Stop()
+	{
+		if (!Monitoring)
+			return WCL_E_BLUETOOTH_LE_BEACON_MONITORING_NOT_RUNNING;
+
+		Monitoring = false;
+		// No advertisement is delivered after this call.
+		Radio->GetFleet()->StopScan(this);
+
+		DoStopped();
+		return WCL_E_SUCCESS;
+	}
+
+	void CwclBluetoothLeBeaconWatcher::OnAdvertisementUuidFrame(void* Sender,
+		const __int64 Address, const __int64 Timestamp, const char Rssi, const GUID& Uuid)
+	{
+		wclEvents::Raise(this, &CwclBluetoothLeBeaconWatcher::OnAdvertisementUuidFrame,
+			Sender, Address, Timestamp, Rssi, Uuid);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::OnAdvertisementManufacturerRawFrame(void* Sender,
+		const __int64 Address, const __int64 Timestamp, const char Rssi,
+		const unsigned short CompanyId, const unsigned char* const Data,
+		const unsigned long Length)
+	{
+		wclEvents::Raise(this, &CwclBluetoothLeBeaconWatcher::OnAdvertisementManufacturerRawFrame,
+			Sender, Address, Timestamp, Rssi, CompanyId, Data, Length);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::OnStarted(void* Sender)
+	{
+		wclEvents::Raise(this, &CwclBluetoothLeBeaconWatcher::OnStarted, Sender);
+	}
+
+	void CwclBluetoothLeBeaconWatcher::OnStopped(void* Sender)
+	{
+		wclEvents::Raise(this, &CwclBluetoothLeBeaconWatcher::OnStopped, Sender);
+	}
+#pragma endregion CwclBluetoothLeBeaconWatcher
+
+#pragma region CwclGattClient
+	void CwclGattClient::DoConnect(const int Error)
+	{
+		OnConnect(this, Error);
+	}
+
+	void CwclGattClient::DoDisconnect(const int Reason)
+	{
+		OnDisconnect(this, Reason);
+	}
+
+	void CwclGattClient::DoCharacteristicChanged(const unsigned short Handle,
+		const unsigned char* const Value, const unsigned long Length)
+	{
+		OnCharacteristicChanged(this, Handle, Value, Length);
+	}
+
+	void CwclGattClient::DoMaxPduSizeChanged()
+	{
+		OnMaxPduSizeChanged(this);
+	}
+
+	void CwclGattClient::DoConnectionParamsChanged()
+	{
+		OnConnectionParamsChanged(this);
+	}
+
+	void CwclGattClient::DoConnectionPhyChanged()
+	{
+		OnConnectionPhyChanged(this);
+	}
+
+	CwclGattClient::CwclGattClient()
+	{
+		FRadio = NULL;
+		FPeripheral = NULL;
+
+		Address = 0;
+		State = csDisconnected;
+	}
+
+	CwclGattClient::~CwclGattClient()
+	{
+		if (FRadio != NULL)
+			FRadio->GetFleet()->Detach(this);
+		wclEvents::RemoveSource(this);
+	}
+
+	int CwclGattClient::Connect(CwclBluetoothRadio* const Radio)
+	{
+		if (State != csDisconnected)
+			return WCL_E_CONNECTION_ACTIVE;
+		if (Radio == NULL)
+			return WCL_E_INVALID_ARGUMENT;
+
+		FRadio = Radio;
+		return FRadio->GetFleet()->Connect(this);
+	}
+
+	int CwclGattClient::Disconnect()
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->Disconnect(this);
+	}
+
+	int CwclGattClient::FindService(const wclGattUuid& Uuid, wclGattService& Service)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->FindService(this, Uuid, Service);
+	}
+
+	int CwclGattClient::ReadCharacteristics(const wclGattService& Service,
+		const wclGattOperationFlag OperationFlag, wclGattCharacteristics& Characteristics)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->ReadCharacteristics(this, Service, Characteristics);
+	}
+
+	int CwclGattClient::SubscribeForNotifications(const wclGattCharacteristic& Characteristic)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->Subscribe(this, Characteristic);
+	}
+
+	int CwclGattClient::ReadCharacteristicValue(const wclGattCharacteristic& Characteristic,
+		const wclGattOperationFlag OperationFlag, unsigned char*& Value,
+		unsigned long& Length)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->Read(this, Characteristic, Value, Length);
+	}
+
+	int CwclGattClient::WriteCharacteristicValue(const wclGattCharacteristic& Characteristic,
+		const unsigned char* const Value, const unsigned long Length,
+		const wclGattProtectionLevel Protection, const wclGattWriteKind Kind)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		if (Kind == wkWithoutResponse && !Characteristic.IsWritableWithoutResponse)
+			return WCL_E_BLUETOOTH_LE_WRITE_WITHOUT_RESPONSE_NOT_SUPPORTED;
+
+		wclGattWriteKind WriteKind = Kind;
+		if (WriteKind == wkAuto)
+		{
+			if (Characteristic.IsWritable)
+				WriteKind = wkWithResponse;
+			else
+				WriteKind = wkWithoutResponse;
+		}
+		return FRadio->GetFleet()->Write(this, Characteristic, Value, Length, WriteKind);
+	}
+
+	int CwclGattClient::GetMaxPduSize(unsigned short& Size)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->GetMaxPduSize(this, Size);
+	}
+
+	int CwclGattClient::GetConnectionParams(wclBluetoothLeConnectionParameters& Params)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->GetConnectionParams(this, Params);
+	}
+
+	int CwclGattClient::SetConnectionParams(const wclBluetoothLeConnectionParametersPreset Preset)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->SetConnectionParams(this, Preset);
+	}
+
+	int CwclGattClient::GetConnectionPhyInfo(wclBluetoothLeConnectionPhy& Phy)
+	{
+		if (FRadio == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		return FRadio->GetFleet()->GetConnectionPhy(this, Phy);
+	}
+
+	void CwclGattClient::OnConnect(void* Sender, const int Error)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnConnect, Sender, Error);
+	}
+
+	void CwclGattClient::OnDisconnect(void* Sender, const int Reason)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnDisconnect, Sender, Reason);
+	}
+
+	void CwclGattClient::OnCharacteristicChanged(void* Sender, const unsigned short Handle,
+		const unsigned char* const Value, const unsigned long Length)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnCharacteristicChanged, Sender, Handle,
+			Value, Length);
+	}
+
+	void CwclGattClient::OnMaxPduSizeChanged(void* Sender)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnMaxPduSizeChanged, Sender);
+	}
+
+	void CwclGattClient::OnConnectionParamsChanged(void* Sender)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnConnectionParamsChanged, Sender);
+	}
+
+	void CwclGattClient::OnConnectionPhyChanged(void* Sender)
+	{
+		wclEvents::Raise(this, &CwclGattClient::OnConnectionPhyChanged, Sender);
+	}
+#pragma endregion CwclGattClient
+}
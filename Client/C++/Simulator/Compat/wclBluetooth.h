@@ -0,0 +1,261 @@
+#pragma once
+
+// The part of the Wireless Communication Library Bluetooth LE API used by the
+// client's core modules. Instead of the radio the classes talk to the
+// simulated peripherals fleet (see SimFleet.h). The radio object selects the
+// fleet so an application creates the CwclBluetoothRadio for the fleet and
+// uses it as it would use the real one.
+// The library's properties are plain fields here. Only the library changes
+// them: an application must treat them as read only.
+
+#include "wclHelpers.h"
+#include "wclMessaging.h"
+
+class CSimFleet;
+class CSimPeripheral;
+
+namespace wclCommunication
+{
+	typedef enum
+	{
+		csDisconnected,
+		csConnecting,
+		csConnected,
+		csDisconnecting
+	} wclClientState;
+}
+
+namespace wclBluetooth
+{
+	using namespace wclCommon;
+	using namespace wclCommunication;
+
+#pragma region GATT types
+	typedef struct
+	{
+		bool			IsShortUuid;
+		unsigned short	ShortUuid;
+		GUID			LongUuid;
+	} wclGattUuid;
+
+	typedef struct
+	{
+		wclGattUuid		Uuid;
+		unsigned short	Handle;
+	} wclGattService;
+
+	typedef struct
+	{
+		unsigned short	ServiceHandle;
+		wclGattUuid		Uuid;
+		unsigned short	Handle;
+		unsigned short	ValueHandle;
+		bool			IsBroadcastable;
+		bool			IsReadable;
+		bool			IsWritable;
+		bool			IsWritableWithoutResponse;
+		bool			IsSignedWritable;
+		bool			IsNotifiable;
+		bool			IsIndicatable;
+		bool			HasExtendedProperties;
+	} wclGattCharacteristic;
+
+	typedef std::vector<wclGattCharacteristic> wclGattCharacteristics;
+
+	typedef enum
+	{
+		goNone,
+		goReadFromDevice,
+		goReadFromCache
+	} wclGattOperationFlag;
+
+	typedef enum
+	{
+		plNone,
+		plSign,
+		plEncryption,
+		plEncryptionAndAuthentication
+	} wclGattProtectionLevel;
+
+	typedef enum
+	{
+		wkAuto,
+		wkWithResponse,
+		wkWithoutResponse
+	} wclGattWriteKind;
+#pragma endregion GATT types
+
+#pragma region Connection types
+	typedef struct
+	{
+		// Connection interval in 1.25 ms units.
+		unsigned short	Interval;
+		// Peripheral latency in connection events.
+		unsigned short	Latency;
+		// Supervision timeout in 10 ms units.
+		unsigned short	LinkTimeout;
+	} wclBluetoothLeConnectionParameters;
+
+	typedef enum
+	{
+		ppBalanced,
+		ppPowerOptimized,
+		ppThroughputOptimized
+	} wclBluetoothLeConnectionParametersPreset;
+
+	typedef struct
+	{
+		bool	IsCoded;
+		bool	IsUncoded1MPhy;
+		bool	IsUncoded2MPhy;
+	} wclBluetoothLeConnectionPhyInfo;
+
+	typedef struct
+	{
+		wclBluetoothLeConnectionPhyInfo	Receive;
+		wclBluetoothLeConnectionPhyInfo	Transmit;
+	} wclBluetoothLeConnectionPhy;
+#pragma endregion Connection types
+
+#pragma region Advertisement types
+	typedef enum
+	{
+		atConnectableUndirected,
+		atConnectableDirected,
+		atScannableUndirected,
+		atNonConnectableUndirected,
+		atScanResponse
+	} wclBluetoothLeAdvertisementType;
+
+	typedef struct
+	{
+		bool	LimitedDiscoverableMode;
+		bool	GeneralDiscoverableMode;
+		bool	ClassicNotSupported;
+		bool	DualModeControllerCapable;
+		bool	DualModeHostCapable;
+	} wclBluetoothLeAdvertisementFlags;
+
+	typedef enum
+	{
+		smPassive,
+		smActive
+	} wclBluetoothLeScanningMode;
+#pragma endregion Advertisement types
+
+	// The simulated radio. All the clients and watchers that use the radio
+	// work with its fleet.
+	class CwclBluetoothRadio
+	{
+		DISABLE_COPY(CwclBluetoothRadio);
+
+	private:
+		CSimFleet*	FFleet;
+
+	public:
+		explicit CwclBluetoothRadio(CSimFleet* const Fleet);
+
+		CSimFleet* GetFleet() const;
+	};
+
+	class CwclBluetoothLeBeaconWatcher
+	{
+		DISABLE_COPY(CwclBluetoothLeBeaconWatcher);
+
+		friend class ::CSimFleet;
+
+	protected:
+		virtual void DoAdvertisementFrameInformation(const __int64 Address,
+			const __int64 Timestamp, const char Rssi, const tstring& Name,
+			const wclBluetoothLeAdvertisementType PacketType,
+			const wclBluetoothLeAdvertisementFlags& Flags);
+		// Called for each 128-bit service UUID of the advertisement.
+		virtual void DoAdvertisementUuidFrame(const __int64 Address,
+			const __int64 Timestamp, const char Rssi, const GUID& Uuid);
+		// Called for each manufacturer specific data of the advertisement.
+		virtual void DoAdvertisementManufacturerRawFrame(const __int64 Address,
+			const __int64 Timestamp, const char Rssi, const unsigned short CompanyId,
+			const unsigned char* const Data, const unsigned long Length);
+		virtual void DoStarted();
+		virtual void DoStopped();
+
+	public:
+		CwclBluetoothLeBeaconWatcher();
+		virtual ~CwclBluetoothLeBeaconWatcher();
+
+		int Start(CwclBluetoothRadio* const Radio,
+			const wclBluetoothLeScanningMode ScanningMode = smActive);
+		int Stop();
+
+		// Properties.
+		volatile bool				Monitoring;
+		CwclBluetoothRadio*			Radio;
+		wclBluetoothLeScanningMode	ScanningMode;
+
+		__event void OnAdvertisementUuidFrame(void* Sender, const __int64 Address,
+			const __int64 Timestamp, const char Rssi, const GUID& Uuid);
+		__event void OnAdvertisementManufacturerRawFrame(void* Sender, const __int64 Address,
+			const __int64 Timestamp, const char Rssi, const unsigned short CompanyId,
+			const unsigned char* const Data, const unsigned long Length);
+		__event void OnStarted(void* Sender);
+		__event void OnStopped(void* Sender);
+	};
+
+	class CwclGattClient
+	{
+		DISABLE_COPY(CwclGattClient);
+
+		friend class ::CSimFleet;
+
+	private:
+		CwclBluetoothRadio*		FRadio;
+		// The fleet's connection binding.
+		CSimPeripheral*			FPeripheral;
+
+	protected:
+		virtual void DoConnect(const int Error);
+		virtual void DoDisconnect(const int Reason);
+		virtual void DoCharacteristicChanged(const unsigned short Handle,
+			const unsigned char* const Value, const unsigned long Length);
+		virtual void DoMaxPduSizeChanged();
+		virtual void DoConnectionParamsChanged();
+		virtual void DoConnectionPhyChanged();
+
+	public:
+		CwclGattClient();
+		virtual ~CwclGattClient();
+
+		int Connect(CwclBluetoothRadio* const Radio);
+		int Disconnect();
+
+		int FindService(const wclGattUuid& Uuid, wclGattService& Service);
+		int ReadCharacteristics(const wclGattService& Service,
+			const wclGattOperationFlag OperationFlag, wclGattCharacteristics& Characteristics);
+		int SubscribeForNotifications(const wclGattCharacteristic& Characteristic);
+		// The value is allocated with malloc. The caller frees it.
+		int ReadCharacteristicValue(const wclGattCharacteristic& Characteristic,
+			const wclGattOperationFlag OperationFlag, unsigned char*& Value,
+			unsigned long& Length);
+		int WriteCharacteristicValue(const wclGattCharacteristic& Characteristic,
+			const unsigned char* const Value, const unsigned long Length,
+			const wclGattProtectionLevel Protection = plNone,
+			const wclGattWriteKind Kind = wkAuto);
+
+		int GetMaxPduSize(unsigned short& Size);
+		int GetConnectionParams(wclBluetoothLeConnectionParameters& Params);
+		int SetConnectionParams(const wclBluetoothLeConnectionParametersPreset Preset);
+		int GetConnectionPhyInfo(wclBluetoothLeConnectionPhy& Phy);
+
+		// Properties.
+		__int64						Address;
+		volatile wclClientState		State;
+
+		__event void OnConnect(void* Sender, const int Error);
+		__event void OnDisconnect(void* Sender, const int Reason);
+		__event void OnCharacteristicChanged(void* Sender, const unsigned short Handle,
+			const unsigned char* const Value, const unsigned long Length);
+		__event void OnMaxPduSizeChanged(void* Sender);
+		__event void OnConnectionParamsChanged(void* Sender);
+		__event void OnConnectionPhyChanged(void* Sender);
+	};
+}
@@ -0,0 +1,121 @@
+#include "wclHelpers.h"
+
+using namespace std;
+
+namespace wclEvents
+{
+	typedef struct
+	{
+		const void*		Source;
+		TMethodKey		Event;
+	} TEventKey;
+
+	class TEventKeyOrder
+	{
+	public:
+		bool operator()(const TEventKey& a, const TEventKey& b) const
+		{
+			// Source first so all the source's events are adjacent.
+			if (a.Source != b.Source)
+				return (a.Source < b.Source);
+			return (memcmp(a.Event.Bytes, b.Event.Bytes, sizeof(TMethodKey)) < 0);
+		}
+	};
+
+	typedef map<TEventKey, HANDLERS, TEventKeyOrder> EVENTS;
+
+	// Events are raised much more often than hooked so the registry is
+	// guarded by the readers-writer lock.
+	static shared_mutex	Lock;
+	static EVENTS		Events;
+
+	static EVENTS::iterator FirstEvent(const void* Source)
+	{
+		TEventKey Key;
+		Key.Source = Source;
+		memset(&Key.Event, 0, sizeof(TMethodKey));
+		return Events.lower_bound(Key);
+	}
+
+	void AddHandler(const void* Source, const TMethodKey& Event,
+		const shared_ptr<CHandler>& Handler)
+	{
+		TEventKey Key;
+		Key.Source = Source;
+		Key.Event = Event;
+
+		unique_lock<shared_mutex> Guard(Lock);
+		Events[Key].push_back(Handler);
+	}
+
+	void RemoveHandler(const void* Receiver, const void* Source, const TMethodKey& Event,
+		const TMethodKey& Method)
+	{
+		TEventKey Key;
+		Key.Source = Source;
+		Key.Event = Event;
+
+		unique_lock<shared_mutex> Guard(Lock);
+		EVENTS::iterator Item = Events.find(Key);
+		if (Item == Events.end())
+			return;
+
+		HANDLERS& Handlers = Item->second;
+		for (HANDLERS::iterator Handler = Handlers.begin(); Handler != Handlers.end(); Handler++)
+		{
+			if ((*Handler)->Receiver == Receiver &&
+				memcmp((*Handler)->Method.Bytes, Method.Bytes, sizeof(TMethodKey)) == 0)
+			{
+				Handlers.erase(Handler);
+				break;
+			}
+		}
+		if (Handlers.empty())
+			Events.erase(Item);
+	}
+
+	void RemoveHandlers(const void* Receiver, const void* Source)
+	{
+		unique_lock<shared_mutex> Guard(Lock);
+		EVENTS::iterator Item = FirstEvent(Source);
+		while (Item != Events.end() && Item->first.Source == Source)
+		{
+			HANDLERS& Handlers = Item->second;
+			HANDLERS::iterator Handler = Handlers.begin();
+			while (Handler != Handlers.end())
+			{
+				if ((*Handler)->Receiver == Receiver)
+					Handler = Handlers.erase(Handler);
+				else
+					Handler++;
+			}
+
+			if (Handlers.empty())
+				Item = Events.erase(Item);
+			else
+				Item++;
+		}
+	}
+
+	void RemoveSource(const void* Source)
+	{
+		unique_lock<shared_mutex> Guard(Lock);
+		EVENTS::iterator Item = FirstEvent(Source);
+		while (Item != Events.end() && Item->first.Source == Source)
+			Item = Events.erase(Item);
+	}
+
+	bool GetHandlers(const void* Source, const TMethodKey& Event, HANDLERS& Handlers)
+	{
+		TEventKey Key;
+		Key.Source = Source;
+		Key.Event = Event;
+
+		shared_lock<shared_mutex> Guard(Lock);
+		EVENTS::const_iterator Item = Events.find(Key);
+		if (Item == Events.end())
+			return false;
+		Handlers = Item->second;
+		return true;
+	}
+}
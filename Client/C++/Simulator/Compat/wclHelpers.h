@@ -0,0 +1,134 @@
+#pragma once
+
+// The part of the Wireless Communication Library helpers used by the client's
+// core modules. The error codes have the library's names but the simulator's
+// own values: the application never depends on the values.
+
+#include "Win32Compat.h"
+
+#define DISABLE_COPY(ClassName) \
+	ClassName(const ClassName&) = delete; \
+	ClassName& operator=(const ClassName&) = delete
+
+// The application is built without UNICODE here.
+typedef std::string tstring;
+#define _T(x) x
+
+#pragma region Events emulation
+// Visual C++ native events are not available. Events are declared as
+// ordinary methods (the simulator defines their bodies with wclRaiseEvent),
+// __raise becomes a simple call and __hook/__unhook go to the process-wide
+// handlers registry.
+#define __event
+#define __raise
+#define __hook(Event, Source, Handler) \
+	wclEvents::Hook(Event, Source, this, Handler)
+#define __unhook(...) \
+	wclEvents::Unhook(this, __VA_ARGS__)
+
+namespace wclEvents
+{
+	// Event or handler method pointer as the registry key.
+	typedef struct
+	{
+		unsigned char	Bytes[16];
+	} TMethodKey;
+
+	template<typename M>
+	TMethodKey MethodKey(M Method)
+	{
+		static_assert(sizeof(M) <= sizeof(TMethodKey), "Method pointer is too large");
+		TMethodKey Key;
+		memset(&Key, 0, sizeof(TMethodKey));
+		memcpy(Key.Bytes, &Method, sizeof(M));
+		return Key;
+	}
+
+	class CHandler
+	{
+	public:
+		const void*		Receiver;
+		TMethodKey		Method;
+
+		virtual ~CHandler() { }
+	};
+
+	template<typename... P>
+	class CHandlerT : public CHandler
+	{
+	public:
+		std::function<void(P...)>	Call;
+	};
+
+	typedef std::vector<std::shared_ptr<CHandler>> HANDLERS;
+
+	void AddHandler(const void* Source, const TMethodKey& Event,
+		const std::shared_ptr<CHandler>& Handler);
+	void RemoveHandler(const void* Receiver, const void* Source, const TMethodKey& Event,
+		const TMethodKey& Method);
+	// Removes all the Source's handlers set by the Receiver.
+	void RemoveHandlers(const void* Receiver, const void* Source);
+	// Removes all the Source's handlers. Called when the source is destroyed.
+	void RemoveSource(const void* Source);
+	// Copies the event's handlers. Returns false if there are none.
+	bool GetHandlers(const void* Source, const TMethodKey& Event, HANDLERS& Handlers);
+
+	template<typename C, typename... P, typename S, typename R, typename... Q>
+	void Hook(void (C::*Event)(P...), S* Source, R* Receiver, void (R::*Method)(Q...))
+	{
+		std::shared_ptr<CHandlerT<P...>> Handler(new CHandlerT<P...>());
+		Handler->Receiver = Receiver;
+		Handler->Method = MethodKey(Method);
+		Handler->Call = [Receiver, Method](P... Params) { (Receiver->*Method)(Params...); };
+		AddHandler(static_cast<C*>(Source), MethodKey(Event), Handler);
+	}
+
+	template<typename R, typename S>
+	void Unhook(R* Receiver, S* Source)
+	{
+		RemoveHandlers(Receiver, Source);
+	}
+
+	template<typename R, typename C, typename... P, typename S, typename... Q>
+	void Unhook(R* Receiver, void (C::*Event)(P...), S* Source, void (R::*Method)(Q...))
+	{
+		RemoveHandler(Receiver, static_cast<C*>(Source), MethodKey(Event), MethodKey(Method));
+	}
+
+	// Calls all the handlers of the Source's event.
+	template<typename C, typename... P, typename... A>
+	void Raise(C* Source, void (C::*Event)(P...), A&&... Params)
+	{
+		HANDLERS Handlers;
+		if (!GetHandlers(Source, MethodKey(Event), Handlers))
+			return;
+		for (HANDLERS::iterator Handler = Handlers.begin(); Handler != Handlers.end(); Handler++)
+			static_cast<CHandlerT<P...>*>(Handler->get())->Call(Params...);
+	}
+}
+#pragma endregion Events emulation
+
+namespace wclCommon
+{
+#pragma region Error codes
+	const int WCL_E_SUCCESS = 0x00000000;
+	const int WCL_E_INVALID_ARGUMENT = 0x00000001;
+	const int WCL_E_OUT_OF_MEMORY = 0x00000002;
+	const int WCL_E_MR_CLOSED = 0x00001000;
+	const int WCL_E_MR_OPENED = 0x00001001;
+	const int WCL_E_MB_WAIT_TIMEOUT = 0x0000200B;
+	const int WCL_E_MB_WAIT_FAILED = 0x0000200C;
+	const int WCL_E_CONNECTION_ACTIVE = 0x00010001;
+	const int WCL_E_CONNECTION_CLOSED = 0x00010002;
+	const int WCL_E_CONNECTION_NOT_ACTIVE = 0x00010003;
+	// The simulated link failed to establish or lost the connection.
+	const int WCL_E_CONNECTION_TERMINATED = 0x00010004;
+	const int WCL_E_CONNECTION_TIMEOUT = 0x00010005;
+	const int WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND = 0x00050001;
+	const int WCL_E_BLUETOOTH_LE_BEACON_MONITORING_RUNNING = 0x00050002;
+	const int WCL_E_BLUETOOTH_LE_BEACON_MONITORING_NOT_RUNNING = 0x00050003;
+	const int WCL_E_BLUETOOTH_LE_FEATURE_NOT_SUPPORTED = 0x00050004;
+	const int WCL_E_BLUETOOTH_LE_WRITE_WITHOUT_RESPONSE_NOT_SUPPORTED = 0x00050005;
+	const int WCL_E_BLUETOOTH_LE_DEVICE_NOT_FOUND = 0x00050006;
+#pragma endregion Error codes
+}
@@ -0,0 +1,272 @@
+#include "wclMessaging.h"
+
+using namespace std;
+
+namespace wclCommon
+{
+#pragma region Synchronization thread
+	// Delivers the messages of all the receivers. Plays the role of the
+	// application's UI thread. Never destroyed: receivers may be closed when
+	// static objects are destroyed.
+	class CSyncThread
+	{
+	private:
+		typedef struct
+		{
+			CwclMessageReceiver*	Receiver;
+			CwclMessage*			Message;
+		} TItem;
+
+		mutex					FLock;
+		condition_variable		FSignal;
+		deque<TItem>			FQueue;
+		// The receiver whose message is being delivered now.
+		CwclMessageReceiver*	FDelivering;
+		thread::id				FThreadId;
+
+		// Delivers the oldest message. Called with the lock taken and returns
+		// with the lock taken.
+		void Deliver(unique_lock<mutex>& Lock)
+		{
+			TItem Item = FQueue.front();
+			FQueue.pop_front();
+
+			// The delivery may be nested when the handler waits with the
+			// broadcaster.
+			CwclMessageReceiver* Delivering = FDelivering;
+			FDelivering = Item.Receiver;
+			Lock.unlock();
+			Item.Receiver->DoMessage(Item.Message);
+			Item.Message->Release();
+			Lock.lock();
+			FDelivering = Delivering;
+			FSignal.notify_all();
+		}
+
+		void ThreadProc()
+		{
+			unique_lock<mutex> Lock(FLock);
+			while (true)
+			{
+				FSignal.wait(Lock, [this] { return !FQueue.empty(); });
+				Deliver(Lock);
+			}
+		}
+
+		CSyncThread()
+		{
+			FDelivering = NULL;
+			thread Thread(&CSyncThread::ThreadProc, this);
+			FThreadId = Thread.get_id();
+			Thread.detach();
+		}
+
+	public:
+		static CSyncThread* Get()
+		{
+			static CSyncThread* Sync = new CSyncThread();
+			return Sync;
+		}
+
+		bool IsCurrent() const
+		{
+			return (this_thread::get_id() == FThreadId);
+		}
+
+		int Open(CwclMessageReceiver* const Receiver)
+		{
+			lock_guard<mutex> Lock(FLock);
+			if (Receiver->FListening)
+				return WCL_E_MR_OPENED;
+			Receiver->FListening = true;
+			return WCL_E_SUCCESS;
+		}
+
+		int Close(CwclMessageReceiver* const Receiver)
+		{
+			deque<TItem> Dropped;
+			{
+				unique_lock<mutex> Lock(FLock);
+				if (!Receiver->FListening)
+					return WCL_E_MR_CLOSED;
+				Receiver->FListening = false;
+
+				for (deque<TItem>::iterator Item = FQueue.begin(); Item != FQueue.end(); )
+				{
+					if (Item->Receiver == Receiver)
+					{
+						Dropped.push_back(*Item);
+						Item = FQueue.erase(Item);
+					}
+					else
+						Item++;
+				}
+
+				if (!IsCurrent())
+					FSignal.wait(Lock, [this, Receiver] { return (FDelivering != Receiver); });
+			}
+
+			for (deque<TItem>::iterator Item = Dropped.begin(); Item != Dropped.end(); Item++)
+				Item->Message->Release();
+			return WCL_E_SUCCESS;
+		}
+
+		int Post(CwclMessageReceiver* const Receiver, CwclMessage* const Message,
+			const bool Sync)
+		{
+			unique_lock<mutex> Lock(FLock);
+			if (!Receiver->FListening)
+				return WCL_E_MR_CLOSED;
+
+			if (Sync && IsCurrent())
+			{
+				Lock.unlock();
+				Receiver->DoMessage(Message);
+				return WCL_E_SUCCESS;
+			}
+
+			Message->AddRef();
+			TItem Item;
+			Item.Receiver = Receiver;
+			Item.Message = Message;
+			FQueue.push_back(Item);
+			FSignal.notify_all();
+			return WCL_E_SUCCESS;
+		}
+
+		// Delivers the messages queued so far. Must be called from the
+		// synchronization thread.
+		void ProcessMessages()
+		{
+			unique_lock<mutex> Lock(FLock);
+			size_t Count = FQueue.size();
+			while (Count > 0 && !FQueue.empty())
+			{
+				Deliver(Lock);
+				Count--;
+			}
+		}
+	};
+#pragma endregion Synchronization thread
+
+#pragma region CwclMessage
+	CwclMessage::CwclMessage(const unsigned char Id, const unsigned char Category)
+	{
+		FId = Id;
+		FCategory = Category;
+		FRefCounter = 1;
+	}
+
+	CwclMessage::~CwclMessage()
+	{
+	}
+
+	void CwclMessage::AddRef()
+	{
+		InterlockedIncrement(&FRefCounter);
+	}
+
+	void CwclMessage::Release()
+	{
+		if (InterlockedDecrement(&FRefCounter) == 0)
+			delete this;
+	}
+
+	unsigned char CwclMessage::GetCategory() const
+	{
+		return FCategory;
+	}
+
+	unsigned char CwclMessage::GetId() const
+	{
+		return FId;
+	}
+
+	CwclUserDefinedCategoryMessage::CwclUserDefinedCategoryMessage(const unsigned char Id)
+		: CwclMessage(Id, WCL_MSG_CATEGORY_USER)
+	{
+	}
+#pragma endregion CwclMessage
+
+#pragma region CwclMessageReceiver
+	CwclMessageReceiver::CwclMessageReceiver()
+	{
+		FListening = false;
+	}
+
+	CwclMessageReceiver::~CwclMessageReceiver()
+	{
+		Close();
+		wclEvents::RemoveSource(this);
+	}
+
+	void CwclMessageReceiver::DoMessage(const CwclMessage* const Message)
+	{
+		OnMessage(Message);
+	}
+
+	int CwclMessageReceiver::Close()
+	{
+		return CSyncThread::Get()->Close(this);
+	}
+
+	int CwclMessageReceiver::Open()
+	{
+		return CSyncThread::Get()->Open(this);
+	}
+
+	int CwclMessageReceiver::Post(CwclMessage* const Message, const bool Sync)
+	{
+		if (Message == NULL)
+			return WCL_E_INVALID_ARGUMENT;
+		return CSyncThread::Get()->Post(this, Message, Sync);
+	}
+
+	bool CwclMessageReceiver::_GetListening() const
+	{
+		return FListening;
+	}
+
+	void CwclMessageReceiver::OnMessage(const CwclMessage* const Message)
+	{
+		wclEvents::Raise(this, &CwclMessageReceiver::OnMessage, Message);
+	}
+#pragma endregion CwclMessageReceiver
+
+#pragma region CwclMessageBroadcaster
+	int CwclMessageBroadcaster::Wait(HANDLE Event, unsigned long Timeout)
+	{
+		CSyncThread* Sync = CSyncThread::Get();
+		if (!Sync->IsCurrent())
+		{
+			DWORD Res = WaitForSingleObject(Event, Timeout);
+			if (Res == WAIT_OBJECT_0)
+				return WCL_E_SUCCESS;
+			if (Res == WAIT_TIMEOUT)
+				return WCL_E_MB_WAIT_TIMEOUT;
+			return WCL_E_MB_WAIT_FAILED;
+		}
+
+		// The kernel objects and the messages queue can not be waited for
+		// together here so the object is polled between the deliveries.
+		ULONGLONG Started = GetTickCount64();
+		while (true)
+		{
+			Sync->ProcessMessages();
+
+			DWORD Res = WaitForSingleObject(Event, 1);
+			if (Res == WAIT_OBJECT_0)
+				return WCL_E_SUCCESS;
+			if (Res != WAIT_TIMEOUT)
+				return WCL_E_MB_WAIT_FAILED;
+			if (Timeout != INFINITE && GetTickCount64() - Started >= Timeout)
+				return WCL_E_MB_WAIT_TIMEOUT;
+		}
+	}
+
+	int CwclMessageBroadcaster::Wait(const HANDLE Event)
+	{
+		return Wait(Event, INFINITE);
+	}
+#pragma endregion CwclMessageBroadcaster
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// The part of the Wireless Communication Library messaging used by the
+// client's core modules. The library's receiver delivers the messages to the
+// thread that created it through the thread's message loop. The simulator has
+// no UI thread so a single process-wide synchronization thread plays its
+// role: the messages of all the receivers are delivered there in the order
+// they were posted. The broadcaster's Wait processes the messages when it is
+// called from that thread as the library's one does on the UI thread.
+
+#include "wclHelpers.h"
+
+namespace wclCommon
+{
+	const unsigned char WCL_MSG_CATEGORY_USER = 200;
+
+#pragma region CwclMessage
+	class CwclMessage
+	{
+		DISABLE_COPY(CwclMessage);
+
+	private:
+		unsigned char	FId;
+		unsigned char	FCategory;
+		volatile LONG	FRefCounter;
+
+	public:
+		CwclMessage(const unsigned char Id, const unsigned char Category);
+		virtual ~CwclMessage();
+
+		void AddRef();
+		void Release();
+
+		unsigned char GetCategory() const;
+		__declspec(property(get = GetCategory)) unsigned char Category;
+		unsigned char GetId() const;
+		__declspec(property(get = GetId)) unsigned char Id;
+	};
+
+	class CwclUserDefinedCategoryMessage : public CwclMessage
+	{
+		DISABLE_COPY(CwclUserDefinedCategoryMessage);
+
+	public:
+		CwclUserDefinedCategoryMessage(const unsigned char Id);
+	};
+#pragma endregion CwclMessage
+
+#define wclMessageEvent(_event_name_) \
+	__event void _event_name_(const CwclMessage* const Message)
+
+#pragma region CwclMessageReceiver
+	class CwclMessageReceiver
+	{
+		DISABLE_COPY(CwclMessageReceiver);
+
+	private:
+		friend class CSyncThread;
+
+		// Changed under the synchronization thread's lock.
+		bool	FListening;
+
+	protected:
+		virtual void DoMessage(const CwclMessage* const Message);
+
+	public:
+		CwclMessageReceiver();
+		virtual ~CwclMessageReceiver();
+
+		// Drops the messages that were not delivered yet and waits for the
+		// one being delivered now unless it is called from the handler.
+		int Close();
+		int Open();
+
+		// The receiver takes its own reference of the queued message.
+		int Post(CwclMessage* const Message, const bool Sync = false);
+
+		bool _GetListening() const;
+		__declspec(property(get = _GetListening)) bool Listening;
+
+		wclMessageEvent(OnMessage);
+	};
+#pragma endregion CwclMessageReceiver
+
+#pragma region CwclMessageBroadcaster
+	class CwclMessageBroadcaster
+	{
+		DISABLE_COPY(CwclMessageBroadcaster);
+
+	public:
+		static int Wait(HANDLE Event, unsigned long Timeout);
+		static int Wait(const HANDLE Event);
+	};
+#pragma endregion CwclMessageBroadcaster
+}
@@ -0,0 +1,754 @@
+// Benchmark of the client's core against the simulated peripherals fleet. For
+// each device count the benchmark connects the CClientWatcher to the whole
+// fleet and measures:
+//   - the time from the first advertisement of a device to its connection;
+//   - the notifications throughput, aggregate and per device;
+//   - the read and write round trips seen by the application;
+//   - the cost of the client lookup: the raw CClientRegistry and the
+//     watcher's GetClient.
+// The fleet is seeded so the runs are repeatable. Results are written as the
+// text table, CSV or JSON.
+
+#include <cinttypes>
+#include <fstream>
+#include <sstream>
+
+#include "ClientWatcher.h"
+#include "ClientRegistry.h"
+#include "LatencyHistogram.h"
+#include "SimFleet.h"
+#include "Timestamp.h"
+
+using namespace std;
+
+typedef enum
+{
+	bfText,
+	bfCsv,
+	bfJson
+} TBenchFormat;
+
+typedef struct
+{
+	TSimFleetParams		Fleet;
+	vector<unsigned long>	Devices;
+	// Time given to connect all the devices (s).
+	unsigned long		ConnectTimeout;
+	// Measurement window (s).
+	unsigned long		Duration;
+	// Threads running the closed loop of reads and writes.
+	unsigned long		LoadThreads;
+	unsigned long		MaxPending;
+	unsigned long		DiscoveryConcurrency;
+	// Values batch window (ms). Zero disables batching.
+	unsigned long		BatchWindow;
+	// Advertisements filter pass interval (ms).
+	unsigned long		PassInterval;
+	// Match the devices by the service UUID with passive scanning.
+	bool				Passive;
+	// Lookups per registry measurement.
+	unsigned long		Lookups;
+	TBenchFormat		Format;
+	string				Output;
+} TBenchParams;
+
+// Results of single device count.
+typedef struct
+{
+	unsigned long		Devices;
+	unsigned long		Connected;
+	// Time to connect all the devices (ms).
+	unsigned __int64	ConnectTime;
+	TLatencySummary		AdvToConnected;
+	// Notifications per second.
+	double				NotificationRate;
+	double				DeviceRateMean;
+	double				DeviceRateMin;
+	double				DeviceRateMax;
+	TLatencySummary		Read;
+	TLatencySummary		Write;
+	unsigned __int64	ReadErrors;
+	unsigned __int64	WriteErrors;
+	// Average lookup times (ns).
+	double				RegistryHit;
+	double				RegistryMiss;
+	double				GetClient;
+} TBenchResult;
+
+// The watcher that remembers when each device was seen first.
+class CBenchWatcher : public CClientWatcher
+{
+	DISABLE_COPY(CBenchWatcher);
+
+private:
+	mutex								FLock;
+	unordered_map<__int64, unsigned __int64>	FFirstSeen;
+
+protected:
+	virtual void DoAdvertisementFrameInformation(const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const tstring& Name,
+		const wclBluetoothLeAdvertisementType PacketType,
+		const wclBluetoothLeAdvertisementFlags& Flags) override
+	{
+		{
+			lock_guard<mutex> Lock(FLock);
+			FFirstSeen.emplace(Address, GetTimestamp());
+		}
+		CClientWatcher::DoAdvertisementFrameInformation(Address, Timestamp, Rssi,
+			Name, PacketType, Flags);
+	}
+
+public:
+	CBenchWatcher() : CClientWatcher() { }
+
+	// Returns the time the device was seen first and forgets it so the next
+	// connection is measured from the next advertisement.
+	bool TakeFirstSeen(const __int64 Address, unsigned __int64& Time)
+	{
+		lock_guard<mutex> Lock(FLock);
+		unordered_map<__int64, unsigned __int64>::iterator Item = FFirstSeen.find(Address);
+		if (Item == FFirstSeen.end())
+			return false;
+		Time = Item->second;
+		FFirstSeen.erase(Item);
+		return true;
+	}
+};
+
+class CSimBench
+{
+	DISABLE_COPY(CSimBench);
+
+private:
+	TBenchParams					FParams;
+
+	CBenchWatcher*					FWatcher;
+	mutex							FLock;
+	set<__int64>					FConnected;
+	unordered_map<__int64, unsigned __int64>	FValues;
+	bool							FCounting;
+	atomic<bool>					FTerminate;
+
+	CLatencyHistogram*				FAdvToConnected;
+	CLatencyHistogram*				FRead;
+	CLatencyHistogram*				FWrite;
+	atomic<unsigned __int64>		FReadErrors;
+	atomic<unsigned __int64>		FWriteErrors;
+
+	void WatcherClientDisconnected(const __int64 Address, const int Reason);
+	void WatcherConnectionCompleted(const __int64 Address, const int Error);
+	void WatcherValueChanged(const __int64 Address, const unsigned char* Value,
+		const unsigned long Length);
+	void WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count);
+
+	void LoadProc(const unsigned long Index);
+	void CopyConnected(vector<__int64>& Addresses);
+
+	void MeasureRegistry(const unsigned long Devices, TBenchResult& Result);
+	void MeasureGetClient(TBenchResult& Result);
+	int RunDevices(const unsigned long Devices, TBenchResult& Result);
+
+	static void WriteText(ostream& Stream, const vector<TBenchResult>& Results);
+	static void WriteCsv(ostream& Stream, const vector<TBenchResult>& Results);
+	static void WriteJson(ostream& Stream, const vector<TBenchResult>& Results);
+
+public:
+	CSimBench(const TBenchParams& Params);
+	~CSimBench();
+
+	int Run();
+};
+
+void CSimBench::WatcherClientDisconnected(const __int64 Address, const int Reason)
+{
+	lock_guard<mutex> Lock(FLock);
+	FConnected.erase(Address);
+}
+
+void CSimBench::WatcherConnectionCompleted(const __int64 Address, const int Error)
+{
+	if (Error != WCL_E_SUCCESS)
+		return;
+
+	unsigned __int64 FirstSeen;
+	if (FWatcher->TakeFirstSeen(Address, FirstSeen))
+		FAdvToConnected->Record(GetTimestamp() - FirstSeen);
+
+	lock_guard<mutex> Lock(FLock);
+	FConnected.insert(Address);
+}
+
+void CSimBench::WatcherValueChanged(const __int64 Address, const unsigned char* Value,
+	const unsigned long Length)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (FCounting)
+		FValues[Address]++;
+}
+
+void CSimBench::WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (FCounting)
+	{
+		for (unsigned long i = 0; i < Count; i++)
+			FValues[Records[i].Address]++;
+	}
+}
+
+void CSimBench::CopyConnected(vector<__int64>& Addresses)
+{
+	lock_guard<mutex> Lock(FLock);
+	Addresses.assign(FConnected.begin(), FConnected.end());
+}
+
+void CSimBench::LoadProc(const unsigned long Index)
+{
+	static const unsigned char DATA[] = "0123456789";
+
+	vector<__int64> Addresses;
+	CopyConnected(Addresses);
+
+	// Threads start from different devices so they do not queue on one.
+	size_t Position = Index;
+	while (!FTerminate && Addresses.size() > 0)
+	{
+		__int64 Address = Addresses[Position % Addresses.size()];
+		Position += FParams.LoadThreads;
+
+		CPooledBuffer Buffer;
+		unsigned __int64 Started = GetTimestamp();
+		if (FWatcher->ReadData(Address, Buffer) == WCL_E_SUCCESS)
+			FRead->Record(GetTimestamp() - Started);
+		else
+			FReadErrors++;
+
+		Started = GetTimestamp();
+		if (FWatcher->WriteData(Address, DATA, sizeof(DATA)) == WCL_E_SUCCESS)
+			FWrite->Record(GetTimestamp() - Started);
+		else
+			FWriteErrors++;
+	}
+}
+
+void CSimBench::MeasureRegistry(const unsigned long Devices, TBenchResult& Result)
+{
+	// Real addresses are random so the registry is filled with random ones.
+	mt19937_64 Random(FParams.Fleet.Seed);
+	vector<__int64> Addresses;
+	CClientRegistry* Registry = new CClientRegistry();
+	while (Addresses.size() < Devices)
+	{
+		__int64 Address = (__int64)(Random() & 0xFFFFFFFFFFFFLL);
+		if (Address != 0 && Registry->Add(Address, NULL, rsConnected))
+			Addresses.push_back(Address);
+	}
+
+	vector<__int64> Misses;
+	while (Misses.size() < Devices)
+	{
+		__int64 Address = (__int64)(Random() & 0xFFFFFFFFFFFFLL);
+		if (Address != 0 && Registry->Find(Address) == NULL)
+			Misses.push_back(Address);
+	}
+
+	// Walk the addresses in the random order so the cache does not help more
+	// than it does in the real life.
+	shuffle(Addresses.begin(), Addresses.end(), Random);
+
+	size_t Found = 0;
+	chrono::steady_clock::time_point Started = chrono::steady_clock::now();
+	for (unsigned long i = 0; i < FParams.Lookups; i++)
+	{
+		if (Registry->Find(Addresses[i % Addresses.size()]) != NULL)
+			Found++;
+	}
+	chrono::steady_clock::time_point Finished = chrono::steady_clock::now();
+	Result.RegistryHit = (double)chrono::duration_cast<chrono::nanoseconds>(
+		Finished - Started).count() / FParams.Lookups;
+
+	Started = chrono::steady_clock::now();
+	for (unsigned long i = 0; i < FParams.Lookups; i++)
+	{
+		if (Registry->Find(Misses[i % Misses.size()]) != NULL)
+			Found++;
+	}
+	Finished = chrono::steady_clock::now();
+	Result.RegistryMiss = (double)chrono::duration_cast<chrono::nanoseconds>(
+		Finished - Started).count() / FParams.Lookups;
+
+	delete Registry;
+
+	// Keeps the lookups from being optimized out.
+	if (Found != FParams.Lookups)
+		fprintf(stderr, "Registry lookup mismatch: %zu of %lu\n", Found, FParams.Lookups);
+}
+
+void CSimBench::MeasureGetClient(TBenchResult& Result)
+{
+	Result.GetClient = 0;
+
+	vector<__int64> Addresses;
+	CopyConnected(Addresses);
+	if (Addresses.size() == 0)
+		return;
+
+	chrono::steady_clock::time_point Started = chrono::steady_clock::now();
+	for (unsigned long i = 0; i < FParams.Lookups; i++)
+	{
+		CGattClientRef Client;
+		FWatcher->GetClient(Addresses[i % Addresses.size()], Client);
+	}
+	chrono::steady_clock::time_point Finished = chrono::steady_clock::now();
+	Result.GetClient = (double)chrono::duration_cast<chrono::nanoseconds>(
+		Finished - Started).count() / FParams.Lookups;
+}
+
+int CSimBench::RunDevices(const unsigned long Devices, TBenchResult& Result)
+{
+	ZeroMemory(&Result, sizeof(TBenchResult));
+	Result.Devices = Devices;
+
+	TSimFleetParams FleetParams = FParams.Fleet;
+	FleetParams.Devices = Devices;
+	CSimFleet* Fleet = new CSimFleet(FleetParams);
+	CwclBluetoothRadio* Radio = new CwclBluetoothRadio(Fleet);
+	FWatcher = new CBenchWatcher();
+
+	FConnected.clear();
+	FValues.clear();
+	FCounting = false;
+	FTerminate = false;
+	FAdvToConnected->Reset();
+	FRead->Reset();
+	FWrite->Reset();
+	FReadErrors = 0;
+	FWriteErrors = 0;
+
+	__hook(&CClientWatcher::OnClientDisconnected, FWatcher, &CSimBench::WatcherClientDisconnected);
+	__hook(&CClientWatcher::OnConnectionCompleted, FWatcher, &CSimBench::WatcherConnectionCompleted);
+	__hook(&CClientWatcher::OnValueChanged, FWatcher, &CSimBench::WatcherValueChanged);
+	__hook(&CClientWatcher::OnValuesChanged, FWatcher, &CSimBench::WatcherValuesChanged);
+
+	int Res = FWatcher->SetMaxPendingConnections(FParams.MaxPending);
+	if (Res == WCL_E_SUCCESS)
+		Res = FWatcher->SetDiscoveryConcurrency(FParams.DiscoveryConcurrency);
+	if (Res == WCL_E_SUCCESS && FParams.BatchWindow > 0)
+		Res = FWatcher->SetValuesBatch(FParams.BatchWindow, 64);
+	if (Res == WCL_E_SUCCESS)
+	{
+		Res = FWatcher->SetAdvertisementFilter(max(DEFAULT_ADVERTISEMENT_FILTER_SIZE, Devices * 2),
+			FParams.PassInterval, DEFAULT_ADVERTISEMENT_REJECT_TIMEOUT);
+	}
+	if (Res == WCL_E_SUCCESS && FParams.Passive)
+		Res = FWatcher->SetServiceFilter(&SERVICE_UUID, 1);
+	if (Res == WCL_E_SUCCESS)
+		Res = FWatcher->Start(Radio, FParams.Passive ? smPassive : smActive);
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		// Connection phase.
+		fprintf(stderr, "%lu devices: connecting...\n", Devices);
+		unsigned __int64 Started = GetTickCount64();
+		unsigned __int64 Timeout = (unsigned __int64)FParams.ConnectTimeout * 1000;
+		while (GetTickCount64() - Started < Timeout)
+		{
+			{
+				lock_guard<mutex> Lock(FLock);
+				if (FConnected.size() == Devices)
+					break;
+			}
+			Sleep(10);
+		}
+		Result.ConnectTime = GetTickCount64() - Started;
+		FAdvToConnected->GetSummary(Result.AdvToConnected);
+
+		// Measurement phase.
+		fprintf(stderr, "%lu devices: measuring...\n", Devices);
+		{
+			lock_guard<mutex> Lock(FLock);
+			Result.Connected = (unsigned long)FConnected.size();
+			FCounting = true;
+		}
+
+		vector<thread> Threads;
+		for (unsigned long i = 0; i < FParams.LoadThreads; i++)
+			Threads.push_back(thread(&CSimBench::LoadProc, this, i));
+
+		unsigned __int64 Measured = GetTimestamp();
+		Sleep(FParams.Duration * 1000);
+		FTerminate = true;
+		for (vector<thread>::iterator Thread = Threads.begin(); Thread != Threads.end(); Thread++)
+			Thread->join();
+
+		double Seconds;
+		{
+			lock_guard<mutex> Lock(FLock);
+			FCounting = false;
+			Seconds = (double)(GetTimestamp() - Measured) / 1000000.0;
+
+			unsigned __int64 Total = 0;
+			Result.DeviceRateMin = -1;
+			for (unordered_map<__int64, unsigned __int64>::iterator Item = FValues.begin(); Item != FValues.end(); Item++)
+			{
+				double Rate = (double)Item->second / Seconds;
+				Total += Item->second;
+				if (Result.DeviceRateMin < 0 || Rate < Result.DeviceRateMin)
+					Result.DeviceRateMin = Rate;
+				if (Rate > Result.DeviceRateMax)
+					Result.DeviceRateMax = Rate;
+			}
+			// Connected devices that sent nothing count too.
+			if (FValues.size() < Result.Connected)
+				Result.DeviceRateMin = 0;
+			if (Result.DeviceRateMin < 0)
+				Result.DeviceRateMin = 0;
+
+			Result.NotificationRate = (double)Total / Seconds;
+			if (Result.Connected > 0)
+				Result.DeviceRateMean = Result.NotificationRate / Result.Connected;
+		}
+
+		FRead->GetSummary(Result.Read);
+		FWrite->GetSummary(Result.Write);
+		Result.ReadErrors = FReadErrors;
+		Result.WriteErrors = FWriteErrors;
+
+		MeasureGetClient(Result);
+
+		FWatcher->Stop();
+		// Wait for the disconnections requested by the watcher.
+		Started = GetTickCount64();
+		TSimFleetStats Stats;
+		do
+		{
+			Fleet->GetStats(Stats);
+			if (Stats.Connected == 0)
+				break;
+			Sleep(10);
+		} while (GetTickCount64() - Started < 5000);
+	}
+
+	__unhook(FWatcher);
+	delete FWatcher;
+	FWatcher = NULL;
+	delete Radio;
+	delete Fleet;
+
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	MeasureRegistry(Devices, Result);
+	return WCL_E_SUCCESS;
+}
+
+void CSimBench::WriteText(ostream& Stream, const vector<TBenchResult>& Results)
+{
+	char Line[512];
+	snprintf(Line, sizeof(Line), "%-8s %-9s %-9s %-27s %-21s %-27s %-27s %-20s\n",
+		"devices", "connected", "conn(ms)", "adv->conn p50/p99/max(us)",
+		"notif/s total/device", "read p50/p99/max(us)", "write p50/p99/max(us)",
+		"lookup hit/miss/get(ns)");
+	Stream << Line;
+
+	for (vector<TBenchResult>::const_iterator Result = Results.begin(); Result != Results.end(); Result++)
+	{
+		char Adv[64];
+		char Notif[64];
+		char Read[64];
+		char Write[64];
+		char Lookup[64];
+		snprintf(Adv, sizeof(Adv), "%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+			(uint64_t)Result->AdvToConnected.P50, (uint64_t)Result->AdvToConnected.P99,
+			(uint64_t)Result->AdvToConnected.Max);
+		snprintf(Notif, sizeof(Notif), "%.1f/%.2f", Result->NotificationRate, Result->DeviceRateMean);
+		snprintf(Read, sizeof(Read), "%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+			(uint64_t)Result->Read.P50, (uint64_t)Result->Read.P99, (uint64_t)Result->Read.Max);
+		snprintf(Write, sizeof(Write), "%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+			(uint64_t)Result->Write.P50, (uint64_t)Result->Write.P99, (uint64_t)Result->Write.Max);
+		snprintf(Lookup, sizeof(Lookup), "%.1f/%.1f/%.1f", Result->RegistryHit,
+			Result->RegistryMiss, Result->GetClient);
+
+		snprintf(Line, sizeof(Line), "%-8lu %-9lu %-9" PRIu64 " %-27s %-21s %-27s %-27s %-20s\n",
+			Result->Devices, Result->Connected, (uint64_t)Result->ConnectTime, Adv, Notif,
+			Read, Write, Lookup);
+		Stream << Line;
+	}
+}
+
+static void WriteCsvSummary(ostream& Stream, const TLatencySummary& Summary)
+{
+	Stream << Summary.Count << ',' << Summary.Mean << ',' << Summary.P50 << ',' << Summary.P90
+		<< ',' << Summary.P99 << ',' << Summary.P999 << ',' << Summary.Max;
+}
+
+void CSimBench::WriteCsv(ostream& Stream, const vector<TBenchResult>& Results)
+{
+	const char* Summaries[] = { "adv_to_connected", "read", "write" };
+	const char* Fields[] = { "count", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us" };
+
+	Stream << "devices,connected,connect_time_ms";
+	for (size_t s = 0; s < sizeof(Summaries) / sizeof(Summaries[0]); s++)
+	{
+		for (size_t f = 0; f < sizeof(Fields) / sizeof(Fields[0]); f++)
+			Stream << ',' << Summaries[s] << '_' << Fields[f];
+	}
+	Stream << ",notifications_per_s,device_notifications_per_s_mean"
+		<< ",device_notifications_per_s_min,device_notifications_per_s_max"
+		<< ",read_errors,write_errors,registry_hit_ns,registry_miss_ns,get_client_ns\n";
+
+	for (vector<TBenchResult>::const_iterator Result = Results.begin(); Result != Results.end(); Result++)
+	{
+		Stream << Result->Devices << ',' << Result->Connected << ',' << Result->ConnectTime << ',';
+		WriteCsvSummary(Stream, Result->AdvToConnected);
+		Stream << ',';
+		WriteCsvSummary(Stream, Result->Read);
+		Stream << ',';
+		WriteCsvSummary(Stream, Result->Write);
+		Stream << ',' << Result->NotificationRate << ',' << Result->DeviceRateMean
+			<< ',' << Result->DeviceRateMin << ',' << Result->DeviceRateMax
+			<< ',' << Result->ReadErrors << ',' << Result->WriteErrors
+			<< ',' << Result->RegistryHit << ',' << Result->RegistryMiss
+			<< ',' << Result->GetClient << '\n';
+	}
+}
+
+static void WriteJsonSummary(ostream& Stream, const char* const Name,
+	const TLatencySummary& Summary)
+{
+	Stream << "      \"" << Name << "\": { \"count\": " << Summary.Count
+		<< ", \"mean_us\": " << Summary.Mean << ", \"p50_us\": " << Summary.P50
+		<< ", \"p90_us\": " << Summary.P90 << ", \"p99_us\": " << Summary.P99
+		<< ", \"p999_us\": " << Summary.P999 << ", \"max_us\": " << Summary.Max << " },\n";
+}
+
+void CSimBench::WriteJson(ostream& Stream, const vector<TBenchResult>& Results)
+{
+	Stream << "{\n  \"results\": [\n";
+	for (vector<TBenchResult>::const_iterator Result = Results.begin(); Result != Results.end(); Result++)
+	{
+		Stream << "    {\n";
+		Stream << "      \"devices\": " << Result->Devices << ",\n";
+		Stream << "      \"connected\": " << Result->Connected << ",\n";
+		Stream << "      \"connect_time_ms\": " << Result->ConnectTime << ",\n";
+		WriteJsonSummary(Stream, "adv_to_connected", Result->AdvToConnected);
+		WriteJsonSummary(Stream, "read", Result->Read);
+		WriteJsonSummary(Stream, "write", Result->Write);
+		Stream << "      \"notifications\": { \"per_s\": " << Result->NotificationRate
+			<< ", \"device_per_s_mean\": " << Result->DeviceRateMean
+			<< ", \"device_per_s_min\": " << Result->DeviceRateMin
+			<< ", \"device_per_s_max\": " << Result->DeviceRateMax << " },\n";
+		Stream << "      \"read_errors\": " << Result->ReadErrors << ",\n";
+		Stream << "      \"write_errors\": " << Result->WriteErrors << ",\n";
+		Stream << "      \"lookup\": { \"registry_hit_ns\": " << Result->RegistryHit
+			<< ", \"registry_miss_ns\": " << Result->RegistryMiss
+			<< ", \"get_client_ns\": " << Result->GetClient << " }\n";
+		Stream << "    }" << (Result + 1 != Results.end() ? "," : "") << "\n";
+	}
+	Stream << "  ]\n}\n";
+}
+
+CSimBench::CSimBench(const TBenchParams& Params)
+{
+	FParams = Params;
+	if (FParams.Lookups == 0)
+		FParams.Lookups = 1;
+
+	FWatcher = NULL;
+	FCounting = false;
+	FTerminate = false;
+
+	FAdvToConnected = new CLatencyHistogram();
+	FRead = new CLatencyHistogram();
+	FWrite = new CLatencyHistogram();
+	FReadErrors = 0;
+	FWriteErrors = 0;
+}
+
+CSimBench::~CSimBench()
+{
+	delete FAdvToConnected;
+	delete FRead;
+	delete FWrite;
+}
+
+int CSimBench::Run()
+{
+	vector<TBenchResult> Results;
+	for (vector<unsigned long>::iterator Devices = FParams.Devices.begin(); Devices != FParams.Devices.end(); Devices++)
+	{
+		TBenchResult Result;
+		int Res = RunDevices(*Devices, Result);
+		if (Res != WCL_E_SUCCESS)
+		{
+			fprintf(stderr, "Benchmark of %lu devices failed: 0x%.8X\n", *Devices, Res);
+			return Res;
+		}
+		Results.push_back(Result);
+	}
+
+	ostringstream Stream;
+	switch (FParams.Format)
+	{
+	case bfCsv:
+		WriteCsv(Stream, Results);
+		break;
+	case bfJson:
+		WriteJson(Stream, Results);
+		break;
+	default:
+		WriteText(Stream, Results);
+		break;
+	}
+
+	if (FParams.Output.empty())
+		fputs(Stream.str().c_str(), stdout);
+	else
+	{
+		ofstream File(FParams.Output);
+		File << Stream.str();
+		if (!File)
+		{
+			fprintf(stderr, "Unable to write %s\n", FParams.Output.c_str());
+			return WCL_E_INVALID_ARGUMENT;
+		}
+	}
+	return WCL_E_SUCCESS;
+}
+
+static void Usage()
+{
+	printf("Usage: SimBench [options]\n");
+	printf("  --devices N,N,...      device counts to run\n");
+	printf("  --duration S           measurement window (s)\n");
+	printf("  --connect-timeout S    time given to connect all the devices (s)\n");
+	printf("  --adv-interval MS      advertising interval (ms)\n");
+	printf("  --connect-latency MS   mean connection time (ms)\n");
+	printf("  --op-latency US        mean GATT request round trip (us)\n");
+	printf("  --jitter PERCENT       latencies deviation\n");
+	printf("  --notify-period MS     notification period (ms)\n");
+	printf("  --dispatch-threads N   fleet's event dispatching threads\n");
+	printf("  --seed N               random generator seed\n");
+	printf("  --load-threads N       threads running reads and writes\n");
+	printf("  --max-pending N        connections started at the same time\n");
+	printf("  --discovery N          discovery concurrency\n");
+	printf("  --batch MS             values batch window (0 - no batching)\n");
+	printf("  --pass-interval MS     advertisements filter pass interval\n");
+	printf("  --passive              find devices by service UUID with passive scanning\n");
+	printf("  --lookups N            lookups per registry measurement\n");
+	printf("  --format text|csv|json output format\n");
+	printf("  --output FILE          write the results to the file\n");
+}
+
+static bool ParseDevices(const char* Value, vector<unsigned long>& Devices)
+{
+	Devices.clear();
+	stringstream Stream(Value);
+	string Item;
+	while (getline(Stream, Item, ','))
+	{
+		unsigned long Count = strtoul(Item.c_str(), NULL, 10);
+		if (Count == 0)
+			return false;
+		Devices.push_back(Count);
+	}
+	return (Devices.size() > 0);
+}
+
+int main(int argc, char* argv[])
+{
+	TBenchParams Params;
+	CSimFleet::GetDefaultParams(Params.Fleet);
+	// Short latencies so 10000 devices connect in reasonable time.
+	Params.Fleet.ConnectLatency = 20;
+	Params.Fleet.OperationLatency = 1000;
+	Params.Fleet.NotificationPeriod = 100;
+	Params.Devices = { 10, 100, 1000, 10000 };
+	Params.ConnectTimeout = 120;
+	Params.Duration = 5;
+	Params.LoadThreads = 4;
+	Params.MaxPending = 64;
+	Params.DiscoveryConcurrency = 16;
+	Params.BatchWindow = DEFAULT_VALUES_BATCH_WINDOW;
+	Params.PassInterval = DEFAULT_ADVERTISEMENT_PASS_INTERVAL;
+	Params.Passive = false;
+	Params.Lookups = 1000000;
+	Params.Format = bfText;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string Option = argv[i];
+		if (Option == "--passive")
+		{
+			Params.Passive = true;
+			continue;
+		}
+		if (Option == "--help" || i + 1 >= argc)
+		{
+			Usage();
+			return (Option == "--help" ? 0 : 1);
+		}
+
+		const char* Value = argv[++i];
+		bool Valid = true;
+		if (Option == "--devices")
+			Valid = ParseDevices(Value, Params.Devices);
+		else if (Option == "--duration")
+			Params.Duration = strtoul(Value, NULL, 10);
+		else if (Option == "--connect-timeout")
+			Params.ConnectTimeout = strtoul(Value, NULL, 10);
+		else if (Option == "--adv-interval")
+			Params.Fleet.AdvertisingInterval = strtoul(Value, NULL, 10);
+		else if (Option == "--connect-latency")
+			Params.Fleet.ConnectLatency = strtoul(Value, NULL, 10);
+		else if (Option == "--op-latency")
+			Params.Fleet.OperationLatency = strtoul(Value, NULL, 10);
+		else if (Option == "--jitter")
+			Params.Fleet.Jitter = strtoul(Value, NULL, 10);
+		else if (Option == "--notify-period")
+			Params.Fleet.NotificationPeriod = strtoul(Value, NULL, 10);
+		else if (Option == "--dispatch-threads")
+			Params.Fleet.DispatchThreads = strtoul(Value, NULL, 10);
+		else if (Option == "--seed")
+			Params.Fleet.Seed = strtoul(Value, NULL, 10);
+		else if (Option == "--load-threads")
+			Params.LoadThreads = strtoul(Value, NULL, 10);
+		else if (Option == "--max-pending")
+			Params.MaxPending = strtoul(Value, NULL, 10);
+		else if (Option == "--discovery")
+			Params.DiscoveryConcurrency = strtoul(Value, NULL, 10);
+		else if (Option == "--batch")
+			Params.BatchWindow = strtoul(Value, NULL, 10);
+		else if (Option == "--pass-interval")
+			Params.PassInterval = strtoul(Value, NULL, 10);
+		else if (Option == "--lookups")
+			Params.Lookups = strtoul(Value, NULL, 10);
+		else if (Option == "--output")
+			Params.Output = Value;
+		else if (Option == "--format")
+		{
+			string Format = Value;
+			if (Format == "text")
+				Params.Format = bfText;
+			else if (Format == "csv")
+				Params.Format = bfCsv;
+			else if (Format == "json")
+				Params.Format = bfJson;
+			else
+				Valid = false;
+		}
+		else
+			Valid = false;
+
+		if (!Valid)
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	CSimBench* Bench = new CSimBench(Params);
+	int Res = Bench->Run();
+	delete Bench;
+	return (Res == WCL_E_SUCCESS ? 0 : 1);
+}
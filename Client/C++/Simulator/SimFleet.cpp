@@ -0,0 +1,788 @@
+#include <cmath>
+
+#include "SimFleet.h"
+
+using namespace std;
+
+#pragma region GATT database
+// Attribute handles of the server's service in the order it creates them.
+const unsigned short SERVICE_HANDLE = 0x0001;
+const unsigned short NOTIFIABLE_HANDLE = 0x0002;
+const unsigned short NOTIFIABLE_VALUE_HANDLE = 0x0003;
+const unsigned short READABLE_HANDLE = 0x0005;
+const unsigned short READABLE_VALUE_HANDLE = 0x0006;
+const unsigned short WRITABLE_HANDLE = 0x0007;
+const unsigned short WRITABLE_VALUE_HANDLE = 0x0008;
+
+// The server responds with the string including the terminating zero.
+static const char READ_RESPONSE[] = "This is simple response";
+
+static const tstring SIM_DEVICE_NAME = _T("MultyGattServer");
+#pragma endregion GATT database
+
+#pragma region Connection parameters presets
+static const wclBluetoothLeConnectionParameters BALANCED_PARAMS = { 24, 0, 200 };
+static const wclBluetoothLeConnectionParameters POWER_OPTIMIZED_PARAMS = { 144, 0, 500 };
+static const wclBluetoothLeConnectionParameters THROUGHPUT_OPTIMIZED_PARAMS = { 12, 0, 200 };
+#pragma endregion Connection parameters presets
+
+CSimPeripheral::CSimPeripheral(const __int64 Address, const char Rssi,
+	const unsigned long Index, const unsigned long Kind)
+{
+	FAddress = Address;
+	FRssi = Rssi;
+	FIndex = Index;
+	FKind = Kind;
+
+	FState = CSimPeripheral::psAdvertising;
+	FGeneration = 0;
+	FClient = NULL;
+	FSubscribed = false;
+	FCancelled = false;
+	FParams = BALANCED_PARAMS;
+
+	FNotifyValue = 0;
+	FReassembler = NULL;
+}
+
+CSimPeripheral::~CSimPeripheral()
+{
+	if (FReassembler != NULL)
+		delete FReassembler;
+}
+
+bool CSimFleet::TEventOrder::operator()(const TEvent& a, const TEvent& b) const
+{
+	// priority_queue keeps the "largest" item on top: the earliest event must
+	// be the largest one. Same time events keep the scheduling order.
+	if (a.Due != b.Due)
+		return (a.Due > b.Due);
+	return (a.Sequence > b.Sequence);
+}
+
+unsigned __int64 CSimFleet::Now()
+{
+	return (unsigned __int64)chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double CSimFleet::Random()
+{
+	return uniform_real_distribution<double>(0.0, 1.0)(FRandom);
+}
+
+unsigned __int64 CSimFleet::Randomize(const unsigned __int64 Mean)
+{
+	if (Mean == 0 || FParams.Jitter == 0)
+		return Mean;
+
+	unsigned __int64 Deviation = Mean * FParams.Jitter / 100;
+	if (Deviation > Mean)
+		Deviation = Mean;
+	return Mean - Deviation + (unsigned __int64)(Random() * 2 * Deviation);
+}
+
+void CSimFleet::Schedule(const TEventKind Kind, CSimPeripheral* const Peripheral,
+	const unsigned __int64 Delay, const int Param)
+{
+	TEvent Event;
+	Event.Due = Now() + Delay;
+	Event.Sequence = FSequence++;
+	Event.Kind = Kind;
+	Event.Peripheral = Peripheral;
+	Event.Generation = Peripheral->FGeneration;
+	Event.Param = Param;
+	FEvents.push(Event);
+	FSignal.notify_one();
+}
+
+void CSimFleet::Advertise(CSimPeripheral* const Peripheral, const unsigned __int64 Delay)
+{
+	Schedule(seAdvertise, Peripheral, Delay);
+}
+
+void CSimFleet::Unbind(CSimPeripheral* const Peripheral)
+{
+	if (Peripheral->FClient != NULL)
+	{
+		FRadioLinks[Peripheral->FClient->FRadio]--;
+		Peripheral->FClient->FPeripheral = NULL;
+		Peripheral->FClient->State = csDisconnected;
+	}
+	if (Peripheral->FState == CSimPeripheral::psConnected)
+		FStats.Connected--;
+
+	Peripheral->FClient = NULL;
+	Peripheral->FSubscribed = false;
+	Peripheral->FCancelled = false;
+	Peripheral->FState = CSimPeripheral::psAdvertising;
+	// All the events of the connection are outdated now.
+	Peripheral->FGeneration++;
+	// The server restarts advertising on disconnection.
+	Advertise(Peripheral, Randomize((unsigned __int64)FParams.AdvertisingInterval * 1000));
+}
+
+void CSimFleet::WaitDelivered(unique_lock<mutex>& Lock, const void* const Target)
+{
+	thread::id Current = this_thread::get_id();
+	FDelivered.wait(Lock, [this, Target, Current]
+	{
+		for (vector<TDispatcher*>::iterator Dispatcher = FDispatchers.begin(); Dispatcher != FDispatchers.end(); Dispatcher++)
+		{
+			// The target may destroy itself from its own event handler.
+			if ((*Dispatcher)->Target == Target && (*Dispatcher)->Thread.get_id() != Current)
+				return false;
+		}
+		return true;
+	});
+}
+
+CSimPeripheral* CSimFleet::GetPeripheral(const CwclGattClient* const Client)
+{
+	CSimPeripheral* Peripheral = Client->FPeripheral;
+	if (Peripheral == NULL || Peripheral->FClient != Client || Peripheral->FState != CSimPeripheral::psConnected)
+		return NULL;
+	return Peripheral;
+}
+
+void CSimFleet::TimerProc()
+{
+	unique_lock<mutex> Lock(FLock);
+	while (!FTerminate)
+	{
+		if (FEvents.empty())
+		{
+			FSignal.wait(Lock);
+			continue;
+		}
+
+		unsigned __int64 Due = FEvents.top().Due;
+		unsigned __int64 Current = Now();
+		if (Current < Due)
+		{
+			FSignal.wait_for(Lock, chrono::microseconds(Due - Current));
+			continue;
+		}
+
+		TEvent Event = FEvents.top();
+		FEvents.pop();
+
+		// Events of one peripheral always go to the same dispatcher.
+		TDispatcher* Dispatcher = FDispatchers[Event.Peripheral->FIndex % FDispatchers.size()];
+		Dispatcher->Queue.push_back(Event);
+		Dispatcher->Signal.notify_one();
+	}
+}
+
+void CSimFleet::DispatchProc(TDispatcher* const Dispatcher)
+{
+	unique_lock<mutex> Lock(FLock);
+	while (true)
+	{
+		Dispatcher->Signal.wait(Lock, [this, Dispatcher]
+		{
+			return (FTerminate || !Dispatcher->Queue.empty());
+		});
+		if (FTerminate)
+			break;
+
+		TEvent Event = Dispatcher->Queue.front();
+		Dispatcher->Queue.pop_front();
+		Deliver(Dispatcher, Event, Lock);
+	}
+}
+
+void CSimFleet::Call(TDispatcher* const Dispatcher, const void* const Target,
+	unique_lock<mutex>& Lock, const function<void()>& Method)
+{
+	Dispatcher->Target = Target;
+	Lock.unlock();
+	Method();
+	Lock.lock();
+	Dispatcher->Target = NULL;
+	FDelivered.notify_all();
+}
+
+void CSimFleet::Deliver(TDispatcher* const Dispatcher, const TEvent& Event,
+	unique_lock<mutex>& Lock)
+{
+	CSimPeripheral* Peripheral = Event.Peripheral;
+	if (Event.Generation != Peripheral->FGeneration)
+		return;
+
+	CwclGattClient* Client = Peripheral->FClient;
+	switch (Event.Kind)
+	{
+	case seAdvertise:
+		{
+			if (Peripheral->FState != CSimPeripheral::psAdvertising)
+				return;
+
+			FStats.Advertisements++;
+			Advertise(Peripheral, Randomize((unsigned __int64)FParams.AdvertisingInterval * 1000));
+
+			// RSSI varies a little from packet to packet.
+			char Rssi = (char)(Peripheral->FRssi + (int)(Random() * 7) - 3);
+			__int64 Timestamp = (__int64)Now();
+			wclBluetoothLeAdvertisementFlags Flags;
+			ZeroMemory(&Flags, sizeof(wclBluetoothLeAdvertisementFlags));
+			Flags.GeneralDiscoverableMode = true;
+			Flags.ClassicNotSupported = true;
+
+			vector<CwclBluetoothLeBeaconWatcher*> Watchers(FWatchers.begin(), FWatchers.end());
+			for (vector<CwclBluetoothLeBeaconWatcher*>::iterator Watcher = Watchers.begin(); Watcher != Watchers.end(); Watcher++)
+			{
+				// The watcher may have stopped while we delivered to other one.
+				if (find(FWatchers.begin(), FWatchers.end(), *Watcher) == FWatchers.end())
+					continue;
+
+				// The advertisement carries the service UUID and the manufacturer
+				// data. The name comes with the scan response which only active
+				// scanning requests.
+				CwclBluetoothLeBeaconWatcher* Target = *Watcher;
+				Call(Dispatcher, Target, Lock, [Target, Peripheral, Timestamp, Rssi, &Flags]
+				{
+					TClientProfile Profile;
+					GetProfile(Peripheral->FKind, Profile);
+					unsigned char Data = (unsigned char)Peripheral->FKind;
+
+					Target->DoAdvertisementFrameInformation(Peripheral->FAddress, Timestamp,
+						Rssi, _T(""), atConnectableUndirected, Flags);
+					Target->DoAdvertisementUuidFrame(Peripheral->FAddress, Timestamp,
+						Rssi, Profile.Service);
+					Target->DoAdvertisementManufacturerRawFrame(Peripheral->FAddress, Timestamp,
+						Rssi, SIM_COMPANY_ID, &Data, 1);
+					if (Target->ScanningMode == smActive)
+					{
+						Target->DoAdvertisementFrameInformation(Peripheral->FAddress, Timestamp,
+							Rssi, GetName(Peripheral->FKind), atScanResponse, Flags);
+					}
+				});
+			}
+		}
+		break;
+
+	case seConnected:
+		{
+			if (Peripheral->FState != CSimPeripheral::psConnecting)
+				return;
+
+			int Error = Event.Param;
+			if (Peripheral->FCancelled)
+				Error = WCL_E_CONNECTION_TERMINATED;
+
+			if (Error == WCL_E_SUCCESS)
+			{
+				Peripheral->FState = CSimPeripheral::psConnected;
+				Peripheral->FParams = BALANCED_PARAMS;
+				Client->State = csConnected;
+				FStats.Connected++;
+
+				// Link losses are the Poisson process.
+				if (FParams.DisconnectRate > 0)
+				{
+					double Seconds = -log(1.0 - Random()) / FParams.DisconnectRate;
+					Schedule(seLinkLoss, Peripheral, (unsigned __int64)(Seconds * 1000000.0));
+				}
+			}
+			else
+			{
+				FStats.ConnectFailures++;
+				Unbind(Peripheral);
+			}
+
+			Call(Dispatcher, Client, Lock, [Client, Error] { Client->DoConnect(Error); });
+		}
+		break;
+
+	case seNotify:
+		{
+			if (Peripheral->FState != CSimPeripheral::psConnected || !Peripheral->FSubscribed)
+				return;
+
+			unsigned long Value = Peripheral->FNotifyValue++;
+			Schedule(seNotify, Peripheral, Randomize((unsigned __int64)FParams.NotificationPeriod * 1000));
+
+			if (FParams.NotificationLoss > 0 && Random() < FParams.NotificationLoss)
+			{
+				FStats.NotificationsLost++;
+				return;
+			}
+			FStats.NotificationsSent++;
+
+			// The ESP32 sends 32-bit value in little endian.
+			unsigned char Data[4];
+			Data[0] = (unsigned char)(Value & 0xFF);
+			Data[1] = (unsigned char)((Value >> 8) & 0xFF);
+			Data[2] = (unsigned char)((Value >> 16) & 0xFF);
+			Data[3] = (unsigned char)((Value >> 24) & 0xFF);
+			Call(Dispatcher, Client, Lock, [Client, &Data]
+			{
+				Client->DoCharacteristicChanged(NOTIFIABLE_VALUE_HANDLE, Data, sizeof(Data));
+			});
+		}
+		break;
+
+	case seLinkLoss:
+	case seDisconnected:
+		{
+			if (Peripheral->FState != CSimPeripheral::psConnected)
+				return;
+
+			int Reason = WCL_E_SUCCESS;
+			if (Event.Kind == seLinkLoss)
+			{
+				FStats.LinkLosses++;
+				Reason = WCL_E_CONNECTION_TERMINATED;
+			}
+			Unbind(Peripheral);
+
+			Call(Dispatcher, Client, Lock, [Client, Reason] { Client->DoDisconnect(Reason); });
+		}
+		break;
+
+	case seParamsChanged:
+		if (Peripheral->FState == CSimPeripheral::psConnected)
+			Call(Dispatcher, Client, Lock, [Client] { Client->DoConnectionParamsChanged(); });
+		break;
+	}
+}
+
+int CSimFleet::Request(const CwclGattClient* const Client)
+{
+	unsigned long Kind;
+	return Request(Client, Kind);
+}
+
+int CSimFleet::Request(const CwclGattClient* const Client, unsigned long& Kind)
+{
+	unsigned __int64 Delay;
+	{
+		lock_guard<mutex> Lock(FLock);
+		CSimPeripheral* Peripheral = GetPeripheral(Client);
+		if (Peripheral == NULL)
+			return WCL_E_CONNECTION_NOT_ACTIVE;
+		Kind = Peripheral->FKind;
+		Delay = Randomize(FParams.OperationLatency);
+	}
+
+	if (Delay > 0)
+		this_thread::sleep_for(chrono::microseconds(Delay));
+	return WCL_E_SUCCESS;
+}
+
+void CSimFleet::BuildService(const unsigned long Kind, wclGattService& Service)
+{
+	TClientProfile Profile;
+	GetProfile(Kind, Profile);
+
+	ZeroMemory(&Service, sizeof(wclGattService));
+	Service.Uuid.IsShortUuid = false;
+	Service.Uuid.LongUuid = Profile.Service;
+	Service.Handle = SERVICE_HANDLE;
+}
+
+void CSimFleet::BuildCharacteristics(const unsigned long Kind, wclGattCharacteristics& Chars)
+{
+	TClientProfile Profile;
+	GetProfile(Kind, Profile);
+
+	Chars.clear();
+
+	wclGattCharacteristic Char;
+	ZeroMemory(&Char, sizeof(wclGattCharacteristic));
+	Char.ServiceHandle = SERVICE_HANDLE;
+	Char.Uuid.IsShortUuid = false;
+
+	Char.Uuid.LongUuid = Profile.NotifiableChar;
+	Char.Handle = NOTIFIABLE_HANDLE;
+	Char.ValueHandle = NOTIFIABLE_VALUE_HANDLE;
+	Char.IsNotifiable = true;
+	Chars.push_back(Char);
+
+	Char.IsNotifiable = false;
+	Char.Uuid.LongUuid = Profile.ReadableChar;
+	Char.Handle = READABLE_HANDLE;
+	Char.ValueHandle = READABLE_VALUE_HANDLE;
+	Char.IsReadable = true;
+	Chars.push_back(Char);
+
+	Char.IsReadable = false;
+	Char.Uuid.LongUuid = Profile.WritableChar;
+	Char.Handle = WRITABLE_HANDLE;
+	Char.ValueHandle = WRITABLE_VALUE_HANDLE;
+	Char.IsWritable = true;
+	Char.IsWritableWithoutResponse = true;
+	Chars.push_back(Char);
+}
+
+CSimFleet::CSimFleet(const TSimFleetParams& Params)
+{
+	FParams = Params;
+	if (FParams.DispatchThreads == 0)
+		FParams.DispatchThreads = 1;
+	if (FParams.MaxPduSize < 23)
+		FParams.MaxPduSize = 23;
+	if (FParams.Profiles == 0)
+		FParams.Profiles = 1;
+
+	FTerminate = false;
+	FSequence = 0;
+	FRandom.seed(FParams.Seed);
+	ZeroMemory(&FStats, sizeof(TSimFleetStats));
+
+	for (unsigned long i = 0; i < FParams.Devices; i++)
+	{
+		// Random static addresses.
+		__int64 Address = 0xC00000000000LL | (__int64)(i + 1);
+		char Rssi = (char)(-90 + (int)(Random() * 50));
+		CSimPeripheral* Peripheral = new CSimPeripheral(Address, Rssi, i, i % FParams.Profiles);
+		FPeripherals.push_back(Peripheral);
+		FAddresses[Address] = Peripheral;
+
+		// Spread the advertisements over the interval.
+		Advertise(Peripheral, (unsigned __int64)(Random() * FParams.AdvertisingInterval * 1000));
+	}
+
+	for (unsigned long i = 0; i < FParams.DispatchThreads; i++)
+	{
+		TDispatcher* Dispatcher = new TDispatcher();
+		Dispatcher->Target = NULL;
+		FDispatchers.push_back(Dispatcher);
+	}
+	for (vector<TDispatcher*>::iterator Dispatcher = FDispatchers.begin(); Dispatcher != FDispatchers.end(); Dispatcher++)
+		(*Dispatcher)->Thread = thread(&CSimFleet::DispatchProc, this, *Dispatcher);
+	FTimerThread = thread(&CSimFleet::TimerProc, this);
+}
+
+CSimFleet::~CSimFleet()
+{
+	{
+		lock_guard<mutex> Lock(FLock);
+		FTerminate = true;
+		FSignal.notify_all();
+		for (vector<TDispatcher*>::iterator Dispatcher = FDispatchers.begin(); Dispatcher != FDispatchers.end(); Dispatcher++)
+			(*Dispatcher)->Signal.notify_all();
+	}
+
+	FTimerThread.join();
+	for (vector<TDispatcher*>::iterator Dispatcher = FDispatchers.begin(); Dispatcher != FDispatchers.end(); Dispatcher++)
+	{
+		(*Dispatcher)->Thread.join();
+		delete *Dispatcher;
+	}
+
+	// All the clients must be destroyed before the fleet.
+	for (vector<CSimPeripheral*>::iterator Peripheral = FPeripherals.begin(); Peripheral != FPeripherals.end(); Peripheral++)
+		delete *Peripheral;
+}
+
+void CSimFleet::GetDefaultParams(TSimFleetParams& Params)
+{
+	Params.Devices = 100;
+	Params.AdvertisingInterval = 100;
+	Params.ConnectLatency = 50;
+	Params.OperationLatency = 7500;
+	Params.Jitter = 20;
+	Params.ConnectLoss = 0.0;
+	Params.NotificationLoss = 0.0;
+	Params.DisconnectRate = 0.0;
+	// As the server does.
+	Params.NotificationPeriod = 1000;
+	Params.MaxPduSize = 255;
+	Params.Profiles = 1;
+	Params.RadioConnections = 0;
+	Params.DispatchThreads = 4;
+	Params.Seed = 1;
+}
+
+void CSimFleet::GetProfile(const unsigned long Kind, TClientProfile& Profile)
+{
+	// Other kinds have the server's UUIDs with the kind in the first word.
+	Profile = DEFAULT_CLIENT_PROFILE;
+	Profile.Service.Data1 += Kind;
+	Profile.ReadableChar.Data1 += Kind;
+	Profile.WritableChar.Data1 += Kind;
+	Profile.NotifiableChar.Data1 += Kind;
+}
+
+tstring CSimFleet::GetName(const unsigned long Kind)
+{
+	if (Kind == 0)
+		return SIM_DEVICE_NAME;
+	return _T("SimDevice") + to_string(Kind);
+}
+
+void CSimFleet::GetStats(TSimFleetStats& Stats)
+{
+	lock_guard<mutex> Lock(FLock);
+	Stats = FStats;
+}
+
+void CSimFleet::GetAddresses(vector<__int64>& Addresses)
+{
+	Addresses.clear();
+	for (vector<CSimPeripheral*>::iterator Peripheral = FPeripherals.begin(); Peripheral != FPeripherals.end(); Peripheral++)
+		Addresses.push_back((*Peripheral)->FAddress);
+}
+
+void CSimFleet::StartScan(CwclBluetoothLeBeaconWatcher* const Watcher)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (find(FWatchers.begin(), FWatchers.end(), Watcher) == FWatchers.end())
+		FWatchers.push_back(Watcher);
+}
+
+void CSimFleet::StopScan(CwclBluetoothLeBeaconWatcher* const Watcher)
+{
+	unique_lock<mutex> Lock(FLock);
+	FWatchers.remove(Watcher);
+	WaitDelivered(Lock, Watcher);
+}
+
+int CSimFleet::Connect(CwclGattClient* const Client)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (Client->FPeripheral != NULL)
+		return WCL_E_CONNECTION_ACTIVE;
+
+	unordered_map<__int64, CSimPeripheral*>::iterator Item = FAddresses.find(Client->Address);
+	// Connected peripheral does not advertise so it can not be found.
+	if (Item == FAddresses.end() || Item->second->FState != CSimPeripheral::psAdvertising)
+		return WCL_E_BLUETOOTH_LE_DEVICE_NOT_FOUND;
+
+	// The controller has no room for one more link.
+	unsigned long& Links = FRadioLinks[Client->FRadio];
+	if (FParams.RadioConnections > 0 && Links >= FParams.RadioConnections)
+	{
+		FStats.RadioRejects++;
+		return WCL_E_CONNECTION_TIMEOUT;
+	}
+	Links++;
+
+	CSimPeripheral* Peripheral = Item->second;
+	FStats.ConnectAttempts++;
+
+	Peripheral->FState = CSimPeripheral::psConnecting;
+	Peripheral->FGeneration++;
+	Peripheral->FClient = Client;
+	Client->FPeripheral = Peripheral;
+	Client->State = csConnecting;
+
+	int Error = WCL_E_SUCCESS;
+	if (FParams.ConnectLoss > 0 && Random() < FParams.ConnectLoss)
+		Error = WCL_E_CONNECTION_TIMEOUT;
+	Schedule(seConnected, Peripheral, Randomize((unsigned __int64)FParams.ConnectLatency * 1000), Error);
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::Disconnect(CwclGattClient* const Client)
+{
+	lock_guard<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = Client->FPeripheral;
+	if (Peripheral == NULL || Peripheral->FClient != Client)
+		return WCL_E_CONNECTION_NOT_ACTIVE;
+	if (Client->State == csDisconnecting)
+		return WCL_E_SUCCESS;
+
+	Client->State = csDisconnecting;
+	// Connection in progress completes with error.
+	if (Peripheral->FState == CSimPeripheral::psConnecting)
+		Peripheral->FCancelled = true;
+	else
+		Schedule(seDisconnected, Peripheral, Randomize(FParams.OperationLatency));
+	return WCL_E_SUCCESS;
+}
+
+void CSimFleet::Detach(CwclGattClient* const Client)
+{
+	unique_lock<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = Client->FPeripheral;
+	if (Peripheral != NULL && Peripheral->FClient == Client)
+		Unbind(Peripheral);
+	WaitDelivered(Lock, Client);
+}
+
+int CSimFleet::FindService(const CwclGattClient* const Client, const wclGattUuid& Uuid,
+	wclGattService& Service)
+{
+	unsigned long Kind;
+	int Res = Request(Client, Kind);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	TClientProfile Profile;
+	GetProfile(Kind, Profile);
+	if (Uuid.IsShortUuid || !IsEqualGUID(Uuid.LongUuid, Profile.Service))
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+	BuildService(Kind, Service);
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::ReadCharacteristics(const CwclGattClient* const Client,
+	const wclGattService& Service, wclGattCharacteristics& Chars)
+{
+	unsigned long Kind;
+	int Res = Request(Client, Kind);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	if (Service.Handle != SERVICE_HANDLE)
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+	BuildCharacteristics(Kind, Chars);
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::Subscribe(const CwclGattClient* const Client, const wclGattCharacteristic& Char)
+{
+	// Writing the CCCD is a request.
+	int Res = Request(Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	if (Char.ValueHandle != NOTIFIABLE_VALUE_HANDLE)
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+
+	lock_guard<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = GetPeripheral(Client);
+	if (Peripheral == NULL)
+		return WCL_E_CONNECTION_TERMINATED;
+
+	if (!Peripheral->FSubscribed)
+	{
+		Peripheral->FSubscribed = true;
+		Schedule(seNotify, Peripheral, Randomize((unsigned __int64)FParams.NotificationPeriod * 1000));
+	}
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::Read(const CwclGattClient* const Client, const wclGattCharacteristic& Char,
+	unsigned char*& Value, unsigned long& Length)
+{
+	Value = NULL;
+	Length = 0;
+
+	int Res = Request(Client);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	if (Char.ValueHandle != READABLE_VALUE_HANDLE)
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+
+	{
+		lock_guard<mutex> Lock(FLock);
+		if (GetPeripheral(Client) == NULL)
+			return WCL_E_CONNECTION_TERMINATED;
+		FStats.Reads++;
+	}
+
+	Value = (unsigned char*)malloc(sizeof(READ_RESPONSE));
+	if (Value == NULL)
+		return WCL_E_OUT_OF_MEMORY;
+	memcpy(Value, READ_RESPONSE, sizeof(READ_RESPONSE));
+	Length = sizeof(READ_RESPONSE);
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::Write(const CwclGattClient* const Client, const wclGattCharacteristic& Char,
+	const unsigned char* const Value, const unsigned long Length, const wclGattWriteKind Kind)
+{
+	if (Value == NULL || Length == 0 || Length > MAX_ATTRIBUTE_VALUE_LENGTH)
+		return WCL_E_INVALID_ARGUMENT;
+
+	// Write Without Response is queued by the stack and returns at once.
+	bool WithResponse = (Kind != wkWithoutResponse);
+	if (WithResponse)
+	{
+		int Res = Request(Client);
+		if (Res != WCL_E_SUCCESS)
+			return Res;
+	}
+
+	if (Char.ValueHandle != WRITABLE_VALUE_HANDLE)
+		return WCL_E_BLUETOOTH_LE_ATTRIBUTE_NOT_FOUND;
+
+	lock_guard<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = GetPeripheral(Client);
+	if (Peripheral == NULL)
+		return (WithResponse ? WCL_E_CONNECTION_TERMINATED : WCL_E_CONNECTION_NOT_ACTIVE);
+	// The command must fit into single PDU.
+	if (!WithResponse && Length > (unsigned long)FParams.MaxPduSize - 3)
+		return WCL_E_INVALID_ARGUMENT;
+
+	if (WithResponse)
+		FStats.Writes++;
+	else
+		FStats.WritesWithoutResponse++;
+
+	// Framed segments are reassembled as the server does.
+	if ((Value[0] & FRAME_MARKER_MASK) == FRAME_MARKER)
+	{
+		if (Peripheral->FReassembler == NULL)
+			Peripheral->FReassembler = new CFrameReassembler();
+
+		bool Complete;
+		if (Peripheral->FReassembler->Push(Value, Length, Complete) == WCL_E_SUCCESS && Complete)
+			FStats.Messages++;
+	}
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::GetMaxPduSize(const CwclGattClient* const Client, unsigned short& Size)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (GetPeripheral(Client) == NULL)
+		return WCL_E_CONNECTION_NOT_ACTIVE;
+	Size = FParams.MaxPduSize;
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::GetConnectionParams(const CwclGattClient* const Client,
+	wclBluetoothLeConnectionParameters& Params)
+{
+	lock_guard<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = GetPeripheral(Client);
+	if (Peripheral == NULL)
+		return WCL_E_CONNECTION_NOT_ACTIVE;
+	Params = Peripheral->FParams;
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::SetConnectionParams(const CwclGattClient* const Client,
+	const wclBluetoothLeConnectionParametersPreset Preset)
+{
+	lock_guard<mutex> Lock(FLock);
+	CSimPeripheral* Peripheral = GetPeripheral(Client);
+	if (Peripheral == NULL)
+		return WCL_E_CONNECTION_NOT_ACTIVE;
+
+	switch (Preset)
+	{
+	case ppPowerOptimized:
+		Peripheral->FParams = POWER_OPTIMIZED_PARAMS;
+		break;
+	case ppThroughputOptimized:
+		Peripheral->FParams = THROUGHPUT_OPTIMIZED_PARAMS;
+		break;
+	default:
+		Peripheral->FParams = BALANCED_PARAMS;
+		break;
+	}
+	// The new parameters are reported after the link layer procedure.
+	Schedule(seParamsChanged, Peripheral, Randomize(FParams.OperationLatency));
+	return WCL_E_SUCCESS;
+}
+
+int CSimFleet::GetConnectionPhy(const CwclGattClient* const Client,
+	wclBluetoothLeConnectionPhy& Phy)
+{
+	lock_guard<mutex> Lock(FLock);
+	if (GetPeripheral(Client) == NULL)
+		return WCL_E_CONNECTION_NOT_ACTIVE;
+
+	// ESP32 and modern adapters switch to 2M PHY.
+	ZeroMemory(&Phy, sizeof(wclBluetoothLeConnectionPhy));
+	Phy.Receive.IsUncoded2MPhy = true;
+	Phy.Transmit.IsUncoded2MPhy = true;
+	return WCL_E_SUCCESS;
+}
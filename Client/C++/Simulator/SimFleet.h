@@ -0,0 +1,266 @@
+#pragma once
+
+#include "wclBluetooth.h"
+
+#include "Framing.h"
+#include "GattClient.h"
+
+using namespace wclCommon;
+using namespace wclCommunication;
+using namespace wclBluetooth;
+
+// The company identifier of the peripherals' manufacturer data (reserved for
+// tests by the Bluetooth SIG). The data is the single byte: the device kind.
+const unsigned short SIM_COMPANY_ID = 0xFFFF;
+
+// Fleet configuration. All the random values come from the generator seeded
+// with Seed so a run can be repeated.
+typedef struct
+{
+	// Number of virtual peripherals.
+	unsigned long		Devices;
+	// Advertising interval of a not connected peripheral (ms).
+	unsigned long		AdvertisingInterval;
+	// Mean time from connection request to connection event (ms).
+	unsigned long		ConnectLatency;
+	// Mean GATT request round trip (us).
+	unsigned long		OperationLatency;
+	// Random deviation of all the latencies (percents of the mean).
+	unsigned long		Jitter;
+	// Probability that a connection attempt fails.
+	double				ConnectLoss;
+	// Probability that a notification is lost on the air.
+	double				NotificationLoss;
+	// Link losses per connected peripheral per second.
+	double				DisconnectRate;
+	// Notification period of the notifiable characteristic (ms).
+	unsigned long		NotificationPeriod;
+	// ATT MTU negotiated by the peripheral.
+	unsigned short		MaxPduSize;
+	// Number of device kinds. The peripherals are spread over the kinds
+	// evenly. Each kind has its own name, service and characteristic UUIDs
+	// (see CSimFleet::GetProfile) and the manufacturer data. Kind 0 is our
+	// server.
+	unsigned long		Profiles;
+	// Connections each radio's controller can hold at the same time. The
+	// connection request beyond the limit is rejected. Zero means no limit.
+	unsigned long		RadioConnections;
+	// Number of threads delivering the events. Events of one peripheral are
+	// always delivered by the same thread so they come in order.
+	unsigned long		DispatchThreads;
+	unsigned long		Seed;
+} TSimFleetParams;
+
+// Fleet counters.
+typedef struct
+{
+	unsigned __int64	Advertisements;
+	unsigned __int64	ConnectAttempts;
+	unsigned __int64	ConnectFailures;
+	unsigned __int64	LinkLosses;
+	unsigned __int64	NotificationsSent;
+	unsigned __int64	NotificationsLost;
+	unsigned __int64	Reads;
+	unsigned __int64	Writes;
+	unsigned __int64	WritesWithoutResponse;
+	unsigned __int64	Messages;
+	// Connection requests rejected because the radio's controller was full.
+	unsigned __int64	RadioRejects;
+	// Currently connected peripherals.
+	unsigned long		Connected;
+} TSimFleetStats;
+
+// The virtual peripheral. Implements the same GATT database and behavior as
+// Server/Server.ino: the readable characteristic returns the fixed string,
+// the writable one accepts writes with and without response (framed
+// messages are reassembled) and the notifiable one sends the incrementing
+// 32-bit counter each NotificationPeriod while the client is subscribed.
+// The peripheral advertises only while it is not connected.
+class CSimPeripheral
+{
+	DISABLE_COPY(CSimPeripheral);
+
+	friend class CSimFleet;
+
+private:
+	typedef enum
+	{
+		psAdvertising,
+		psConnecting,
+		psConnected
+	} TState;
+
+	__int64					FAddress;
+	char					FRssi;
+	unsigned long			FIndex;
+	unsigned long			FKind;
+
+	TState					FState;
+	// Changes on each state change. Scheduled events of other generations are
+	// outdated and ignored.
+	unsigned long			FGeneration;
+	CwclGattClient*			FClient;
+	bool					FSubscribed;
+	bool					FCancelled;
+	wclBluetoothLeConnectionParameters	FParams;
+
+	// The same counter as the server's one: it is not reset on reconnection.
+	unsigned long			FNotifyValue;
+	CFrameReassembler*		FReassembler;
+
+	CSimPeripheral(const __int64 Address, const char Rssi, const unsigned long Index,
+		const unsigned long Kind);
+	~CSimPeripheral();
+};
+
+// The fleet of the virtual peripherals and the simulated link between them and
+// the clients. A single timer thread schedules the events (advertisements,
+// connection completions, notifications, link losses) and the dispatch
+// threads deliver them to the clients and watchers. GATT requests are
+// executed synchronously on the caller's thread and take OperationLatency.
+class CSimFleet
+{
+	DISABLE_COPY(CSimFleet);
+
+private:
+	typedef enum
+	{
+		seAdvertise,
+		seConnected,
+		seNotify,
+		seLinkLoss,
+		seDisconnected,
+		seParamsChanged
+	} TEventKind;
+
+	typedef struct
+	{
+		unsigned __int64	Due;
+		unsigned __int64	Sequence;
+		TEventKind			Kind;
+		CSimPeripheral*		Peripheral;
+		unsigned long		Generation;
+		int					Param;
+	} TEvent;
+
+	class TEventOrder
+	{
+	public:
+		bool operator()(const TEvent& a, const TEvent& b) const;
+	};
+
+	typedef std::priority_queue<TEvent, std::vector<TEvent>, TEventOrder> EVENTS;
+	typedef std::list<CwclBluetoothLeBeaconWatcher*> WATCHERS;
+
+	// Dispatch thread state.
+	typedef struct
+	{
+		std::thread						Thread;
+		std::deque<TEvent>				Queue;
+		std::condition_variable			Signal;
+		// The object which event is delivered right now.
+		const void*						Target;
+	} TDispatcher;
+
+	TSimFleetParams						FParams;
+
+	std::mutex							FLock;
+	std::condition_variable				FSignal;
+	// Signaled when a dispatcher finished delivering the event.
+	std::condition_variable				FDelivered;
+	bool								FTerminate;
+
+	std::vector<CSimPeripheral*>		FPeripherals;
+	std::unordered_map<__int64, CSimPeripheral*>	FAddresses;
+	// Connections started or established through each radio.
+	std::unordered_map<const CwclBluetoothRadio*, unsigned long>	FRadioLinks;
+	WATCHERS							FWatchers;
+
+	EVENTS								FEvents;
+	unsigned __int64					FSequence;
+	std::thread							FTimerThread;
+	std::vector<TDispatcher*>			FDispatchers;
+
+	std::mt19937_64						FRandom;
+	TSimFleetStats						FStats;
+
+	static unsigned __int64 Now();
+
+#pragma region Must be called under the lock
+	double Random();
+	// Returns the mean value randomized by the Jitter.
+	unsigned __int64 Randomize(const unsigned __int64 Mean);
+	void Schedule(const TEventKind Kind, CSimPeripheral* const Peripheral,
+		const unsigned __int64 Delay, const int Param = WCL_E_SUCCESS);
+	// Starts advertising of the peripheral.
+	void Advertise(CSimPeripheral* const Peripheral, const unsigned __int64 Delay);
+	// Drops the connection and returns the peripheral to advertising.
+	void Unbind(CSimPeripheral* const Peripheral);
+	// Waits until the Target is not used by the dispatchers (except the current
+	// thread's one).
+	void WaitDelivered(std::unique_lock<std::mutex>& Lock, const void* const Target);
+	// Returns the connected peripheral of the client or NULL.
+	CSimPeripheral* GetPeripheral(const CwclGattClient* const Client);
+#pragma endregion Must be called under the lock
+
+	void TimerProc();
+	void DispatchProc(TDispatcher* const Dispatcher);
+	// Delivers the event. Called with the lock held. The lock is released
+	// while the client's or watcher's method runs.
+	void Deliver(TDispatcher* const Dispatcher, const TEvent& Event,
+		std::unique_lock<std::mutex>& Lock);
+	// Calls the method of the Target without the lock.
+	void Call(TDispatcher* const Dispatcher, const void* const Target,
+		std::unique_lock<std::mutex>& Lock, const std::function<void()>& Method);
+	// Simulates the GATT request round trip. Returns the error if the client
+	// is not connected.
+	int Request(const CwclGattClient* const Client);
+	// The same but also returns the kind of the connected peripheral.
+	int Request(const CwclGattClient* const Client, unsigned long& Kind);
+
+	static void BuildService(const unsigned long Kind, wclGattService& Service);
+	static void BuildCharacteristics(const unsigned long Kind, wclGattCharacteristics& Chars);
+
+public:
+	CSimFleet(const TSimFleetParams& Params);
+	~CSimFleet();
+
+	static void GetDefaultParams(TSimFleetParams& Params);
+	// Returns the service and the characteristics of the device kind.
+	static void GetProfile(const unsigned long Kind, TClientProfile& Profile);
+	// Returns the advertised name of the device kind.
+	static tstring GetName(const unsigned long Kind);
+
+	void GetStats(TSimFleetStats& Stats);
+	// Returns the addresses of all the peripherals.
+	void GetAddresses(std::vector<__int64>& Addresses);
+
+#pragma region Radio side
+	void StartScan(CwclBluetoothLeBeaconWatcher* const Watcher);
+	void StopScan(CwclBluetoothLeBeaconWatcher* const Watcher);
+
+	int Connect(CwclGattClient* const Client);
+	int Disconnect(CwclGattClient* const Client);
+	// Called from the client's destructor. Drops the client's connection and
+	// waits until no event is delivered to the client.
+	void Detach(CwclGattClient* const Client);
+
+	int FindService(const CwclGattClient* const Client, const wclGattUuid& Uuid,
+		wclGattService& Service);
+	int ReadCharacteristics(const CwclGattClient* const Client, const wclGattService& Service,
+		wclGattCharacteristics& Chars);
+	int Subscribe(const CwclGattClient* const Client, const wclGattCharacteristic& Char);
+	int Read(const CwclGattClient* const Client, const wclGattCharacteristic& Char,
+		unsigned char*& Value, unsigned long& Length);
+	int Write(const CwclGattClient* const Client, const wclGattCharacteristic& Char,
+		const unsigned char* const Value, const unsigned long Length,
+		const wclGattWriteKind Kind);
+
+	int GetMaxPduSize(const CwclGattClient* const Client, unsigned short& Size);
+	int GetConnectionParams(const CwclGattClient* const Client,
+		wclBluetoothLeConnectionParameters& Params);
+	int SetConnectionParams(const CwclGattClient* const Client,
+		const wclBluetoothLeConnectionParametersPreset Preset);
+	int GetConnectionPhy(const CwclGattClient* const Client, wclBluetoothLeConnectionPhy& Phy);
+#pragma endregion Radio side
+};
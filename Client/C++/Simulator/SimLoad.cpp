@@ -0,0 +1,738 @@
+// Load test of the CClientWatcher against the simulated peripherals fleet.
+// The watcher connects to all the fleet's devices, the load threads read and
+// write each connected device periodically and at the end the fleet's and
+// the watcher's counters are printed. With --async single thread queues the
+// operations of all the devices and counts their completions.
+
+#include <cinttypes>
+
+#include "ClientWatcher.h"
+#include "SimFleet.h"
+
+using namespace std;
+
+typedef struct
+{
+	TSimFleetParams		Fleet;
+	// Test duration (s).
+	unsigned long		Duration;
+	// Period of the read and write of each connected device (ms). Zero
+	// disables the load.
+	unsigned long		LoadPeriod;
+	unsigned long		LoadThreads;
+	unsigned long		MaxPending;
+	unsigned long		DiscoveryConcurrency;
+	// Values batch window (ms). Zero disables batching.
+	unsigned long		BatchWindow;
+	bool				Framing;
+	// Match the devices by the service UUID with passive scanning.
+	bool				Passive;
+	// Weakest signal of the devices to connect.
+	char				MinRssi;
+	// Reconnect the devices that lost the link directly.
+	bool				Reconnect;
+	// Queue the load operations with the asynchronous API from single
+	// thread.
+	bool				Async;
+	// Every load thread serves all the devices instead of its own part so
+	// the reads of the same device meet.
+	bool				FanIn;
+	// Oldest value the load reads accept from the cache (ms). Zero always
+	// reads from the device.
+	unsigned long		MaxAge;
+	// Number of radios the connections are spread over. The first one scans.
+	unsigned long		Radios;
+	// Devices served at the same time by the group reads and writes. Zero
+	// runs the per-device load.
+	unsigned long		GroupFanOut;
+} TSimLoadParams;
+
+class CSimLoad
+{
+	DISABLE_COPY(CSimLoad);
+
+private:
+	TSimLoadParams				FParams;
+	CSimFleet*					FFleet;
+	vector<CwclBluetoothRadio*>	FRadios;
+	// Connections of each radio right before the watcher stopped.
+	vector<TRadioLoad>			FRadioLoads;
+	CClientWatcher*				FWatcher;
+
+	mutex						FLock;
+	set<__int64>				FConnected;
+	atomic<bool>				FTerminate;
+
+	atomic<unsigned __int64>	FDevicesFound;
+	atomic<unsigned __int64>	FConnectionsStarted;
+	atomic<unsigned __int64>	FConnections;
+	atomic<unsigned __int64>	FConnectionFailures;
+	atomic<unsigned __int64>	FDisconnections;
+	atomic<unsigned __int64>	FValues;
+	atomic<unsigned __int64>	FMessages;
+	atomic<unsigned __int64>	FReads;
+	atomic<unsigned __int64>	FReadErrors;
+	atomic<unsigned __int64>	FWrites;
+	atomic<unsigned __int64>	FWriteErrors;
+	// Fresh notified values taken from the clients' caches.
+	atomic<unsigned __int64>	FNotifiedReads;
+	// Asynchronous operations rejected because the device's queue was full.
+	atomic<unsigned __int64>	FQueueFull;
+	// Group reads and writes issued and the longest single device operation
+	// in them (us).
+	atomic<unsigned __int64>	FGroupRounds;
+	atomic<unsigned __int64>	FGroupSlowest;
+
+	void WatcherClientDisconnected(const __int64 Address, const int Reason);
+	void WatcherConnectionCompleted(const __int64 Address, const int Error);
+	void WatcherConnectionStarted(const __int64 Address, const int Result);
+	void WatcherDeviceFound(const __int64 Address, const tstring& Name, const int Rule);
+	void WatcherValueChanged(const __int64 Address, const unsigned char* Value,
+		const unsigned long Length);
+	void WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count);
+	void WatcherMessageReceived(const __int64 Address, const unsigned char* Message,
+		const unsigned long Length);
+	void WatcherReadCompleted(const __int64 Address, const unsigned long Id,
+		const int Result, const unsigned char* Value, const unsigned long Length);
+	void WatcherWriteCompleted(const __int64 Address, const unsigned long Id,
+		const int Result);
+
+	// Sets the match rule per device kind.
+	int SetMatchRules();
+	void LoadProc(const unsigned long Index);
+	void AsyncLoadProc();
+	void GroupLoadProc();
+	// Counts the results of single group operation.
+	void CountGroup(const vector<TGroupResult>& Results, atomic<unsigned __int64>& Done,
+		atomic<unsigned __int64>& Errors);
+	void PrintStats();
+
+public:
+	CSimLoad(const TSimLoadParams& Params);
+	~CSimLoad();
+
+	int Run();
+};
+
+void CSimLoad::WatcherClientDisconnected(const __int64 Address, const int Reason)
+{
+	FDisconnections++;
+	lock_guard<mutex> Lock(FLock);
+	FConnected.erase(Address);
+}
+
+void CSimLoad::WatcherConnectionCompleted(const __int64 Address, const int Error)
+{
+	if (Error != WCL_E_SUCCESS)
+	{
+		FConnectionFailures++;
+		return;
+	}
+
+	FConnections++;
+	lock_guard<mutex> Lock(FLock);
+	FConnected.insert(Address);
+}
+
+void CSimLoad::WatcherConnectionStarted(const __int64 Address, const int Result)
+{
+	if (Result == WCL_E_SUCCESS)
+		FConnectionsStarted++;
+}
+
+void CSimLoad::WatcherDeviceFound(const __int64 Address, const tstring& Name,
+	const int Rule)
+{
+	FDevicesFound++;
+}
+
+void CSimLoad::WatcherValueChanged(const __int64 Address, const unsigned char* Value,
+	const unsigned long Length)
+{
+	FValues++;
+}
+
+void CSimLoad::WatcherValuesChanged(const TValueRecord* Records, const unsigned long Count)
+{
+	FValues += Count;
+}
+
+void CSimLoad::WatcherMessageReceived(const __int64 Address, const unsigned char* Message,
+	const unsigned long Length)
+{
+	FMessages++;
+}
+
+void CSimLoad::WatcherReadCompleted(const __int64 Address, const unsigned long Id,
+	const int Result, const unsigned char* Value, const unsigned long Length)
+{
+	if (Result == WCL_E_SUCCESS)
+		FReads++;
+	else
+		FReadErrors++;
+}
+
+void CSimLoad::WatcherWriteCompleted(const __int64 Address, const unsigned long Id,
+	const int Result)
+{
+	if (Result == WCL_E_SUCCESS)
+		FWrites++;
+	else
+		FWriteErrors++;
+}
+
+void CSimLoad::LoadProc(const unsigned long Index)
+{
+	static const unsigned char DATA[] = "0123456789";
+
+	while (!FTerminate)
+	{
+		unsigned __int64 Started = GetTickCount64();
+
+		// Each thread serves its part of the connected devices.
+		vector<__int64> Addresses;
+		{
+			lock_guard<mutex> Lock(FLock);
+			unsigned long i = 0;
+			for (set<__int64>::iterator Address = FConnected.begin(); Address != FConnected.end(); Address++, i++)
+			{
+				if (FParams.FanIn || i % FParams.LoadThreads == Index)
+					Addresses.push_back(*Address);
+			}
+		}
+
+		for (vector<__int64>::iterator Address = Addresses.begin(); Address != Addresses.end() && !FTerminate; Address++)
+		{
+			CPooledBuffer Buffer;
+			if (FWatcher->ReadData(*Address, Buffer, FParams.MaxAge) == WCL_E_SUCCESS)
+				FReads++;
+			else
+				FReadErrors++;
+
+			// The notified value is never read from the device.
+			if (FParams.MaxAge > 0)
+			{
+				unsigned char* Value;
+				unsigned long Length;
+				if (FWatcher->ReadNotifiedData(*Address, Value, Length, FParams.MaxAge) == WCL_E_SUCCESS)
+				{
+					FNotifiedReads++;
+					free(Value);
+				}
+			}
+
+			if (FWatcher->WriteData(*Address, DATA, sizeof(DATA)) == WCL_E_SUCCESS)
+				FWrites++;
+			else
+				FWriteErrors++;
+		}
+
+		unsigned __int64 Elapsed = GetTickCount64() - Started;
+		if (Elapsed < FParams.LoadPeriod)
+			Sleep((DWORD)(FParams.LoadPeriod - Elapsed));
+	}
+}
+
+void CSimLoad::AsyncLoadProc()
+{
+	static const unsigned char DATA[] = "0123456789";
+
+	while (!FTerminate)
+	{
+		unsigned __int64 Started = GetTickCount64();
+
+		vector<__int64> Addresses;
+		{
+			lock_guard<mutex> Lock(FLock);
+			Addresses.assign(FConnected.begin(), FConnected.end());
+		}
+
+		// Nothing blocks here: the results come with the completion events.
+		for (vector<__int64>::iterator Address = Addresses.begin(); Address != Addresses.end() && !FTerminate; Address++)
+		{
+			unsigned long Id;
+			int Res = FWatcher->ReadDataAsync(*Address, Id);
+			if (Res == ASYNC_QUEUE_E_QUEUE_FULL)
+				FQueueFull++;
+			else if (Res != WCL_E_SUCCESS)
+				FReadErrors++;
+
+			Res = FWatcher->WriteDataAsync(*Address, DATA, sizeof(DATA), Id);
+			if (Res == ASYNC_QUEUE_E_QUEUE_FULL)
+				FQueueFull++;
+			else if (Res != WCL_E_SUCCESS)
+				FWriteErrors++;
+		}
+
+		unsigned __int64 Elapsed = GetTickCount64() - Started;
+		if (Elapsed < FParams.LoadPeriod)
+			Sleep((DWORD)(FParams.LoadPeriod - Elapsed));
+	}
+}
+
+void CSimLoad::CountGroup(const vector<TGroupResult>& Results,
+	atomic<unsigned __int64>& Done, atomic<unsigned __int64>& Errors)
+{
+	FGroupRounds++;
+	for (vector<TGroupResult>::const_iterator Result = Results.begin(); Result != Results.end(); Result++)
+	{
+		if (Result->Result == WCL_E_SUCCESS)
+			Done++;
+		else
+			Errors++;
+
+		unsigned __int64 Slowest = FGroupSlowest;
+		while (Result->Latency > Slowest && !FGroupSlowest.compare_exchange_weak(Slowest, Result->Latency))
+			;
+	}
+}
+
+void CSimLoad::GroupLoadProc()
+{
+	static const unsigned char DATA[] = "0123456789";
+
+	vector<TGroupResult> Results;
+	while (!FTerminate)
+	{
+		unsigned __int64 Started = GetTickCount64();
+
+		// Snapshot all the connected devices, then push the same value to all
+		// of them.
+		if (FWatcher->ReadGroup(NULL, 0, FParams.GroupFanOut, &Results, FParams.MaxAge) == WCL_E_SUCCESS)
+			CountGroup(Results, FReads, FReadErrors);
+		CClientWatcher::ReleaseGroupResults(&Results);
+
+		if (FWatcher->WriteGroup(NULL, 0, DATA, sizeof(DATA), FParams.GroupFanOut, &Results) == WCL_E_SUCCESS)
+			CountGroup(Results, FWrites, FWriteErrors);
+		CClientWatcher::ReleaseGroupResults(&Results);
+
+		unsigned __int64 Elapsed = GetTickCount64() - Started;
+		if (Elapsed < FParams.LoadPeriod)
+			Sleep((DWORD)(FParams.LoadPeriod - Elapsed));
+	}
+}
+
+void CSimLoad::PrintStats()
+{
+	TSimFleetStats Fleet;
+	FFleet->GetStats(Fleet);
+
+	printf("Fleet\n");
+	printf("  Advertisements:          %" PRIu64 "\n", (uint64_t)Fleet.Advertisements);
+	printf("  Connect attempts:        %" PRIu64 "\n", (uint64_t)Fleet.ConnectAttempts);
+	printf("  Connect failures:        %" PRIu64 "\n", (uint64_t)Fleet.ConnectFailures);
+	printf("  Link losses:             %" PRIu64 "\n", (uint64_t)Fleet.LinkLosses);
+	printf("  Notifications sent:      %" PRIu64 "\n", (uint64_t)Fleet.NotificationsSent);
+	printf("  Notifications lost:      %" PRIu64 "\n", (uint64_t)Fleet.NotificationsLost);
+	printf("  Reads:                   %" PRIu64 "\n", (uint64_t)Fleet.Reads);
+	printf("  Writes:                  %" PRIu64 "\n", (uint64_t)Fleet.Writes);
+	printf("  Writes without response: %" PRIu64 "\n", (uint64_t)Fleet.WritesWithoutResponse);
+	printf("  Radio rejects:           %" PRIu64 "\n", (uint64_t)Fleet.RadioRejects);
+	printf("  Connected:               %lu\n", Fleet.Connected);
+
+	printf("Watcher\n");
+	printf("  Devices found:           %" PRIu64 "\n", (uint64_t)FDevicesFound);
+	printf("  Connections started:     %" PRIu64 "\n", (uint64_t)FConnectionsStarted);
+	printf("  Connections:             %" PRIu64 "\n", (uint64_t)FConnections);
+	printf("  Connection failures:     %" PRIu64 "\n", (uint64_t)FConnectionFailures);
+	printf("  Disconnections:          %" PRIu64 "\n", (uint64_t)FDisconnections);
+	printf("  Values:                  %" PRIu64 "\n", (uint64_t)FValues);
+	printf("  Messages:                %" PRIu64 "\n", (uint64_t)FMessages);
+	printf("  Reads (errors):          %" PRIu64 " (%" PRIu64 ")\n", (uint64_t)FReads, (uint64_t)FReadErrors);
+	printf("  Writes (errors):         %" PRIu64 " (%" PRIu64 ")\n", (uint64_t)FWrites, (uint64_t)FWriteErrors);
+	if (FParams.MaxAge > 0)
+		printf("  Notified values read:    %" PRIu64 "\n", (uint64_t)FNotifiedReads);
+	if (FParams.Async)
+		printf("  Rejected (queue full):   %" PRIu64 "\n", (uint64_t)FQueueFull);
+	if (FParams.GroupFanOut > 0)
+	{
+		printf("  Group operations:        %" PRIu64 "\n", (uint64_t)FGroupRounds);
+		printf("  Slowest group device:    %" PRIu64 " us\n", (uint64_t)FGroupSlowest);
+	}
+
+	list<TConnectionStatistics>* Stats = new list<TConnectionStatistics>();
+	FWatcher->GetStatistics(Stats);
+
+	unsigned __int64 Coalesced = 0;
+	unsigned __int64 Cached = 0;
+	for (list<TConnectionStatistics>::iterator Device = Stats->begin(); Device != Stats->end(); Device++)
+	{
+		Coalesced += Device->CoalescedReads;
+		Cached += Device->CachedReads;
+	}
+	printf("  Coalesced reads:         %" PRIu64 "\n", (uint64_t)Coalesced);
+	printf("  Cached reads:            %" PRIu64 "\n", (uint64_t)Cached);
+
+	if (FRadioLoads.size() > 1)
+	{
+		printf("Radios\n");
+		for (size_t i = 0; i < FRadioLoads.size(); i++)
+			printf("  Radio %zu connections:     %lu\n", i, FRadioLoads[i].Connections);
+	}
+
+	TReconnectStats Reconnect;
+	FWatcher->GetReconnectStats(Reconnect);
+	printf("Reconnection\n");
+	printf("  Pending:                 %lu\n", Reconnect.Pending);
+	printf("  Attempts:                %" PRIu64 "\n", (uint64_t)Reconnect.Attempts);
+	printf("  Recovered:               %" PRIu64 "\n", (uint64_t)Reconnect.Recovered);
+	printf("  Abandoned:               %" PRIu64 "\n", (uint64_t)Reconnect.Abandoned);
+
+	// The per-device latencies: the median of the devices' medians would hide
+	// the outliers so the worst device is shown.
+	TLatencySummary TConnectionStatistics::* Summaries[] = {
+		&TConnectionStatistics::Connect,
+		&TConnectionStatistics::Discovery,
+		&TConnectionStatistics::Read,
+		&TConnectionStatistics::Write,
+		&TConnectionStatistics::NotificationInterval,
+		&TConnectionStatistics::Recovery };
+	const char* Names[] = { "Connect", "Discovery", "Read", "Write", "Notification interval",
+		"Time to recover" };
+
+	printf("Latencies of %zu devices (us)   count      mean(avg)  p50(max)   p99(max)   max\n",
+		Stats->size());
+	for (size_t i = 0; i < sizeof(Summaries) / sizeof(Summaries[0]); i++)
+	{
+		unsigned __int64 Count = 0;
+		unsigned __int64 Mean = 0;
+		unsigned __int64 P50 = 0;
+		unsigned __int64 P99 = 0;
+		unsigned __int64 Max = 0;
+		for (list<TConnectionStatistics>::iterator Device = Stats->begin(); Device != Stats->end(); Device++)
+		{
+			const TLatencySummary& Summary = (*Device).*Summaries[i];
+			if (Summary.Count == 0)
+				continue;
+
+			Count += Summary.Count;
+			Mean += Summary.Mean * Summary.Count;
+			P50 = max(P50, Summary.P50);
+			P99 = max(P99, Summary.P99);
+			Max = max(Max, Summary.Max);
+		}
+		if (Count > 0)
+			Mean /= Count;
+
+		printf("  %-28s %-10" PRIu64 " %-10" PRIu64 " %-10" PRIu64 " %-10" PRIu64 " %" PRIu64 "\n",
+			Names[i], (uint64_t)Count, (uint64_t)Mean, (uint64_t)P50, (uint64_t)P99, (uint64_t)Max);
+	}
+
+	delete Stats;
+}
+
+CSimLoad::CSimLoad(const TSimLoadParams& Params)
+{
+	FParams = Params;
+	if (FParams.LoadThreads == 0)
+		FParams.LoadThreads = 1;
+
+	FFleet = new CSimFleet(FParams.Fleet);
+	if (FParams.Radios == 0)
+		FParams.Radios = 1;
+	if (FParams.Radios > MAX_CONNECTION_RADIOS)
+		FParams.Radios = MAX_CONNECTION_RADIOS;
+	for (unsigned long i = 0; i < FParams.Radios; i++)
+		FRadios.push_back(new CwclBluetoothRadio(FFleet));
+	FWatcher = new CClientWatcher();
+
+	FTerminate = false;
+	FDevicesFound = 0;
+	FConnectionsStarted = 0;
+	FConnections = 0;
+	FConnectionFailures = 0;
+	FDisconnections = 0;
+	FValues = 0;
+	FMessages = 0;
+	FReads = 0;
+	FReadErrors = 0;
+	FWrites = 0;
+	FWriteErrors = 0;
+	FNotifiedReads = 0;
+	FQueueFull = 0;
+	FGroupRounds = 0;
+	FGroupSlowest = 0;
+
+	__hook(&CClientWatcher::OnClientDisconnected, FWatcher, &CSimLoad::WatcherClientDisconnected);
+	__hook(&CClientWatcher::OnConnectionCompleted, FWatcher, &CSimLoad::WatcherConnectionCompleted);
+	__hook(&CClientWatcher::OnConnectionStarted, FWatcher, &CSimLoad::WatcherConnectionStarted);
+	__hook(&CClientWatcher::OnDeviceFound, FWatcher, &CSimLoad::WatcherDeviceFound);
+	__hook(&CClientWatcher::OnValueChanged, FWatcher, &CSimLoad::WatcherValueChanged);
+	__hook(&CClientWatcher::OnValuesChanged, FWatcher, &CSimLoad::WatcherValuesChanged);
+	__hook(&CClientWatcher::OnMessageReceived, FWatcher, &CSimLoad::WatcherMessageReceived);
+	__hook(&CClientWatcher::OnReadCompleted, FWatcher, &CSimLoad::WatcherReadCompleted);
+	__hook(&CClientWatcher::OnWriteCompleted, FWatcher, &CSimLoad::WatcherWriteCompleted);
+}
+
+CSimLoad::~CSimLoad()
+{
+	__unhook(FWatcher);
+
+	// Clients and watchers must be destroyed before the fleet.
+	delete FWatcher;
+	for (vector<CwclBluetoothRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+		delete *Radio;
+	delete FFleet;
+}
+
+int CSimLoad::SetMatchRules()
+{
+	// With passive scanning there is no name: the kind is matched by the
+	// service UUID and the manufacturer data of the advertisement. Otherwise
+	// by the name from the scan response and the service UUID.
+	vector<TMatchRule> Rules(FParams.Fleet.Profiles);
+	for (unsigned long i = 0; i < FParams.Fleet.Profiles; i++)
+	{
+		CSimFleet::GetProfile(i, Rules[i].Profile);
+		if (FParams.Passive)
+			Rules[i].Conditions = MATCH_SERVICE | MATCH_MANUFACTURER;
+		else
+		{
+			Rules[i].Conditions = MATCH_NAME_PREFIX | MATCH_SERVICE;
+			Rules[i].NamePrefix = CSimFleet::GetName(i);
+		}
+		Rules[i].Service = Rules[i].Profile.Service;
+		Rules[i].CompanyId = SIM_COMPANY_ID;
+		Rules[i].MinRssi = FParams.MinRssi;
+	}
+	return FWatcher->SetMatchRules(Rules.data(), (unsigned long)Rules.size());
+}
+
+int CSimLoad::Run()
+{
+	int Res = FWatcher->SetMaxPendingConnections(FParams.MaxPending);
+	if (Res == WCL_E_SUCCESS)
+		Res = FWatcher->SetDiscoveryConcurrency(FParams.DiscoveryConcurrency);
+	if (Res == WCL_E_SUCCESS && FParams.BatchWindow > 0)
+		Res = FWatcher->SetValuesBatch(FParams.BatchWindow, 64);
+	if (Res == WCL_E_SUCCESS)
+		Res = FWatcher->SetFraming(FParams.Framing);
+	if (Res == WCL_E_SUCCESS)
+		Res = FWatcher->SetMaxConnectionsPerRadio(FParams.Fleet.RadioConnections);
+	if (Res == WCL_E_SUCCESS && FParams.Radios > 1)
+		Res = FWatcher->SetConnectionRadios(&FRadios[0], (unsigned long)FRadios.size());
+	if (Res == WCL_E_SUCCESS)
+	{
+		TReconnectParams Reconnect;
+		FWatcher->GetReconnect(Reconnect);
+		Reconnect.Enabled = FParams.Reconnect;
+		Res = FWatcher->SetReconnect(Reconnect);
+	}
+	if (Res == WCL_E_SUCCESS)
+	{
+		if (FParams.Fleet.Profiles > 1 || FParams.MinRssi != MATCH_ANY_RSSI)
+			Res = SetMatchRules();
+		else if (FParams.Passive)
+			Res = FWatcher->SetServiceFilter(&SERVICE_UUID, 1);
+	}
+	if (Res != WCL_E_SUCCESS)
+	{
+		printf("Watcher configuration failed: 0x%.8X\n", Res);
+		return Res;
+	}
+
+	Res = FWatcher->Start(FRadios[0], FParams.Passive ? smPassive : smActive);
+	if (Res != WCL_E_SUCCESS)
+	{
+		printf("Start watcher failed: 0x%.8X\n", Res);
+		return Res;
+	}
+
+	vector<thread> Threads;
+	if (FParams.LoadPeriod > 0 && FParams.Async)
+		Threads.push_back(thread(&CSimLoad::AsyncLoadProc, this));
+	else if (FParams.LoadPeriod > 0 && FParams.GroupFanOut > 0)
+		Threads.push_back(thread(&CSimLoad::GroupLoadProc, this));
+	else if (FParams.LoadPeriod > 0)
+	{
+		for (unsigned long i = 0; i < FParams.LoadThreads; i++)
+			Threads.push_back(thread(&CSimLoad::LoadProc, this, i));
+	}
+
+	unsigned __int64 Started = GetTickCount64();
+	while (GetTickCount64() - Started < (unsigned __int64)FParams.Duration * 1000)
+	{
+		Sleep(1000);
+
+		TSimFleetStats Fleet;
+		FFleet->GetStats(Fleet);
+		printf("%4" PRIu64 " s: connected %lu of %lu, values %" PRIu64 ", reads %" PRIu64 ", writes %" PRIu64 "\n",
+			(uint64_t)((GetTickCount64() - Started) / 1000), Fleet.Connected,
+			FParams.Fleet.Devices, (uint64_t)FValues, (uint64_t)FReads, (uint64_t)FWrites);
+	}
+
+	FTerminate = true;
+	for (vector<thread>::iterator Thread = Threads.begin(); Thread != Threads.end(); Thread++)
+		Thread->join();
+
+	FRadioLoads.resize(FWatcher->GetRadioLoads(NULL, 0));
+	if (FRadioLoads.size() > 0)
+		FWatcher->GetRadioLoads(&FRadioLoads[0], (unsigned long)FRadioLoads.size());
+
+	FWatcher->Stop();
+
+	// Wait for the disconnections requested by the watcher.
+	Started = GetTickCount64();
+	TSimFleetStats Fleet;
+	do
+	{
+		FFleet->GetStats(Fleet);
+		if (Fleet.Connected == 0)
+			break;
+		Sleep(10);
+	} while (GetTickCount64() - Started < 5000);
+
+	PrintStats();
+	return WCL_E_SUCCESS;
+}
+
+static void Usage()
+{
+	printf("Usage: SimLoad [options]\n");
+	printf("  --devices N            number of simulated peripherals\n");
+	printf("  --duration S           test duration (s)\n");
+	printf("  --adv-interval MS      advertising interval (ms)\n");
+	printf("  --connect-latency MS   mean connection time (ms)\n");
+	printf("  --op-latency US        mean GATT request round trip (us)\n");
+	printf("  --jitter PERCENT       latencies deviation\n");
+	printf("  --connect-loss P       probability of the connection failure\n");
+	printf("  --notify-loss P        probability of the notification loss\n");
+	printf("  --disconnect-rate R    link losses per device per second\n");
+	printf("  --notify-period MS     notification period (ms)\n");
+	printf("  --mtu N                ATT MTU\n");
+	printf("  --dispatch-threads N   fleet's event dispatching threads\n");
+	printf("  --seed N               random generator seed\n");
+	printf("  --load-period MS       read and write period per device (0 - no load)\n");
+	printf("  --load-threads N       load threads\n");
+	printf("  --max-pending N        connections started at the same time\n");
+	printf("  --discovery N          discovery concurrency\n");
+	printf("  --batch MS             values batch window (0 - no batching)\n");
+	printf("  --framing              enable framing\n");
+	printf("  --passive              find devices by service UUID with passive scanning\n");
+	printf("  --profiles N           number of device kinds, each with its own profile\n");
+	printf("  --min-rssi DBM         weakest signal of the devices to connect\n");
+	printf("  --no-reconnect         wait for the advertisement after the link loss\n");
+	printf("  --async                queue the load from single thread with the async API\n");
+	printf("  --fan-in               every load thread reads and writes all the devices\n");
+	printf("  --max-age MS           oldest cached value the load reads accept (0 - no cache)\n");
+	printf("  --radios N             number of radios the connections are spread over\n");
+	printf("  --radio-limit N        connections each radio can hold (0 - no limit)\n");
+	printf("  --group N              read and write all the devices with group operations\n");
+	printf("                         serving N devices at the same time\n");
+}
+
+int main(int argc, char* argv[])
+{
+	TSimLoadParams Params;
+	CSimFleet::GetDefaultParams(Params.Fleet);
+	Params.Duration = 10;
+	Params.LoadPeriod = 1000;
+	Params.LoadThreads = 4;
+	Params.MaxPending = 8;
+	Params.DiscoveryConcurrency = DEFAULT_DISCOVERY_CONCURRENCY;
+	Params.BatchWindow = DEFAULT_VALUES_BATCH_WINDOW;
+	Params.Framing = false;
+	Params.Passive = false;
+	Params.MinRssi = MATCH_ANY_RSSI;
+	Params.Reconnect = true;
+	Params.Async = false;
+	Params.FanIn = false;
+	Params.MaxAge = 0;
+	Params.Radios = 1;
+	Params.GroupFanOut = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string Option = argv[i];
+		if (Option == "--framing")
+		{
+			Params.Framing = true;
+			continue;
+		}
+		if (Option == "--passive")
+		{
+			Params.Passive = true;
+			continue;
+		}
+		if (Option == "--no-reconnect")
+		{
+			Params.Reconnect = false;
+			continue;
+		}
+		if (Option == "--async")
+		{
+			Params.Async = true;
+			continue;
+		}
+		if (Option == "--fan-in")
+		{
+			Params.FanIn = true;
+			continue;
+		}
+		if (Option == "--help" || i + 1 >= argc)
+		{
+			Usage();
+			return (Option == "--help" ? 0 : 1);
+		}
+
+		const char* Value = argv[++i];
+		if (Option == "--devices")
+			Params.Fleet.Devices = strtoul(Value, NULL, 10);
+		else if (Option == "--duration")
+			Params.Duration = strtoul(Value, NULL, 10);
+		else if (Option == "--adv-interval")
+			Params.Fleet.AdvertisingInterval = strtoul(Value, NULL, 10);
+		else if (Option == "--connect-latency")
+			Params.Fleet.ConnectLatency = strtoul(Value, NULL, 10);
+		else if (Option == "--op-latency")
+			Params.Fleet.OperationLatency = strtoul(Value, NULL, 10);
+		else if (Option == "--jitter")
+			Params.Fleet.Jitter = strtoul(Value, NULL, 10);
+		else if (Option == "--connect-loss")
+			Params.Fleet.ConnectLoss = strtod(Value, NULL);
+		else if (Option == "--notify-loss")
+			Params.Fleet.NotificationLoss = strtod(Value, NULL);
+		else if (Option == "--disconnect-rate")
+			Params.Fleet.DisconnectRate = strtod(Value, NULL);
+		else if (Option == "--notify-period")
+			Params.Fleet.NotificationPeriod = strtoul(Value, NULL, 10);
+		else if (Option == "--mtu")
+			Params.Fleet.MaxPduSize = (unsigned short)strtoul(Value, NULL, 10);
+		else if (Option == "--dispatch-threads")
+			Params.Fleet.DispatchThreads = strtoul(Value, NULL, 10);
+		else if (Option == "--seed")
+			Params.Fleet.Seed = strtoul(Value, NULL, 10);
+		else if (Option == "--load-period")
+			Params.LoadPeriod = strtoul(Value, NULL, 10);
+		else if (Option == "--load-threads")
+			Params.LoadThreads = strtoul(Value, NULL, 10);
+		else if (Option == "--max-pending")
+			Params.MaxPending = strtoul(Value, NULL, 10);
+		else if (Option == "--discovery")
+			Params.DiscoveryConcurrency = strtoul(Value, NULL, 10);
+		else if (Option == "--batch")
+			Params.BatchWindow = strtoul(Value, NULL, 10);
+		else if (Option == "--profiles")
+			Params.Fleet.Profiles = strtoul(Value, NULL, 10);
+		else if (Option == "--min-rssi")
+			Params.MinRssi = (char)strtol(Value, NULL, 10);
+		else if (Option == "--max-age")
+			Params.MaxAge = strtoul(Value, NULL, 10);
+		else if (Option == "--radios")
+			Params.Radios = strtoul(Value, NULL, 10);
+		else if (Option == "--radio-limit")
+			Params.Fleet.RadioConnections = strtoul(Value, NULL, 10);
+		else if (Option == "--group")
+			Params.GroupFanOut = strtoul(Value, NULL, 10);
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	CSimLoad* Load = new CSimLoad(Params);
+	int Res = Load->Run();
+	delete Load;
+	return (Res == WCL_E_SUCCESS ? 0 : 1);
+}
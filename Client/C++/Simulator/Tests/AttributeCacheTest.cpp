@@ -0,0 +1,156 @@
+// Unit tests of the CAttributeCache file parser: the round trip and the
+// damaged files that must be rejected.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AttributeCache.h"
+#include "SimTest.h"
+
+using namespace std;
+
+static const char FILE_NAME[] = "AttributeCacheTest.bin";
+
+// The file layout (see AttributeCache.cpp).
+static const unsigned long CACHE_MAGIC = 0x4341474D;
+static const unsigned long HEADER_SIZE = 10;
+static const unsigned long RECORD_SIZE = 8 + 16 + 2 + 3 * (16 + 7);
+
+static void PutUInt16(vector<unsigned char>& Data, const unsigned short Value)
+{
+	Data.push_back((unsigned char)(Value & 0xFF));
+	Data.push_back((unsigned char)(Value >> 8));
+}
+
+static void PutUInt32(vector<unsigned char>& Data, const unsigned int Value)
+{
+	PutUInt16(Data, (unsigned short)(Value & 0xFFFF));
+	PutUInt16(Data, (unsigned short)(Value >> 16));
+}
+
+// Appends the FNV-1a checksum of the data.
+static void PutChecksum(vector<unsigned char>& Data)
+{
+	unsigned int Hash = 2166136261U;
+	for (size_t i = 0; i < Data.size(); i++)
+	{
+		Hash ^= Data[i];
+		Hash *= 16777619U;
+	}
+	PutUInt32(Data, Hash);
+}
+
+static void WriteData(const vector<unsigned char>& Data)
+{
+	FILE* File = fopen(FILE_NAME, "wb");
+	if (File != NULL)
+	{
+		if (!Data.empty())
+			fwrite(&Data[0], 1, Data.size(), File);
+		fclose(File);
+	}
+}
+
+// Builds the file with the header and the Records zero bytes of the records.
+static vector<unsigned char> MakeFile(const unsigned short Version, const unsigned int Count,
+	const unsigned long Records)
+{
+	vector<unsigned char> Data;
+	PutUInt32(Data, CACHE_MAGIC);
+	PutUInt16(Data, Version);
+	PutUInt32(Data, Count);
+	Data.resize(Data.size() + Records, 0);
+	PutChecksum(Data);
+	return Data;
+}
+
+static wclGattCharacteristic MakeCharacteristic(const unsigned char Id, const unsigned short Handle)
+{
+	wclGattCharacteristic Char;
+	ZeroMemory(&Char, sizeof(wclGattCharacteristic));
+	Char.Uuid.IsShortUuid = false;
+	Char.Uuid.LongUuid.Data1 = Id;
+	Char.ServiceHandle = 0x0010;
+	Char.Handle = Handle;
+	Char.ValueHandle = Handle + 1;
+	Char.IsReadable = true;
+	Char.IsNotifiable = (Id == 3);
+	return Char;
+}
+
+static void TestRoundTrip()
+{
+	TAttributeCacheRecord Record;
+	ZeroMemory(&Record.Service, sizeof(wclGattService));
+	Record.Service.Uuid.IsShortUuid = false;
+	Record.Service.Uuid.LongUuid.Data1 = 0xABCD;
+	Record.Service.Handle = 0x0010;
+	Record.ReadableChar = MakeCharacteristic(1, 0x0011);
+	Record.WritableChar = MakeCharacteristic(2, 0x0013);
+	Record.NotifiableChar = MakeCharacteristic(3, 0x0015);
+
+	CAttributeCache Cache;
+	Cache.Store(0x00A050000001, Record);
+	Cache.Store(0x00A050000002, Record);
+	CHECK(Cache.SaveToFile(FILE_NAME) == WCL_E_SUCCESS);
+
+	CAttributeCache Loaded;
+	CHECK(Loaded.LoadFromFile(FILE_NAME) == WCL_E_SUCCESS);
+	TAttributeCacheRecord Found;
+	CHECK(Loaded.Find(0x00A050000002, Found));
+	CHECK(IsEqualGUID(Found.Service.Uuid.LongUuid, Record.Service.Uuid.LongUuid));
+	CHECK(Found.ReadableChar.ValueHandle == 0x0012);
+	CHECK(Found.NotifiableChar.IsNotifiable && !Found.WritableChar.IsNotifiable);
+	CHECK(IsEqualGUID(Found.NotifiableChar.Uuid.LongUuid, Record.NotifiableChar.Uuid.LongUuid));
+	CHECK(!Loaded.Find(0x00A050000003, Found));
+}
+
+static void TestDamagedFiles()
+{
+	CAttributeCache Cache;
+
+	// Too short for the header.
+	vector<unsigned char> Data(6, 0);
+	WriteData(Data);
+	CHECK(Cache.LoadFromFile(FILE_NAME) == ATTRIBUTE_CACHE_E_INVALID_FORMAT);
+
+	// Wrong checksum.
+	Data = MakeFile(2, 1, RECORD_SIZE);
+	Data[HEADER_SIZE + 8] ^= 0xFF;
+	WriteData(Data);
+	CHECK(Cache.LoadFromFile(FILE_NAME) == ATTRIBUTE_CACHE_E_INVALID_FORMAT);
+
+	// The old version without the UUIDs.
+	WriteData(MakeFile(1, 1, RECORD_SIZE));
+	CHECK(Cache.LoadFromFile(FILE_NAME) == ATTRIBUTE_CACHE_E_INVALID_FORMAT);
+
+	// The count does not match the records.
+	WriteData(MakeFile(2, 2, RECORD_SIZE));
+	CHECK(Cache.LoadFromFile(FILE_NAME) == ATTRIBUTE_CACHE_E_INVALID_FORMAT);
+
+	// The count makes the expected length wrap around to the real one in
+	// 32 bits: Count * RECORD_SIZE == Records modulo 2^32.
+	unsigned int Inverse = 1;
+	for (int i = 0; i < 5; i++)
+		Inverse *= 2 - (unsigned int)RECORD_SIZE * Inverse;
+	const unsigned long Records = 100;
+	unsigned int Count = (unsigned int)Records * Inverse;
+	CHECK((unsigned int)(Count * RECORD_SIZE) == Records && Count > Records);
+	WriteData(MakeFile(2, Count, Records));
+	CHECK(Cache.LoadFromFile(FILE_NAME) == ATTRIBUTE_CACHE_E_INVALID_FORMAT);
+
+	// The valid empty file.
+	WriteData(MakeFile(2, 0, 0));
+	CHECK(Cache.LoadFromFile(FILE_NAME) == WCL_E_SUCCESS);
+
+	CHECK(Cache.LoadFromFile("AttributeCacheTest.none") == ATTRIBUTE_CACHE_E_OPEN_FAILED);
+}
+
+int main()
+{
+	RUN_TEST(TestRoundTrip);
+	RUN_TEST(TestDamagedFiles);
+	remove(FILE_NAME);
+	return SimTestResult();
+}
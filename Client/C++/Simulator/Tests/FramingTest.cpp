@@ -0,0 +1,134 @@
+// Unit tests of the framing: the segmenter splits the message into the
+// segments the reassembler puts back together, and the lost or damaged
+// segments drop the partial message.
+
+#include <cstring>
+#include <vector>
+
+#include "Framing.h"
+#include "SimTest.h"
+
+using namespace std;
+
+static const unsigned long SEGMENT_SIZE = 20;
+
+static vector<unsigned char> MakeMessage(const unsigned long Length)
+{
+	vector<unsigned char> Message(Length);
+	for (unsigned long i = 0; i < Length; i++)
+		Message[i] = (unsigned char)(i * 7 + 3);
+	return Message;
+}
+
+// Splits the message into the segments.
+static vector<vector<unsigned char> > Split(const vector<unsigned char>& Message,
+	const unsigned char MessageId)
+{
+	vector<vector<unsigned char> > Segments;
+	CFrameSegmenter Segmenter;
+	if (Segmenter.Init(&Message[0], (unsigned long)Message.size(), SEGMENT_SIZE, MessageId) != WCL_E_SUCCESS)
+		return Segments;
+
+	unsigned char Segment[SEGMENT_SIZE];
+	unsigned long Length;
+	bool Last;
+	while (Segmenter.Next(Segment, Length, Last))
+		Segments.push_back(vector<unsigned char>(Segment, Segment + Length));
+	return Segments;
+}
+
+static void TestRoundTrip()
+{
+	const unsigned long Lengths[] = { 1, SEGMENT_SIZE - FRAME_FIRST_HEADER_SIZE,
+		SEGMENT_SIZE - FRAME_FIRST_HEADER_SIZE + 1, 1000 };
+	CFrameReassembler Reassembler;
+	for (int i = 0; i < 4; i++)
+	{
+		vector<unsigned char> Message = MakeMessage(Lengths[i]);
+		vector<vector<unsigned char> > Segments = Split(Message, (unsigned char)i);
+		CHECK(Segments.size() == CFrameSegmenter::GetSegmentCount(Lengths[i], SEGMENT_SIZE));
+
+		bool Complete = false;
+		for (size_t s = 0; s < Segments.size(); s++)
+		{
+			CHECK(Segments[s].size() <= SEGMENT_SIZE);
+			CHECK((Segments[s][0] & FRAME_MARKER_MASK) == FRAME_MARKER);
+			CHECK(Reassembler.Push(&Segments[s][0], (unsigned long)Segments[s].size(), Complete) == WCL_E_SUCCESS);
+			// Only the last segment completes the message.
+			CHECK(Complete == (s + 1 == Segments.size()));
+		}
+		CHECK(Reassembler.GetLength() == Lengths[i]);
+		CHECK(memcmp(Reassembler.GetData(), &Message[0], Lengths[i]) == 0);
+	}
+	CHECK(Reassembler.GetErrors() == 0);
+}
+
+static void TestLostSegment()
+{
+	vector<vector<unsigned char> > Segments = Split(MakeMessage(100), 1);
+	CHECK(Segments.size() > 3);
+
+	CFrameReassembler Reassembler;
+	bool Complete;
+	CHECK(Reassembler.Push(&Segments[0][0], (unsigned long)Segments[0].size(), Complete) == WCL_E_SUCCESS);
+	CHECK(Reassembler.Push(&Segments[2][0], (unsigned long)Segments[2].size(), Complete) == FRAMING_E_SEQUENCE_GAP);
+	CHECK(!Complete);
+	CHECK(Reassembler.GetErrors() == 1);
+
+	// The rest of the broken message is dropped and the next one comes
+	// through.
+	CHECK(Reassembler.Push(&Segments[3][0], (unsigned long)Segments[3].size(), Complete) == FRAMING_E_SEQUENCE_GAP);
+	vector<unsigned char> Message = MakeMessage(30);
+	vector<vector<unsigned char> > Next = Split(Message, 2);
+	for (size_t s = 0; s < Next.size(); s++)
+		CHECK(Reassembler.Push(&Next[s][0], (unsigned long)Next[s].size(), Complete) == WCL_E_SUCCESS);
+	CHECK(Complete && Reassembler.GetLength() == Message.size());
+}
+
+static void TestInterruptedMessage()
+{
+	vector<vector<unsigned char> > First = Split(MakeMessage(100), 1);
+	vector<unsigned char> Message = MakeMessage(50);
+	vector<vector<unsigned char> > Second = Split(Message, 2);
+
+	// The new message starts before the previous one completed.
+	CFrameReassembler Reassembler;
+	bool Complete;
+	Reassembler.Push(&First[0][0], (unsigned long)First[0].size(), Complete);
+	for (size_t s = 0; s < Second.size(); s++)
+		CHECK(Reassembler.Push(&Second[s][0], (unsigned long)Second[s].size(), Complete) == WCL_E_SUCCESS);
+	CHECK(Complete && memcmp(Reassembler.GetData(), &Message[0], Message.size()) == 0);
+	CHECK(Reassembler.GetErrors() == 1);
+}
+
+static void TestInvalidSegments()
+{
+	CFrameReassembler Reassembler(64);
+	bool Complete;
+
+	// Plain write, not a segment.
+	const unsigned char Text[] = "Hello";
+	CHECK(Reassembler.Push(Text, sizeof(Text), Complete) == FRAMING_E_INVALID_SEGMENT);
+	// Shorter than the header.
+	const unsigned char Short[] = { FRAME_MARKER | FRAME_FIRST, 0 };
+	CHECK(Reassembler.Push(Short, sizeof(Short), Complete) == FRAMING_E_INVALID_SEGMENT);
+
+	// The message is longer than the reassembler allows.
+	vector<vector<unsigned char> > Segments = Split(MakeMessage(100), 1);
+	CHECK(Reassembler.Push(&Segments[0][0], (unsigned long)Segments[0].size(), Complete) == FRAMING_E_MESSAGE_TOO_LARGE);
+
+	// The segmenter needs room for the payload in the first segment.
+	unsigned char Data[10] = { 0 };
+	CFrameSegmenter Segmenter;
+	CHECK(Segmenter.Init(Data, sizeof(Data), FRAME_FIRST_HEADER_SIZE, 0) == FRAMING_E_SEGMENT_TOO_SMALL);
+	CHECK(Segmenter.Init(Data, 0, SEGMENT_SIZE, 0) == WCL_E_INVALID_ARGUMENT);
+}
+
+int main()
+{
+	RUN_TEST(TestRoundTrip);
+	RUN_TEST(TestLostSegment);
+	RUN_TEST(TestInterruptedMessage);
+	RUN_TEST(TestInvalidSegments);
+	return SimTestResult();
+}
@@ -0,0 +1,98 @@
+// Unit tests of the CMatchRules: the default rule, the conditions collected
+// from separate frames, the signal threshold and the rules order.
+
+#include "MatchRules.h"
+#include "SimTest.h"
+
+static const GUID SERVICE = { 0x12345678, 0x1234, 0x5678, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+static const GUID OTHER_SERVICE = { 0x12345678, 0x1234, 0x5678, { 1, 2, 3, 4, 5, 6, 7, 9 } };
+
+static TMatchRule MakeRule(const unsigned long Conditions, const tstring& NamePrefix,
+	const unsigned short CompanyId, const char MinRssi)
+{
+	TMatchRule Rule;
+	Rule.Conditions = Conditions;
+	Rule.NamePrefix = NamePrefix;
+	Rule.Service = SERVICE;
+	Rule.CompanyId = CompanyId;
+	Rule.MinRssi = MinRssi;
+	Rule.Profile = DEFAULT_CLIENT_PROFILE;
+	return Rule;
+}
+
+static void TestDefaultRule()
+{
+	CMatchRules Rules;
+	CHECK(Rules.IsNameRequired());
+	CHECK(Rules.Match(Rules.EvaluateName(DEVICE_NAME), -90) == 0);
+	CHECK(Rules.Match(Rules.EvaluateName(DEVICE_NAME + _T("-2")), -90) == 0);
+	CHECK(Rules.Match(Rules.EvaluateName(_T("Other")), -90) == -1);
+	CHECK(Rules.Match(0, -90) == -1);
+}
+
+static void TestConditions()
+{
+	TMatchRule Table[2];
+	Table[0] = MakeRule(MATCH_NAME_PREFIX | MATCH_SERVICE, _T("Sensor"), 0, MATCH_ANY_RSSI);
+	Table[1] = MakeRule(MATCH_MANUFACTURER, tstring(), 0x0059, -70);
+
+	CMatchRules Rules;
+	CHECK(Rules.Compile(Table, 2) == WCL_E_SUCCESS);
+	CHECK(!Rules.IsNameRequired());
+
+	// The name and the service come with separate frames: each one alone is
+	// not enough.
+	unsigned long Name = Rules.EvaluateName(_T("Sensor-17"));
+	unsigned long Service = Rules.EvaluateService(SERVICE);
+	CHECK(Rules.Match(Name, -50) == -1);
+	CHECK(Rules.Match(Service, -50) == -1);
+	CHECK(Rules.Match(Name | Service, -50) == 0);
+	CHECK(Rules.Match(Name | Rules.EvaluateService(OTHER_SERVICE), -50) == -1);
+
+	// The frame that completes the match must be strong enough.
+	unsigned long Manufacturer = Rules.EvaluateManufacturer(0x0059);
+	CHECK(Rules.Match(Manufacturer, -80) == -1);
+	CHECK(Rules.Match(Manufacturer, -60) == 1);
+	CHECK(Rules.Match(Rules.EvaluateManufacturer(0x0006), -60) == -1);
+
+	// The first satisfied rule wins.
+	CHECK(Rules.Match(Name | Service | Manufacturer, -60) == 0);
+}
+
+static void TestAnyDevice()
+{
+	TMatchRule Rule = MakeRule(0, tstring(), 0, -60);
+	CMatchRules Rules;
+	CHECK(Rules.Compile(&Rule, 1) == WCL_E_SUCCESS);
+	CHECK(Rules.Match(0, -50) == 0);
+	CHECK(Rules.Match(0, -70) == -1);
+}
+
+static void TestInvalidRules()
+{
+	TMatchRule Table[MAX_MATCH_RULES + 1];
+	for (unsigned long i = 0; i <= MAX_MATCH_RULES; i++)
+		Table[i] = MakeRule(MATCH_SERVICE, tstring(), 0, MATCH_ANY_RSSI);
+
+	CMatchRules Rules;
+	CHECK(Rules.Compile(Table, MAX_MATCH_RULES + 1) == WCL_E_INVALID_ARGUMENT);
+	CHECK(Rules.Compile(Table, MAX_MATCH_RULES) == WCL_E_SUCCESS);
+
+	TMatchRule Rule = MakeRule(MATCH_NAME_PREFIX, tstring(), 0, MATCH_ANY_RSSI);
+	CHECK(Rules.Compile(&Rule, 1) == WCL_E_INVALID_ARGUMENT);
+	Rule = MakeRule(0x80, tstring(), 0, MATCH_ANY_RSSI);
+	CHECK(Rules.Compile(&Rule, 1) == WCL_E_INVALID_ARGUMENT);
+
+	// Zero count restores the default rule.
+	CHECK(Rules.Compile(NULL, 0) == WCL_E_SUCCESS);
+	CHECK(Rules.Match(Rules.EvaluateName(DEVICE_NAME), -90) == 0);
+}
+
+int main()
+{
+	RUN_TEST(TestDefaultRule);
+	RUN_TEST(TestConditions);
+	RUN_TEST(TestAnyDevice);
+	RUN_TEST(TestInvalidRules);
+	return SimTestResult();
+}
@@ -0,0 +1,166 @@
+// Unit tests of the CClientReclaimer epochs: a retired client is destroyed
+// only after two epoch advances, never while a dispatch that started before
+// it was retired is running and never while its connection can still fire
+// events.
+
+#include <vector>
+
+#include "ClientReclaimer.h"
+#include "GattClient.h"
+#include "SimFleet.h"
+#include "SimTest.h"
+
+using namespace std;
+
+// Reports its destruction and the completed connection.
+class CTestClient : public CGattClient
+{
+private:
+	bool*	FDestroyed;
+
+protected:
+	virtual void DoConnect(const int Error) override
+	{
+		CGattClient::DoConnect(Error);
+		Connected = (Error == WCL_E_SUCCESS);
+	}
+
+public:
+	volatile bool	Connected;
+
+	CTestClient(CClientReclaimer* const Reclaimer, bool* const Destroyed)
+		: CGattClient(Reclaimer)
+	{
+		FDestroyed = Destroyed;
+		*FDestroyed = false;
+		Connected = false;
+	}
+
+	virtual ~CTestClient()
+	{
+		*FDestroyed = true;
+	}
+};
+
+static void TestGracePeriod()
+{
+	CClientReclaimer Reclaimer;
+	bool Destroyed;
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &Destroyed));
+
+	// First advance: the client may still be used by the dispatches that
+	// started in its epoch.
+	Reclaimer.Reclaim();
+	CHECK(!Destroyed);
+	Reclaimer.Reclaim();
+	CHECK(Destroyed);
+}
+
+static void TestActiveDispatch()
+{
+	CClientReclaimer Reclaimer;
+	LONG Token = Reclaimer.Enter();
+
+	bool Destroyed;
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &Destroyed));
+
+	// The dispatch blocks the second advance however often it is tried.
+	for (int i = 0; i < 10; i++)
+		Reclaimer.Reclaim();
+	CHECK(!Destroyed);
+
+	Reclaimer.Leave(Token);
+	Reclaimer.Reclaim();
+	CHECK(Destroyed);
+}
+
+static void TestLaterDispatch()
+{
+	CClientReclaimer Reclaimer;
+	bool Destroyed;
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &Destroyed));
+	Reclaimer.Reclaim();
+
+	// The dispatch started after the client was retired can not reach it so
+	// it does not hold the client back. It holds back only the advance after
+	// the next one.
+	LONG Token = Reclaimer.Enter();
+	Reclaimer.Reclaim();
+	CHECK(Destroyed);
+
+	bool Next;
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &Next));
+	Reclaimer.Reclaim();
+	Reclaimer.Reclaim();
+	CHECK(!Next);
+	Reclaimer.Leave(Token);
+	Reclaimer.Reclaim();
+	CHECK(!Next);
+	Reclaimer.Reclaim();
+	CHECK(Next);
+}
+
+static void TestLinkedClient()
+{
+	TSimFleetParams Params;
+	CSimFleet::GetDefaultParams(Params);
+	Params.Devices = 1;
+	Params.ConnectLatency = 1;
+	Params.OperationLatency = 100;
+	Params.NotificationPeriod = 2;
+	CSimFleet Fleet(Params);
+	CwclBluetoothRadio Radio(&Fleet);
+	vector<__int64> Addresses;
+	Fleet.GetAddresses(Addresses);
+
+	CClientReclaimer Reclaimer;
+	bool Destroyed;
+	CTestClient* Client = new CTestClient(&Reclaimer, &Destroyed);
+	CHECK(Client->Connect(Addresses[0], &Radio) == WCL_E_SUCCESS);
+	for (int i = 0; i < 1000 && !Client->Connected; i++)
+		Sleep(1);
+	CHECK(Client->Connected);
+
+	// The owner is gone but the link is up. The notifications keep coming
+	// after the client was retired however many epochs pass.
+	Client->Release();
+	for (int i = 0; i < 100; i++)
+	{
+		Reclaimer.Reclaim();
+		Sleep(1);
+	}
+	CHECK(!Destroyed);
+
+	// The disconnection event is the last one: it unlinks the client.
+	CHECK(Client->Disconnect() == WCL_E_SUCCESS);
+	for (int i = 0; i < 1000 && !Destroyed; i++)
+	{
+		Reclaimer.Reclaim();
+		Sleep(1);
+	}
+	CHECK(Destroyed);
+}
+
+static void TestReclaimAll()
+{
+	CClientReclaimer Reclaimer;
+	LONG Token = Reclaimer.Enter();
+	bool First;
+	bool Second;
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &First));
+	Reclaimer.Retire(new CTestClient(&Reclaimer, &Second));
+
+	Reclaimer.ReclaimAll();
+	CHECK(First && Second);
+	Reclaimer.Leave(Token);
+}
+
+int main()
+{
+	RUN_TEST(TestGracePeriod);
+	RUN_TEST(TestActiveDispatch);
+	RUN_TEST(TestLaterDispatch);
+	RUN_TEST(TestLinkedClient);
+	RUN_TEST(TestReclaimAll);
+	return SimTestResult();
+}
@@ -0,0 +1,117 @@
+// Unit tests of the CClientRegistry: linear probing, backward shift deletion
+// and growth.
+
+#include <set>
+
+#include "ClientRegistry.h"
+#include "SimTest.h"
+
+using namespace std;
+
+// Any non-zero pointer: the registry never touches the clients.
+static CGattClient* const CLIENT = (CGattClient*)0x1000;
+
+static void TestAddFindRemove()
+{
+	CClientRegistry Registry;
+	CHECK(Registry.Add(0x001122334455, CLIENT, rsPending));
+	CHECK(!Registry.Add(0x001122334455, CLIENT, rsConnected));
+	// Zero address marks a free slot.
+	CHECK(!Registry.Add(0, CLIENT, rsPending));
+	CHECK(Registry.GetCount() == 1);
+
+	TRegistryEntry* Entry = Registry.Find(0x001122334455);
+	CHECK(Entry != NULL && Entry->Client == CLIENT && Entry->State == rsPending);
+	CHECK(Registry.Find(0x001122334456) == NULL);
+
+	CHECK(Registry.Remove(0x001122334455));
+	CHECK(!Registry.Remove(0x001122334455));
+	CHECK(Registry.Find(0x001122334455) == NULL);
+	CHECK(Registry.GetCount() == 0);
+}
+
+// Returns true if all the addresses of the set are found and the registry
+// has no other entries.
+static bool Matches(const CClientRegistry& Registry, const set<__int64>& Expected)
+{
+	if (Registry.GetCount() != Expected.size())
+		return false;
+	for (set<__int64>::const_iterator Address = Expected.begin(); Address != Expected.end(); Address++)
+	{
+		if (Registry.Find(*Address) == NULL)
+			return false;
+	}
+
+	size_t Used = 0;
+	for (size_t i = 0; i < Registry.GetCapacity(); i++)
+	{
+		if (Registry.GetSlot(i)->Address != 0)
+			Used++;
+	}
+	return (Used == Expected.size());
+}
+
+static void TestBackwardShiftDelete()
+{
+	// Twelve entries in sixteen slots make long probe chains that wrap around
+	// the table. The capacity never grows so every removal has to shift the
+	// chain back for the rest to stay reachable.
+	CClientRegistry Registry(16);
+	set<__int64> Expected;
+
+	unsigned __int64 Seed = 1;
+	for (int i = 0; i < 20000; i++)
+	{
+		Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		// Few distinct addresses with the common vendor prefix.
+		__int64 Address = 0x00A0500000 + (__int64)((Seed >> 33) % 24) + 1;
+
+		if (Expected.find(Address) != Expected.end())
+		{
+			CHECK(Registry.Remove(Address));
+			Expected.erase(Address);
+		}
+		else if (Expected.size() < 12)
+		{
+			CHECK(Registry.Add(Address, CLIENT, rsConnected));
+			Expected.insert(Address);
+		}
+
+		if (!Matches(Registry, Expected))
+		{
+			CHECK(Matches(Registry, Expected));
+			break;
+		}
+	}
+	CHECK(Registry.GetCapacity() == 16);
+
+	// No tombstones are left behind.
+	for (set<__int64>::iterator Address = Expected.begin(); Address != Expected.end(); Address++)
+		CHECK(Registry.Remove(*Address));
+	for (size_t i = 0; i < Registry.GetCapacity(); i++)
+		CHECK(Registry.GetSlot(i)->Address == 0);
+}
+
+static void TestGrow()
+{
+	CClientRegistry Registry(16);
+	for (__int64 i = 1; i <= 1000; i++)
+		CHECK(Registry.Add(0x00A0500000 + i, CLIENT, rsConnected));
+	CHECK(Registry.GetCount() == 1000);
+	// The load factor stays below 3/4.
+	CHECK(Registry.GetCapacity() * 3 >= Registry.GetCount() * 4);
+	for (__int64 i = 1; i <= 1000; i++)
+		CHECK(Registry.Find(0x00A0500000 + i) != NULL);
+
+	Registry.Clear();
+	CHECK(Registry.GetCount() == 0);
+	CHECK(Registry.Find(0x00A0500001) == NULL);
+}
+
+int main()
+{
+	RUN_TEST(TestAddFindRemove);
+	RUN_TEST(TestBackwardShiftDelete);
+	RUN_TEST(TestGrow);
+	return SimTestResult();
+}
@@ -0,0 +1,98 @@
+// Unit tests of the CConnectionScheduler: admission order, the connection
+// slots and the exponential backoff of the failed devices.
+
+#include "ConnectionScheduler.h"
+#include "SimTest.h"
+
+static void TestOrder()
+{
+	CConnectionScheduler Scheduler;
+	Scheduler.SetMaxInFlight(3);
+	Scheduler.Offer(1, -80, 100, 0, tstring());
+	Scheduler.Offer(2, -40, 100, 0, _T("Near"));
+	Scheduler.Offer(3, -80, 200, 0, tstring());
+
+	__int64 Address;
+	unsigned long Rule;
+	tstring Name;
+	// Better signal first, then the most recently seen.
+	CHECK(Scheduler.Next(300, Address, Rule, Name) && Address == 2 && Name == _T("Near"));
+	CHECK(Scheduler.Next(300, Address, Rule, Name) && Address == 3);
+	CHECK(Scheduler.Next(300, Address, Rule, Name) && Address == 1);
+	CHECK(!Scheduler.Next(300, Address, Rule, Name));
+}
+
+static void TestSlots()
+{
+	CConnectionScheduler Scheduler;
+	Scheduler.SetMaxInFlight(1);
+	Scheduler.Offer(1, -50, 100, 0, tstring());
+	Scheduler.Offer(2, -60, 100, 0, tstring());
+
+	__int64 Address;
+	unsigned long Rule;
+	tstring Name;
+	CHECK(Scheduler.Next(100, Address, Rule, Name) && Address == 1);
+	CHECK(Scheduler.IsInFlight(1));
+	// The only slot is taken.
+	CHECK(!Scheduler.Next(100, Address, Rule, Name));
+	CHECK(!Scheduler.Acquire(2));
+
+	Scheduler.Completed(1, true, 200);
+	CHECK(Scheduler.GetInFlightCount() == 0);
+	CHECK(Scheduler.Next(200, Address, Rule, Name) && Address == 2);
+}
+
+static void TestBackoff()
+{
+	CConnectionScheduler Scheduler;
+	Scheduler.SetBackoff(1000, 3000);
+
+	__int64 Address;
+	unsigned long Rule;
+	tstring Name;
+	unsigned __int64 Now = 10000;
+	// The delay doubles on each failure up to the limit.
+	const unsigned long Delays[] = { 1000, 2000, 3000, 3000 };
+	for (int i = 0; i < 4; i++)
+	{
+		Scheduler.Offer(1, -50, Now, 0, tstring());
+		CHECK(Scheduler.Next(Now, Address, Rule, Name) && Address == 1);
+		Scheduler.Completed(1, false, Now);
+
+		// The device is not admitted until its backoff expires.
+		Scheduler.Offer(1, -50, Now + Delays[i] - 1, 0, tstring());
+		CHECK(!Scheduler.Next(Now + Delays[i] - 1, Address, Rule, Name));
+		Now += Delays[i];
+	}
+
+	// Success resets the backoff.
+	Scheduler.Offer(1, -50, Now, 0, tstring());
+	CHECK(Scheduler.Next(Now, Address, Rule, Name));
+	Scheduler.Completed(1, true, Now);
+	Scheduler.Offer(1, -50, Now, 0, tstring());
+	CHECK(Scheduler.Next(Now, Address, Rule, Name));
+	Scheduler.Completed(1, false, Now);
+	Scheduler.Offer(1, -50, Now + 1000, 0, tstring());
+	CHECK(Scheduler.Next(Now + 1000, Address, Rule, Name));
+}
+
+static void TestStaleCandidate()
+{
+	CConnectionScheduler Scheduler;
+	Scheduler.Offer(1, -50, 100, 0, tstring());
+
+	__int64 Address;
+	unsigned long Rule;
+	tstring Name;
+	CHECK(!Scheduler.Next(100 + CANDIDATE_TIMEOUT + 1, Address, Rule, Name));
+}
+
+int main()
+{
+	RUN_TEST(TestOrder);
+	RUN_TEST(TestSlots);
+	RUN_TEST(TestBackoff);
+	RUN_TEST(TestStaleCandidate);
+	return SimTestResult();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Minimal checks for the unit tests of the client's core modules. Each test
+// executable runs its cases with RUN_TEST and returns the SimTestResult: the
+// failed checks are printed and make the ctest case fail.
+
+#include <cstdio>
+
+inline int& SimTestFailures()
+{
+	static int Failures = 0;
+	return Failures;
+}
+
+#define CHECK(_condition_) \
+	do \
+	{ \
+		if (!(_condition_)) \
+		{ \
+			printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #_condition_); \
+			SimTestFailures()++; \
+		} \
+	} while (false)
+
+#define RUN_TEST(_test_) \
+	do \
+	{ \
+		int Failed = SimTestFailures(); \
+		_test_(); \
+		printf("%s %s\n", (SimTestFailures() == Failed ? "PASS" : "FAIL"), #_test_); \
+	} while (false)
+
+inline int SimTestResult()
+{
+	return (SimTestFailures() == 0 ? 0 : 1);
+}
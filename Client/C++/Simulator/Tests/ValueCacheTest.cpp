@@ -0,0 +1,77 @@
+// Unit tests of the CValueCache: the values age, the newer value wins and
+// each handle keeps its own value.
+
+#include <cstdlib>
+#include <cstring>
+
+#include "ValueCache.h"
+#include "Timestamp.h"
+#include "SimTest.h"
+
+static const unsigned char VALUE[] = { 1, 2, 3, 4 };
+static const unsigned char NEWER_VALUE[] = { 5, 6 };
+
+static void TestAge()
+{
+	CValueCache Cache;
+	// Two seconds old.
+	Cache.Put(0x10, VALUE, sizeof(VALUE), GetTimestamp() - 2000000);
+
+	unsigned char* Value;
+	unsigned long Length;
+	CHECK(!Cache.Get(0x10, 1000, Value, Length));
+	CHECK(Value == NULL && Length == 0);
+	CHECK(Cache.Get(0x10, 5000, Value, Length));
+	CHECK(Length == sizeof(VALUE) && memcmp(Value, VALUE, Length) == 0);
+	free(Value);
+
+	CHECK(!Cache.Get(0x11, 5000, Value, Length));
+}
+
+static void TestNewerWins()
+{
+	CValueCache Cache;
+	unsigned __int64 Now = GetTimestamp();
+	Cache.Put(0x10, NEWER_VALUE, sizeof(NEWER_VALUE), Now);
+	// The read that started before the notification completes after it.
+	Cache.Put(0x10, VALUE, sizeof(VALUE), Now - 1000);
+
+	unsigned char Buffer[16];
+	unsigned long Length;
+	CHECK(Cache.Get(0x10, 1000, Buffer, sizeof(Buffer), Length));
+	CHECK(Length == sizeof(NEWER_VALUE) && memcmp(Buffer, NEWER_VALUE, Length) == 0);
+
+	Cache.Put(0x10, VALUE, sizeof(VALUE), Now + 1);
+	CHECK(Cache.Get(0x10, 1000, Buffer, sizeof(Buffer), Length));
+	CHECK(Length == sizeof(VALUE) && memcmp(Buffer, VALUE, Length) == 0);
+}
+
+static void TestHandles()
+{
+	CValueCache Cache;
+	unsigned __int64 Now = GetTimestamp();
+	Cache.Put(0x10, VALUE, sizeof(VALUE), Now);
+	Cache.Put(0x20, NEWER_VALUE, sizeof(NEWER_VALUE), Now);
+
+	unsigned char Buffer[16];
+	unsigned long Length;
+	CHECK(Cache.Get(0x10, 1000, Buffer, sizeof(Buffer), Length) && Length == sizeof(VALUE));
+	CHECK(Cache.Get(0x20, 1000, Buffer, sizeof(Buffer), Length) && Length == sizeof(NEWER_VALUE));
+
+	// The value does not fit: its length is reported.
+	Buffer[0] = 0;
+	CHECK(Cache.Get(0x10, 1000, Buffer, 2, Length) && Length == sizeof(VALUE));
+	CHECK(Buffer[0] == 0);
+
+	Cache.Clear();
+	CHECK(!Cache.Get(0x10, 1000, Buffer, sizeof(Buffer), Length));
+	CHECK(!Cache.Get(0x20, 1000, Buffer, sizeof(Buffer), Length));
+}
+
+int main()
+{
+	RUN_TEST(TestAge);
+	RUN_TEST(TestNewerWins);
+	RUN_TEST(TestHandles);
+	return SimTestResult();
+}
@@ -13,6 +13,15 @@
 
 #define MAX_PDU_SIZE    255
 
+// Framed message segment header (see client's Framing.h).
+#define FRAME_MARKER            0xA0
+#define FRAME_MARKER_MASK       0xF0
+#define FRAME_FIRST             0x01
+#define FRAME_LAST              0x02
+#define FRAME_HEADER_SIZE       4
+#define FRAME_FIRST_HEADER_SIZE 8
+#define MAX_MESSAGE_SIZE        (16 * 1024)
+
 
 bool ClientConnected = false;
 BLECharacteristic* NotifyChar = NULL;
@@ -52,16 +61,121 @@ public:
 };
 
 
+class CMessageReassembler
+{
+private:
+    uint8_t*    FBuffer;
+    size_t      FLength;
+    size_t      FReceived;
+    uint8_t     FMessageId;
+    uint16_t    FSequence;
+    bool        FActive;
+
+public:
+    CMessageReassembler()
+    {
+        FBuffer = (uint8_t*)malloc(MAX_MESSAGE_SIZE);
+        FLength = 0;
+        FReceived = 0;
+        FMessageId = 0;
+        FSequence = 0;
+        FActive = false;
+    }
+
+    // Returns true when the message is complete.
+    bool Push(const uint8_t* Data, size_t Len)
+    {
+        if (FBuffer == NULL || Len < FRAME_HEADER_SIZE)
+            return false;
+
+        uint8_t Flags = Data[0];
+        uint8_t MessageId = Data[1];
+        uint16_t Sequence = Data[2] | (Data[3] << 8);
+        Data += FRAME_HEADER_SIZE;
+        Len -= FRAME_HEADER_SIZE;
+
+        if (Flags & FRAME_FIRST)
+        {
+            if (Sequence != 0 || Len < 4)
+            {
+                FActive = false;
+                return false;
+            }
+
+            FLength = Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((uint32_t)Data[3] << 24);
+            Data += 4;
+            Len -= 4;
+            if (FLength > MAX_MESSAGE_SIZE)
+            {
+                Serial.println("Message is too large");
+                FActive = false;
+                return false;
+            }
+
+            FReceived = 0;
+            FMessageId = MessageId;
+            FSequence = 0;
+            FActive = true;
+        }
+        else
+        {
+            if (!FActive || MessageId != FMessageId || Sequence != FSequence)
+            {
+                Serial.println("Segment lost. Message dropped");
+                FActive = false;
+                return false;
+            }
+        }
+
+        if (FReceived + Len > FLength)
+        {
+            FActive = false;
+            return false;
+        }
+        memcpy(FBuffer + FReceived, Data, Len);
+        FReceived += Len;
+        FSequence++;
+
+        if (Flags & FRAME_LAST)
+        {
+            FActive = false;
+            return (FReceived == FLength);
+        }
+        return false;
+    }
+
+    const uint8_t* GetData() const { return FBuffer; }
+    size_t GetLength() const { return FLength; }
+};
+
+
 class CWritableCharacteristicCallbacks : public BLECharacteristicCallbacks
 {
+private:
+    CMessageReassembler FReassembler;
+
 public:
     // This is write only characteristic.
     virtual void onWrite(BLECharacteristic* pCharacteristic) override
     {
-        Serial.println("Write requested");
-
         size_t Len = pCharacteristic->getLength();
         uint8_t* Data = pCharacteristic->getData();
+
+        // Framed segments are not logged one by one: printing would slow
+        // down the stream.
+        if (Len > 0 && Data != NULL && (Data[0] & FRAME_MARKER_MASK) == FRAME_MARKER)
+        {
+            if (FReassembler.Push(Data, Len))
+            {
+                Serial.print("Message received: ");
+                Serial.print(FReassembler.GetLength());
+                Serial.println(" bytes");
+            }
+            return;
+        }
+
+        Serial.println("Write requested");
+
         if (Len > 0 && Data != NULL)
             Serial.println((char*)Data);
         
@@ -109,7 +223,9 @@ void setup()
 
     // Create writable characteristic.
     Serial.println("Create WRITABLE characteristic");
-    Char = new BLECharacteristic(WRITABLE_CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_WRITE);
+    // Write Without Response is used by the client for data streaming.
+    Char = new BLECharacteristic(WRITABLE_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR);
     // Set characteristic callback.
     Char->setCallbacks(new CWritableCharacteristicCallbacks());
     Service->addCharacteristic(Char);